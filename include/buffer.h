@@ -26,6 +26,7 @@ DEALINGS IN THE SOFTWARE.
 #define __STDC_FORMAT_MACROS 1
 #include <inttypes.h>
 
+#include <algorithm>
 #include <cstddef>
 #include <iostream>
 #include <stdint.h>
@@ -114,6 +115,29 @@ public:
 		this->iterator_position_ += n_length;
 	}
 
+	/**<
+	 * Make sure there is room for at least `n_length` additional bytes such
+	 * that a fixed-layout run of records can be written with direct stores
+	 * without per-field capacity checks.
+	 * @param n_length Number of bytes to be appended.
+	 */
+	inline void reserve(const uint64_t n_length){
+		if(this->n_chars_ + n_length >= this->width_)
+			this->resize(std::max(this->width_*2, this->n_chars_ + n_length + 1000));
+	}
+
+	/**<
+	 * In-place view of the next `n_length` unread bytes. The iterator is
+	 * advanced past them but no data is copied.
+	 * @param n_length Number of bytes to consume.
+	 * @return         Returns a pointer to the first consumed byte.
+	 */
+	inline const char* view(const uint64_t n_length){
+		const char* p = &this->buffer_[this->iterator_position_];
+		this->iterator_position_ += n_length;
+		return(p);
+	}
+
 private:
 	friend self_type& operator>>(self_type& data, uint8_t& target);
 	friend self_type& operator>>(self_type& data, uint16_t& target);
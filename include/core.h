@@ -25,6 +25,9 @@ DEALINGS IN THE SOFTWARE.
 
 #include <cstdint>
 #include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <vector>
 
 #include "tomahawk.h"
 #include "buffer.h"
@@ -85,6 +88,7 @@ private:
 #define TWK_LDD_VEC    1
 #define TWK_LDD_LIST   2
 #define TWK_LDD_BITMAP 4
+#define TWK_LDD_SORT   8 // permutation grouped by missingness and sorted by frequency
 #define TWK_LDD_ALL  ((TWK_LDD_VEC) | (TWK_LDD_LIST) | (TWK_LDD_BITMAP))
 
 /****************************
@@ -157,22 +161,82 @@ private:
 /****************************
 *  Core genotype
 ****************************/
+// Genotype encodings stored in `twk1_t::gt_ptype` and `twk1_gt_t::psize`.
+// Run-length encodings are identified by the width of their primitive.
+#define TWK_GT_RLE8   1
+#define TWK_GT_RLE16  2
+#define TWK_GT_RLE32  4
+#define TWK_GT_PACKED 8  // one packed genotype of 2 (4 if missing) bits per sample
+#define TWK_GT_SPARSE 16 // sample offset and packed genotype of non-reference samples
+
+/**<
+ * Genotypes of a record in one of the encodings above. Data is stored as
+ * primitives pointed to by `data`:
+ *
+ *   run-length: `n` runs of `psize` bytes holding the run length and the
+ *               packed genotype of the run.
+ *   packed:     `n` genotypes, one per sample, packed into 64-bit words.
+ *   sparse:     `n` 32-bit entries holding the sample offset and packed
+ *               genotype of every sample that is not homozygous for the
+ *               reference allele, terminated by an entry with offset equal
+ *               to the number of samples.
+ *
+ * Use twk1_gt_cursor to read the runs of genotypes of any encoding. The
+ * accessors below are non-virtual, valid for run-length encodings only, and
+ * dispatch on `psize` such that they can be inlined into tight loops. If `own`
+ * is not set then `data` points into memory owned by someone else, such as the
+ * arena of a twk1_block_t, and is never released by this object.
+ */
 struct twk1_gt_t {
-	twk1_gt_t() : n(0), miss(0){}
+	twk1_gt_t() : n(0), miss(0), psize(0), own(1), data(nullptr){}
 	virtual ~twk1_gt_t(){}
 	virtual void print() =0;
 	virtual void clear() =0;
 
-	virtual uint32_t GetLength(const uint32_t p) const =0;
-	virtual uint8_t GetRefByte(const uint32_t p) const =0;
-	virtual uint8_t GetRefA(const uint32_t p) const =0;
-	virtual uint8_t GetRefB(const uint32_t p) const =0;
+	inline uint32_t GetRun(const uint32_t p) const{
+		switch(psize){
+		case(1): return(reinterpret_cast<const uint8_t*>(data)[p]);
+		case(2): return(reinterpret_cast<const uint16_t*>(data)[p]);
+		default: return(reinterpret_cast<const uint32_t*>(data)[p]);
+		}
+	}
+
+	/**<
+	 * Estimate the number of runs of genotypes, as used by kernels choosing
+	 * between run-length and vectorized algorithms. Exact for run-length
+	 * encodings. Sparse encodings hold about two runs per entry as every
+	 * non-reference genotype is typically preceded by a run of reference
+	 * genotypes. Packed encodings are only chosen when runs are short and
+	 * report a large value such that the sum of two estimates cannot overflow.
+	 * @return Returns the estimated number of runs.
+	 */
+	inline uint32_t GetRunEstimate() const{
+		switch(psize){
+		case(TWK_GT_PACKED): return(UINT32_MAX / 2);
+		case(TWK_GT_SPARSE): return(2*n);
+		default: return(n);
+		}
+	}
+
+	inline uint32_t GetLength(const uint32_t p) const{ return(GetRun(p) >> (2 + 2*miss)); }
+	inline uint8_t GetRefByte(const uint32_t p) const{ return(GetRun(p) & ((1 << (2 + 2*miss)) - 1)); }
+	inline uint8_t GetRefA(const uint32_t p) const{ return((GetRun(p) >> (1 + miss)) & ((1 << (1 + miss)) - 1)); }
+	inline uint8_t GetRefB(const uint32_t p) const{ return(GetRun(p) & ((1 << (1 + miss)) - 1)); }
 
 	virtual twk1_gt_t* Clone() =0;
 	virtual void Move(twk1_gt_t*& other) =0;
 	virtual twk_buffer_t& AddBuffer(twk_buffer_t& buffer) const =0;
 	virtual twk_buffer_t& ReadBuffer(twk_buffer_t& buffer) =0;
 
+	/**<
+	 * Deserialize runs into externally owned memory. The runs are copied to
+	 * `arena`, aligned to the primitive size, and `arena` is advanced past them.
+	 * @param buffer Src buffer.
+	 * @param arena  Src/dst pointer into pre-allocated memory.
+	 * @return       Returns the src buffer reference.
+	 */
+	virtual twk_buffer_t& ReadBufferArena(twk_buffer_t& buffer, uint8_t*& arena) =0;
+
 	friend inline twk_buffer_t& operator<<(twk_buffer_t& buffer, const twk1_gt_t& self){
 		return(self.AddBuffer(buffer));
 	}
@@ -182,25 +246,88 @@ struct twk1_gt_t {
 	}
 
 	uint32_t n: 31, miss: 1;
+	uint8_t psize: 7, own: 1;
+	void* data;
+};
+
+/**<
+ * Sequential reader of the runs of genotypes of a record in any encoding.
+ * Run-length encodings return their runs, packed encodings coalesce equal
+ * neighbouring genotypes, and sparse encodings return runs of reference
+ * genotypes interleaved with single non-reference genotypes. Call Next()
+ * before reading the first run.
+ */
+struct twk1_gt_cursor {
+public:
+	twk1_gt_cursor(const twk1_gt_t& gt) :
+		gt(gt), shift(2 + 2*gt.miss), mask((1 << (2 + 2*gt.miss)) - 1),
+		p(0), k(0), len(0), ref(0)
+	{}
+
+	/**<
+	 * Advance to the next run.
+	 * @return Returns TRUE if a run was read or FALSE if all runs are consumed.
+	 */
+	inline bool Next(){
+		switch(gt.psize){
+		case(TWK_GT_PACKED):
+			if(p == gt.n) return false;
+			ref = GetPacked(p); len = 1;
+			while(++p < gt.n && GetPacked(p) == ref) ++len;
+			return true;
+		case(TWK_GT_SPARSE): {
+			const uint32_t e = reinterpret_cast<const uint32_t*>(gt.data)[k];
+			if(p < (e >> shift)){ // reference genotypes preceding the entry
+				len = (e >> shift) - p; ref = 0; p = e >> shift;
+				return true;
+			}
+			if(k + 1 >= gt.n) return false; // terminal entry
+			len = 1; ref = e & mask; ++p; ++k;
+			return true;
+		}
+		default:
+			if(k == gt.n) return false;
+			const uint32_t run = gt.GetRun(k++);
+			len = run >> shift; ref = run & mask;
+			return true;
+		}
+	}
+
+	inline uint8_t GetRefA() const{ return(ref >> (shift >> 1)); }
+	inline uint8_t GetRefB() const{ return(ref & ((1 << (shift >> 1)) - 1)); }
+
+private:
+	inline uint8_t GetPacked(const uint32_t i) const{
+		return((reinterpret_cast<const uint64_t*>(gt.data)[(i*shift) >> 6] >> ((i*shift) & 63)) & mask);
+	}
+
+public:
+	const twk1_gt_t& gt;
+	const uint8_t shift, mask; // bits per packed genotype and its mask
+	uint32_t p, k; // current sample and entry offset
+	uint32_t len; // length of the current run
+	uint8_t  ref; // packed genotype of the current run
 };
 
 // internal genotype structure
-template <class int_t>
+template <class int_t, uint8_t ptype = sizeof(int_t)>
 struct twk1_igt_t : public twk1_gt_t {
-	static const uint8_t psize = sizeof(int_t);
+	twk1_igt_t(){ psize = ptype; }
+	~twk1_igt_t(){ if(own) delete[] runs(); }
 
-	twk1_igt_t() : data(nullptr){}
-	~twk1_igt_t(){ delete[] data; }
+	inline int_t* runs(){ return(reinterpret_cast<int_t*>(data)); }
+	inline const int_t* runs() const{ return(reinterpret_cast<const int_t*>(data)); }
 
-	inline uint32_t GetLength(const uint32_t p) const{ return(data[p] >> (2 + 2*miss)); }
-	inline uint8_t GetRefByte(const uint32_t p) const{ return(data[p] & ((1 << (2 + 2*miss)) - 1)); }
-	inline uint8_t GetRefA(const uint32_t p) const{ return((data[p] >> (1 + miss)) & ((1 << (1 + miss)) - 1)); }
-	inline uint8_t GetRefB(const uint32_t p) const{ return(data[p] & ((1 << (1 + miss)) - 1)); }
+	// Number of stored primitives.
+	inline uint32_t size() const{
+		if(ptype == TWK_GT_PACKED) return((n*(2 + 2*miss) + 8*sizeof(int_t) - 1) / (8*sizeof(int_t)));
+		return(n);
+	}
 
 	twk_buffer_t& AddBuffer(twk_buffer_t& buffer) const{
 		uint32_t n_write = this->n << 1 | this->miss;
 		SerializePrimitive(n_write, buffer);
-		for(int i = 0; i < this->n; ++i) SerializePrimitive<int_t>(this->data[i], buffer);
+		buffer.Add(reinterpret_cast<const char*>(this->runs()), sizeof(int_t)*this->size());
 		return(buffer);
 	}
 
@@ -209,32 +336,52 @@ struct twk1_igt_t : public twk1_gt_t {
 		DeserializePrimitive(n_write, buffer);
 		this->n = n_write >> 1;
 		this->miss = n_write & 1;
-		delete[] data; data = new int_t[n];
-		for(int i = 0; i < this->n; ++i) DeserializePrimitive<int_t>(this->data[i], buffer);
+		if(own) delete[] runs();
+		data = new int_t[size()]; own = 1;
+		buffer.read(reinterpret_cast<char*>(data), sizeof(int_t)*size());
+		return(buffer);
+	}
+
+	twk_buffer_t& ReadBufferArena(twk_buffer_t& buffer, uint8_t*& arena){
+		uint32_t n_write = 0;
+		DeserializePrimitive(n_write, buffer);
+		this->n = n_write >> 1;
+		this->miss = n_write & 1;
+		if(own) delete[] runs();
+		arena += (sizeof(int_t) - (reinterpret_cast<uintptr_t>(arena) % sizeof(int_t))) % sizeof(int_t);
+		data = arena; own = 0;
+		buffer.read(reinterpret_cast<char*>(data), sizeof(int_t)*size());
+		arena += sizeof(int_t)*size();
 		return(buffer);
 	}
 
 	/**<
-	 * Clone operator for copying an inherited (virtual) class.
+	 * Clone operator for copying an inherited (virtual) class. The copy
+	 * always owns its runs.
 	 * @return
 	 */
 	twk1_gt_t* Clone(){
-		twk1_igt_t* copied = new twk1_igt_t<int_t>;
+		twk1_igt_t* copied = new twk1_igt_t<int_t, ptype>;
 		copied->n = n;
 		copied->miss = miss;
-		copied->data = new int_t[n];
-		memcpy(copied->data, data, sizeof(int_t)*n);
+		copied->data = new int_t[size()];
+		memcpy(copied->data, data, sizeof(int_t)*size());
 		return(copied);
 	}
 
 	/**<
-	 * Move operator for moving an inherited (virtual) class.
+	 * Move operator for moving an inherited (virtual) class. Runs that are
+	 * not owned by this object are copied rather than moved.
 	 * @param other
 	 */
 	void Move(twk1_gt_t*& other){
 		delete other;
-		twk1_igt_t* dat = new twk1_igt_t<int_t>;
-		//twk1_igt_t<int_t>* temp = reinterpret_cast<twk1_igt_t<int_t>*>(other);
+		if(own == false){
+			other = this->Clone();
+			n = 0; data = nullptr; own = 1;
+			return;
+		}
+		twk1_igt_t* dat = new twk1_igt_t<int_t, ptype>;
 		dat->n = n; n = 0;
 		dat->miss = miss;
 		std::swap(data, dat->data);
@@ -242,24 +389,29 @@ struct twk1_igt_t : public twk1_gt_t {
 		data = nullptr;
 	}
 
-	void clear(void){ delete[] data; data = nullptr; n = 0; }
+	void clear(void){ if(own) delete[] runs(); data = nullptr; n = 0; own = 1; }
 
 	void print(){
 		std::cerr << "print=" << n << std::endl;
-		for(int i = 0; i < n; ++i){
-			std::cerr << " <" << (data[i] & 3) << "," << (data[i] >> 2) << ">";
+		twk1_gt_cursor c(*this);
+		while(c.Next()){
+			std::cerr << " <" << (int)c.ref << "," << c.len << ">";
 		}
 		std::cerr << std::endl;
 	}
-
-	int_t* data;
 };
 
+typedef twk1_igt_t<uint64_t, TWK_GT_PACKED> twk1_igt_packed_t;
+typedef twk1_igt_t<uint32_t, TWK_GT_SPARSE> twk1_igt_sparse_t;
+
 /****************************
 *  Core record
 ****************************/
 struct twk1_t {
 public:
+	// Size of the fixed-layout fields preceding the genotypes when serialized.
+	const static uint32_t packed_size = 2*sizeof(uint8_t) + 6*sizeof(uint32_t) + sizeof(double);
+
 	twk1_t();
 	~twk1_t();
 
@@ -282,6 +434,15 @@ public:
 	 */
 	void calculateHardyWeinberg(void);
 
+	/**<
+	 * Exact test of Hardy-Weinberg Equilibrium from genotype counts that are
+	 * already available, for example when importing pre-packed genotypes.
+	 * @param obs_hets Number of heterozygous samples.
+	 * @param obs_hom1 Number of samples homozygous for the first allele.
+	 * @param obs_hom2 Number of samples homozygous for the second allele.
+	 */
+	void calculateHardyWeinberg(const uint64_t obs_hets, const uint64_t obs_hom1, const uint64_t obs_hom2);
+
 	void clear();
 
 	friend twk_buffer_t& operator<<(twk_buffer_t& buffer, const twk1_t& self);
@@ -347,6 +508,8 @@ public:
 	uint32_t n, m, rid;
 	uint32_t minpos, maxpos;
 	twk1_t* rcds;
+	uint64_t m_arena; // allocated bytes in arena
+	uint8_t* arena; // run-length encoded genotypes of all records when deserialized
 };
 
 struct twk_oblock_t {
@@ -533,7 +696,9 @@ public:
 			}
 		}
 
-		if(twk.ac > m){
+		// Lists are not allocated if the length was preset by a borrowed
+		// bitvector and the record is monomorphic (e.g. when subsampled).
+		if(twk.ac > m || list == nullptr){
 			m = twk.ac;
 			delete[] list; list = new uint32_t[m];
 
@@ -554,10 +719,11 @@ public:
 		l_list = 0; l_aa = 0; l_het = 0;
 		uint32_t cumpos = 0;
 		if(own){
-			for(int i = 0; i < twk.gt->n; ++i){
-				const uint32_t len  = twk.gt->GetLength(i);
-				const uint8_t  refA = twk.gt->GetRefA(i);
-				const uint8_t  refB = twk.gt->GetRefB(i);
+			twk1_gt_cursor c(*twk.gt);
+			while(c.Next()){
+				const uint32_t len  = c.len;
+				const uint8_t  refA = c.GetRefA();
+				const uint8_t  refB = c.GetRefB();
 
 				if(refA == 0 && refB == 0){
 					cumpos += 2*len;
@@ -575,11 +741,13 @@ public:
 			assert(cumpos == n_samples*2);
 			assert(l_list <= m);
 		} else {
-			//x.resize(n_samples);
-			for(int i = 0; i < twk.gt->n; ++i){
-				const uint32_t len  = twk.gt->GetLength(i);
-				const uint8_t  refA = twk.gt->GetRefA(i);
-				const uint8_t  refB = twk.gt->GetRefB(i);
+			// The borrowed bitvector is already constructed and may be
+			// read-only: only the lists are built.
+			twk1_gt_cursor c(*twk.gt);
+			while(c.Next()){
+				const uint32_t len  = c.len;
+				const uint8_t  refA = c.GetRefA();
+				const uint8_t  refB = c.GetRefB();
 
 				if(refA == 0 && refB == 0){
 					cumpos += 2*len;
@@ -587,8 +755,8 @@ public:
 				}
 
 				for(int j = 0; j < 2*len; j+=2){
-					if(refA != 0){ this->set(cumpos + j + 0); list[l_list++] = cumpos + j + 0; }
-					if(refB != 0){ this->set(cumpos + j + 1); list[l_list++] = cumpos + j + 1; }
+					if(refA != 0){ list[l_list++] = cumpos + j + 0; }
+					if(refB != 0){ list[l_list++] = cumpos + j + 1; }
 					if(build_unphased && refA == 1 && refB == 1){ list_aa[l_aa++] = cumpos + j + 0; }
 					if(build_unphased && ((refA == 0 && refB == 1) || (refA == 1 && refB == 0))){ list_het[l_het++] = cumpos + j + 0; }
 				}
@@ -721,11 +889,44 @@ const static uint8_t TWK_GT_BV_MASK_MISS_LOOKUP[16] = {0, 0, 3, 3, 0, 0, 3, 3, 3
 const static uint8_t TWK_GT_BV_DATA_LOOKUP[16]      = {0, 1, 2, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 const static uint8_t TWK_GT_BV_DATA_MISS_LOOKUP[16] = {0, 1, 0, 0, 2, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
 
+/**<
+ * Bitvector view of the genotypes of a single record. The words are not
+ * owned: they are laid out back-to-back for all records of a block in a
+ * single aligned slab owned by the block (see `twk1_ldd_blk`).
+ */
 struct twk_igt_vec {
 public:
 	twk_igt_vec();
 	~twk_igt_vec();
 
+	/**<
+	 * Number of 64-bit words in a bitvector over the given number of samples.
+	 * @param n_samples Total number of samples.
+	 * @return          Returns the number of words.
+	 */
+	static uint32_t GetNumberWords(const uint32_t n_samples);
+
+	/**<
+	 * Number of 64-bit words between consecutive bitvectors in a slab such
+	 * that every bitvector starts at a SIMD boundary.
+	 * @param n_samples Total number of samples.
+	 * @return          Returns the number of words.
+	 */
+	static inline uint32_t GetStride(const uint32_t n_samples){
+		const uint32_t w = SIMD_ALIGNMENT / sizeof(uint64_t);
+		return(((GetNumberWords(n_samples) + w - 1) / w) * w);
+	}
+
+	/**<
+	 * Point this view to pre-allocated words.
+	 * @param data Dst pointer to the data words.
+	 * @param mask Dst pointer to the mask words or nullptr if no genotypes are missing.
+	 * @param n    Number of words.
+	 */
+	inline void Set(uint64_t* data, uint64_t* mask, const uint32_t n){
+		this->data = data; this->mask = mask; this->n = n;
+	}
+
 	inline void reset(void){ memset(this->data, 0, this->n*sizeof(uint64_t)); memset(this->mask, 0, this->n*sizeof(uint64_t)); }
 	inline const bool operator[](const uint32_t p) const{ return(this->data[p] & (1L << (p % 64))); }
 	inline const bool get(const uint32_t p) const{ return(this->data[p/64] & (1L << (p % 64)));}
@@ -735,9 +936,9 @@ public:
 	inline void SetMask(const uint32_t p, const bool val){ this->mask[p/64] |= ((uint64_t)val << (p % 64)); }
 
 	/**<
-	 * Constructs a 1-bitvector from from the given compressed genotypes. The
-	 * bitvector is guaranteed to fit in the largest SIMD vector available and
-	 * has enforced memory boundary alignments according to the hardware.
+	 * Constructs a 1-bitvector from from the given compressed genotypes into
+	 * the words set with Set(). The mask words have to be set if the record
+	 * has missing genotypes.
 	 * @param rec       Input reference twk1_t record
 	 * @param n_samples Total number of samples.
 	 * @return          Returns TRUE upon success or FALSE otherwise.
@@ -801,6 +1002,16 @@ public:
 	 */
 	std::ostream& PrintLDJson(std::ostream& os) const;
 
+	/**<
+	 * Fixed-layout (de)serialization of a record to/from exactly
+	 * `packed_size` bytes. These are used to write and read entire blocks of
+	 * records without per-field capacity checks.
+	 * @param dst Dst pointer to at least `packed_size` writable bytes.
+	 * @param src Src pointer to at least `packed_size` readable bytes.
+	 */
+	void Pack(char* dst) const;
+	void Unpack(const char* src);
+
 	friend twk_buffer_t& operator<<(twk_buffer_t& os, const twk1_two_t& entry);
 	friend twk_buffer_t& operator>>(twk_buffer_t& os, twk1_two_t& entry);
 	friend std::ostream& operator<<(std::ostream& os, const twk1_two_t& entry);
@@ -911,27 +1122,186 @@ public:
 	twk_ld_settings();
 	std::string GetString() const;
 
+	/**<
+	 * Smallest R2 a pair has to reach over the genotypes it is computed from
+	 * to be reported. When approximating LD over a subsample with exact
+	 * re-computation this is the screening threshold.
+	 * @return Returns the R2 threshold.
+	 */
+	inline double GetScreenR2() const{ return((n_sampled && sample_refine >= 0) ? sample_refine : minR2); }
+
 public:
 	bool square, window, low_memory, bitmaps, single; // using square compute, using window compute
 	bool force_phased, forced_unphased, force_cross_intervals;
 	int32_t c_level, bl_size, b_size, l_window; // compression level, block_size, output block size, window size in bp
+	int32_t l_window_variants; // window size in number of variants (0 = unbounded)
+	double l_window_cm; // window size in centiMorgans (0 = unbounded)
+	std::string genetic_map; // genetic map used for windows in centiMorgans
 	int32_t n_threads, cycle_threshold, ldd_load_type;
+	int32_t n_compressors; // output compressor threads (< 0 = automatic, 0 = compress on compute threads)
 	int32_t l_surrounding; // left,right-padding in base-pairs when running in single mode
+	uint64_t memory_limit; // memory budget in bytes for inflated blocks (0 = unbounded)
+	bool bv_sidecar; // map bitvectors from a persistent sidecar, building it if needed
+	bool numa; // bind threads to NUMA nodes and partition blocks between them
 	std::string in, out; // input file, output file/cout
 	double minP, minR2, maxR2, minDprime, maxDprime;
 	int32_t n_chunks, c_chunk;
+	uint32_t n_sampled, sample_seed; // number of samples to approximate LD over (0 = all), random seed
+	double sample_refine; // re-compute pairs with sampled R2 >= this value over all samples (< 0 = disabled)
+	bool lsh; // only compute pairs colliding in locality-sensitive hashing sketches
+	double lsh_recall; // desired probability of computing a pair at the R2 threshold
 	std::vector<std::string> ival_strings; // unparsed interval strings
 };
 
 /**<
- * Standard summary statistics object.
+ * Mergeable streaming quantile sketch (KLL). Values are kept in a hierarchy of
+ * compactors where an item at level h represents 2^h input values. When a
+ * compactor is full it is sorted and every other item is promoted to the next
+ * level. Memory is bounded by O(k log(n/k)) items and sketches built on
+ * separate threads can be merged without increasing the rank error.
+ */
+struct twk_kll_sketch {
+    twk_kll_sketch(const uint32_t k = 200) : k(k), coin(0), n(0), size(0), capacity(0){}
+
+    void Add(const float value){
+        if(levels.size() == 0){
+            levels.resize(1);
+            capacity = this->ComputeCapacity();
+        }
+        levels[0].push_back(value);
+        ++n; ++size;
+        if(size >= capacity) this->Compress();
+    }
+
+    /**<
+     * Merge another sketch into this sketch.
+     * @param other Reference to other sketch.
+     */
+    void Merge(const twk_kll_sketch& other){
+        if(other.n == 0) return;
+        if(levels.size() < other.levels.size()){
+            levels.resize(other.levels.size());
+            capacity = this->ComputeCapacity();
+        }
+
+        for(int i = 0; i < other.levels.size(); ++i)
+            levels[i].insert(levels[i].end(), other.levels[i].begin(), other.levels[i].end());
+
+        n    += other.n;
+        size += other.size;
+        while(size >= capacity) this->Compress();
+    }
+
+    /**<
+     * Estimate the value at the provided quantile.
+     * @param q Target quantile in [0,1].
+     * @return  Returns the estimated value or 0 if the sketch is empty.
+     */
+    double Quantile(const double q) const {
+        if(size == 0) return(0);
+
+        std::vector< std::pair<float, uint64_t> > items;
+        items.reserve(size);
+        uint64_t total = 0;
+        for(int i = 0; i < levels.size(); ++i){
+            for(int j = 0; j < levels[i].size(); ++j)
+                items.push_back(std::pair<float, uint64_t>(levels[i][j], (uint64_t)1 << i));
+            total += levels[i].size() * ((uint64_t)1 << i);
+        }
+        std::sort(items.begin(), items.end());
+
+        const double target = q * total;
+        uint64_t cum = 0;
+        for(int i = 0; i < items.size(); ++i){
+            cum += items[i].second;
+            if(cum >= target) return(items[i].first);
+        }
+        return(items.back().first);
+    }
+
+private:
+    uint32_t LevelCapacity(const uint32_t h) const {
+        const double c = k * pow(2.0/3, levels.size() - h - 1);
+        return(c < 2 ? 2 : (uint32_t)ceil(c));
+    }
+
+    uint64_t ComputeCapacity() const {
+        uint64_t c = 0;
+        for(int i = 0; i < levels.size(); ++i) c += this->LevelCapacity(i);
+        return(c);
+    }
+
+    /**<
+     * Compact the lowest level that has reached its capacity by sorting it
+     * and promoting every other item (randomised offset) to the next level.
+     */
+    void Compress(){
+        for(int h = 0; h < levels.size(); ++h){
+            if(levels[h].size() < this->LevelCapacity(h)) continue;
+
+            if(h + 1 == levels.size()){
+                levels.resize(levels.size() + 1);
+                capacity = this->ComputeCapacity();
+            }
+
+            std::vector<float>& lvl = levels[h];
+            std::sort(lvl.begin(), lvl.end());
+            const bool odd = lvl.size() & 1;
+            const float last = lvl.back();
+            const uint32_t m = lvl.size() - odd;
+
+            for(int i = coin; i < m; i += 2) levels[h+1].push_back(lvl[i]);
+            coin ^= 1;
+
+            size -= lvl.size();
+            lvl.clear();
+            if(odd) lvl.push_back(last);
+            size += lvl.size() + m / 2;
+            return;
+        }
+    }
+
+public:
+    uint32_t k, coin;
+    uint64_t n, size, capacity;
+    std::vector< std::vector<float> > levels;
+};
+
+/**<
+ * Standard summary statistics object. Quantile reductions require a sketch
+ * to be enabled with `EnableSketch` prior to adding values.
  */
 struct twk_sstats {
     // Functional pointer definitions used in reduce/aggregate subroutines.
     typedef void (twk_sstats::*aggfunc)(const twk1_two_t*);
     typedef double (twk_sstats::*redfunc)(const uint32_t) const;
 
-    twk_sstats() : n(0), total(0), total_squared(0), min(0), max(0){}
+    twk_sstats() : n(0), total(0), total_squared(0), min(0), max(0), sketch(nullptr){}
+    twk_sstats(const twk_sstats& other) : n(other.n), total(other.total),
+        total_squared(other.total_squared), min(other.min), max(other.max),
+        sketch(other.sketch == nullptr ? nullptr : new twk_kll_sketch(*other.sketch))
+    {}
+    ~twk_sstats(){ delete sketch; }
+
+    twk_sstats& operator=(const twk_sstats& other){
+        if(this == &other) return(*this);
+        n = other.n;
+        total = other.total;
+        total_squared = other.total_squared;
+        min = other.min;
+        max = other.max;
+        delete sketch;
+        sketch = (other.sketch == nullptr ? nullptr : new twk_kll_sketch(*other.sketch));
+        return(*this);
+    }
+
+    /**<
+     * Allocate a quantile sketch for this object.
+     * @param k Accuracy parameter of the sketch: larger values use more memory.
+     */
+    void EnableSketch(const uint32_t k = 200){
+        if(sketch == nullptr) sketch = new twk_kll_sketch(k);
+    }
 
     template <class T> void Add(const T value, const double weight = 1){
         this->total         += value;
@@ -939,6 +1309,7 @@ struct twk_sstats {
         this->n             += weight;
         this->min = value < min ? value : min;
         this->max = value > max ? value : max;
+        if(sketch != nullptr) sketch->Add(value);
     }
 
     void AddR2(const twk1_two_t* rec)  { Add(rec->R2); }
@@ -969,6 +1340,30 @@ struct twk_sstats {
         return(sqrt(this->total_squared/this->n - (this->total / this->n)*(this->total / this->n)));
     }
 
+    double GetQuantile(const double q, const uint32_t min = 0) const {
+        if(sketch == nullptr || n < min) return(0);
+        return(sketch->Quantile(q));
+    }
+
+    double GetMedian(const uint32_t min = 0) const { return(GetQuantile(0.50, min)); }
+    double GetQ25(const uint32_t min = 0) const { return(GetQuantile(0.25, min)); }
+    double GetQ75(const uint32_t min = 0) const { return(GetQuantile(0.75, min)); }
+    double GetQ90(const uint32_t min = 0) const { return(GetQuantile(0.90, min)); }
+    double GetQ95(const uint32_t min = 0) const { return(GetQuantile(0.95, min)); }
+    double GetQ99(const uint32_t min = 0) const { return(GetQuantile(0.99, min)); }
+
+    /**<
+     * Predicate returning TRUE if the provided reduction function requires a
+     * quantile sketch.
+     * @param f Reduction function pointer.
+     * @return  Returns TRUE if a sketch is required or FALSE otherwise.
+     */
+    static bool RequiresSketch(const redfunc f){
+        return(f == &twk_sstats::GetMedian || f == &twk_sstats::GetQ25 ||
+               f == &twk_sstats::GetQ75 || f == &twk_sstats::GetQ90 ||
+               f == &twk_sstats::GetQ95 || f == &twk_sstats::GetQ99);
+    }
+
     // Accessor functions
     inline double GetTotal(const uint32_t cutoff = 0) const{ return(total < cutoff ? 0 : total); }
     inline double GetTotalSquared(const uint32_t cutoff = 0) const{ return(total_squared < cutoff ? 0 : total_squared); }
@@ -981,12 +1376,17 @@ struct twk_sstats {
         total_squared += other.total_squared;
         min = std::min(min, other.min);
         max = std::max(max, other.max);
+        if(other.sketch != nullptr){
+            if(sketch == nullptr) sketch = new twk_kll_sketch(other.sketch->k);
+            sketch->Merge(*other.sketch);
+        }
     }
 
 public:
     uint64_t n;
     double total, total_squared;
     double min, max;
+    twk_kll_sketch* sketch; // optional quantile sketch
 };
 
 /**<
@@ -1005,9 +1405,29 @@ public:
 	twk1_aggregate_t(const uint32_t x, const uint32_t y);
 	~twk1_aggregate_t();
 
+	/**<
+	 * Writes the aggregate to the stream. Dense aggregates (data != nullptr)
+	 * are written as TWOAGG\1 with all x*y cells. Sparse aggregates are written
+	 * as TWOAGG\2 with the number of non-zero cells followed by their
+	 * compressed delta-encoded cell offsets and values.
+	 */
 	friend std::ostream& operator<<(std::ostream& stream, const twk1_aggregate_t& agg);
 
-	bool Open(std::string input);
+	/**<
+	 * Read an aggregate file from disk.
+	 * @param input   Input file path.
+	 * @param densify Expand sparse files into the dense `data` array.
+	 * @return        Returns TRUE upon success or FALSE otherwise.
+	 */
+	bool Open(std::string input, const bool densify = true);
+
+	/**<
+	 * Materialize the dense `data` array from the sparse representation.
+	 * @return Returns TRUE upon success or FALSE otherwise.
+	 */
+	bool Densify();
+
+	inline bool IsSparse() const { return(data == nullptr); }
 
 public:
 	// magic header
@@ -1016,6 +1436,8 @@ public:
 	std::string filename; // input filename
 	std::vector<offset_tuple> rid_offsets; // mat offsets
 	double* data;
+	std::vector<uint32_t> s_idx; // sparse cell offsets (i*y + j), sorted
+	std::vector<double> s_val; // sparse cell values
 	// EOF
 };
 
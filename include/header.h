@@ -328,6 +328,22 @@ public:
 	~VcfHeader() = default;
 
 	inline size_t GetNumberSamples(void) const{ return(this->samples_.size()); }
+
+	/**<
+	 * Samples may be stored in a different order than in the input to
+	 * lengthen runs of genotypes. Retrieve the input offset of the sample
+	 * stored at a given offset.
+	 * @param i Stored sample offset.
+	 * @return  Returns the input sample offset.
+	 */
+	inline uint32_t GetSampleOrder(const uint32_t i) const{ return(this->sample_order_.size() ? this->sample_order_[i] : i); }
+
+	// Sample names in input order.
+	std::vector<std::string> GetInputSamples(void) const{
+		std::vector<std::string> names(this->samples_.size());
+		for(uint32_t i = 0; i < names.size(); ++i) names[this->GetSampleOrder(i)] = this->samples_[i];
+		return(names);
+	}
 	inline size_t GetNumberContigs(void) const{ return(this->contigs_.size()); }
 
 	VcfContig* GetContig(const std::string& name);
@@ -378,6 +394,11 @@ public:
 	// VcfFilter: Data specifying a given FILTER field
 	// VcfStructuredExtra:
 	std::vector<std::string>        samples_;
+	// Input offset of each stored sample or empty if samples are stored in
+	// input order. Written after the contigs such that older readers ignore
+	// it: as sample names are stored in the same order as their genotypes
+	// those readers remain correct.
+	std::vector<uint32_t>           sample_order_;
 	std::vector<VcfContig>          contigs_;
 	// Not written out: used during Import procedure only.
 	std::vector<VcfInfo>            info_fields_;
@@ -33,18 +33,21 @@ namespace tomahawk {
  * class below. If you want to write to stdout then set output to '-'. If reading
  */
 struct twk_vimport_settings {
-	twk_vimport_settings() : remove_univariate(true), flip_major_minor(false), c_level(1), block_size(500), threshold_miss(0.9), hwe(0), input("-"), output("-"){}
+	twk_vimport_settings() : remove_univariate(true), flip_major_minor(false), rle_only(false), c_level(1), block_size(500), n_permute(0), threshold_miss(0.9), hwe(0), input("-"), output("-"){}
 
 	bool remove_univariate, flip_major_minor;
+	bool rle_only; // run-length encode all genotypes instead of choosing per variant
 	uint8_t c_level;
 	uint32_t block_size;
+	uint32_t n_permute; // number of variants used to reorder samples or 0 to keep the input order
 	float threshold_miss;
 	double hwe;
 	std::string input, output;
 };
 
 /**<
- * Basic class for importing htslib-compatible files into the tomahawk file format.
+ * Basic class for importing htslib-compatible files and PLINK 1 binary filesets
+ * into the tomahawk file format.
  * Importing require the use of the `twk_vimport_settings` struct for providing
  * parameters.
  */
@@ -53,6 +56,14 @@ public:
 	bool Import(twk_vimport_settings& settings);
 	bool Import(void);
 
+	/**<
+	 * Import a PLINK 1 binary fileset. Invoked by Import() if the input has
+	 * the .bed extension: the .bim and .fam files are expected alongside it.
+	 * Genotypes are converted from the packed .bed data directly.
+	 * @return Returns TRUE upon success or FALSE otherwise.
+	 */
+	bool ImportPlink(void);
+
 public:
 	twk_vimport_settings settings;
 };
@@ -51,6 +51,7 @@ const std::string TOMAHAWK_LD_MAGIC_HEADER  = "TWO\1";
 const uint32_t    TOMAHAWK_LD_MAGIC_HEADER_LENGTH = 4;
 const std::string TOMAHAWK_AGGREGATE_MAGIC_HEADER  = "TWOAGG\1";
 const uint32_t    TOMAHAWK_AGGREGATE_MAGIC_HEADER_LENGTH = 7;
+const std::string TOMAHAWK_AGGREGATE_SPARSE_MAGIC_HEADER  = "TWOAGG\2";
 
 /*------   Regular expression patterns  ------*/
 const std::regex TWK_REGEX_CANONICAL_BASES = std::regex("^[ATGC]{1}$");
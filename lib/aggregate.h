@@ -35,13 +35,15 @@ void aggregate_usage(void){
 	"Options:\n"
 	"  -i   FILE   input TWO file (required)\n"
 	"  -o   FILE   output file path (default: -)\n"
-	"  -O   <b,u>  b: compressed binary representation, u: uncompressed matrix (default: b)\n"
+	"  -O   <b,s,u> b: compressed binary representation, s: compressed sparse binary\n"
+	"              representation of non-zero bins, u: uncompressed matrix (default: b)\n"
 	"  -x,y INT    number of X/Y-axis bins (default: 1000)\n"
 	"  -f   STRING aggregation function: can be one of (r2,r,d,dprime,dp,p,hets,alts,het,alt)(required)\n"
-	"  -r   STRING reduction function: can be one of (mean,count,n,min,max,sd,total)(required)\n"
+	"  -r   STRING reduction function: can be one of (mean,count,n,min,max,sd,total,median,q25,q75,q90,q95,q99)(required)\n"
 	"  -I   STRING filter interval <contig>:pos-pos (TWK/TWO) or linked interval <contig>:pos-pos,<contig>:pos-pos\n"
 	"  -c   INT    min cut-off value used in reduction function: value < c will be set to 0 (default: 5)\n"
-	"  -t   INT    number of parallel threads: each thread will use " << sizeof(tomahawk::twk_sstats) << "(x*y) bytes\n" << std::endl;
+	"  -t   INT    number of parallel threads: each thread will use " << sizeof(tomahawk::twk_sstats) << " bytes for every\n"
+	"              bin in tiles of " << tomahawk::twk_sstats_tiles::TWK_AGG_TILE_SIZE << "x" << tomahawk::twk_sstats_tiles::TWK_AGG_TILE_SIZE << " bins containing data\n" << std::endl;
 }
 
 int aggregate(int argc, char** argv){
@@ -107,8 +109,8 @@ int aggregate(int argc, char** argv){
 		}
 	}
 
-	if(settings.out_type != 'u' && settings.out_type != 'b'){
-		std::cerr << tomahawk::utility::timestamp("ERROR") << "Output format must be either 'u' or 'b'..." << std::endl;
+	if(settings.out_type != 'u' && settings.out_type != 'b' && settings.out_type != 's'){
+		std::cerr << tomahawk::utility::timestamp("ERROR") << "Output format must be either 'u', 'b', or 's'..." << std::endl;
 		return(1);
 	}
 
@@ -176,6 +178,12 @@ int aggregate(int argc, char** argv){
 		else if(reduce_func_name == "n")    { r = &tomahawk::twk_sstats::GetCount; }
 		else if(reduce_func_name == "total"){ r = &tomahawk::twk_sstats::GetTotal; }
 		else if(reduce_func_name == "sd")   { r = &tomahawk::twk_sstats::GetStandardDeviation; }
+		else if(reduce_func_name == "median"){ r = &tomahawk::twk_sstats::GetMedian; }
+		else if(reduce_func_name == "q25")  { r = &tomahawk::twk_sstats::GetQ25; }
+		else if(reduce_func_name == "q75")  { r = &tomahawk::twk_sstats::GetQ75; }
+		else if(reduce_func_name == "q90")  { r = &tomahawk::twk_sstats::GetQ90; }
+		else if(reduce_func_name == "q95")  { r = &tomahawk::twk_sstats::GetQ95; }
+		else if(reduce_func_name == "q99")  { r = &tomahawk::twk_sstats::GetQ99; }
 		else {
 			std::cerr << tomahawk::utility::timestamp("ERROR") << "Unknown reduce function \"" << reduce_func_name << "\"..." << std::endl;
 			return(1);
@@ -380,7 +388,12 @@ int aggregate(int argc, char** argv){
 	uint32_t xrange = std::ceil((float)range / x_bins);
 	uint32_t yrange = std::ceil((float)range / y_bins);
 
-	tomahawk::twk1_aggregate_t agg(x_bins, y_bins);
+	// Sparse output never materializes the dense matrix.
+	tomahawk::twk1_aggregate_t agg;
+	agg.n = x_bins*y_bins;
+	agg.x = x_bins;
+	agg.y = y_bins;
+	if(settings.out_type == 'b') agg.data = new double[agg.n];
 	agg.bpx = xrange;
 	agg.bpy = yrange;
 	agg.range = range;
@@ -389,7 +402,6 @@ int aggregate(int argc, char** argv){
 
 	std::cerr << tomahawk::utility::timestamp("LOG") << "===== Second pass (building matrix) =====" << std::endl;
 	std::cerr << tomahawk::utility::timestamp("LOG") << "Aggregating " << tomahawk::utility::ToPrettyString(n_recs) << " records..." << std::endl;
-	std::cerr << tomahawk::utility::timestamp("LOG","THREAD") << "Allocating: " << tomahawk::utility::ToPrettyDiskString(sizeof(tomahawk::twk_sstats)*x_bins*y_bins*settings.n_threads) << " for matrices..." << std::endl;
 
 	tomahawk::twk_sort_progress progress_sort_step2;
 	progress_sort_step2.n_cmps = n_recs;
@@ -406,14 +418,18 @@ int aggregate(int argc, char** argv){
 	for(int i = 0; i < settings.n_threads; ++i) slaves[i].thread->join();
 	progress_sort_step2.is_ticking = false;
 	progress_sort_step2.PrintFinal();
+	uint64_t tile_mem = 0;
+	for(int i = 0; i < settings.n_threads; ++i) tile_mem += slaves[i].mat.GetMemoryUsage();
+	std::cerr << tomahawk::utility::timestamp("LOG","THREAD") << "Allocated: " << tomahawk::utility::ToPrettyDiskString(tile_mem) << " for matrix tiles..." << std::endl;
+
 	for(int i = 1; i < settings.n_threads; ++i) slaves[0].AddMatrix(slaves[i]);
 
 	// Print matrix
 	//slaves[0].PrintMatrix(std::cout, min_cutoff);
-	slaves[0].Overload(agg, min_cutoff);
+	if(settings.out_type != 'u') slaves[0].Overload(agg, min_cutoff);
 
 	if(use_writer){
-		if(settings.out_type == 'b'){
+		if(settings.out_type == 'b' || settings.out_type == 's'){
 			*writer << agg;
 		} else {
 			slaves[0].PrintMatrix(*writer, min_cutoff);
@@ -422,7 +438,7 @@ int aggregate(int argc, char** argv){
 		writer->close();
 		delete writer;
 	} else {
-		if(settings.out_type == 'b') std::cout << agg;
+		if(settings.out_type == 'b' || settings.out_type == 's') std::cout << agg;
 		else slaves[0].PrintMatrix(std::cout, min_cutoff);
 	}
 
@@ -4,6 +4,7 @@
 #include <thread>
 #include <limits>
 #include <cstdint>
+#include <unordered_map>
 
 #include "core.h"
 #include "two_reader.h"
@@ -11,6 +12,91 @@
 
 namespace tomahawk {
 
+/**<
+ * Sparse tiled matrix of summary statistics. The (x,y)-space is partitioned
+ * into square tiles of TWK_AGG_TILE_SIZE^2 bins that are only allocated when
+ * a bin inside them is first touched. Empty regions of the landscape
+ * therefore use no memory. Tiles are stored in a flat arena and looked up
+ * by their (tile x, tile y)-coordinate with a cache of the last tile used,
+ * as consecutive records usually fall into the same tile.
+ */
+struct twk_sstats_tiles {
+public:
+	static const uint32_t TWK_AGG_TILE_SHIFT = 5;
+	static const uint32_t TWK_AGG_TILE_SIZE  = 1 << TWK_AGG_TILE_SHIFT;
+
+	twk_sstats_tiles() : x(0), y(0), ty(0), sketch(false), last_key(std::numeric_limits<uint64_t>::max()), last_tile(0){}
+
+	/**<
+	 * Clear all data and set the dimensions of the matrix.
+	 * @param x_bins Number of bins in X-dimension.
+	 * @param y_bins Number of bins in Y-dimension.
+	 * @param use_sketch Allocate quantile sketches in every bin.
+	 */
+	void Reset(const uint32_t x_bins, const uint32_t y_bins, const bool use_sketch){
+		x = x_bins; y = y_bins;
+		ty = (y + TWK_AGG_TILE_SIZE - 1) >> TWK_AGG_TILE_SHIFT;
+		sketch = use_sketch;
+		tiles.clear(); keys.clear(); map.clear();
+		last_key = std::numeric_limits<uint64_t>::max(); last_tile = 0;
+	}
+
+	inline twk_sstats& operator()(const uint32_t i, const uint32_t j){
+		const uint64_t key = (uint64_t)(i >> TWK_AGG_TILE_SHIFT) * ty + (j >> TWK_AGG_TILE_SHIFT);
+		if(key != last_key){
+			last_tile = this->GetTile(key);
+			last_key  = key;
+		}
+		return(tiles[last_tile][((i & (TWK_AGG_TILE_SIZE - 1)) << TWK_AGG_TILE_SHIFT) + (j & (TWK_AGG_TILE_SIZE - 1))]);
+	}
+
+	/**<
+	 * Accessor for a bin without allocating new tiles.
+	 * @param i Bin in X-dimension.
+	 * @param j Bin in Y-dimension.
+	 * @return  Returns a pointer to the bin or a nullptr if the tile is empty.
+	 */
+	const twk_sstats* Get(const uint32_t i, const uint32_t j) const {
+		const uint64_t key = (uint64_t)(i >> TWK_AGG_TILE_SHIFT) * ty + (j >> TWK_AGG_TILE_SHIFT);
+		std::unordered_map<uint64_t, uint32_t>::const_iterator it = map.find(key);
+		if(it == map.end()) return nullptr;
+		return(&tiles[it->second][((i & (TWK_AGG_TILE_SIZE - 1)) << TWK_AGG_TILE_SHIFT) + (j & (TWK_AGG_TILE_SIZE - 1))]);
+	}
+
+	void operator+=(const twk_sstats_tiles& other){
+		for(int i = 0; i < other.tiles.size(); ++i){
+			std::vector<twk_sstats>& tile = tiles[this->GetTile(other.keys[i])];
+			for(int j = 0; j < tile.size(); ++j) tile[j] += other.tiles[i][j];
+		}
+	}
+
+	inline size_t size() const { return(tiles.size()); }
+	inline uint64_t GetMemoryUsage() const { return(tiles.size() * TWK_AGG_TILE_SIZE * TWK_AGG_TILE_SIZE * sizeof(twk_sstats)); }
+
+private:
+	uint32_t GetTile(const uint64_t key){
+		std::unordered_map<uint64_t, uint32_t>::const_iterator it = map.find(key);
+		if(it != map.end()) return(it->second);
+
+		tiles.push_back(std::vector<twk_sstats>(TWK_AGG_TILE_SIZE * TWK_AGG_TILE_SIZE));
+		if(sketch){
+			for(int i = 0; i < tiles.back().size(); ++i) tiles.back()[i].EnableSketch();
+		}
+		keys.push_back(key);
+		map[key] = tiles.size() - 1;
+		return(tiles.size() - 1);
+	}
+
+public:
+	uint32_t x, y, ty; // number of bins in X and Y and number of tiles in Y
+	bool sketch;
+	uint64_t last_key; // cached tile key
+	uint32_t last_tile; // cached tile offset
+	std::vector< std::vector<twk_sstats> > tiles; // tile arena
+	std::vector<uint64_t> keys; // tile offset -> key
+	std::unordered_map<uint64_t, uint32_t> map; // key -> tile offset
+};
+
 struct twk_agg_slave {
 public:
 	struct range_helper {
@@ -90,7 +176,8 @@ public:
 		reductor = red;
 		xrange = xr;
 		yrange = yr;
-		mat = std::vector< std::vector<twk_sstats> >(x, std::vector<twk_sstats>(y));
+		// Quantile reductions require a mergeable sketch in every bin.
+		mat.Reset(x, y, twk_sstats::RequiresSketch(red));
 
 		if(stream.good()) stream.close();
 
@@ -165,7 +252,8 @@ public:
 				// Invoke aggregator function.
 				// Position: cumulative offset up to chromosome + left-adjusted position
 				// Position: (chromosome_offset.range - chromosome_offset.max - chromoosme_offset.min) + (Apos - smallest_in_chr)
-				(mat[((rid_offsets[it->blk[j].ridA].range - (rid_offsets[it->blk[j].ridA].max - rid_offsets[it->blk[j].ridA].min)) + (it->blk[j].Apos - rid_offsets[it->blk[j].ridA].min))/xrange][((rid_offsets[it->blk[j].ridB].range - (rid_offsets[it->blk[j].ridB].max - rid_offsets[it->blk[j].ridB].min)) + (it->blk[j].Bpos - rid_offsets[it->blk[j].ridB].min))/yrange].*aggregator)(&it->blk[j]);
+				(mat(((rid_offsets[it->blk[j].ridA].range - (rid_offsets[it->blk[j].ridA].max - rid_offsets[it->blk[j].ridA].min)) + (it->blk[j].Apos - rid_offsets[it->blk[j].ridA].min))/xrange,
+				     ((rid_offsets[it->blk[j].ridB].range - (rid_offsets[it->blk[j].ridB].max - rid_offsets[it->blk[j].ridB].min)) + (it->blk[j].Bpos - rid_offsets[it->blk[j].ridB].min))/yrange).*aggregator)(&it->blk[j]);
 			}
 			if(progress != nullptr) progress->cmps += it->GetBlock().n;
 		}
@@ -179,11 +267,20 @@ public:
 	 * slave instance to the current instance.
 	 * @param other Reference to other slave instance.
 	 */
-	void AddMatrix(const twk_agg_slave& other){
-		for(int i = 0; i < mat.size(); ++i){
-			for(int j = 0; j < mat[i].size(); ++j)
-				mat[i][j] += other.mat[i][j];
-		}
+	void AddMatrix(const twk_agg_slave& other){ mat += other.mat; }
+
+	/**<
+	 * Reduce the bin at (i,j). Bins in unallocated tiles are reduced as
+	 * empty bins.
+	 * @param i          Bin in X-dimension.
+	 * @param j          Bin in Y-dimension.
+	 * @param min_cutoff Minimum number of elements require to output a value.
+	 * @return           Returns the reduced value.
+	 */
+	inline double Reduce(const uint32_t i, const uint32_t j, const uint32_t min_cutoff) const {
+		static const twk_sstats empty;
+		const twk_sstats* s = mat.Get(i, j);
+		return(((s == nullptr ? empty : *s).*reductor)(min_cutoff));
 	}
 
 	/**<
@@ -192,25 +289,54 @@ public:
 	 * @param min_cutoff Minimum number of elements require to output a value. If the observed frequency is smaller than this value then we emit 0.
 	 */
 	void PrintMatrix(std::ostream& stream, uint32_t min_cutoff = 5) const {
-		for(int i = 0; i < mat.size(); ++i){
-			stream << (mat[i][0].*reductor)(min_cutoff);
-			for(int j = 1; j < mat[i].size(); ++j)
-				stream << '\t' << (mat[i][j].*reductor)(min_cutoff);
+		for(int i = 0; i < mat.x; ++i){
+			stream << this->Reduce(i, 0, min_cutoff);
+			for(int j = 1; j < mat.y; ++j)
+				stream << '\t' << this->Reduce(i, j, min_cutoff);
 			stream << '\n';
 		}
 		stream.flush();
 	}
 
+	/**<
+	 * Reduce all bins into the output aggregate. If the aggregate has no
+	 * dense data allocated then only non-zero bins in allocated tiles are
+	 * stored in its sparse representation.
+	 * @param agg        Destination aggregate.
+	 * @param min_cutoff Minimum number of elements require to output a value.
+	 * @return           Returns a reference to the destination aggregate.
+	 */
 	twk1_aggregate_t& Overload(twk1_aggregate_t& agg, uint32_t min_cutoff = 5) const {
-		for(int i = 0; i < mat.size(); ++i){
-			agg.data[i*mat.size() + 0] = (mat[i][0].*reductor)(min_cutoff);
-			for(int j = 1; j < mat[i].size(); ++j){
-				agg.data[i*mat.size() + j] = (mat[i][j].*reductor)(min_cutoff);
-				//stream << '\t' << (mat[i][j].*reductor)(min_cutoff);
+		if(agg.data != nullptr){
+			for(int i = 0; i < mat.x; ++i){
+				for(int j = 0; j < mat.y; ++j)
+					agg.data[i*mat.y + j] = this->Reduce(i, j, min_cutoff);
 			}
-			//stream << '\n';
+			return(agg);
+		}
+
+		// Only allocated tiles can contain non-empty bins.
+		std::vector< std::pair<uint32_t, double> > cells;
+		for(int t = 0; t < mat.tiles.size(); ++t){
+			const uint32_t ti = (mat.keys[t] / mat.ty) << twk_sstats_tiles::TWK_AGG_TILE_SHIFT;
+			const uint32_t tj = (mat.keys[t] % mat.ty) << twk_sstats_tiles::TWK_AGG_TILE_SHIFT;
+			for(int k = 0; k < mat.tiles[t].size(); ++k){
+				const uint32_t i = ti + (k >> twk_sstats_tiles::TWK_AGG_TILE_SHIFT);
+				const uint32_t j = tj + (k & (twk_sstats_tiles::TWK_AGG_TILE_SIZE - 1));
+				if(i >= mat.x || j >= mat.y) continue;
+
+				const double v = (mat.tiles[t][k].*reductor)(min_cutoff);
+				if(v != 0) cells.push_back(std::pair<uint32_t, double>(i*mat.y + j, v));
+			}
+		}
+		std::sort(cells.begin(), cells.end());
+
+		agg.s_idx.resize(cells.size());
+		agg.s_val.resize(cells.size());
+		for(int i = 0; i < cells.size(); ++i){
+			agg.s_idx[i] = cells[i].first;
+			agg.s_val[i] = cells[i].second;
 		}
-		//stream.flush();
 		return(agg);
 	}
 
@@ -226,7 +352,7 @@ public:
 	std::string filename; // input filename
 	std::vector<range_helper> contig_avail;
 	std::vector<twk1_aggregate_t::offset_tuple> rid_offsets; // mat offsets
-	std::vector< std::vector<twk_sstats> > mat; // Output matrix
+	twk_sstats_tiles mat; // Output matrix
 };
 
 }
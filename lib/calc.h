@@ -41,16 +41,32 @@ void calc_usage(void){
 	"  -m        run in low-memory mode: this is considerably slower but use no more memory than\n"
 	"               block1*variants + block2*variants\n"
 	"  -M        use phased bitmaps in low-memory mode. Automatically triggers -m and -p.\n"
+	"  -B SIZE   keep at most SIZE bytes of pre-computed blocks in memory (suffixes K, M, G, T).\n"
+	"               In between standard and low-memory mode in both speed and memory usage\n"
+	"  -V        map pre-computed bitvectors from the sidecar <in>.bv, building it if missing\n"
+	"               or out of date. Speeds up repeated runs on the same input\n"
+	"  -n        bind threads to NUMA nodes and compute blocks on the node they were loaded on\n"
 	"  -b        number of records in a block. Has an effect on memory usage only when -m is set.\n"
 	"  -w INT    sliding window width in bases\n"
+	"  -N INT    sliding window width in number of variants\n"
+	"  -G FLOAT  sliding window width in centiMorgans (requires -g)\n"
+	"  -g FILE   genetic map with columns contig, position, [rate,] cM\n"
+	"               Window widths can be combined: pairs have to be within all of them\n"
 	"  -I STRING filter interval <contig>:pos-pos (see manual)\n"
 	"  -p        force computations to use phased math\n"
 	"  -u        force computations to use unphased math\n"
-	//"  -S INT    trigger sampling mode: number of individuals to sample when allele counts are large.\n"
+	"  -S INT    approximate LD over a stratified random subset of INT individuals\n"
+	"  -e FLOAT  with -S: re-compute pairs with sampled R-squared >= FLOAT over all individuals\n"
+	"  -z INT    with -S: random seed used for drawing individuals (default: 0)\n"
+	"  -L        only compute pairs colliding in locality-sensitive hashing sketches: fast\n"
+	"               but approximate genome-wide search for pairs above a high -r threshold\n"
+	"  -l FLOAT  with -L: desired probability of finding a pair at the -r threshold (default: 0.99)\n"
 	"  -P FLOAT  Fisher's exact test / Chi-squared cutoff P-value (default: 1)\n"
 	"  -r FLOAT  Pearson's R-squared minimum cut-off value (default: 0.1)\n"
 	//"  -R FLOAT  Pearson's R-squared maximum cut-off value (default: 1.0)\n"
-	"  -k INT    compression level to use (default: 1, max = 22).\n" << std::endl;
+	"  -k INT    compression level to use (default: 1, max = 22).\n"
+	"  -K INT    number of output compressor threads; 0 compresses on the compute threads\n"
+	"               (default: max(1, threads/4))\n" << std::endl;
 }
 
 int calc(int argc, char** argv){
@@ -74,7 +90,11 @@ int calc(int argc, char** argv){
 		{"low-memory",        optional_argument, 0, 'm' },
 		{"block-size",        optional_argument, 0, 'b' },
 		{"bitmaps",           optional_argument, 0, 'M' },
+		{"memory-limit",      optional_argument, 0, 'B' },
+		{"bv-sidecar",        no_argument,       0, 'V' },
+		{"numa",              no_argument,       0, 'n' },
 		{"compression-level", optional_argument, 0, 'k' },
+		{"compressors",       optional_argument, 0, 'K' },
 
 		{"cross-chr-only",    no_argument, 0, 'X' },
 		{"no-cross-chr",      no_argument, 0, 'x' },
@@ -83,6 +103,10 @@ int calc(int argc, char** argv){
 		{"force-phased",      no_argument,       0, 'p' },
 		{"force-unphased",    no_argument,       0, 'u' },
 		{"samples",           optional_argument, 0, 'S' },
+		{"sample-refine",     optional_argument, 0, 'e' },
+		{"sample-seed",       optional_argument, 0, 'z' },
+		{"lsh",               no_argument,       0, 'L' },
+		{"lsh-recall",        optional_argument, 0, 'l' },
 		{"minR2",             optional_argument, 0, 'r' },
 		//{"maxR2",             optional_argument, 0, 'R' },
 
@@ -90,13 +114,17 @@ int calc(int argc, char** argv){
 		{"silent",            no_argument,       0, 's' },
 		// Not implemented
 		{"windowBases",       optional_argument, 0, 'w' },
+		{"window-variants",   optional_argument, 0, 'N' },
+		{"window-cm",         optional_argument, 0, 'G' },
+		{"genetic-map",       optional_argument, 0, 'g' },
 		{0,0,0,0}
 	};
 
 	tomahawk::twk_ld_settings settings;
+	bool window_bases = false;
 	//std::vector<std::string> filter_regions;
 
-	while ((c = getopt_long(argc, argv, "i:o:t:puP:a:A:r:w:S:I:sdc:C:mMb:xXk:?", long_options, &option_index)) != -1){
+	while ((c = getopt_long(argc, argv, "i:o:t:puP:a:A:r:w:N:G:g:S:e:z:Ll:I:sdc:C:mMB:Vnb:xXk:K:?", long_options, &option_index)) != -1){
 		switch (c){
 		case 0:
 			std::cerr << "Case 0: " << option_index << '\t' << long_options[option_index].name << std::endl;
@@ -126,6 +154,30 @@ int calc(int argc, char** argv){
 			settings.low_memory = true;
 			settings.bitmaps = true;
 			break;
+		case 'B':
+		{
+			char* end = nullptr;
+			double limit = strtod(optarg, &end);
+			// Scale by 1024 for every unit up to and including the suffix.
+			const char* units = "KMGT";
+			const char* unit  = (*end != '\0' ? strchr(units, toupper(*end)) : nullptr);
+			if(unit != nullptr){
+				for(const char* u = units; u <= unit; ++u) limit *= 1024;
+				++end;
+			}
+			if(end == optarg || *end != '\0' || limit < 1){
+				std::cerr << tomahawk::utility::timestamp("ERROR") << "Cannot parse memory limit: " << optarg << std::endl;
+				return(1);
+			}
+			settings.memory_limit = limit;
+			break;
+		}
+		case 'V':
+			settings.bv_sidecar = true;
+			break;
+		case 'n':
+			settings.numa = true;
+			break;
 		case 't':
 			settings.n_threads = atoi(optarg);
 			if(settings.n_threads <= 0){
@@ -178,6 +230,33 @@ int calc(int argc, char** argv){
 			}
 			break;
 		*/
+		case 'S':
+			if(atoi(optarg) <= 0){
+				std::cerr << tomahawk::utility::timestamp("ERROR") << "Cannot sample a non-positive number of individuals" << std::endl;
+				return(1);
+			}
+			settings.n_sampled = atoi(optarg);
+			break;
+		case 'e':
+			settings.sample_refine = atof(optarg);
+			if(settings.sample_refine < 0 || settings.sample_refine > 1){
+				std::cerr << tomahawk::utility::timestamp("ERROR") << "Re-computation R-squared threshold must be in [0,1]" << std::endl;
+				return(1);
+			}
+			break;
+		case 'z':
+			settings.sample_seed = atoi(optarg);
+			break;
+		case 'L':
+			settings.lsh = true;
+			break;
+		case 'l':
+			settings.lsh_recall = atof(optarg);
+			if(settings.lsh_recall <= 0 || settings.lsh_recall >= 1){
+				std::cerr << tomahawk::utility::timestamp("ERROR") << "LSH recall must be in (0,1)" << std::endl;
+				return(1);
+			}
+			break;
 		case 'P':
 		  settings.minP = atof(optarg);
 		  if(settings.minP < 0){
@@ -191,6 +270,7 @@ int calc(int argc, char** argv){
 
 		case 'w':
 			settings.window = true;
+			window_bases = true;
 		  if(std::regex_match(std::string(optarg), std::regex("^(([0-9]+)|([0-9]+[eE]{1}[0-9]+))$")) == false){
 			  std::cerr << "not an integer" << std::endl;
 			  return(1);
@@ -208,10 +288,38 @@ int calc(int argc, char** argv){
 
 		  break;
 
+		case 'N':
+			settings.window = true;
+			settings.l_window_variants = atoi(optarg);
+			if(settings.l_window_variants <= 0){
+				std::cerr << tomahawk::utility::timestamp("ERROR") << "Cannot have a non-positive window size" << std::endl;
+				return(1);
+			}
+			break;
+		case 'G':
+			settings.window = true;
+			settings.l_window_cm = atof(optarg);
+			if(settings.l_window_cm <= 0){
+				std::cerr << tomahawk::utility::timestamp("ERROR") << "Cannot have a non-positive window size" << std::endl;
+				return(1);
+			}
+			break;
+		case 'g':
+			settings.genetic_map = std::string(optarg);
+			break;
+
 		case 'k':
 		settings.c_level = std::atoi(optarg);
 		break;
 
+		case 'K':
+		settings.n_compressors = std::atoi(optarg);
+		if(settings.n_compressors < 0){
+			std::cerr << tomahawk::utility::timestamp("ERROR") << "Cannot have a negative number of compressor threads" << std::endl;
+			return(1);
+		}
+		break;
+
 
 		default:
 		  std::cerr << tomahawk::utility::timestamp("ERROR") << "Unrecognized option: " << (char)c << std::endl;
@@ -229,6 +337,14 @@ int calc(int argc, char** argv){
 		return(1);
 	}
 
+	if(settings.l_window_cm > 0 && settings.genetic_map.size() == 0){
+		std::cerr << tomahawk::utility::timestamp("ERROR") << "Windows in centiMorgans require a genetic map (-g)..." << std::endl;
+		return(1);
+	}
+
+	// Windows given only in variants or centiMorgans are unbounded in bases.
+	if(settings.window && window_bases == false) settings.l_window = 0;
+
 	// Print messages
 	tomahawk::ProgramMessage();
 	std::cerr << tomahawk::utility::timestamp("LOG") << "Calling calc..." << std::endl;
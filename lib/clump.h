@@ -0,0 +1,265 @@
+/*
+Copyright (C) 2016-present Genome Research Ltd.
+Author: Marcus D. R. Klarqvist <mk819@cam.ac.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+#include <getopt.h>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+#include "utility.h"
+#include "twk_reader.h"
+#include "timer.h"
+#include "prune_structs.h"
+
+void clump_usage(void){
+	tomahawk::ProgramMessage();
+	std::cerr <<
+	"About:  Clump associated variants around index variants. Variants with\n"
+	"        P <= -p are visited in order of significance and claim every\n"
+	"        unclaimed variant with P <= -P within -w bases with R-squared\n"
+	"        >= -r. Pairs are computed on demand and never written.\n\n"
+	"Usage:  " << tomahawk::TOMAHAWK_PROGRAM_NAME << " clump [options] -i <in.twk> -a <assoc.txt>\n\n"
+	"Options:\n"
+	"  -i FILE   input TWK file (required)\n"
+	"  -a FILE   association file with (contig,position,P-value) in the first three columns (required)\n"
+	"  -o FILE   output file (default: stdout)\n"
+	"  -p FLOAT  P-value threshold for index variants (default: 1e-4)\n"
+	"  -P FLOAT  P-value threshold for clumped variants (default: 0.01)\n"
+	"  -w INT    window size in bases on either side of an index variant (default: 250000)\n"
+	"  -r FLOAT  Pearson's R-squared threshold (default: 0.5)\n"
+	"  -u        force computations to use unphased math\n"
+	"  -t INT    number of parallel threads (default: " << std::thread::hardware_concurrency() << ")\n\n"
+	"Output is one line per clump: contig, position and P-value of the index\n"
+	"variant followed by the number and positions of the clumped variants.\n\n";
+}
+
+int clump(int argc, char** argv){
+	if(argc < 3){
+		clump_usage();
+		return(0);
+	}
+
+	static struct option long_options[] = {
+		{"input",       required_argument, 0, 'i' },
+		{"assoc",       required_argument, 0, 'a' },
+		{"output",      required_argument, 0, 'o' },
+		{"p1",          required_argument, 0, 'p' },
+		{"p2",          required_argument, 0, 'P' },
+		{"window",      required_argument, 0, 'w' },
+		{"minR2",       required_argument, 0, 'r' },
+		{"force-unphased", no_argument,    0, 'u' },
+		{"threads",     required_argument, 0, 't' },
+		{0,0,0,0}
+	};
+
+	std::string input, assoc, output;
+	double p1 = 1e-4, p2 = 0.01, minR2 = 0.5;
+	int32_t window = 250000;
+	bool unphased = false;
+	int32_t n_threads = std::thread::hardware_concurrency();
+
+	int c = 0;
+	int long_index = 0;
+	int hits = 0;
+	while ((c = getopt_long(argc, argv, "i:a:o:p:P:w:r:ut:?", long_options, &long_index)) != -1){
+		hits += 2;
+		switch (c){
+		case ':':   /* missing option argument */
+			fprintf(stderr, "%s: option `-%c' requires an argument\n",
+					argv[0], optopt);
+			break;
+
+		case '?':
+		default:
+			fprintf(stderr, "%s: option `-%c' is invalid: ignored\n",
+					argv[0], optopt);
+			break;
+
+		case 'i': input  = std::string(optarg); break;
+		case 'a': assoc  = std::string(optarg); break;
+		case 'o': output = std::string(optarg); break;
+		case 'p': p1     = atof(optarg); break;
+		case 'P': p2     = atof(optarg); break;
+		case 'w': window = atoi(optarg); break;
+		case 'r': minR2  = atof(optarg); break;
+		case 'u': unphased = true; break;
+		case 't': n_threads = atoi(optarg); break;
+		}
+	}
+
+	if(input.length() == 0){
+		std::cerr << tomahawk::utility::timestamp("ERROR") << "No input value specified..." << std::endl;
+		return(1);
+	}
+
+	if(assoc.length() == 0){
+		std::cerr << tomahawk::utility::timestamp("ERROR") << "No association file specified..." << std::endl;
+		return(1);
+	}
+
+	if(p1 < 0 || p1 > 1 || p2 < 0 || p2 > 1){
+		std::cerr << tomahawk::utility::timestamp("ERROR") << "P-value thresholds must be in [0,1]..." << std::endl;
+		return(1);
+	}
+
+	if(window < 0){
+		std::cerr << tomahawk::utility::timestamp("ERROR") << "Cannot have a negative window size..." << std::endl;
+		return(1);
+	}
+
+	if(minR2 < 0 || minR2 > 1){
+		std::cerr << tomahawk::utility::timestamp("ERROR") << "R-squared threshold must be in [0,1]..." << std::endl;
+		return(1);
+	}
+
+	if(n_threads <= 0){
+		std::cerr << tomahawk::utility::timestamp("ERROR") << "Cannot have a non-positive number of threads..." << std::endl;
+		return(1);
+	}
+
+	// Print messages
+	tomahawk::ProgramMessage();
+	std::cerr << tomahawk::utility::timestamp("LOG") << "Calling clump..." << std::endl;
+
+	tomahawk::twk_reader rdr;
+	if(rdr.Open(input) == false) return 1;
+
+	// Read P-values of (contig,position)-tuples. Lines that do not parse,
+	// such as headers, are skipped. Only variants with P <= p2 take part.
+	std::ifstream afs(assoc);
+	if(afs.good() == false){
+		std::cerr << tomahawk::utility::timestamp("ERROR") << "Failed to open \"" << assoc << "\"..." << std::endl;
+		return 1;
+	}
+
+	std::unordered_map<uint64_t, double> pvalues;
+	std::string line, chrom;
+	uint64_t n_lines = 0;
+	while(std::getline(afs, line)){
+		if(line.size() == 0 || line[0] == '#') continue;
+		std::istringstream ss(line);
+		uint32_t pos = 0; double p = 0;
+		if(!(ss >> chrom >> pos >> p) || pos == 0) continue;
+		++n_lines;
+		if(p > p2) continue;
+
+		const tomahawk::VcfContig* contig = rdr.hdr.GetContig(chrom);
+		if(contig == nullptr) continue;
+		const uint64_t key = ((uint64_t)contig->idx << 32) | (pos - 1);
+		std::unordered_map<uint64_t, double>::iterator it = pvalues.find(key);
+		if(it == pvalues.end() || p < it->second) pvalues[key] = p;
+	}
+	std::cerr << tomahawk::utility::timestamp("LOG") << "Read " << tomahawk::utility::ToPrettyString(n_lines) << " associations of which " << tomahawk::utility::ToPrettyString(pvalues.size()) << " have P <= " << p2 << "..." << std::endl;
+
+	if(pvalues.size() == 0){
+		std::cerr << tomahawk::utility::timestamp("ERROR") << "No associations to clump..." << std::endl;
+		return 1;
+	}
+
+	// Collect the records of associated variants per contig.
+	const std::vector<tomahawk::twk_contig_range> ranges = tomahawk::twk_contig_range::Build(rdr.index);
+	const uint32_t n_samples = rdr.hdr.GetNumberSamples();
+	tomahawk::twk1_block_t* data = new tomahawk::twk1_block_t[ranges.size()];
+	std::vector< std::vector<tomahawk::twk_clump_variant> > variants(ranges.size());
+	std::vector<std::string> names(ranges.size());
+
+	tomahawk::Timer timer;
+	timer.Start();
+	tomahawk::twk1_blk_iterator bit;
+	bit.stream = rdr.stream;
+	for(int r = 0; r < ranges.size(); ++r){
+		names[r] = rdr.hdr.GetContig(ranges[r].rid)->name;
+		bit.stream->seekg(rdr.index.ent[ranges[r].from].foff);
+		for(int b = ranges[r].from; b < ranges[r].to; ++b){
+			if(bit.NextBlock() == false){
+				std::cerr << tomahawk::utility::timestamp("ERROR") << "Failed to load block " << b << "..." << std::endl;
+				delete[] data;
+				return 1;
+			}
+
+			for(int j = 0; j < bit.blk.n; ++j){
+				std::unordered_map<uint64_t, double>::const_iterator it = pvalues.find(((uint64_t)bit.blk.rcds[j].rid << 32) | bit.blk.rcds[j].pos);
+				if(it == pvalues.end()) continue;
+				data[r].Add(bit.blk.rcds[j]);
+				variants[r].push_back(tomahawk::twk_clump_variant());
+				variants[r].back().p = it->second;
+			}
+		}
+	}
+
+	tomahawk::twk1_ldd_blk* ldd = new tomahawk::twk1_ldd_blk[ranges.size()];
+	uint64_t n_variants = 0;
+	for(int r = 0; r < ranges.size(); ++r){
+		ldd[r].SetOwn(data[r], n_samples);
+		ldd[r].Inflate(n_samples, TWK_LDD_VEC, true);
+		n_variants += data[r].n;
+	}
+	std::cerr << tomahawk::utility::timestamp("LOG") << "Loaded " << tomahawk::utility::ToPrettyString(n_variants) << " associated variants in " << timer.ElapsedString() << "..." << std::endl;
+
+	std::ostream* os = &std::cout;
+	std::ofstream ofs;
+	if(output.size() && output != "-"){
+		ofs.open(output);
+		if(ofs.good() == false){
+			std::cerr << tomahawk::utility::timestamp("ERROR") << "Failed to open \"" << output << "\"..." << std::endl;
+			delete[] ldd; delete[] data;
+			return 1;
+		}
+		os = &ofs;
+	}
+
+	n_threads = std::min((uint32_t)n_threads, (uint32_t)ranges.size());
+	std::atomic<uint32_t> ticker(0);
+	std::vector<std::string> out(ranges.size());
+	tomahawk::twk_clump_slave* slaves = new tomahawk::twk_clump_slave[n_threads];
+
+	timer.Start();
+	for(int i = 0; i < n_threads; ++i){
+		slaves[i].n_samples = n_samples;
+		slaves[i].window    = window;
+		slaves[i].minR2     = minR2;
+		slaves[i].p1        = p1;
+		slaves[i].unphased  = unphased;
+		slaves[i].blocks    = ldd;
+		slaves[i].variants  = &variants;
+		slaves[i].ticker    = &ticker;
+		slaves[i].out       = &out;
+		slaves[i].names     = &names;
+		slaves[i].Start();
+	}
+
+	uint64_t n_cmps = 0;
+	for(int i = 0; i < n_threads; ++i){
+		slaves[i].thread->join();
+		n_cmps += slaves[i].query.n_cmps;
+	}
+
+	*os << "#CHROM\tPOS\tP\tN_CLUMPED\tCLUMPED\n";
+	for(int i = 0; i < ranges.size(); ++i)
+		os->write(out[i].data(), out[i].size());
+	os->flush();
+	delete[] slaves; delete[] ldd; delete[] data;
+
+	std::cerr << tomahawk::utility::timestamp("LOG") << "Clumped with " << tomahawk::utility::ToPrettyString(n_cmps) << " comparisons in " << timer.ElapsedString() << "..." << std::endl;
+	return 0;
+}
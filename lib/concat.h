@@ -21,9 +21,115 @@ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
 DEALINGS IN THE SOFTWARE.
 */
 #include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <queue>
 
 #include "utility.h"
 #include "two_reader.h"
+#include "two_sorter_structs.h"
+
+namespace tomahawk {
+
+/**<
+ * Worker for copying raw byte ranges of compressed TWO blocks from an input
+ * file to their precomputed offsets in the output file. Blocks are never
+ * decompressed: concatenation is pure I/O and each slave uses positional
+ * reads and writes (pread/pwrite) on its own file descriptors so that any
+ * number of slaves can write into the same output file concurrently.
+ */
+struct twk_concat_slave {
+public:
+	struct copy_job {
+		copy_job() : file(0), ioff(0), ooff(0), len(0){}
+		copy_job(uint32_t f, uint64_t i, uint64_t o, uint64_t l) : file(f), ioff(i), ooff(o), len(l){}
+
+		uint32_t file; // input file identifier
+		uint64_t ioff, ooff, len; // input offset, output offset, length in bytes
+	};
+
+public:
+	twk_concat_slave() : f(0), t(0), b_buf(8000000), jobs(nullptr), files(nullptr), thread(nullptr), success(false){}
+	~twk_concat_slave(){ delete thread; }
+
+	/**<
+	 * Spawn a new thread copying the jobs in the range [f,t).
+	 * @return Returns a pointer to the spawned thread instance if successful or a nullptr otherwise.
+	 */
+	std::thread* Start(){
+		if(f > t) return nullptr;
+		if(jobs == nullptr || files == nullptr) return nullptr;
+
+		delete thread; thread = nullptr;
+		thread = new std::thread(&twk_concat_slave::Copy, this);
+		return(thread);
+	}
+
+	bool Copy(){
+		success = false;
+		int ofd = open(out.c_str(), O_WRONLY);
+		if(ofd < 0){
+			std::cerr << utility::timestamp("ERROR","THREAD") << "Failed to open \"" << out << "\" for writing..." << std::endl;
+			return false;
+		}
+
+		std::vector<char> buf(b_buf);
+		int32_t ifd = -1;
+		uint32_t ifile = 0;
+		for(int i = f; i < t; ++i){
+			const copy_job& job = (*jobs)[i];
+			if(ifd < 0 || job.file != ifile){
+				if(ifd >= 0) close(ifd);
+				ifile = job.file;
+				ifd = open((*files)[ifile].c_str(), O_RDONLY);
+				if(ifd < 0){
+					std::cerr << utility::timestamp("ERROR","THREAD") << "Failed to open \"" << (*files)[ifile] << "\"..." << std::endl;
+					close(ofd);
+					return false;
+				}
+			}
+
+			uint64_t done = 0;
+			while(done < job.len){
+				const size_t n_want = std::min((uint64_t)buf.size(), job.len - done);
+				const ssize_t n_read = pread(ifd, &buf[0], n_want, job.ioff + done);
+				if(n_read <= 0){
+					std::cerr << utility::timestamp("ERROR","THREAD") << "Failed to read " << n_want << " bytes at offset " << job.ioff + done << " in \"" << (*files)[ifile] << "\"..." << std::endl;
+					close(ifd); close(ofd);
+					return false;
+				}
+
+				ssize_t n_written = 0;
+				while(n_written < n_read){
+					const ssize_t ret = pwrite(ofd, &buf[n_written], n_read - n_written, job.ooff + done + n_written);
+					if(ret <= 0){
+						std::cerr << utility::timestamp("ERROR","THREAD") << "Failed to write to \"" << out << "\"..." << std::endl;
+						close(ifd); close(ofd);
+						return false;
+					}
+					n_written += ret;
+				}
+				done += n_read;
+			}
+		}
+
+		if(ifd >= 0) close(ifd);
+		close(ofd);
+		success = true;
+		return true;
+	}
+
+public:
+	uint32_t f, t; // (from,to)-tuple of jobs
+	uint64_t b_buf; // size of copy buffer in bytes
+	std::string out; // output filename
+	const std::vector<copy_job>* jobs;
+	const std::vector<std::string>* files;
+	std::thread* thread;
+	bool success;
+};
+
+}
 
 void concat_usage(void){
 	tomahawk::ProgramMessage();
@@ -33,7 +139,10 @@ void concat_usage(void){
 	"Options:\n"
 	"  -i FILE    input TWO file specified 1-or-more times (required)\n"
 	"  -I STRING  input file list (required)\n"
-	"  -o FILE    output file (- for stdout; default: -)\n" << std::endl;
+	"  -o FILE    output file (required)\n"
+	"  -t INT     number of copy threads (default: maximum available)\n"
+	"  -s         k-way merge sorted input files such that the output is sorted\n"
+	"  -c INT     compression level 1-20 used when merging with -s (default: 1)\n" << std::endl;
 }
 
 /**<
@@ -60,6 +169,172 @@ bool GrabNames(const std::vector<std::string>& list, std::vector<std::string>& f
 	return true;
 }
 
+/**<
+ * Concatenate the input files by copying the raw compressed blocks into the
+ * output file. All output offsets are computed upfront from the input indices
+ * such that the byte ranges can be copied in parallel without ever touching
+ * the stream sequentially.
+ * @param in_list   List of input file names.
+ * @param readers   Opened readers for each input file.
+ * @param writer    Opened output writer with the header already written.
+ * @param out       Output file name.
+ * @param n_threads Number of copy threads.
+ * @return          Returns TRUE upon success or FALSE otherwise.
+ */
+bool ConcatParallel(const std::vector<std::string>& in_list,
+                    std::vector<tomahawk::two_reader*>& readers,
+                    tomahawk::twk_two_writer_t& writer,
+                    const std::string& out,
+                    int32_t n_threads)
+{
+	typedef tomahawk::twk_concat_slave::copy_job copy_job;
+
+	// Split copy jobs into chunks of at most this many bytes to allow for
+	// load-balancing when a single input file dominates.
+	const uint64_t b_job_limit = 64000000;
+
+	writer.flush();
+	const uint64_t data_start = writer.tellp();
+
+	// Compute output offsets and the new index from the input indices. Adjacent
+	// blocks are merged into a single contiguous copy job.
+	std::vector<copy_job> jobs;
+	uint64_t ooff = data_start;
+	uint64_t nt_b = 0, nt_bc = 0;
+	for(int i = 0; i < readers.size(); ++i){
+		const tomahawk::IndexOutput& index = readers[i]->index;
+		uint64_t n_b = 0, n_bc = 0;
+		for(int j = 0; j < index.n; ++j){
+			tomahawk::IndexEntryOutput rec = index.ent[j];
+			const uint64_t len = rec.fend - rec.foff;
+
+			if(jobs.size() && jobs.back().file == i &&
+			   jobs.back().ioff + jobs.back().len == rec.foff &&
+			   jobs.back().len + len <= b_job_limit)
+			{
+				jobs.back().len += len;
+			} else jobs.push_back(copy_job(i, rec.foff, ooff, len));
+
+			rec.foff = ooff;
+			rec.fend = ooff + len;
+			ooff += len;
+			n_b  += rec.b_unc;
+			n_bc += rec.b_cmp;
+			writer.oindex += rec;
+		}
+		std::cerr << tomahawk::utility::timestamp("LOG") << "Appending " << in_list[i] << "... " << tomahawk::utility::ToPrettyDiskString(n_b) << "/" << tomahawk::utility::ToPrettyDiskString(n_bc) << std::endl;
+		nt_b += n_b; nt_bc += n_bc;
+	}
+
+	// Balance jobs over threads by the number of bytes to copy.
+	const uint64_t b_total = ooff - data_start;
+	if(jobs.size() < n_threads) n_threads = jobs.size();
+	if(n_threads <= 0) n_threads = 1;
+	const uint64_t b_thread = b_total / n_threads;
+
+	std::vector< std::pair<uint32_t,uint32_t> > ranges;
+	uint64_t fR = 0, tR = 0, b_tot = 0;
+	for(int i = 0; i < jobs.size(); ++i){
+		if(b_tot >= b_thread && ranges.size() + 1 < n_threads){
+			ranges.push_back(std::pair<uint32_t,uint32_t>(fR, tR));
+			b_tot = 0;
+			fR = tR;
+		}
+		b_tot += jobs[i].len;
+		++tR;
+	}
+	if(fR != tR || ranges.size() == 0) ranges.push_back(std::pair<uint32_t,uint32_t>(fR, tR));
+
+	std::cerr << tomahawk::utility::timestamp("LOG","THREAD") << "Copying " << tomahawk::utility::ToPrettyDiskString(b_total) << " in " << tomahawk::utility::ToPrettyString(jobs.size()) << " ranges with " << ranges.size() << " threads..." << std::endl;
+
+	tomahawk::twk_concat_slave* slaves = new tomahawk::twk_concat_slave[ranges.size()];
+	for(int i = 0; i < ranges.size(); ++i){
+		slaves[i].f = ranges[i].first;
+		slaves[i].t = ranges[i].second;
+		slaves[i].out = out;
+		slaves[i].jobs = &jobs;
+		slaves[i].files = &in_list;
+		if(slaves[i].Start() == nullptr){
+			std::cerr << tomahawk::utility::timestamp("ERROR","THREAD") << "Failed to spawn slave" << std::endl;
+			for(int j = 0; j < i; ++j) slaves[j].thread->join();
+			delete[] slaves;
+			return false;
+		}
+	}
+
+	bool success = true;
+	for(int i = 0; i < ranges.size(); ++i){
+		slaves[i].thread->join();
+		success &= slaves[i].success;
+	}
+	delete[] slaves;
+	if(success == false) return false;
+
+	std::cerr << tomahawk::utility::timestamp("LOG") << "Finished. Added " << in_list.size() << " files..." << std::endl;
+	std::cerr << tomahawk::utility::timestamp("LOG") << "Total size: Uncompressed = " << tomahawk::utility::ToPrettyDiskString(nt_b) <<  " and compressed = " << tomahawk::utility::ToPrettyDiskString(nt_bc) << std::endl;
+
+	// Move the writer past the copied data before writing the index.
+	writer.seekp(ooff);
+	return(writer.good());
+}
+
+/**<
+ * Concatenate sorted input files with a k-way merge such that the output
+ * remains sorted. Records are merged with a priority queue over one
+ * streaming reader per input file.
+ * @param readers Opened readers for each input file.
+ * @param writer  Opened output writer with the header already written.
+ * @return        Returns TRUE upon success or FALSE otherwise.
+ */
+bool ConcatSorted(std::vector<tomahawk::two_reader*>& readers,
+                  tomahawk::twk_two_writer_t& writer)
+{
+	uint64_t n_recs = 0;
+	for(int i = 0; i < readers.size(); ++i)
+		n_recs += readers[i]->index.GetTotalVariants();
+
+	std::cerr << tomahawk::utility::timestamp("LOG") << "Merging " << tomahawk::utility::ToPrettyString(n_recs) << " records from " << readers.size() << " sorted files..." << std::endl;
+
+	std::priority_queue<tomahawk::two_queue_entry> queue;
+	for(int i = 0; i < readers.size(); ++i){
+		if(readers[i]->NextRecord())
+			queue.push(tomahawk::two_queue_entry(*readers[i]->it.rcd, i));
+	}
+
+	if(queue.empty()){
+		std::cerr << tomahawk::utility::timestamp("ERROR") << "No data in queue..." << std::endl;
+		return false;
+	}
+
+	tomahawk::twk_sort_progress progress;
+	progress.n_cmps = n_recs;
+	progress.Start();
+
+	uint32_t ridA = queue.top().rec.ridA;
+	while(queue.empty() == false){
+		const uint32_t id = queue.top().qid;
+
+		// Blocks in sorted files never span more than one contig.
+		if(queue.top().rec.ridA != ridA){
+			if(writer.WriteBlock() == false){
+				std::cerr << tomahawk::utility::timestamp("ERROR") << "Failed to flush block..." << std::endl;
+				return false;
+			}
+		}
+		writer.Add(queue.top().rec);
+		ridA = queue.top().rec.ridA;
+		++progress.cmps;
+		queue.pop();
+
+		if(readers[id]->NextRecord())
+			queue.push(tomahawk::two_queue_entry(*readers[id]->it.rcd, id));
+	}
+	progress.is_ticking = false;
+	progress.PrintFinal();
+
+	return true;
+}
+
 int concat(int argc, char** argv){
 	if(argc < 3){
 		concat_usage();
@@ -70,6 +345,9 @@ int concat(int argc, char** argv){
 		{"input",   optional_argument, 0, 'i' },
 		{"output",  optional_argument, 0, 'o' },
 		{"list",    optional_argument, 0, 'I' },
+		{"threads", optional_argument, 0, 't' },
+		{"sorted",  no_argument,       0, 's' },
+		{"compression-level", optional_argument, 0, 'c' },
 
 		{0,0,0,0}
 	};
@@ -77,11 +355,14 @@ int concat(int argc, char** argv){
 	std::vector<std::string> in_list;
 	std::vector<std::string> in_file_list;
 	std::string out;
+	int32_t n_threads = std::thread::hardware_concurrency();
+	int32_t c_level = 1;
+	bool merge_sorted = false;
 
 	int c = 0;
 	int long_index = 0;
 	int hits = 0;
-	while ((c = getopt_long(argc, argv, "i:I:o:?", long_options, &long_index)) != -1){
+	while ((c = getopt_long(argc, argv, "i:I:o:t:c:s?", long_options, &long_index)) != -1){
 		hits += 2;
 		switch (c){
 		case ':':   /* missing option argument */
@@ -104,6 +385,15 @@ int concat(int argc, char** argv){
 		case 'I':
 			in_file_list.push_back(std::string(optarg));
 			break;
+		case 't':
+			n_threads = atoi(optarg);
+			break;
+		case 'c':
+			c_level = atoi(optarg);
+			break;
+		case 's':
+			merge_sorted = true;
+			break;
 		}
 	}
 
@@ -128,34 +418,70 @@ int concat(int argc, char** argv){
 		return(1);
 	}
 
-	tomahawk::two_reader oreader;
+	// Output blocks are written in parallel at their final offsets and
+	// therefore require a seekable file.
+	if(out.size() == 0 || out == "-"){
+		std::cerr << tomahawk::utility::timestamp("ERROR") << "No output file specified (-o): cannot write to stdout..." << std::endl;
+		return(1);
+	}
 
-	// open first
-	if(oreader.Open(in_list[0]) == false) return 1;
+	if(n_threads <= 0){
+		std::cerr << tomahawk::utility::timestamp("ERROR") << "Cannot have <= 0 threads (-t)..." << std::endl;
+		return(1);
+	}
 
-	// Open each file and peek at the headers to check the files are possible to merge.
-	for(int i = 1; i < in_list.size(); ++i){
-		tomahawk::two_reader rdr;
+	if(c_level < 1 || c_level > 20){
+		std::cerr << tomahawk::utility::timestamp("ERROR") << "Compression level must be in the range 1-20 (-c)..." << std::endl;
+		return(1);
+	}
 
-		// open first
-		if(rdr.Open(in_list[i]) == false){
+	// Open each file and peek at the headers to check the files are possible to merge.
+	// The index of each file is kept as it is required to compute output offsets.
+	std::vector<tomahawk::two_reader*> readers(in_list.size(), nullptr);
+	for(int i = 0; i < in_list.size(); ++i){
+		readers[i] = new tomahawk::two_reader;
+		if(readers[i]->Open(in_list[i]) == false){
 		    std::cerr << tomahawk::utility::timestamp("ERROR") << "Failed to open \"" << in_list[i] << "\"..." << std::endl;
+		    for(int j = 0; j <= i; ++j) delete readers[j];
 			return 1;
 		}
+	}
+
+	int ret = 0;
+	tomahawk::two_reader& oreader = *readers[0];
+	for(int i = 1; i < in_list.size() && ret == 0; ++i){
+		tomahawk::two_reader& rdr = *readers[i];
 
 		if(oreader.hdr.samples_.size() != rdr.hdr.samples_.size()){
 			std::cerr << tomahawk::utility::timestamp("ERROR") << "Sample have different sample lengths..." << std::endl;
-			return 1;
+			ret = 1;
+			break;
 		}
 
 		for(int j = 0; j < oreader.hdr.samples_.size(); ++j){
 			if(oreader.hdr.samples_[j] != rdr.hdr.samples_[j]){
 				std::cerr << tomahawk::utility::timestamp("ERROR") << "Sample have different sample names..." << std::endl;
-				std::cerr << tomahawk::utility::timestamp("ERROR") << "Conflict: " << oreader.hdr.samples_[j] << "!=" << rdr.hdr.samples_[i] << " in file " << in_list[i] << std::endl;
-				return 1;
+				std::cerr << tomahawk::utility::timestamp("ERROR") << "Conflict: " << oreader.hdr.samples_[j] << "!=" << rdr.hdr.samples_[j] << " in file " << in_list[i] << std::endl;
+				ret = 1;
+				break;
+			}
+		}
+	}
+
+	if(ret == 0 && merge_sorted){
+		for(int i = 0; i < in_list.size(); ++i){
+			if(readers[i]->index.state != TWK_IDX_SORTED){
+				std::cerr << tomahawk::utility::timestamp("ERROR") << "Cannot merge unsorted file \"" << in_list[i] << "\" (-s). Sort it first..." << std::endl;
+				ret = 1;
+				break;
 			}
 		}
 	}
+
+	if(ret){
+		for(int i = 0; i < readers.size(); ++i) delete readers[i];
+		return(ret);
+	}
 	std::cerr << tomahawk::utility::timestamp("LOG") << "All files are compatible. Beginning merging..." << std::endl;
 
 	std::string concat_string = "\n##tomahawk_concatVersion=" + std::string(VERSION) + "\n";
@@ -165,6 +491,8 @@ int concat(int argc, char** argv){
 	tomahawk::twk_two_writer_t writer;
 	writer.mode = 'b';
 	writer.oindex.SetChroms(oreader.hdr.GetNumberContigs());
+	writer.SetCompressionLevel(c_level);
+	if(merge_sorted) writer.oindex.state = TWK_IDX_SORTED;
 
 	// Take care of output suffix.
 	std::string base_path = tomahawk::twk_writer_t::GetBasePath(out);
@@ -181,69 +509,23 @@ int concat(int argc, char** argv){
 	std::cerr << tomahawk::utility::timestamp("LOG","WRITER") << "Opening " << out << "..." << std::endl;
 	if(writer.Open(out) == false){
 		std::cerr << "failed to open " << out << std::endl;
-		return false;
+		for(int i = 0; i < readers.size(); ++i) delete readers[i];
+		return 1;
 	}
 
 	writer.WriteHeader(oreader);
 
-	// Loggers.
-	uint64_t n_b = 0, n_bc = 0;
-	uint64_t nt_b = 0, nt_bc = 0;
+	bool success = merge_sorted ? ConcatSorted(readers, writer)
+	                            : ConcatParallel(in_list, readers, writer, out, n_threads);
 
-	// Begin merge
-	// Step0: write out first file
-	std::cerr << tomahawk::utility::timestamp("LOG") << "Appending " << in_list[0] << "... ";
-	std::cerr.flush();
-	uint32_t idx_offset = 0;
-	while(oreader.NextBlockRaw()){ // get raw uncompressed data
-		tomahawk::IndexEntryOutput rec = oreader.index.ent[idx_offset];
-		rec.foff = writer.stream.tellp();
-		writer.stream << oreader.it.oblk;
-		rec.fend = writer.stream.tellp();
-		rec.b_cmp = oreader.it.oblk.nc;
-		rec.b_unc = oreader.it.oblk.n;
-		n_b  += rec.b_unc;
-		n_bc += rec.b_cmp;
-		writer.oindex += rec;
-		++idx_offset;
-	}
-	std::cerr << tomahawk::utility::ToPrettyDiskString(n_b) << "/" << tomahawk::utility::ToPrettyDiskString(n_bc) << std::endl;
-	nt_b += n_b; nt_bc += n_bc;
-	n_b = 0, n_bc = 0;
-
-	for(int i = 1; i < in_list.size(); ++i){
-		tomahawk::two_reader rdr;
-
-		// open first
-		if(rdr.Open(in_list[i]) == false){
-			std::cerr << "failed to open=" << in_list[i] << std::endl;
-			return 1;
-		}
+	for(int i = 0; i < readers.size(); ++i) delete readers[i];
 
-		std::cerr << tomahawk::utility::timestamp("LOG") << "Appending " << in_list[i] << "... ";
-		std::cerr.flush();
-
-		idx_offset = 0;
-		while(rdr.NextBlockRaw()){ // get raw uncompressed data
-			tomahawk::IndexEntryOutput rec = rdr.index.ent[idx_offset];
-			rec.foff = writer.stream.tellp();
-			writer.stream << rdr.it.oblk;
-			rec.fend = writer.stream.tellp();
-			rec.b_cmp = rdr.it.oblk.nc;
-			rec.b_unc = rdr.it.oblk.n;
-			n_b  += rec.b_unc;
-			n_bc += rec.b_cmp;
-			writer.oindex += rec;
-			++idx_offset;
-		}
-		std::cerr << tomahawk::utility::ToPrettyDiskString(n_b) << "/" << tomahawk::utility::ToPrettyDiskString(n_bc) << std::endl;
-		nt_b += n_b; nt_bc += n_bc;
-		n_b = 0, n_bc = 0;
+	if(success == false){
+		std::cerr << tomahawk::utility::timestamp("ERROR") << "Failed to concatenate files..." << std::endl;
+		writer.close();
+		return 1;
 	}
 
-	std::cerr << tomahawk::utility::timestamp("LOG") << "Finished. Added " << in_list.size() << " files..." << std::endl;
-	std::cerr << tomahawk::utility::timestamp("LOG") << "Total size: Uncompressed = " << tomahawk::utility::ToPrettyDiskString(nt_b) <<  " and compressed = " << tomahawk::utility::ToPrettyDiskString(nt_bc) << std::endl;
-
 	if(writer.mode == 'b') writer.WriteFinal();
 	else writer.WriteBlock();
 	writer.close();
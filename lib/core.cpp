@@ -58,45 +58,59 @@ void twk1_t::clear(){
 
 twk_buffer_t& operator<<(twk_buffer_t& buffer, const twk1_t& self){
 	assert(self.gt != nullptr);
-	uint8_t pack = self.gt_ptype << 3 | self.gt_flipped << 2 | self.gt_phase << 1 | self.gt_missing;
-	SerializePrimitive(pack, buffer);
-	SerializePrimitive(self.alleles, buffer);
-	SerializePrimitive(self.pos, buffer);
-	SerializePrimitive(self.ac, buffer);
-	SerializePrimitive(self.an, buffer);
-	SerializePrimitive(self.rid, buffer);
-	SerializePrimitive(self.n_het, buffer);
-	SerializePrimitive(self.n_hom, buffer);
-	SerializePrimitive(self.hwe, buffer);
+	const uint8_t pack = self.gt_ptype << 3 | self.gt_flipped << 2 | self.gt_phase << 1 | self.gt_missing;
+	buffer.reserve(twk1_t::packed_size);
+	char* dst = &buffer.buffer_[buffer.n_chars_];
+	dst[0] = pack;
+	dst[1] = self.alleles;
+	memcpy(&dst[2],  &self.pos,   sizeof(uint32_t));
+	memcpy(&dst[6],  &self.ac,    sizeof(uint32_t));
+	memcpy(&dst[10], &self.an,    sizeof(uint32_t));
+	memcpy(&dst[14], &self.rid,   sizeof(uint32_t));
+	memcpy(&dst[18], &self.n_het, sizeof(uint32_t));
+	memcpy(&dst[22], &self.n_hom, sizeof(uint32_t));
+	memcpy(&dst[26], &self.hwe,   sizeof(double));
+	buffer.n_chars_ += twk1_t::packed_size;
 	buffer << *self.gt;
 	return(buffer);
 }
 
-twk_buffer_t& operator>>(twk_buffer_t& buffer, twk1_t& self){
-	delete self.gt; self.gt = nullptr;
-	uint8_t pack = 0;
-	DeserializePrimitive(pack, buffer);
+/**<
+ * Deserialize the fields of a record preceding its genotypes and make sure
+ * `gt` is a container of the correct primitive type. An existing container is
+ * reused if its type matches.
+ */
+static void DeserializeRecordHeader(twk_buffer_t& buffer, twk1_t& self){
+	const char* src = buffer.view(twk1_t::packed_size);
+	const uint8_t pack = src[0];
 	self.gt_ptype   = pack >> 3;
 	self.gt_flipped = (pack >> 2 & 1);
 	self.gt_phase   = (pack >> 1) & 1;
 	self.gt_missing = pack & 1;
-	DeserializePrimitive(self.alleles, buffer);
-	DeserializePrimitive(self.pos, buffer);
-	DeserializePrimitive(self.ac, buffer);
-	DeserializePrimitive(self.an, buffer);
-	DeserializePrimitive(self.rid, buffer);
-	DeserializePrimitive(self.n_het, buffer);
-	DeserializePrimitive(self.n_hom, buffer);
-	DeserializePrimitive(self.hwe, buffer);
+	self.alleles    = src[1];
+	memcpy(&self.pos,   &src[2],  sizeof(uint32_t));
+	memcpy(&self.ac,    &src[6],  sizeof(uint32_t));
+	memcpy(&self.an,    &src[10], sizeof(uint32_t));
+	memcpy(&self.rid,   &src[14], sizeof(uint32_t));
+	memcpy(&self.n_het, &src[18], sizeof(uint32_t));
+	memcpy(&self.n_hom, &src[22], sizeof(uint32_t));
+	memcpy(&self.hwe,   &src[26], sizeof(double));
+
+	if(self.gt != nullptr && self.gt->psize == self.gt_ptype) return;
+	delete self.gt; self.gt = nullptr;
 	switch(self.gt_ptype){
-	case(1): self.gt = new twk1_igt_t<uint8_t>; break;
-	case(2): self.gt = new twk1_igt_t<uint16_t>; break;
-	case(4): self.gt = new twk1_igt_t<uint32_t>; break;
+	case(TWK_GT_RLE8):   self.gt = new twk1_igt_t<uint8_t>;  break;
+	case(TWK_GT_RLE16):  self.gt = new twk1_igt_t<uint16_t>; break;
+	case(TWK_GT_RLE32):  self.gt = new twk1_igt_t<uint32_t>; break;
+	case(TWK_GT_PACKED): self.gt = new twk1_igt_packed_t;    break;
+	case(TWK_GT_SPARSE): self.gt = new twk1_igt_sparse_t;    break;
 	default: std::cerr << "illegal gt primitive type" << std::endl; exit(1);
 	}
+}
 
+twk_buffer_t& operator>>(twk_buffer_t& buffer, twk1_t& self){
+	DeserializeRecordHeader(buffer, self);
 	buffer >> *self.gt;
-
 	return(buffer);
 }
 
@@ -107,9 +121,10 @@ void twk1_t::calculateHardyWeinberg(){
 	uint32_t n_tot = 0;
 	if(gt->miss){
 		// Todo: validate
-		for(int i = 0; i < gt->n; ++i){
-			const uint32_t len = gt->GetLength(i);
-			const uint8_t ref  = gt->GetRefByte(i);
+		twk1_gt_cursor c(*gt);
+		while(c.Next()){
+			const uint32_t len = c.len;
+			const uint8_t ref  = c.ref;
 			obs_hom1 += ref == 0 ? len : 0;
 			obs_hets += (ref == 1 || ref == 4) ? len : 0;
 			obs_hom2 += ref == 5 ? len : 0;
@@ -118,9 +133,10 @@ void twk1_t::calculateHardyWeinberg(){
 			n_tot += len;
 		}
 	} else {
-		for(int i = 0; i < gt->n; ++i){
-			const uint32_t len = gt->GetLength(i);
-			const uint8_t ref  = gt->GetRefByte(i);
+		twk1_gt_cursor c(*gt);
+		while(c.Next()){
+			const uint32_t len = c.len;
+			const uint8_t ref  = c.ref;
 			obs_hom1 += ref == 0 ? len : 0;
 			obs_hets += (ref == 1 || ref == 2) ? len : 0;
 			obs_hom2 += ref == 3 ? len : 0;
@@ -132,6 +148,10 @@ void twk1_t::calculateHardyWeinberg(){
 	//std::cerr << "data=" << obs_hom1 << "," << obs_hets << "," << obs_hom2 << " total=" << obs_hom1 + obs_hom2 + obs_hets << std::endl;
 	//assert(n_tot == 2504);
 
+	this->calculateHardyWeinberg(obs_hets, obs_hom1, obs_hom2);
+}
+
+void twk1_t::calculateHardyWeinberg(const uint64_t obs_hets, const uint64_t obs_hom1, const uint64_t obs_hom2){
 	uint64_t obs_homc = obs_hom1 < obs_hom2 ? obs_hom2 : obs_hom1;
 	uint64_t obs_homr = obs_hom1 < obs_hom2 ? obs_hom1 : obs_hom2;
 
@@ -203,14 +223,16 @@ void twk1_t::calculateHardyWeinberg(){
 /****************************
 *  Core containers
 ****************************/
-twk1_block_t::twk1_block_t() : n(0), m(0), rid(0), minpos(0), maxpos(0), rcds(nullptr){}
-twk1_block_t::twk1_block_t(const uint32_t p): n(0), m(p), rid(0), minpos(0), maxpos(0), rcds(new twk1_t[p]){}
-twk1_block_t::~twk1_block_t(){ delete[] rcds; }
+twk1_block_t::twk1_block_t() : n(0), m(0), rid(0), minpos(0), maxpos(0), rcds(nullptr), m_arena(0), arena(nullptr){}
+twk1_block_t::twk1_block_t(const uint32_t p): n(0), m(p), rid(0), minpos(0), maxpos(0), rcds(new twk1_t[p]), m_arena(0), arena(nullptr){}
+twk1_block_t::~twk1_block_t(){ delete[] rcds; delete[] arena; }
 
 twk1_block_t& twk1_block_t::operator=(twk1_block_t&& other){
 	//std::cerr << "invoking move ctor" << std::endl;
 	delete[] rcds; rcds = nullptr;
 	std::swap(rcds, other.rcds);
+	std::swap(arena, other.arena);
+	std::swap(m_arena, other.m_arena);
 	n = other.n; m = other.m; rid = other.rid;
 	minpos = other.minpos; maxpos = other.maxpos;
 	return(*this);
@@ -251,12 +273,37 @@ twk_buffer_t& operator<<(twk_buffer_t& buffer, const twk1_block_t& self){
 }
 
 twk_buffer_t& operator>>(twk_buffer_t& buffer, twk1_block_t& self){
-	delete[] self.rcds; self.rcds = nullptr;
+	uint32_t m = 0;
 	DeserializePrimitive(self.n, buffer);
-	DeserializePrimitive(self.m, buffer);
+	DeserializePrimitive(m, buffer);
 	DeserializePrimitive(self.rid, buffer);
-	self.rcds = new twk1_t[self.m];
-	for(int i = 0; i < self.n; ++i) buffer >> self.rcds[i];
+
+	// Records and their genotype containers are reused across blocks.
+	if(self.rcds == nullptr || self.n > self.m){
+		delete[] self.rcds;
+		self.m = std::max(m, self.n);
+		self.rcds = new twk1_t[self.m];
+	}
+
+	// All genotypes are copied into a single arena. The genotypes cannot
+	// exceed the remaining bytes of the buffer plus the alignment padding per
+	// record.
+	const uint64_t n_arena = buffer.size() - buffer.iterator_position_ + sizeof(uint64_t)*self.n;
+	if(n_arena > self.m_arena){
+		for(int i = 0; i < self.m; ++i){
+			if(self.rcds[i].gt != nullptr) self.rcds[i].gt->clear();
+		}
+		delete[] self.arena;
+		self.arena = new uint8_t[n_arena];
+		self.m_arena = n_arena;
+	}
+
+	uint8_t* cursor = self.arena;
+	for(int i = 0; i < self.n; ++i){
+		DeserializeRecordHeader(buffer, self.rcds[i]);
+		self.rcds[i].gt->ReadBufferArena(buffer, cursor);
+	}
+	assert(cursor <= self.arena + self.m_arena);
 	return(buffer);
 }
 
@@ -298,17 +345,24 @@ twk_ld_settings::twk_ld_settings() :
 	square(true), window(false), low_memory(false), bitmaps(false), single(false),
 	force_phased(false), forced_unphased(false), force_cross_intervals(false),
 	c_level(1), bl_size(500), b_size(10000), l_window(1000000),
+	l_window_variants(0), l_window_cm(0),
 	n_threads(std::thread::hardware_concurrency()), cycle_threshold(0),
-	ldd_load_type(TWK_LDD_ALL), l_surrounding(500000),
+	ldd_load_type(TWK_LDD_ALL), n_compressors(-1), l_surrounding(500000),
+	memory_limit(0), bv_sidecar(false), numa(false),
 	out("-"),
 	minP(1), minR2(0.1), maxR2(100), minDprime(0), maxDprime(100),
-	n_chunks(1), c_chunk(0)
+	n_chunks(1), c_chunk(0),
+	n_sampled(0), sample_seed(0), sample_refine(-1),
+	lsh(false), lsh_recall(0.99)
 {}
 
 std::string twk_ld_settings::GetString() const{
 	std::string s =  "square=" + std::string((square ? "TRUE" : "FALSE"))
 				  + ",window=" + std::string((window ? "TRUE" : "FALSE"))
 				  + ",low_memory=" + std::string((low_memory ? "TRUE" : "FALSE"))
+				  + (memory_limit ? std::string(",memory_limit=") + std::to_string(memory_limit) : "")
+				  + (bv_sidecar ? std::string(",bv_sidecar=TRUE") : "")
+				  + (numa ? std::string(",numa=TRUE") : "")
 				  + ",bitmaps=" + std::string((bitmaps ? "TRUE" : "FALSE"))
 	              + ",single=" + std::string((single ? "TRUE" : "FALSE"))
 				  + ",force_phased=" + std::string((force_phased ? "TRUE" : "FALSE"))
@@ -317,6 +371,8 @@ std::string twk_ld_settings::GetString() const{
 				  + ",block_size=" + std::to_string(bl_size)
 				  + ",output_block_size=" + std::to_string(b_size)
 				  + (window ? std::string(",window_size=") + std::to_string(l_window) : "")
+				  + (window && l_window_variants ? std::string(",window_variants=") + std::to_string(l_window_variants) : "")
+				  + (window && l_window_cm > 0 ? std::string(",window_cm=") + std::to_string(l_window_cm) + ",genetic_map=" + genetic_map : "")
 				  + ",l_surrounding=" + std::to_string(l_surrounding)
 				  + ",minP=" + std::to_string(minP)
 				  + ",minR2=" + std::to_string(minR2)
@@ -327,7 +383,11 @@ std::string twk_ld_settings::GetString() const{
 				  + ",c_chunk=" + std::to_string(c_chunk)
 				  + ",n_threads=" + std::to_string(n_threads)
 				  + ",ldd_type=" + std::to_string((int)ldd_load_type)
-				  + ",cycle_threshold=" + std::to_string(cycle_threshold);
+				  + ",cycle_threshold=" + std::to_string(cycle_threshold)
+				  + ",n_compressors=" + std::to_string(n_compressors)
+				  + (n_sampled ? std::string(",sampled=") + std::to_string(n_sampled) + ",sample_seed=" + std::to_string(sample_seed) : "")
+				  + (n_sampled && sample_refine >= 0 ? std::string(",sample_refine=") + std::to_string(sample_refine) : "")
+				  + (lsh ? std::string(",lsh_recall=") + std::to_string(lsh_recall) : "");
 	return(s);
 }
 
@@ -341,45 +401,53 @@ twk_igt_vec::twk_igt_vec():
 {
 }
 
-twk_igt_vec::~twk_igt_vec(){
-	aligned_free(data);
-	aligned_free(mask);
+twk_igt_vec::~twk_igt_vec(){}
+
+uint32_t twk_igt_vec::GetNumberWords(const uint32_t n_samples){
+	uint32_t n = ceil((double)(n_samples*2)/64);
+	n += (n*64) % 128; // must be divisible by 128-bit register
+	return(n);
 }
 
 bool twk_igt_vec::Build(const twk1_t& rec,
                         const uint32_t& n_samples)
 {
-	if(n == 0){
-		n = ceil((double)(n_samples*2)/64);
-		n += (n*64) % 128; // must be divisible by 128-bit register
-		data = reinterpret_cast<uint64_t*>(aligned_malloc(n*sizeof(uint64_t), SIMD_ALIGNMENT));
-		if(rec.gt_missing){
-			mask = reinterpret_cast<uint64_t*>(aligned_malloc(n*sizeof(uint64_t), SIMD_ALIGNMENT));
-		}
-	}
+	assert(data != nullptr && (rec.gt_missing == false || mask != nullptr));
 
 	memset(data, 0, n*sizeof(uint64_t));
 	if(rec.gt_missing)
 		memset(mask, 0, n*sizeof(uint64_t));
 
 	uint32_t cumpos = 0;
-	for(int i = 0; i < rec.gt->n; ++i){
-		const uint32_t len  = rec.gt->GetLength(i);
-		const uint8_t  refA = rec.gt->GetRefA(i);
-		const uint8_t  refB = rec.gt->GetRefB(i);
+	if(rec.gt->psize == TWK_GT_PACKED && rec.gt_missing == false){
+		// Packed genotypes without missing data already hold one bit per
+		// haplotype in sample order: only the two haplotypes of each sample
+		// are swapped.
+		const uint64_t* src = reinterpret_cast<const uint64_t*>(rec.gt->data);
+		const uint32_t n_src = (2*n_samples + 63) / 64;
+		for(uint32_t i = 0; i < n_src; ++i)
+			data[i] = ((src[i] & 0x5555555555555555ULL) << 1) | ((src[i] >> 1) & 0x5555555555555555ULL);
+		cumpos = 2*n_samples;
+	} else {
+		twk1_gt_cursor c(*rec.gt);
+		while(c.Next()){
+			const uint32_t len  = c.len;
+			const uint8_t  refA = c.GetRefA();
+			const uint8_t  refB = c.GetRefB();
+
+			if(refA == 0 && refB == 0){
+				cumpos += 2*len;
+				continue;
+			}
 
-		if(refA == 0 && refB == 0){
+			for(int j = 0; j < 2*len; j+=2){
+				if(refA == 1){ this->SetData(cumpos + j + 0); }
+				if(refB == 1){ this->SetData(cumpos + j + 1); }
+				if(refA == 2){ this->SetMask(cumpos + j + 0); this->SetMask(cumpos + j + 1); }
+				if(refB == 2){ this->SetMask(cumpos + j + 0); this->SetMask(cumpos + j + 1); }
+			}
 			cumpos += 2*len;
-			continue;
-		}
-
-		for(int j = 0; j < 2*len; j+=2){
-			if(refA == 1){ this->SetData(cumpos + j + 0); }
-			if(refB == 1){ this->SetData(cumpos + j + 1); }
-			if(refA == 2){ this->SetMask(cumpos + j + 0); this->SetMask(cumpos + j + 1); }
-			if(refB == 2){ this->SetMask(cumpos + j + 0); this->SetMask(cumpos + j + 1); }
 		}
-		cumpos += 2*len;
 	}
 
 	if(rec.gt_missing){
@@ -467,53 +535,56 @@ bool twk1_two_t::operator<(const twk1_two_t& other) const{
 	return false;
 }
 
+void twk1_two_t::Pack(char* dst) const{
+	const uint32_t packA = Apos << 2 | Aphased << 1 | Amiss;
+	const uint32_t packB = Bpos << 2 | Bphased << 1 | Bmiss;
+	memcpy(dst, &controller, sizeof(uint16_t)); dst += sizeof(uint16_t);
+	memcpy(dst, &ridA,  sizeof(uint32_t)); dst += sizeof(uint32_t);
+	memcpy(dst, &ridB,  sizeof(uint32_t)); dst += sizeof(uint32_t);
+	memcpy(dst, &packA, sizeof(uint32_t)); dst += sizeof(uint32_t);
+	memcpy(dst, &packB, sizeof(uint32_t)); dst += sizeof(uint32_t);
+	memcpy(dst, cnt, 4*sizeof(double)); dst += 4*sizeof(double);
+	memcpy(dst, &D,      sizeof(double)); dst += sizeof(double);
+	memcpy(dst, &Dprime, sizeof(double)); dst += sizeof(double);
+	memcpy(dst, &R,      sizeof(double)); dst += sizeof(double);
+	memcpy(dst, &R2,     sizeof(double)); dst += sizeof(double);
+	memcpy(dst, &P,      sizeof(double)); dst += sizeof(double);
+	memcpy(dst, &ChiSqFisher, sizeof(double)); dst += sizeof(double);
+	memcpy(dst, &ChiSqModel,  sizeof(double));
+}
+
+void twk1_two_t::Unpack(const char* src){
+	uint32_t packA = 0, packB = 0;
+	memcpy(&controller, src, sizeof(uint16_t)); src += sizeof(uint16_t);
+	memcpy(&ridA,  src, sizeof(uint32_t)); src += sizeof(uint32_t);
+	memcpy(&ridB,  src, sizeof(uint32_t)); src += sizeof(uint32_t);
+	memcpy(&packA, src, sizeof(uint32_t)); src += sizeof(uint32_t);
+	memcpy(&packB, src, sizeof(uint32_t)); src += sizeof(uint32_t);
+	memcpy(cnt, src, 4*sizeof(double)); src += 4*sizeof(double);
+	memcpy(&D,      src, sizeof(double)); src += sizeof(double);
+	memcpy(&Dprime, src, sizeof(double)); src += sizeof(double);
+	memcpy(&R,      src, sizeof(double)); src += sizeof(double);
+	memcpy(&R2,     src, sizeof(double)); src += sizeof(double);
+	memcpy(&P,      src, sizeof(double)); src += sizeof(double);
+	memcpy(&ChiSqFisher, src, sizeof(double)); src += sizeof(double);
+	memcpy(&ChiSqModel,  src, sizeof(double));
+	Apos = packA >> 2;
+	Bpos = packB >> 2;
+	Aphased = (packA >> 1) & 1;
+	Bphased = (packB >> 1) & 1;
+	Amiss = packA & 1;
+	Bmiss = packB & 1;
+}
+
 twk_buffer_t& operator<<(twk_buffer_t& os, const twk1_two_t& entry){
-	SerializePrimitive(entry.controller, os);
-	SerializePrimitive(entry.ridA, os);
-	SerializePrimitive(entry.ridB, os);
-	uint32_t packA = entry.Apos << 2 | entry.Aphased << 1 | entry.Amiss;
-	uint32_t packB = entry.Bpos << 2 | entry.Bphased << 1 | entry.Bmiss;
-	SerializePrimitive(packA, os);
-	SerializePrimitive(packB, os);
-	SerializePrimitive(entry.cnt[0], os);
-	SerializePrimitive(entry.cnt[1], os);
-	SerializePrimitive(entry.cnt[2], os);
-	SerializePrimitive(entry.cnt[3], os);
-	SerializePrimitive(entry.D, os);
-	SerializePrimitive(entry.Dprime, os);
-	SerializePrimitive(entry.R, os);
-	SerializePrimitive(entry.R2, os);
-	SerializePrimitive(entry.P, os);
-	SerializePrimitive(entry.ChiSqFisher, os);
-	SerializePrimitive(entry.ChiSqModel, os);
+	os.reserve(twk1_two_t::packed_size);
+	entry.Pack(&os.buffer_[os.n_chars_]);
+	os.n_chars_ += twk1_two_t::packed_size;
 	return os;
 }
 
 twk_buffer_t& operator>>(twk_buffer_t& os, twk1_two_t& entry){
-	DeserializePrimitive(entry.controller, os);
-	DeserializePrimitive(entry.ridA, os);
-	DeserializePrimitive(entry.ridB, os);
-	uint32_t packA = 0;
-	uint32_t packB = 0;
-	DeserializePrimitive(packA, os);
-	DeserializePrimitive(packB, os);
-	entry.Apos = packA >> 2;
-	entry.Bpos = packB >> 2;
-	entry.Aphased = (packA >> 1) & 1;
-	entry.Bphased = (packB >> 1) & 1;
-	entry.Amiss = packA & 1;
-	entry.Bmiss = packB & 1;
-	DeserializePrimitive(entry.cnt[0], os);
-	DeserializePrimitive(entry.cnt[1], os);
-	DeserializePrimitive(entry.cnt[2], os);
-	DeserializePrimitive(entry.cnt[3], os);
-	DeserializePrimitive(entry.D, os);
-	DeserializePrimitive(entry.Dprime, os);
-	DeserializePrimitive(entry.R, os);
-	DeserializePrimitive(entry.R2, os);
-	DeserializePrimitive(entry.P, os);
-	DeserializePrimitive(entry.ChiSqFisher, os);
-	DeserializePrimitive(entry.ChiSqModel, os);
+	entry.Unpack(os.view(twk1_two_t::packed_size));
 	return(os);
 }
 
@@ -626,16 +697,31 @@ bool twk1_two_block_t::Sort(){
 twk_buffer_t& operator<<(twk_buffer_t& buffer, const twk1_two_block_t& self){
 	SerializePrimitive(self.n, buffer);
 	SerializePrimitive(self.m, buffer);
-	for(int i = 0; i < self.n; ++i) buffer << self.rcds[i];
+	buffer.reserve((uint64_t)self.n * twk1_two_t::packed_size);
+	char* dst = &buffer.buffer_[buffer.n_chars_];
+	for(int i = 0; i < self.n; ++i, dst += twk1_two_t::packed_size)
+		self.rcds[i].Pack(dst);
+	buffer.n_chars_ += (uint64_t)self.n * twk1_two_t::packed_size;
 	return(buffer);
 }
 
 twk_buffer_t& operator>>(twk_buffer_t& buffer, twk1_two_block_t& self){
-	delete[] self.rcds; self.rcds = nullptr;
+	uint32_t m = 0;
 	DeserializePrimitive(self.n, buffer);
-	DeserializePrimitive(self.m, buffer);
-	self.rcds = new twk1_two_t[self.m];
-	for(int i = 0; i < self.n; ++i) buffer >> self.rcds[i];
+	DeserializePrimitive(m, buffer);
+	m = std::max(m, self.n);
+	// Records are overwritten in place: only reallocate if the current
+	// allocation is too small.
+	if(self.rcds == nullptr || m > self.m){
+		delete[] self.rcds;
+		self.rcds = new twk1_two_t[m];
+		self.m = m;
+	}
+
+	// Decode the fixed-layout records directly from the byte stream.
+	const char* src = buffer.view((uint64_t)self.n * twk1_two_t::packed_size);
+	for(int i = 0; i < self.n; ++i, src += twk1_two_t::packed_size)
+		self.rcds[i].Unpack(src);
 	return(buffer);
 }
 
@@ -645,7 +731,8 @@ twk1_aggregate_t::twk1_aggregate_t(const uint32_t x, const uint32_t y) : n(x*y),
 twk1_aggregate_t::~twk1_aggregate_t(){ delete[] data; }
 
 std::ostream& operator<<(std::ostream& stream, const twk1_aggregate_t& agg){
-	stream.write(TOMAHAWK_AGGREGATE_MAGIC_HEADER.data(), TOMAHAWK_AGGREGATE_MAGIC_HEADER_LENGTH);
+	if(agg.data != nullptr) stream.write(TOMAHAWK_AGGREGATE_MAGIC_HEADER.data(), TOMAHAWK_AGGREGATE_MAGIC_HEADER_LENGTH);
+	else stream.write(TOMAHAWK_AGGREGATE_SPARSE_MAGIC_HEADER.data(), TOMAHAWK_AGGREGATE_MAGIC_HEADER_LENGTH);
 
 	SerializePrimitive(agg.n, stream);
 	SerializePrimitive(agg.x, stream);
@@ -669,10 +756,25 @@ std::ostream& operator<<(std::ostream& stream, const twk1_aggregate_t& agg){
 
 	ZSTDCodec zcodec;
 	twk_buffer_t ibuf, obuf;
-	for(int i = 0; i < agg.n; ++i) ibuf += agg.data[i];
+	if(agg.data != nullptr){
+		for(int i = 0; i < agg.n; ++i) ibuf += agg.data[i];
+	} else {
+		assert(agg.s_idx.size() == agg.s_val.size());
+		const uint32_t n_cells = agg.s_idx.size();
+		uint32_t prev = 0;
+		for(int i = 0; i < n_cells; ++i){
+			ibuf += (uint32_t)(agg.s_idx[i] - prev);
+			prev = agg.s_idx[i];
+		}
+		for(int i = 0; i < n_cells; ++i) ibuf += agg.s_val[i];
+	}
 	zcodec.Compress(ibuf, obuf, 6);
 
 	// Write data.
+	if(agg.data == nullptr){
+		const uint32_t n_cells = agg.s_idx.size();
+		SerializePrimitive(n_cells, stream);
+	}
 	uint32_t obuf_size = obuf.size();
 	SerializePrimitive(obuf_size, stream);
 	stream.write(obuf.data(), obuf.size());
@@ -681,7 +783,7 @@ std::ostream& operator<<(std::ostream& stream, const twk1_aggregate_t& agg){
 	return(stream);
 }
 
-bool twk1_aggregate_t::Open(std::string input){
+bool twk1_aggregate_t::Open(std::string input, const bool densify){
 	if(input.size() == 0){
 		std::cerr << utility::timestamp("ERROR") << "No input path provided..." << std::endl;
 		return false;
@@ -702,7 +804,10 @@ bool twk1_aggregate_t::Open(std::string input){
 		std::cerr << utility::timestamp("ERROR") << "File stream corrupted..." << std::endl;
 		return false;
 	}
-	if(strncmp(magic, TOMAHAWK_AGGREGATE_MAGIC_HEADER.data(), TOMAHAWK_AGGREGATE_MAGIC_HEADER_LENGTH) != 0){
+	bool sparse = false;
+	if(strncmp(magic, TOMAHAWK_AGGREGATE_SPARSE_MAGIC_HEADER.data(), TOMAHAWK_AGGREGATE_MAGIC_HEADER_LENGTH) == 0){
+		sparse = true;
+	} else if(strncmp(magic, TOMAHAWK_AGGREGATE_MAGIC_HEADER.data(), TOMAHAWK_AGGREGATE_MAGIC_HEADER_LENGTH) != 0){
 		std::cerr << utility::timestamp("ERROR") << "Incorrect magic string in file header..." << std::endl;
 		return false;
 	}
@@ -737,14 +842,14 @@ bool twk1_aggregate_t::Open(std::string input){
 		return false;
 	}
 
-	uint32_t obuf_size = 0;
+	uint32_t n_cells = 0, obuf_size = 0;
+	if(sparse) DeserializePrimitive(n_cells, in);
 	DeserializePrimitive(obuf_size, in);
 
 	ZSTDCodec zcodec;
 	twk_buffer_t ibuf, obuf;
 	ibuf.resize(obuf_size);
 	in.read(ibuf.data(), obuf_size);
-	obuf.resize(n*sizeof(double));
 	ibuf.n_chars_ = obuf_size;
 
 	if(in.good() == false){
@@ -757,22 +862,54 @@ bool twk1_aggregate_t::Open(std::string input){
 		return false;
 	}
 
-	if(zcodec.Decompress(ibuf, obuf) == false){
-		std::cerr << utility::timestamp("ERROR") << "Failed to decompress data..." << std::endl;
-		return false;
-	}
+	delete[] data; data = nullptr;
+	s_idx.clear(); s_val.clear();
 
-	if(obuf.size() != n*sizeof(double)){
-		std::cerr << utility::timestamp("ERROR") << "Corrupted decompression size (" << obuf.size() << "!=" << n*sizeof(double) << ")!"  << std::endl;
-		return false;
-	}
+	if(sparse){
+		obuf.resize(n_cells*(sizeof(uint32_t) + sizeof(double)));
+		if(zcodec.Decompress(ibuf, obuf) == false){
+			std::cerr << utility::timestamp("ERROR") << "Failed to decompress data..." << std::endl;
+			return false;
+		}
 
-	// Write data.
-	delete[] data; data = nullptr;
-	data = new double[n];
-	double* obuf_double = reinterpret_cast<double*>(obuf.data());
+		if(obuf.size() != n_cells*(sizeof(uint32_t) + sizeof(double))){
+			std::cerr << utility::timestamp("ERROR") << "Corrupted decompression size (" << obuf.size() << "!=" << n_cells*(sizeof(uint32_t) + sizeof(double)) << ")!"  << std::endl;
+			return false;
+		}
+
+		s_idx.resize(n_cells);
+		s_val.resize(n_cells);
+		uint32_t prev = 0;
+		for(int i = 0; i < n_cells; ++i){
+			obuf >> s_idx[i];
+			s_idx[i] += prev;
+			prev = s_idx[i];
+			if(s_idx[i] >= n){
+				std::cerr << utility::timestamp("ERROR") << "Sparse cell offset out of bounds (" << s_idx[i] << ">=" << n << ")!"  << std::endl;
+				return false;
+			}
+		}
+		for(int i = 0; i < n_cells; ++i) obuf >> s_val[i];
+
+		if(densify && this->Densify() == false) return false;
+	} else {
+		obuf.resize(n*sizeof(double));
+		if(zcodec.Decompress(ibuf, obuf) == false){
+			std::cerr << utility::timestamp("ERROR") << "Failed to decompress data..." << std::endl;
+			return false;
+		}
+
+		if(obuf.size() != n*sizeof(double)){
+			std::cerr << utility::timestamp("ERROR") << "Corrupted decompression size (" << obuf.size() << "!=" << n*sizeof(double) << ")!"  << std::endl;
+			return false;
+		}
 
-	for(int i = 0; i < n; ++i) data[i] = obuf_double[i];
+		// Write data.
+		data = new double[n];
+		double* obuf_double = reinterpret_cast<double*>(obuf.data());
+
+		for(int i = 0; i < n; ++i) data[i] = obuf_double[i];
+	}
 
 	//in.seekg(fsize - TOMAHAWK_TWOAGG_EOF_LENGTH);
 	if(in.good() == false){
@@ -790,4 +927,22 @@ bool twk1_aggregate_t::Open(std::string input){
 	return true;
 }
 
+bool twk1_aggregate_t::Densify(){
+	if(s_idx.size() != s_val.size()){
+		std::cerr << utility::timestamp("ERROR") << "Sparse representation is corrupted..." << std::endl;
+		return false;
+	}
+
+	delete[] data; data = nullptr;
+	data = new double[n];
+	memset(data, 0, sizeof(double)*n);
+	for(int i = 0; i < s_idx.size(); ++i){
+		if(s_idx[i] >= n) return false;
+		data[s_idx[i]] = s_val[i];
+	}
+	s_idx.clear(); s_val.clear();
+
+	return true;
+}
+
 }
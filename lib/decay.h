@@ -21,6 +21,7 @@ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
 DEALINGS IN THE SOFTWARE.
 */
 #include <getopt.h>
+#include <thread>
 
 #include "utility.h"
 #include "two_reader.h"
@@ -35,6 +36,7 @@ void decay_usage(void){
 	"  -I STRING interval string for target region\n"
 	"  -w INT    window size in base bairs (default: 10Mb)\n"
 	"  -b INT    number of bins each window is separated into\n"
+	"  -t INT    number of parallel threads (default: " << std::thread::hardware_concurrency() << ")\n"
 	"  -m        output haplotypes in tab-delimited matrix form\n\n";
 }
 
@@ -50,6 +52,7 @@ int decay(int argc, char** argv){
 		{"window",      optional_argument, 0, 'w' },
 		{"bins",        optional_argument, 0, 'b' },
 		{"matrix",      no_argument,       0, 'm' },
+		{"threads",     optional_argument, 0, 't' },
 		{0,0,0,0}
 	};
 
@@ -61,7 +64,7 @@ int decay(int argc, char** argv){
 	int c = 0;
 	int long_index = 0;
 	int hits = 0;
-	while ((c = getopt_long(argc, argv, "i:I:w:b:?", long_options, &long_index)) != -1){
+	while ((c = getopt_long(argc, argv, "i:I:w:b:t:?", long_options, &long_index)) != -1){
 		hits += 2;
 		switch (c){
 		case ':':   /* missing option argument */
@@ -85,6 +88,8 @@ int decay(int argc, char** argv){
 			n_range = atoi(optarg); break;
 		case 'b':
 			n_bins = atoi(optarg); break;
+		case 't':
+			settings.n_threads = atoi(optarg); break;
 		}
 	}
 
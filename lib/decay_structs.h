@@ -0,0 +1,157 @@
+#ifndef LIB_DECAY_STRUCTS_H_
+#define LIB_DECAY_STRUCTS_H_
+
+#include <thread>
+#include <cstdint>
+
+#include "core.h"
+#include "two_reader.h"
+
+namespace tomahawk {
+
+/**<
+ * Summary statistics of partner positions for a given (ridA,posA)-tuple.
+ */
+struct twk_sstats_pos : public twk_sstats {
+	twk_sstats_pos() : rid(0), pos(0){}
+	twk_sstats_pos(uint32_t chrom, uint32_t position) : rid(chrom), pos(position){}
+
+	using twk_sstats::operator+=;
+
+	void operator+=(const twk1_two_t* rec){
+		if(rec->ridA == rec->ridB && rec->Apos < rec->Bpos)
+			Add(rec->Bpos, 1);
+	}
+
+	uint32_t rid, pos;
+};
+
+/**<
+ * Worker for computing LD decay over a subset of blocks. Blocks are provided
+ * as an ordered list of block offsets into the index such that blocks not
+ * containing intra-contig associations can be skipped in sorted files.
+ * Consecutive blocks are read without seeking.
+ */
+struct twk_decay_slave {
+public:
+	twk_decay_slave() : positional(false), success(false), n_bins(0), n_range_bin(0),
+		rdr(nullptr), it(nullptr), thread(nullptr)
+	{}
+	~twk_decay_slave(){ delete it; delete thread; }
+
+	/**<
+	 * Spawn a new thread computing decay statistics for the blocks in `blocks`.
+	 * @param reader Reference instance of a two reader.
+	 * @return       Returns a pointer to the spawned thread instance if successful or a nullptr otherwise.
+	 */
+	std::thread* Start(two_reader& reader){
+		if(blocks.size() == 0) return nullptr;
+		rdr = &reader;
+
+		if(stream.good()) stream.close();
+
+		stream.open(filename,std::ios::binary | std::ios::in);
+		if(stream.good() == false){
+			std::cerr << utility::timestamp("ERROR","THREAD") << "Failed to open \"" << filename << "\"..." << std::endl;
+			return nullptr;
+		}
+
+		delete it; it = nullptr;
+		it  = new twk1_two_iterator;
+		it->stream = &stream;
+
+		delete thread; thread = nullptr;
+		thread = new std::thread(&twk_decay_slave::Compute, this);
+
+		return(thread);
+	}
+
+	bool Compute(){
+		success = false;
+		uint64_t fend = 0;
+		for(int i = 0; i < blocks.size(); ++i){
+			const IndexEntryOutput& ent = rdr->index.ent[blocks[i]];
+			if(ent.foff != fend) stream.seekg(ent.foff);
+			fend = ent.fend;
+
+			if(it->NextBlock() == false){
+				std::cerr << utility::timestamp("ERROR","THREAD") << "Failed to read block " << blocks[i] << "..." << std::endl;
+				delete it; it = nullptr;
+				return false;
+			}
+
+			if(positional) this->UpdatePositional(it->GetBlock());
+			else this->UpdateBins(it->GetBlock());
+		}
+
+		delete it; it = nullptr;
+		success = true;
+		return true;
+	}
+
+	void UpdateBins(const twk1_two_block_t& blk){
+		const uint32_t n_bins_i = n_bins - 1;
+		for(int j = 0; j < blk.n; ++j){
+			const twk1_two_t& rcd = blk.rcds[j];
+			// Same contig and upper trig only.
+			if(rcd.ridA == rcd.ridB && rcd.Apos < rcd.Bpos){
+				const uint32_t b = std::min((rcd.Bpos - rcd.Apos) / n_range_bin, n_bins_i);
+				decay[b].first += rcd.R2;
+				++decay[b].second;
+			}
+		}
+	}
+
+	void UpdatePositional(const twk1_two_block_t& blk){
+		for(int j = 0; j < blk.n; ++j){
+			const twk1_two_t* rcd = &blk.rcds[j];
+			if(rcd->ridA != rcd->ridB) continue;
+			if(rdr->FilterInterval(rcd)) continue;
+
+			if(variants.size() == 0 || rcd->ridA != variants.back().rid || rcd->Apos != variants.back().pos){
+				variants.push_back(twk_sstats_pos(rcd->ridA, rcd->Apos));
+				variants.back().n = 1;
+			}
+
+			variants.back() += rcd;
+		}
+	}
+
+	/**<
+	 * Reduction helper. Bins are summed. For positional decay the variants of
+	 * the passed slave are appended: if a run of records for the same
+	 * (ridA,posA)-tuple was split across the two slaves then it is merged.
+	 * @param other Reference to the next slave in block order.
+	 */
+	void operator+=(const twk_decay_slave& other){
+		for(int i = 0; i < decay.size() && i < other.decay.size(); ++i){
+			decay[i].first  += other.decay[i].first;
+			decay[i].second += other.decay[i].second;
+		}
+
+		if(other.variants.size() == 0) return;
+		uint32_t start = 0;
+		if(variants.size() && variants.back().rid == other.variants[0].rid && variants.back().pos == other.variants[0].pos){
+			variants.back() += other.variants[0];
+			variants.back().n -= 1; // both runs were seeded with n = 1
+			start = 1;
+		}
+		variants.insert(variants.end(), other.variants.begin() + start, other.variants.end());
+	}
+
+public:
+	bool positional, success;
+	uint32_t n_bins, n_range_bin;
+	std::vector<uint32_t> blocks; // ordered list of blocks to process
+	std::string filename;
+	std::ifstream stream;
+	two_reader* rdr;
+	twk1_two_iterator* it;
+	std::thread* thread;
+	std::vector< std::pair<double, uint64_t> > decay; // (sum R2, count) per bin
+	std::vector<twk_sstats_pos> variants;
+};
+
+}
+
+#endif /* LIB_DECAY_STRUCTS_H_ */
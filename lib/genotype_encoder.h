@@ -2,7 +2,9 @@
 #define TWK_GENOTYPE_ENCODER_H_
 
 #include <cstdint>
+#include <cstring>
 #include <cassert>
+#include <algorithm>
 
 #include "core.h"
 
@@ -28,6 +30,35 @@ const static uint8_t TWK_GT_FLIP_NONE[3] = {0,1,2}; // usage TWK_GT_FLIP_NONE[TW
 static uint64_t TWK_SITES_FILTERED[9];
 const static std::string TWK_SITES_FILTERED_NAMES[9] = {"Invariant","Missing threshold","Insufficient samples","Mixed ploidy","No genotypes","No FORMAT","Not biallelic","Not SNP","Hardy-Weinberg threshold"};
 
+// PLINK .bed genotypes are packed four samples per byte, lowest bits first:
+// 00 homozygous A1, 01 missing, 10 heterozygous, and 11 homozygous A2. A2 is
+// imported as the reference allele and A1 as the alternative allele.
+#define TWK_BED_LO   0x5555555555555555ULL // lowest bit of every 2-bit genotype
+#define TWK_BED_LO4  0x1111111111111111ULL // lowest bit of every 4-bit genotype
+
+/**<
+ * Lookup from a byte of four .bed genotypes to four packed genotypes of 4 bits
+ * as used when missing values are present. Without missing values no lookup
+ * is needed: the 2-bit packed genotype is the complement of the .bed genotype,
+ * or the .bed genotype itself if alleles are flipped.
+ */
+struct twk_bed_lookup {
+	twk_bed_lookup(){
+		const uint8_t map[2][4] = {{5,10,1,0}, {0,10,4,5}}; // unflipped, flipped
+		for(int f = 0; f < 2; ++f){
+			for(uint32_t b = 0; b < 256; ++b){
+				uint16_t v = 0;
+				for(int j = 0; j < 4; ++j) v |= map[f][(b >> (2*j)) & 3] << (4*j);
+				table[f][b] = v;
+			}
+		}
+	}
+
+	static const twk_bed_lookup& Get(){ static const twk_bed_lookup lookup; return(lookup); }
+
+	uint16_t table[2][256];
+};
+
 struct GenotypeSummary {
 public:
 	GenotypeSummary(void) :
@@ -254,14 +285,172 @@ public:
 		twk.n_hom = gt.hap_cnt[5];
 		twk.n_het = gt.hap_cnt[1] + gt.hap_cnt[4];
 
+		// Choose the smallest of the run-length, packed, and sparse encodings.
+		// Samples homozygous for the (possibly flipped) reference allele are
+		// implicit in the sparse encoding.
+		const bool flip = flip_allele && settings.flip_major_minor;
+		if(settings.rle_only == false){
+			const uint64_t n_carriers = rec->n_sample - (flip ? gt.hap_cnt[5] : gt.hap_cnt[0]);
+			const uint64_t b_rle    = (uint64_t)ret.cnt << ret.ptype;
+			const uint64_t b_packed = ((uint64_t)rec->n_sample*(2 + 2*(gt.n_missing != 0)) + 63) / 64 * sizeof(uint64_t);
+			const uint64_t b_sparse = (n_carriers + 1) * sizeof(uint32_t);
+
+			if(b_sparse < b_rle && b_sparse <= b_packed)
+				return GenotypeEncoder::EncodeSparse_(rec, n_carriers + 1, twk, flip, gt.n_missing != 0);
+			if(b_packed < b_rle)
+				return GenotypeEncoder::EncodePacked_(rec, twk, flip, gt.n_missing != 0);
+		}
+
 		switch(ret.ptype){
-		case(0): return GenotypeEncoder::Encode_<uint8_t> (rec, ret.cnt, twk, flip_allele && settings.flip_major_minor, gt.n_missing != 0);
-		case(1): return GenotypeEncoder::Encode_<uint16_t>(rec, ret.cnt, twk, flip_allele && settings.flip_major_minor, gt.n_missing != 0);
-		case(2): return GenotypeEncoder::Encode_<uint32_t>(rec, ret.cnt, twk, flip_allele && settings.flip_major_minor, gt.n_missing != 0);
+		case(0): return GenotypeEncoder::Encode_<uint8_t> (rec, ret.cnt, twk, flip, gt.n_missing != 0);
+		case(1): return GenotypeEncoder::Encode_<uint16_t>(rec, ret.cnt, twk, flip, gt.n_missing != 0);
+		case(2): return GenotypeEncoder::Encode_<uint32_t>(rec, ret.cnt, twk, flip, gt.n_missing != 0);
 		}
 		return false;
 	}
 
+	/**<
+	 * Encode the genotypes of a variant read from a PLINK .bed file without
+	 * decoding samples individually. Genotype counts are computed with
+	 * population counts over 64-bit words of the .bed data, genotypes are
+	 * converted to the packed encoding with word operations, and the
+	 * run-length and sparse encodings are built from the packed words by
+	 * visiting runs or carriers only. Filters and the choice of encoding are
+	 * identical to Encode().
+	 * @param bed       Src packed genotypes of the variant.
+	 * @param n_samples Number of samples.
+	 * @param twk       Dst record.
+	 * @param settings  Src import settings.
+	 * @return          Returns TRUE upon success or FALSE if the variant is filtered.
+	 */
+	static bool EncodePlink(const uint8_t* bed, const uint32_t n_samples, twk1_t& twk, const twk_vimport_settings& settings){
+		const uint32_t n_bytes  = (n_samples + 3) / 4;
+		const uint32_t n_bwords = (n_bytes + 7) / 8;
+
+		// Padding genotypes are 00 and are counted as homozygous A1 only.
+		uint64_t n_miss = 0, n_het = 0, n_a2a2 = 0;
+		for(uint32_t k = 0; k < n_bwords; ++k){
+			const uint64_t w  = LoadBedWord_(bed, k, n_bytes);
+			const uint64_t lo = w & TWK_BED_LO, hi = (w >> 1) & TWK_BED_LO;
+			n_miss += __builtin_popcountll(lo & ~hi);
+			n_het  += __builtin_popcountll(hi & ~lo);
+			n_a2a2 += __builtin_popcountll(lo & hi);
+		}
+		const uint64_t n_a1a1 = n_samples - n_miss - n_het - n_a2a2;
+
+		const uint64_t total_hap = n_samples - n_miss;
+		if(total_hap < settings.threshold_miss*n_samples){
+			++TWK_SITES_FILTERED[1];
+			return false;
+		}
+
+		if(total_hap < 5){
+			++TWK_SITES_FILTERED[2];
+			return false;
+		}
+
+		if(n_a2a2 == total_hap || n_het == total_hap || n_a1a1 == total_hap){
+			if(settings.remove_univariate){
+				++TWK_SITES_FILTERED[0];
+				return false;
+			}
+		}
+
+		const uint64_t ac_ref = 2*n_a2a2 + n_het, ac_alt = 2*n_a1a1 + n_het;
+		const bool flip = (ac_alt > ac_ref) && settings.flip_major_minor;
+		if(flip) twk.gt_flipped = true;
+		twk.gt_phase   = 0;
+		twk.gt_missing = (n_miss != 0);
+		twk.n_hom = n_a1a1;
+		twk.n_het = n_het;
+		twk.ac = (flip ? ac_ref : ac_alt);
+		twk.an = 2*n_miss;
+		twk.calculateHardyWeinberg(n_het, n_a2a2, n_a1a1);
+
+		// Convert to the packed encoding.
+		const bool missing = (n_miss != 0);
+		const uint8_t shift = 2 + 2*missing;
+		twk1_igt_packed_t* packed = new twk1_igt_packed_t;
+		packed->n = n_samples;
+		packed->miss = missing;
+		const uint32_t n_words = packed->size();
+		uint64_t* words = new uint64_t[n_words];
+		packed->data = words;
+
+		if(missing){
+			const uint16_t* table = twk_bed_lookup::Get().table[flip];
+			const uint32_t n_full = n_bytes / 4;
+			for(uint32_t k = 0; k < n_full; ++k){
+				const uint8_t* b = &bed[4*k];
+				words[k] = (uint64_t)table[b[0]] | ((uint64_t)table[b[1]] << 16) | ((uint64_t)table[b[2]] << 32) | ((uint64_t)table[b[3]] << 48);
+			}
+			if(n_full < n_words){
+				uint64_t w = 0;
+				for(uint32_t j = 0; 4*n_full + j < n_bytes; ++j) w |= (uint64_t)table[bed[4*n_full + j]] << (16*j);
+				words[n_full] = w;
+			}
+		} else {
+			for(uint32_t k = 0; k < n_words; ++k){
+				const uint64_t w = LoadBedWord_(bed, k, n_bytes);
+				words[k] = (flip ? w : ~w);
+			}
+		}
+		const uint64_t n_bits = (uint64_t)n_samples*shift;
+		if(n_bits & 63) words[n_words - 1] &= (1ULL << (n_bits & 63)) - 1;
+
+		// Sizes of the encodings as in Encode(). Run-length encodings are at
+		// least one byte per run: their exact size is only computed if they
+		// can be chosen.
+		const uint64_t n_carriers = n_samples - (flip ? n_a1a1 : n_a2a2);
+		const uint64_t b_packed = (uint64_t)n_words * sizeof(uint64_t);
+		const uint64_t b_sparse = (n_carriers + 1) * sizeof(uint32_t);
+
+		uint64_t n_runs = 1;
+		for(uint32_t k = 0; k < n_words; ++k)
+			n_runs += __builtin_popcountll(PackedTransitions_(words, k, n_samples, shift));
+
+		uint64_t b_rle = UINT64_MAX;
+		uint8_t  rle_type = 0; uint32_t rle_cnt = 0;
+		if(settings.rle_only || n_runs <= b_packed){
+			const uint32_t limit[3] = {(uint32_t)TWK_GT_LIMIT(8,missing), (uint32_t)TWK_GT_LIMIT(16,missing), (uint32_t)TWK_GT_LIMIT(32,missing)};
+			uint32_t cnt[3] = {0,0,0};
+			ForEachPackedRun_(words, n_words, n_samples, shift, [&](const uint32_t, const uint32_t len){
+				for(int j = 0; j < 3; ++j) cnt[j] += (len + limit[j] - 1) / limit[j];
+			});
+
+			const uint8_t cost_factor[3] = {1,2,4};
+			rle_cnt = cnt[0]; b_rle = cnt[0];
+			for(int j = 1; j < 3; ++j){
+				if((uint64_t)cnt[j]*cost_factor[j] < b_rle){
+					b_rle    = (uint64_t)cnt[j]*cost_factor[j];
+					rle_type = j;
+					rle_cnt  = cnt[j];
+				}
+			}
+		}
+
+		if(settings.rle_only == false){
+			if(b_sparse < b_rle && b_sparse <= b_packed){
+				GenotypeEncoder::EncodePlinkSparse_(*packed, n_carriers + 1, twk);
+				delete packed;
+				return true;
+			}
+			if(b_packed < b_rle){
+				twk.gt = packed;
+				twk.gt_ptype = TWK_GT_PACKED;
+				return true;
+			}
+		}
+
+		switch(rle_type){
+		case(0): GenotypeEncoder::EncodePlinkRuns_<uint8_t> (*packed, rle_cnt, twk); break;
+		case(1): GenotypeEncoder::EncodePlinkRuns_<uint16_t>(*packed, rle_cnt, twk); break;
+		case(2): GenotypeEncoder::EncodePlinkRuns_<uint32_t>(*packed, rle_cnt, twk); break;
+		}
+		delete packed;
+		return true;
+	}
+
 	/**<
 	 * Internal encoding function for genotypes. Run-length encodes genotypes in
 	 * a variant-centric fashion while constraining their length to some unified
@@ -286,10 +475,11 @@ public:
 		const uint32_t limit = TWK_GT_LIMIT(sizeof(int_t)*8,missing);
 		twk.gt = new twk1_igt_t<int_t>; // new gt container
 		twk1_igt_t<int_t>* gt = reinterpret_cast<twk1_igt_t<int_t>*>(twk.gt);
-		gt->data = new int_t[cnt]; // new gt data
+		int_t* runs = new int_t[cnt]; // new gt data
+		gt->data = runs;
 		gt->n = cnt; // set number runs
 		gt->miss = missing;
-		twk.gt_ptype = sizeof(int_t); // set ptype
+		twk.gt_ptype = sizeof(int_t); // set ptype (TWK_GT_RLE*)
 
 		const uint8_t* flip_map = (flip_alleles ? TWK_GT_FLIP : TWK_GT_FLIP_NONE);
 
@@ -310,14 +500,14 @@ public:
 			if(ref != cur){
 				int_t val = TWK_GT_RLE_PACK(ref,len,missing);
 				assert((val >> (2+2*missing)) == len);
-				gt->data[icnt++] = val;
+				runs[icnt++] = val;
 				ref = cur;
 				cumsum += len;
 				len = 0;
 			}
 
 			if(len == limit){
-				gt->data[icnt++] = TWK_GT_RLE_PACK(ref,len,missing);
+				runs[icnt++] = TWK_GT_RLE_PACK(ref,len,missing);
 				cumsum += len;
 				len = 0;
 			}
@@ -326,7 +516,7 @@ public:
 		// Add last
 		int_t val = TWK_GT_RLE_PACK(ref,len,missing);
 		assert((val >> (2+2*missing)) == len);
-		gt->data[icnt++] = val;
+		runs[icnt++] = val;
 		cumsum += len;
 		assert(cumsum == rec->n_sample);
 		assert(icnt == cnt);
@@ -341,6 +531,194 @@ public:
 
 		return true;
 	}
+
+	/**<
+	 * Internal encoding function for genotypes. Packs the genotype of every
+	 * sample into 2 bits (4 bits if missing) of 64-bit words. Used for
+	 * variants where runs are short.
+	 * @param rec
+	 * @param twk
+	 * @param flip_alleles
+	 * @param missing
+	 * @return
+	 */
+	static bool EncodePacked_(const bcf1_t* rec,
+	                          twk1_t& twk,
+	                          const bool flip_alleles,
+	                          const bool missing = false)
+	{
+		assert(rec->n_fmt != 0);
+		assert(rec->d.fmt[0].n == 2);
+		const uint8_t* data = rec->d.fmt[0].p;
+		const uint32_t shift = 2 + 2*missing;
+		twk1_igt_packed_t* gt = new twk1_igt_packed_t;
+		twk.gt = gt;
+		gt->n = rec->n_sample; // set number of genotypes
+		gt->miss = missing;
+		uint64_t* words = new uint64_t[gt->size()];
+		memset(words, 0, sizeof(uint64_t)*gt->size());
+		gt->data = words;
+		twk.gt_ptype = TWK_GT_PACKED;
+
+		const uint8_t* flip_map = (flip_alleles ? TWK_GT_FLIP : TWK_GT_FLIP_NONE);
+
+		uint32_t ac[3]; memset(ac,0,sizeof(uint32_t)*3);
+		for(uint32_t i = 0; i < rec->n_sample; ++i){
+			++ac[flip_map[TWK_GT_MAP[(data[2*i] >> 1)]]];
+			++ac[flip_map[TWK_GT_MAP[(data[2*i+1] >> 1)]]];
+			const uint64_t ref = TWK_GT_PACK_FLIP(data[2*i],data[2*i+1],missing,flip_map);
+			words[(i*shift) >> 6] |= ref << ((i*shift) & 63);
+		}
+
+		assert(ac[0] + ac[1] + ac[2] == rec->n_sample*2);
+		twk.ac = ac[1];
+		twk.an = ac[2];
+		return true;
+	}
+
+	/**<
+	 * Internal encoding function for genotypes. Stores the sample offset and
+	 * genotype of every sample that is not homozygous for the reference
+	 * allele followed by a terminal entry. Used for rare variants.
+	 * @param rec
+	 * @param cnt          Number of entries including the terminal entry.
+	 * @param twk
+	 * @param flip_alleles
+	 * @param missing
+	 * @return
+	 */
+	static bool EncodeSparse_(const bcf1_t* rec,
+	                          const uint32_t cnt,
+	                          twk1_t& twk,
+	                          const bool flip_alleles,
+	                          const bool missing = false)
+	{
+		assert(rec->n_fmt != 0);
+		assert(rec->d.fmt[0].n == 2);
+		const uint8_t* data = rec->d.fmt[0].p;
+		const uint32_t shift = 2 + 2*missing;
+		twk1_igt_sparse_t* gt = new twk1_igt_sparse_t;
+		twk.gt = gt;
+		uint32_t* entries = new uint32_t[cnt];
+		gt->data = entries;
+		gt->n = cnt; // set number of entries
+		gt->miss = missing;
+		twk.gt_ptype = TWK_GT_SPARSE;
+
+		const uint8_t* flip_map = (flip_alleles ? TWK_GT_FLIP : TWK_GT_FLIP_NONE);
+
+		uint32_t ac[3]; memset(ac,0,sizeof(uint32_t)*3);
+		uint32_t icnt = 0;
+		for(uint32_t i = 0; i < rec->n_sample; ++i){
+			++ac[flip_map[TWK_GT_MAP[(data[2*i] >> 1)]]];
+			++ac[flip_map[TWK_GT_MAP[(data[2*i+1] >> 1)]]];
+			const uint32_t ref = TWK_GT_PACK_FLIP(data[2*i],data[2*i+1],missing,flip_map);
+			if(ref != 0){
+				assert(icnt + 1 < cnt);
+				entries[icnt++] = (i << shift) | ref;
+			}
+		}
+		entries[icnt++] = rec->n_sample << shift;
+		assert(icnt == cnt);
+
+		assert(ac[0] + ac[1] + ac[2] == rec->n_sample*2);
+		twk.ac = ac[1];
+		twk.an = ac[2];
+		return true;
+	}
+
+private:
+	// Load the k-th 64-bit word of .bed data, zero-filled past the last byte.
+	static inline uint64_t LoadBedWord_(const uint8_t* bed, const uint32_t k, const uint32_t n_bytes){
+		uint64_t w = 0;
+		memcpy(&w, &bed[8*k], std::min<uint32_t>(8, n_bytes - 8*k));
+		return(w);
+	}
+
+	// Mark the lowest bit of every packed genotype in word k that differs from
+	// the genotype of the preceding sample. The first sample and padding past
+	// the last sample are never marked.
+	static inline uint64_t PackedTransitions_(const uint64_t* words, const uint32_t k, const uint32_t n_samples, const uint8_t shift){
+		const uint64_t prev = (k ? words[k-1] : words[0] << (64 - shift));
+		const uint64_t x = words[k] ^ ((words[k] << shift) | (prev >> (64 - shift)));
+		uint64_t t = x | (x >> 1);
+		if(shift == 4) t |= t >> 2;
+		t &= (shift == 2 ? TWK_BED_LO : TWK_BED_LO4);
+		const uint64_t n_bits = (uint64_t)n_samples*shift - (uint64_t)k*64;
+		if(n_bits < 64) t &= (1ULL << n_bits) - 1;
+		return(t);
+	}
+
+	// Invoke f(start, length) for every run of identical packed genotypes.
+	template <class F>
+	static void ForEachPackedRun_(const uint64_t* words, const uint32_t n_words, const uint32_t n_samples, const uint8_t shift, F f){
+		uint32_t start = 0;
+		for(uint32_t k = 0; k < n_words; ++k){
+			uint64_t t = PackedTransitions_(words, k, n_samples, shift);
+			while(t){
+				const uint32_t i = ((uint64_t)k*64 + __builtin_ctzll(t)) / shift;
+				f(start, i - start);
+				start = i;
+				t &= t - 1;
+			}
+		}
+		f(start, n_samples - start);
+	}
+
+	// Run-length encode packed genotypes using `cnt` runs of int_t.
+	template <class int_t>
+	static void EncodePlinkRuns_(const twk1_igt_packed_t& packed, const uint32_t cnt, twk1_t& twk){
+		const uint64_t* words = reinterpret_cast<const uint64_t*>(packed.data);
+		const bool missing = packed.miss;
+		const uint8_t shift = 2 + 2*missing;
+		const uint32_t limit = TWK_GT_LIMIT(sizeof(int_t)*8,missing);
+		twk1_igt_t<int_t>* gt = new twk1_igt_t<int_t>;
+		twk.gt = gt;
+		int_t* runs = new int_t[cnt];
+		gt->data = runs;
+		gt->n = cnt;
+		gt->miss = missing;
+		twk.gt_ptype = sizeof(int_t);
+
+		uint32_t icnt = 0;
+		ForEachPackedRun_(words, packed.size(), packed.n, shift, [&](const uint32_t start, uint32_t len){
+			const uint8_t ref = (words[((uint64_t)start*shift) >> 6] >> (((uint64_t)start*shift) & 63)) & ((1 << shift) - 1);
+			for(; len > limit; len -= limit) runs[icnt++] = TWK_GT_RLE_PACK(ref,limit,missing);
+			runs[icnt++] = TWK_GT_RLE_PACK(ref,len,missing);
+		});
+		assert(icnt == cnt);
+	}
+
+	// Sparse encode packed genotypes using `cnt` entries including the
+	// terminal entry.
+	static void EncodePlinkSparse_(const twk1_igt_packed_t& packed, const uint32_t cnt, twk1_t& twk){
+		const uint64_t* words = reinterpret_cast<const uint64_t*>(packed.data);
+		const bool missing = packed.miss;
+		const uint8_t shift = 2 + 2*missing;
+		twk1_igt_sparse_t* gt = new twk1_igt_sparse_t;
+		twk.gt = gt;
+		uint32_t* entries = new uint32_t[cnt];
+		gt->data = entries;
+		gt->n = cnt;
+		gt->miss = missing;
+		twk.gt_ptype = TWK_GT_SPARSE;
+
+		uint32_t icnt = 0;
+		for(uint32_t k = 0; k < packed.size(); ++k){
+			const uint64_t w = words[k];
+			uint64_t t = w | (w >> 1);
+			if(shift == 4) t |= t >> 2;
+			t &= (shift == 2 ? TWK_BED_LO : TWK_BED_LO4);
+			while(t){
+				const uint32_t b = __builtin_ctzll(t);
+				assert(icnt + 1 < cnt);
+				entries[icnt++] = ((((uint64_t)k*64 + b) / shift) << shift) | ((w >> b) & ((1 << shift) - 1));
+				t &= t - 1;
+			}
+		}
+		entries[icnt++] = packed.n << shift;
+		assert(icnt == cnt);
+	}
 };
 
 
@@ -21,10 +21,152 @@ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
 DEALINGS IN THE SOFTWARE.
 */
 #include <getopt.h>
+#include <cstring>
 
 #include "utility.h"
 #include "twk_reader.h"
 
+namespace tomahawk {
+
+/**<
+ * Haplotypes of a set of variants packed as bits. Each variant stores one
+ * bitvector of 2N haplotypes where a set bit is the alternative allele and,
+ * only if it has missing genotypes, a second bitvector of missing alleles.
+ * Haplotype rows are produced by transposing tiles of 64 haplotypes by 64
+ * variants.
+ */
+struct twk_haplotype_matrix {
+public:
+	twk_haplotype_matrix() : n_haps(0), n_hwords(0), n_variants(0){}
+
+	/**<
+	 * @param n_samples Number of samples.
+	 * @param order     Input offset of each stored sample or empty if
+	 *                  samples are stored in input order. Haplotypes are
+	 *                  kept in input order.
+	 */
+	void Allocate(const uint32_t n_samples, const std::vector<uint32_t>& order = std::vector<uint32_t>()){
+		this->order = order;
+		n_haps = 2*n_samples;
+		n_hwords = (n_haps + 63) / 64;
+		n_variants = 0;
+		alt.clear(); miss.clear(); miss_offset.clear();
+		positions.clear(); alleles.clear();
+	}
+
+	/**<
+	 * Decode the runs of genotypes of a record directly into its packed
+	 * haplotype bitvectors. Runs are set a word at a time unless samples are
+	 * reordered.
+	 * @param rcd Src twk1_t record.
+	 */
+	void Add(const twk1_t& rcd){
+		const uint64_t off = alt.size();
+		alt.resize(off + n_hwords, 0);
+		if(rcd.gt_missing){
+			miss_offset.push_back(miss.size());
+			miss.resize(miss.size() + n_hwords, 0);
+		} else miss_offset.push_back(-1);
+
+		uint32_t h = 0;
+		twk1_gt_cursor c(*rcd.gt);
+		while(c.Next()){
+			const uint32_t len  = 2*c.len;
+			const uint8_t  refA = c.GetRefA();
+			const uint8_t  refB = c.GetRefB();
+
+			if(order.size()){
+				if(refA == 0 && refB == 0){ h += len; continue; }
+				for(uint32_t e = h + len; h < e; h += 2){
+					const uint32_t t = 2*order[h >> 1];
+					if(refA == 1) alt[off + (t >> 6)] |= 1ULL << (t & 63);
+					if(refB == 1) alt[off + ((t + 1) >> 6)] |= 1ULL << ((t + 1) & 63);
+					if(refA > 1)  miss[miss_offset.back() + (t >> 6)] |= 1ULL << (t & 63);
+					if(refB > 1)  miss[miss_offset.back() + ((t + 1) >> 6)] |= 1ULL << ((t + 1) & 63);
+				}
+				continue;
+			}
+
+			if(refA == 1) SetRange(&alt[off], h, h + len, 0x5555555555555555ULL);
+			if(refB == 1) SetRange(&alt[off], h, h + len, 0xAAAAAAAAAAAAAAAAULL);
+			if(refA > 1)  SetRange(&miss[miss_offset.back()], h, h + len, 0x5555555555555555ULL);
+			if(refB > 1)  SetRange(&miss[miss_offset.back()], h, h + len, 0xAAAAAAAAAAAAAAAAULL);
+			h += len;
+		}
+		assert(h == n_haps);
+
+		positions.push_back(rcd.pos + 1);
+		alleles.push_back(rcd.GetAlleleA());
+		alleles.push_back(rcd.GetAlleleB());
+		++n_variants;
+	}
+
+	/**<
+	 * Transpose the tile of haplotypes [64*hw, 64*hw + 64) into rows of packed
+	 * variants. Row r of the tile occupies `n_vwords` words starting at
+	 * dst[r*n_vwords] with bit v set if variant v is the alternative allele.
+	 * @param hw      Haplotype word (tile) offset.
+	 * @param dst     Dst array of 64*n_vwords words.
+	 * @param missing Set to true to transpose missingness rather than alleles.
+	 */
+	void Transpose(const uint32_t hw, uint64_t* dst, const bool missing) const{
+		const uint32_t n_vwords = (n_variants + 63) / 64;
+		uint64_t tile[64];
+		for(uint32_t vw = 0; vw < n_vwords; ++vw){
+			for(uint32_t k = 0; k < 64; ++k){
+				const uint32_t v = vw*64 + k;
+				if(v >= n_variants){ tile[k] = 0; continue; }
+				if(missing) tile[k] = (miss_offset[v] < 0 ? 0 : miss[miss_offset[v] + hw]);
+				else tile[k] = alt[(uint64_t)v*n_hwords + hw];
+			}
+			Transpose64(tile);
+			for(uint32_t r = 0; r < 64; ++r)
+				dst[r*n_vwords + vw] = tile[r];
+		}
+	}
+
+	/**<
+	 * In-place transpose of a 64x64 bit matrix: bit r of word k is moved to
+	 * bit k of word r.
+	 * @param a Src/dst array of 64 words.
+	 */
+	static void Transpose64(uint64_t* a){
+		uint64_t m = 0x00000000FFFFFFFFULL;
+		for(uint32_t j = 32; j != 0; j >>= 1, m ^= (m << j)){
+			for(uint32_t k = 0; k < 64; k = ((k | j) + 1) & ~j){
+				const uint64_t t = ((a[k] >> j) ^ a[k | j]) & m;
+				a[k] ^= (t << j);
+				a[k | j] ^= t;
+			}
+		}
+	}
+
+private:
+	/**<
+	 * Set the bits in [from,to) of a bitvector that are set in `pattern`.
+	 */
+	static void SetRange(uint64_t* v, const uint32_t from, const uint32_t to, const uint64_t pattern){
+		if(from == to) return;
+		const uint32_t wf = from >> 6, wt = (to - 1) >> 6;
+		const uint64_t mf = ~0ULL << (from & 63);
+		const uint64_t mt = ~0ULL >> (63 - ((to - 1) & 63));
+		if(wf == wt){ v[wf] |= pattern & mf & mt; return; }
+		v[wf] |= pattern & mf;
+		for(uint32_t w = wf + 1; w < wt; ++w) v[w] |= pattern;
+		v[wt] |= pattern & mt;
+	}
+
+public:
+	uint32_t n_haps, n_hwords, n_variants;
+	std::vector<uint32_t> order; // input offset of each stored sample
+	std::vector<uint64_t> alt, miss; // variant-major packed haplotypes
+	std::vector<int64_t> miss_offset; // offset into miss or -1 if no missing
+	std::vector<uint32_t> positions;
+	std::vector<char> alleles; // (A,B)-tuples
+};
+
+}
+
 void haplotype_usage(void){
 	tomahawk::ProgramMessage();
 	std::cerr <<
@@ -35,7 +177,13 @@ void haplotype_usage(void){
 	"Options:\n"
 	"  -i FILE   input TWK file (required)\n"
 	"  -I STRING interval string for target region\n"
-	"  -m        output haplotypes in tab-delimited matrix form\n\n";
+	"  -n        output alleles as 0 (ref), 1 (alt), and 2 (missing) rather than bases\n"
+	"  -m        output haplotypes in tab-delimited matrix form\n"
+	"  -b        output haplotypes in binary form (see below)\n\n"
+	"Binary output: two uint32_t values (number of haplotypes, number of variants)\n"
+	"followed by one row per haplotype of ceil(variants/64) little-endian uint64_t\n"
+	"words. Bit v is set if variant v carries the alternative allele; missing\n"
+	"alleles are stored as the reference allele.\n\n";
 }
 
 int haplotype(int argc, char** argv){
@@ -49,6 +197,7 @@ int haplotype(int argc, char** argv){
 		{"intervals",   required_argument, 0, 'I' },
 		{"numeric",     optional_argument, 0, 'n' },
 		{"matrix",      no_argument,       0, 'm' },
+		{"binary",      no_argument,       0, 'b' },
 		{0,0,0,0}
 	};
 
@@ -57,11 +206,12 @@ int haplotype(int argc, char** argv){
 	std::vector<std::string> intervals;
 	bool output_numeric_encoding = false;
 	bool output_matrix_form = false;
+	bool output_binary = false;
 
 	int c = 0;
 	int long_index = 0;
 	int hits = 0;
-	while ((c = getopt_long(argc, argv, "i:I:mn?", long_options, &long_index)) != -1){
+	while ((c = getopt_long(argc, argv, "i:I:mnb?", long_options, &long_index)) != -1){
 		hits += 2;
 		switch (c){
 		case ':':   /* missing option argument */
@@ -87,6 +237,9 @@ int haplotype(int argc, char** argv){
 		case 'm':
 			output_matrix_form = true;
 			break;
+		case 'b':
+			output_binary = true;
+			break;
 		}
 	}
 
@@ -128,75 +281,96 @@ int haplotype(int argc, char** argv){
 		return 1;
 	}
 
-	// Output matrix.
-	std::vector<uint32_t> positions;
-	std::vector<uint32_t> acs;
-	std::vector< std::vector<uint8_t> > haps(2*rdr.hdr.GetNumberSamples(), std::vector<uint8_t>()); // 2N haplotpyes
+	// Decode all sites in the target region into packed haplotypes.
+	tomahawk::twk_haplotype_matrix mat;
+	mat.Allocate(rdr.hdr.GetNumberSamples(), rdr.hdr.sample_order_);
+	const std::vector<std::string> samples = rdr.hdr.GetInputSamples();
 
 	tomahawk::twk1_blk_iterator bit;
 	bit.stream = rdr.stream;
-	uint32_t n_variants = 0;
-	char fasta_lookup[3]; // pos 0 and 1 is defined in the inner loop.
-	fasta_lookup[2] = 'N';
-	char numeric_lookup[3] = {'0', '1', '2'}; // Numerical format as ASCII literals.
-	char* lookup = output_numeric_encoding ? numeric_lookup : fasta_lookup;
 
 	for(int i = 0; i < n_blks; ++i){
 		bit.stream->seekg(ivals.overlap_blocks[i]->foff);
 		if(bit.NextBlock() == false){
 			std::cerr << tomahawk::utility::timestamp("ERROR") << "Failed to load block " << i << "..." << std::endl;
-			return false;
+			return 1;
 		}
 
-		std::cerr << i << "/" << n_blks << "/" << rdr.index.n << ": " << bit.blk.n << std::endl;
-		n_variants += bit.blk.n;
-		// Foreach record.
 		for(int j = 0; j < bit.blk.n; ++j){
-			positions.push_back(bit.blk.rcds[j].pos+1); // positions
-			acs.push_back(bit.blk.rcds[j].ac); // allele counts
-
-			// Foreach RLE object.
-			uint32_t hap_offset = 0;
-			fasta_lookup[0] = bit.blk.rcds[j].GetAlleleA();
-			fasta_lookup[1] = bit.blk.rcds[j].GetAlleleB();
-			for(int k = 0; k < bit.blk.rcds[j].gt->n; ++k){
-				for(int p = 0; p < bit.blk.rcds[j].gt->GetLength(k); ++p, hap_offset += 2){
-					haps[hap_offset].push_back(lookup[bit.blk.rcds[j].gt->GetRefA(p)]);
-					haps[hap_offset+1].push_back(lookup[bit.blk.rcds[j].gt->GetRefB(p)]);
-				}
-			}
+			if(ivals.itree[bit.blk.rcds[j].rid]->findOverlapping(bit.blk.rcds[j].pos, bit.blk.rcds[j].pos).size() == 0)
+				continue;
+
+			mat.Add(bit.blk.rcds[j]);
 		}
 	}
 
-	std::cerr << tomahawk::utility::timestamp("LOG") << "Number of haplotypes: " << haps.size() << " over " << haps[0].size() << " sites..." << std::endl;
-	if(output_matrix_form == false){
-		std::cerr << tomahawk::utility::timestamp("LOG") << "Writing FASTA..." << std::endl;
+	std::cerr << tomahawk::utility::timestamp("LOG") << "Number of haplotypes: " << mat.n_haps << " over " << mat.n_variants << " sites..." << std::endl;
 
-		for(int p = 0; p < haps.size(); ++p){
-			std::cout << ">" << rdr.hdr.samples_[p/2] << "_" << (p%2) << "\n";
-			for(int i = 0; i < haps[p].size(); ++i){
-				std::cout << haps[p][i];
-			}
-			std::cout.put('\n');
+	const uint32_t n_vwords = (mat.n_variants + 63) / 64;
+	const bool any_missing = mat.miss.size();
+	uint64_t* rows_alt  = new uint64_t[64*n_vwords];
+	uint64_t* rows_miss = new uint64_t[64*n_vwords];
+	memset(rows_miss, 0, sizeof(uint64_t)*64*n_vwords);
+
+	// Output is assembled in a single buffer and flushed in large writes.
+	const size_t flush_limit = 1 << 20;
+	std::string obuf;
+	obuf.reserve(flush_limit + mat.n_variants*2 + 256);
+
+	if(output_binary){
+		std::cerr << tomahawk::utility::timestamp("LOG") << "Writing binary..." << std::endl;
+		std::cout.write(reinterpret_cast<const char*>(&mat.n_haps), sizeof(uint32_t));
+		std::cout.write(reinterpret_cast<const char*>(&mat.n_variants), sizeof(uint32_t));
+	} else if(output_matrix_form){
+		std::cerr << tomahawk::utility::timestamp("LOG") << "Writing output matrix..." << std::endl;
+		obuf += "Name";
+		for(int p = 0; p < mat.positions.size(); ++p){
+			obuf += '\t';
+			obuf += std::to_string(mat.positions[p]);
 		}
+		obuf += '\n';
 	} else {
-		std::cerr << tomahawk::utility::timestamp("LOG") << "Writing output matrix..." << std::endl;
+		std::cerr << tomahawk::utility::timestamp("LOG") << "Writing FASTA..." << std::endl;
+	}
 
-		std::cout << "Name";
-		for(int p = 0; p < positions.size(); ++p){
-			std::cout << "\t" << positions[p];
-		}
-		std::cout.put('\n');
+	for(uint32_t hw = 0; hw < mat.n_hwords; ++hw){
+		mat.Transpose(hw, rows_alt, false);
+		if(any_missing) mat.Transpose(hw, rows_miss, true);
+
+		for(uint32_t r = 0; r < 64 && hw*64 + r < mat.n_haps; ++r){
+			const uint32_t p = hw*64 + r;
+			const uint64_t* ra = &rows_alt[r*n_vwords];
+			const uint64_t* rm = &rows_miss[r*n_vwords];
 
-		for(int p = 0; p < haps.size(); ++p){
-			std::cout << ">" << rdr.hdr.samples_[p/2] << "_" << (p%2);
-			for(int i = 0; i < haps[p].size(); ++i){
-				std::cout << '\t' << haps[p][i];
+			if(output_binary){
+				obuf.append(reinterpret_cast<const char*>(ra), sizeof(uint64_t)*n_vwords);
+			} else {
+				obuf += '>';
+				obuf += samples[p/2];
+				obuf += '_';
+				obuf += (char)('0' + (p%2));
+				obuf += (output_matrix_form ? '\t' : '\n');
+
+				for(uint32_t v = 0; v < mat.n_variants; ++v){
+					const uint8_t a = ((rm[v >> 6] >> (v & 63)) & 1) ? 2 : ((ra[v >> 6] >> (v & 63)) & 1);
+					if(output_matrix_form && v) obuf += '\t';
+					if(output_numeric_encoding) obuf += (char)('0' + a);
+					else obuf += (a == 2 ? 'N' : mat.alleles[2*v + a]);
+				}
+				obuf += '\n';
+			}
+
+			if(obuf.size() >= flush_limit){
+				std::cout.write(obuf.data(), obuf.size());
+				obuf.clear();
 			}
-			std::cout.put('\n');
 		}
 	}
+	std::cout.write(obuf.data(), obuf.size());
 	std::cout.flush();
 
+	delete[] rows_alt;
+	delete[] rows_miss;
+
 	return 0;
 }
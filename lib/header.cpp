@@ -180,6 +180,7 @@ VcfHeader::VcfHeader(const VcfHeader& other) :
 	fileformat_string_(other.fileformat_string_),
 	literals_(other.literals_),
 	samples_(other.samples_),
+	sample_order_(other.sample_order_),
 	contigs_(other.contigs_),
 	info_fields_(other.info_fields_),
 	format_fields_(other.format_fields_),
@@ -341,6 +342,11 @@ twk_buffer_t& operator<<(twk_buffer_t& buffer, const VcfHeader& self){
 	SerializePrimitive(n_contigs, buffer);
 	for(int i = 0; i < n_contigs; ++i) buffer << self.contigs_[i];
 
+	// Sample order
+	const uint32_t n_order = self.sample_order_.size();
+	SerializePrimitive(n_order, buffer);
+	for(int i = 0; i < n_order; ++i) SerializePrimitive(self.sample_order_[i], buffer);
+
 	return(buffer);
 }
 
@@ -360,6 +366,15 @@ twk_buffer_t& operator>>(twk_buffer_t& buffer, VcfHeader& self){
 	self.contigs_.resize(n_contigs);
 	for(int i = 0; i < n_contigs; ++i) buffer >> self.contigs_[i];
 
+	// Sample order: absent in files written by older versions.
+	self.sample_order_.clear();
+	if(buffer.iterator_position_ < buffer.size()){
+		uint32_t n_order = 0;
+		DeserializePrimitive(n_order, buffer);
+		self.sample_order_.resize(n_order);
+		for(int i = 0; i < n_order; ++i) DeserializePrimitive(self.sample_order_[i], buffer);
+	}
+
 	self.BuildMaps();
 	self.BuildReverseMaps();
 
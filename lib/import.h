@@ -9,17 +9,21 @@
 void import_usage(void){
 	tomahawk::ProgramMessage();
 	std::cerr <<
-	"About:  Convert BCF->TWK/; subset and slice TWK/TWO data\n"
+	"About:  Convert BCF or PLINK .bed->TWK; subset and slice TWK/TWO data\n"
 	"        Only biallelic diploid genotypes from SNVs will be retained\n"
 	"Usage:  " << tomahawk::TOMAHAWK_PROGRAM_NAME << " import [options] -i <in.bcf> -o <output.twk>\n\n"
 	"Options:\n"
-	"  -i FILE  input BCF file (required)\n"
+	"  -i FILE  input BCF file or PLINK .bed file with .bim and .fam alongside (required)\n"
 	"  -o FILE  output file prefix (required)\n"
 	"  -f       Flip reference and alternative alleles when major is the alternative allele\n"
 	"  -r       Do NOT filter out variant sites that are univariate for REF or ALT\n"
 	"  -n FLOAT Missingness fraction cutoff (default: 0.95)\n"
 	"  -b INT   Block size (default: 500)\n"
 	"  -L INT   Compression level in range 1-20 (default: 1)\n"
+	"  -R       Run-length encode all genotypes instead of choosing the smallest\n"
+	"           of run-length, packed, and sparse encodings per variant\n"
+	"  -P INT   Reorder samples by genotype similarity over the first INT variants\n"
+	"           to lengthen runs; outputs map samples back to the input order (default: 0)\n"
 	"  -s       Hide all program messages [null]\n";
 }
 
@@ -41,11 +45,13 @@ int import(int argc, char** argv){
 		{"compression-level", optional_argument, 0,  'L' },
 		{"block-size", optional_argument, 0,  'b' },
 		{"hwe", optional_argument, 0,  'H' },
+		{"rle-only", no_argument, 0,  'R' },
+		{"permute-samples", required_argument, 0,  'P' },
 		{0,0,0,0}
 	};
 	tomahawk::twk_vimport_settings settings;
 
-	while ((c = getopt_long(argc, argv, "i:o:rfn:b:L:H:?", long_options, &option_index)) != -1){
+	while ((c = getopt_long(argc, argv, "i:o:rfn:b:L:H:RP:?", long_options, &option_index)) != -1){
 		switch (c){
 		case 0:
 			std::cerr << "Case 0: " << option_index << '\t' << long_options[option_index].name << std::endl;
@@ -98,6 +104,16 @@ int import(int argc, char** argv){
 		case 'L':
 			settings.c_level = atoi(optarg);
 			break;
+		case 'R':
+			settings.rle_only = true;
+			break;
+		case 'P':
+			if(atoi(optarg) < 0){
+				std::cerr << tomahawk::utility::timestamp("ERROR") << "Cannot reorder samples using a negative number of variants..." << std::endl;
+				return(1);
+			}
+			settings.n_permute = atoi(optarg);
+			break;
 
 		default:
 			std::cerr << tomahawk::utility::timestamp("ERROR") << "Unrecognized option: " << (char)c << std::endl;
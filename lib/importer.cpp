@@ -8,6 +8,8 @@
 #include "vcf_reader.h"
 #include "buffer.h"
 #include "genotype_encoder.h"
+#include "sample_order.h"
+#include "plink_reader.h"
 #include "core.h"
 #include "index.h"
 #include "zstd_codec.h"
@@ -22,31 +24,53 @@ bool twk_variant_importer::Import(twk_vimport_settings& settings){
 	return(this->Import());
 }
 
-bool twk_variant_importer::Import(void){
-	// Start timer.
-	Timer timer; timer.Start();
-
-	if(settings.input != "-")
-		std::cerr << utility::timestamp("LOG","READER") << "Opening " << settings.input << "..." << std::endl;
+/**<
+ * Compute a permutation of samples from the first diploid biallelic
+ * records of the input. The input is read separately from the import pass
+ * as the permutation must be known before the header is written.
+ * @param settings Src import settings.
+ * @param permuter Dst permuter.
+ * @return         Returns TRUE upon success or FALSE otherwise.
+ */
+static bool twk_import_sample_order(const twk_vimport_settings& settings, twk_sample_permuter& permuter){
+	if(settings.input == "-"){
+		std::cerr << utility::timestamp("ERROR","PERMUTE") << "Cannot reorder samples when reading from stdin..." << std::endl;
+		return false;
+	}
 
-	// Retrieve a unique VcfReader.
 	std::unique_ptr<VcfReader> vcf = tomahawk::VcfReader::FromFile(settings.input, std::thread::hardware_concurrency());
 	if(vcf == nullptr){
-		std::cerr << "failed to get vcfreader" << std::endl;
+		std::cerr << utility::timestamp("ERROR","PERMUTE") << "Failed to open " << settings.input << "..." << std::endl;
 		return false;
 	}
 
-	if(vcf->vcf_header_.GetFormat("GT") == nullptr){
-		std::cerr << "Genotype data not set in this file" << std::endl;
-		return false;
+	permuter.Allocate(vcf->vcf_header_.GetNumberSamples());
+	while(permuter.size() < settings.n_permute && vcf->next(BCF_UN_ALL)){
+		if(vcf->bcf1_->n_fmt == 0 || vcf->bcf1_->n_allele != 2) continue;
+		if(vcf->vcf_header_.GetFormat(vcf->bcf1_->d.fmt[0].id)->id != "GT") continue;
+		if(vcf->bcf1_->d.fmt[0].n != 2) continue;
+		permuter.Add(vcf->bcf1_);
 	}
-	std::cerr << utility::timestamp("LOG","VCF") << "Constructing lookup table for " << utility::ToPrettyString(vcf->vcf_header_.GetNumberContigs()) << " contigs..." << std::endl;
-	std::cerr << utility::timestamp("LOG","VCF") << "Samples: " << utility::ToPrettyString(vcf->vcf_header_.GetNumberSamples()) << "..." << std::endl;
 
-	// Todo: add header literal tracing input parameters
-	tomahawk::Index index(vcf->vcf_header_.GetNumberContigs());
+	const uint32_t n_vnts = permuter.size();
+	if(permuter.Build()){
+		std::cerr << utility::timestamp("LOG","PERMUTE") << "Reordered " << utility::ToPrettyString(permuter.n_samples) << " samples using " << utility::ToPrettyString(n_vnts) << " variants: runs "
+		          << utility::ToPrettyString(permuter.n_runs_before) << " -> " << utility::ToPrettyString(permuter.n_runs_after) << "..." << std::endl;
+	} else {
+		std::cerr << utility::timestamp("LOG","PERMUTE") << "Keeping input sample order..." << std::endl;
+	}
+	return true;
+}
 
-	std::ostream* stream = nullptr; bool stream_delete = true;
+/**<
+ * Open the output of an import: stdout if the output is '-' or a file with
+ * the .twk extension otherwise.
+ * @param settings      Src/dst import settings. The output path is updated.
+ * @param stream_delete Dst flag set if the returned stream must be deleted.
+ * @return              Returns the output stream or nullptr upon failure.
+ */
+static std::ostream* twk_import_open(twk_vimport_settings& settings, bool& stream_delete){
+	std::ostream* stream = nullptr; stream_delete = true;
 	if(settings.output.size() == 0 || (settings.output.size() == 1 && settings.output[0] == '-')){
 		std::cerr << utility::timestamp("LOG","WRITER") << "Writing to stdout..." << std::endl;
 		stream = &std::cout;
@@ -70,32 +94,181 @@ bool twk_variant_importer::Import(void){
 		outstream->open(settings.output,std::ios::out | std::ios::binary);
 		if(!outstream->good()){
 			std::cerr << "failed to open" << std::endl;
+			delete stream;
+			return nullptr;
+		}
+	}
+	return(stream);
+}
+
+/**<
+ * Write the magic string and compressed header of an output.
+ * @param stream  Dst output stream.
+ * @param hdr     Src header.
+ * @param zcodec  Compression codec.
+ * @param buf     Scratch buffer.
+ * @param obuf    Scratch buffer.
+ * @param c_level Compression level.
+ * @return        Returns TRUE upon success or FALSE otherwise.
+ */
+static bool twk_import_write_header(std::ostream& stream, const VcfHeader& hdr, ZSTDCodec& zcodec, twk_buffer_t& buf, twk_buffer_t& obuf, const int c_level){
+	stream.write(tomahawk::TOMAHAWK_MAGIC_HEADER.data(), tomahawk::TOMAHAWK_MAGIC_HEADER_LENGTH);
+
+	buf << hdr;
+	//std::cerr << "header buf size =" << buf.size() << std::endl;
+	if(zcodec.Compress(buf, obuf, c_level) == false){
+		std::cerr << "failed to compress" << std::endl;
+		return false;
+	}
+	//std::cerr << buf.size() << "->" << obuf.size() << " -> " << (float)buf.size()/obuf.size() << std::endl;
+
+	stream.write(reinterpret_cast<const char*>(&buf.size()),sizeof(uint64_t));
+	stream.write(reinterpret_cast<const char*>(&obuf.size()),sizeof(uint64_t));
+	stream.write(obuf.data(),obuf.size());
+	buf.reset();
+	stream.flush();
+	return true;
+}
+
+/**<
+ * Write the compressed index and the end-of-file marker of an output.
+ * @param stream  Dst output stream.
+ * @param index   Src index.
+ * @param zcodec  Compression codec.
+ * @param buf     Scratch buffer.
+ * @param obuf    Scratch buffer.
+ * @param c_level Compression level.
+ * @return        Returns TRUE upon success or FALSE otherwise.
+ */
+static bool twk_import_write_index(std::ostream& stream, const Index& index, ZSTDCodec& zcodec, twk_buffer_t& buf, twk_buffer_t& obuf, const int c_level){
+	buf << index;
+	//std::cerr << "index buf size =" << buf.size() << std::endl;
+	if(zcodec.Compress(buf, obuf, c_level) == false){
+		std::cerr << "failed to compress" << std::endl;
+		return false;
+	}
+	//std::cerr << buf.size() << "->" << obuf.size() << " -> " << (float)buf.size()/obuf.size() << std::endl;
+	const uint64_t offset_start_index = stream.tellp();
+	uint8_t marker = 0;
+	stream.write(reinterpret_cast<const char*>(&marker),sizeof(uint8_t));
+	stream.write(reinterpret_cast<const char*>(&buf.size()),sizeof(uint64_t));
+	stream.write(reinterpret_cast<const char*>(&obuf.size()),sizeof(uint64_t));
+	stream.write(obuf.data(),obuf.size());
+	stream.write(reinterpret_cast<const char*>(&offset_start_index),sizeof(uint64_t));
+	stream.write(tomahawk::TOMAHAWK_FILE_EOF.data(), tomahawk::TOMAHAWK_FILE_EOF_LENGTH);
+	stream.flush();
+
+	return true;
+}
+
+/**<
+ * Compress and write a block of records and add it to the index. The block
+ * is cleared afterwards.
+ * @param stream  Dst output stream.
+ * @param block   Src block.
+ * @param index   Dst index.
+ * @param zcodec  Compression codec.
+ * @param buf     Scratch buffer.
+ * @param c_level Compression level.
+ * @return        Returns TRUE upon success or FALSE otherwise.
+ */
+static bool twk_import_write_block(std::ostream& stream, twk1_block_t& block, Index& index, ZSTDCodec& zcodec, twk_buffer_t& buf, const int c_level){
+	buf << block;
+	tomahawk::IndexEntry ent;
+	ent.n = block.n; ent.minpos = block.minpos; ent.maxpos = block.maxpos;
+	ent.rid = block.rid;
+	ent.foff = stream.tellp();
+	block.clear();
+
+	tomahawk::twk_buffer_t obuf(buf.size() + 65536);
+	if(zcodec.Compress(buf, obuf, c_level) == false){
+		std::cerr << "failed to compress" << std::endl;
+		return false;
+	}
+	tomahawk::twk_oblock_t oblock;
+	oblock.Write(stream, buf.size(), obuf.size(), obuf);
+
+	ent.fend  = stream.tellp();
+	ent.b_unc = buf.size();
+	ent.b_cmp = obuf.size();
+	index += ent;
+	buf.reset();
+	return true;
+}
+
+// Print the number of written and filtered sites.
+static void twk_import_summary(const Index& index, const uint64_t n_tot_vnts, Timer& timer){
+	std::cerr << utility::timestamp("LOG") << "Wrote: " << utility::ToPrettyString(index.GetTotalVariants()) << " variants to " << utility::ToPrettyString(index.n) << " blocks..." << std::endl;
+	std::cerr << utility::timestamp("LOG") << "Finished: " << timer.ElapsedString() << std::endl;
+	std::cerr << utility::timestamp("LOG") << "Filtered out " << utility::ToPrettyString(n_tot_vnts - index.GetTotalVariants()) << " sites (" << (float)(n_tot_vnts - index.GetTotalVariants())/n_tot_vnts*100 << "%):" << std::endl;
+	for(int i = 0; i < 9; ++i){
+		std::cerr << utility::timestamp("LOG") << "   " << TWK_SITES_FILTERED_NAMES[i] << ": " << utility::ToPrettyString(TWK_SITES_FILTERED[i]) << " (" << (float)TWK_SITES_FILTERED[i]/n_tot_vnts*100 << "%)" << std::endl;
+	}
+}
+
+bool twk_variant_importer::Import(void){
+	if(twk_plink_reader::IsBed(settings.input))
+		return(this->ImportPlink());
+
+	// Start timer.
+	Timer timer; timer.Start();
+
+	twk_sample_permuter permuter;
+	if(settings.n_permute){
+		if(twk_import_sample_order(settings, permuter) == false)
+			return false;
+	}
+
+	if(settings.input != "-")
+		std::cerr << utility::timestamp("LOG","READER") << "Opening " << settings.input << "..." << std::endl;
+
+	// Retrieve a unique VcfReader.
+	std::unique_ptr<VcfReader> vcf = tomahawk::VcfReader::FromFile(settings.input, std::thread::hardware_concurrency());
+	if(vcf == nullptr){
+		std::cerr << "failed to get vcfreader" << std::endl;
+		return false;
+	}
+
+	if(vcf->vcf_header_.GetFormat("GT") == nullptr){
+		std::cerr << "Genotype data not set in this file" << std::endl;
+		return false;
+	}
+	std::cerr << utility::timestamp("LOG","VCF") << "Constructing lookup table for " << utility::ToPrettyString(vcf->vcf_header_.GetNumberContigs()) << " contigs..." << std::endl;
+	std::cerr << utility::timestamp("LOG","VCF") << "Samples: " << utility::ToPrettyString(vcf->vcf_header_.GetNumberSamples()) << "..." << std::endl;
+
+	// Sample names are stored in the same order as their genotypes.
+	if(permuter.IsActive()){
+		VcfHeader& hdr = vcf->vcf_header_;
+		if(permuter.n_samples != hdr.GetNumberSamples()){
+			std::cerr << utility::timestamp("ERROR","PERMUTE") << "Number of samples changed between passes..." << std::endl;
 			return false;
 		}
+		std::vector<std::string> names(hdr.GetNumberSamples());
+		hdr.samples_map_.clear();
+		for(uint32_t i = 0; i < names.size(); ++i){
+			names[i] = hdr.samples_[permuter.order[i]];
+			hdr.samples_map_[names[i]] = i;
+		}
+		hdr.samples_.swap(names);
+		hdr.sample_order_ = permuter.order;
 	}
 
+	// Todo: add header literal tracing input parameters
+	tomahawk::Index index(vcf->vcf_header_.GetNumberContigs());
+
+	bool stream_delete = true;
+	std::ostream* stream = twk_import_open(settings, stream_delete);
+	if(stream == nullptr) return false;
+
 	// Append literal string.
 	std::string import_string = "##tomahawk_importVersion=" + std::string(VERSION) + "\n";
 	import_string += "##tomahawk_importCommand=" + tomahawk::LITERAL_COMMAND_LINE + "; Date=" + utility::datetime() + "\n";
 	vcf->vcf_header_.literals_ += import_string;
 
 	tomahawk::ZSTDCodec zcodec;
-	stream->write(tomahawk::TOMAHAWK_MAGIC_HEADER.data(), tomahawk::TOMAHAWK_MAGIC_HEADER_LENGTH);
 	tomahawk::twk_buffer_t buf(256000), obuf(256000);
-
-	buf << vcf->vcf_header_;
-	//std::cerr << "header buf size =" << buf.size() << std::endl;
-	if(zcodec.Compress(buf, obuf, settings.c_level) == false){
-		std::cerr << "failed to compress" << std::endl;
+	if(twk_import_write_header(*stream, vcf->vcf_header_, zcodec, buf, obuf, settings.c_level) == false)
 		return false;
-	}
-	//std::cerr << buf.size() << "->" << obuf.size() << " -> " << (float)buf.size()/obuf.size() << std::endl;
-
-	stream->write(reinterpret_cast<const char*>(&buf.size()),sizeof(uint64_t));
-	stream->write(reinterpret_cast<const char*>(&obuf.size()),sizeof(uint64_t));
-	stream->write(obuf.data(),obuf.size());
-	buf.reset();
-	stream->flush();
 
 	tomahawk::twk1_block_t block;
 	uint32_t n_vnt_dropped = 0;
@@ -172,6 +345,7 @@ bool twk_variant_importer::Import(void){
 				assert(entry.GetAlleleB() == vcf->bcf1_->d.allele[1][0]);
 
 				// Encode genotypes.
+				if(permuter.IsActive()) permuter.Apply(vcf->bcf1_);
 				if(tomahawk::GenotypeEncoder::Encode(vcf->bcf1_, entry, settings) == false){
 					//std::cerr << "invalid encoding" << std::endl;
 					++n_vnt_dropped;
@@ -308,31 +482,124 @@ bool twk_variant_importer::Import(void){
 		buf.reset();
 	}
 
-	buf << index;
-	//std::cerr << "index buf size =" << buf.size() << std::endl;
-	if(zcodec.Compress(buf, obuf, settings.c_level) == false){
-		std::cerr << "failed to compress" << std::endl;
+	if(twk_import_write_index(*stream, index, zcodec, buf, obuf, settings.c_level) == false)
+		return false;
+
+	twk_import_summary(index, n_tot_vnts, timer);
+
+	if(stream_delete) delete stream;
+	return(true);
+}
+
+bool twk_variant_importer::ImportPlink(void){
+	// Start timer.
+	Timer timer; timer.Start();
+
+	if(settings.n_permute){
+		std::cerr << utility::timestamp("ERROR","PLINK") << "Cannot reorder samples when importing PLINK files..." << std::endl;
 		return false;
 	}
-	//std::cerr << buf.size() << "->" << obuf.size() << " -> " << (float)buf.size()/obuf.size() << std::endl;
-	const uint64_t offset_start_index = stream->tellp();
-	uint8_t marker = 0;
-	stream->write(reinterpret_cast<const char*>(&marker),sizeof(uint8_t));
-	stream->write(reinterpret_cast<const char*>(&buf.size()),sizeof(uint64_t));
-	stream->write(reinterpret_cast<const char*>(&obuf.size()),sizeof(uint64_t));
-	stream->write(obuf.data(),obuf.size());
-	stream->write(reinterpret_cast<const char*>(&offset_start_index),sizeof(uint64_t));
-	stream->write(tomahawk::TOMAHAWK_FILE_EOF.data(), tomahawk::TOMAHAWK_FILE_EOF_LENGTH);
-	stream->flush();
 
-	std::cerr << utility::timestamp("LOG") << "Wrote: " << utility::ToPrettyString(index.GetTotalVariants()) << " variants to " << utility::ToPrettyString(index.n) << " blocks..." << std::endl;
-	std::cerr << utility::timestamp("LOG") << "Finished: " << timer.ElapsedString() << std::endl;
-	std::cerr << utility::timestamp("LOG") << "Filtered out " << utility::ToPrettyString(n_tot_vnts - index.GetTotalVariants()) << " sites (" << (float)(n_tot_vnts - index.GetTotalVariants())/n_tot_vnts*100 << "%):" << std::endl;
-	for(int i = 0; i < 9; ++i){
-		std::cerr << utility::timestamp("LOG") << "   " << TWK_SITES_FILTERED_NAMES[i] << ": " << utility::ToPrettyString(TWK_SITES_FILTERED[i]) << " (" << (float)TWK_SITES_FILTERED[i]/n_tot_vnts*100 << "%)" << std::endl;
+	std::cerr << utility::timestamp("LOG","READER") << "Opening " << settings.input << "..." << std::endl;
+	twk_plink_reader plink;
+	if(plink.Open(settings.input) == false)
+		return false;
+
+	std::cerr << utility::timestamp("LOG","PLINK") << "Contigs: " << utility::ToPrettyString(plink.contigs.size()) << "..." << std::endl;
+	std::cerr << utility::timestamp("LOG","PLINK") << "Samples: " << utility::ToPrettyString(plink.n_samples) << "..." << std::endl;
+	std::cerr << utility::timestamp("LOG","PLINK") << "Variants: " << utility::ToPrettyString(plink.size()) << "..." << std::endl;
+
+	// Header holding the contigs of the .bim file and the samples of the
+	// .fam file. Contig lengths are unknown and set to the largest position.
+	VcfHeader hdr;
+	VcfHeaderInternal* ihdr = reinterpret_cast<VcfHeaderInternal*>(&hdr);
+	hdr.fileformat_string_ = "fileformat";
+	hdr.literals_ = "##fileformat=VCFv4.2\n";
+	for(uint32_t i = 0; i < plink.contigs.size(); ++i){
+		VcfContig c;
+		c.idx  = i;
+		c.name = plink.contigs[i];
+		c.n_bases = plink.contig_max[i];
+		hdr.literals_ += c.ToVcfString() + "\n";
+		hdr.contigs_.push_back(c);
 	}
+	hdr.literals_ += "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">\n";
+	for(uint32_t i = 0; i < plink.samples.size(); ++i)
+		ihdr->AddSample(plink.samples[i]);
+	hdr.BuildMaps();
+	hdr.BuildReverseMaps();
+
+	tomahawk::Index index(hdr.GetNumberContigs());
+
+	bool stream_delete = true;
+	std::ostream* stream = twk_import_open(settings, stream_delete);
+	if(stream == nullptr) return false;
+
+	// Append literal string.
+	std::string import_string = "##tomahawk_importVersion=" + std::string(VERSION) + "\n";
+	import_string += "##tomahawk_importCommand=" + tomahawk::LITERAL_COMMAND_LINE + "; Date=" + utility::datetime() + "\n";
+	hdr.literals_ += import_string;
+
+	tomahawk::ZSTDCodec zcodec;
+	tomahawk::twk_buffer_t buf(256000), obuf(256000);
+	if(twk_import_write_header(*stream, hdr, zcodec, buf, obuf, settings.c_level) == false)
+		return false;
+
+	memset(TWK_SITES_FILTERED, 0, sizeof(TWK_SITES_FILTERED));
+	tomahawk::twk1_block_t block;
+	// Duplicate sites are dropped as in Import(): a site is a duplicate if the
+	// preceding site has the same position and was written.
+	bool prev_dropped = true;
+	for(uint32_t i = 0; i < plink.size(); ++i){
+		const twk_plink_variant& v = plink.variants[i];
+		const bool duplicate = (i != 0 && prev_dropped == false && v.rid == plink.variants[i-1].rid && v.pos == plink.variants[i-1].pos);
+		prev_dropped = true;
+		if(duplicate){
+			if(v.canonical)
+				std::cerr << utility::timestamp("LOG") << "Duplicate site dropped: " << plink.contigs[v.rid] << ":" << v.pos+1 << std::endl;
+			continue;
+		}
+
+		if(v.canonical == false){
+			++TWK_SITES_FILTERED[7];
+			continue;
+		}
+
+		// A2 is the reference allele and A1 the alternative allele.
+		tomahawk::twk1_t entry;
+		entry.pos = v.pos;
+		entry.rid = v.rid;
+		entry.EncodeAlleles(v.a2, v.a1);
+		if(tomahawk::GenotypeEncoder::EncodePlink(plink.GetGenotypes(i), plink.n_samples, entry, settings) == false)
+			continue;
+
+		if(entry.hwe < settings.hwe){
+			++TWK_SITES_FILTERED[8];
+			continue;
+		}
+		prev_dropped = false;
+
+		if(block.n != 0 && (block.rid != v.rid || block.n == settings.block_size)){
+			if(twk_import_write_block(*stream, block, index, zcodec, buf, settings.c_level) == false)
+				return false;
+		}
+		if(block.n == 0) block.rid = v.rid;
+		block += entry;
+	}
+
+	// Add last
+	if(block.n){
+		if(twk_import_write_block(*stream, block, index, zcodec, buf, settings.c_level) == false)
+			return false;
+	}
+
+	if(twk_import_write_index(*stream, index, zcodec, buf, obuf, settings.c_level) == false)
+		return false;
+
+	twk_import_summary(index, plink.size(), timer);
 
 	if(stream_delete) delete stream;
 	return(true);
 }
+
 }
@@ -23,6 +23,25 @@ public:
 	 */
 	bool ParseIntervalStrings(twk_reader& reader, const twk_ld_settings& settings){ return(intervals.ParseIntervalStrings(settings.ival_strings, reader.hdr)); }
 
+	/**<
+	 * Draw the subset of samples LD is approximated over if sampling is
+	 * requested in the settings object.
+	 * @param reader   Reference twk_reader instance.
+	 * @param settings Reference of a user-paramterized settings object.
+	 * @return         Returns the number of samples LD is computed over or 0 if the requested subset is invalid.
+	 */
+	uint32_t DrawSamples(twk_reader& reader, const twk_ld_settings& settings){
+		if(settings.n_sampled == 0) return(reader.hdr.GetNumberSamples());
+		if(sampler.Draw(reader.hdr.GetNumberSamples(), settings.n_sampled, settings.sample_seed) == false){
+			std::cerr << utility::timestamp("ERROR") << "Cannot sample " << settings.n_sampled << " individuals from " << reader.hdr.GetNumberSamples() << " samples..." << std::endl;
+			return(0);
+		}
+		std::cerr << utility::timestamp("LOG") << "Approximating LD over " << utility::ToPrettyString(settings.n_sampled) << " sampled individuals";
+		if(settings.sample_refine >= 0) std::cerr << " and re-computing pairs with R2 >= " << settings.sample_refine << " over all samples";
+		std::cerr << "..." << std::endl;
+		return(settings.n_sampled);
+	}
+
 	/**<
 	 * Reads the desired tomahawk blocks given the balancer intervals. Internally
 	 * decides if the block slicing is based on the universal set of blocks or a
@@ -97,6 +116,10 @@ public:
 	twk_intervals intervals;
 	twk1_ldd_blk* ldd;
 	twk1_block_t* ldd2;
+	twk_ld_sampler sampler;
+	twk_ld_sidecar sidecar; // memory-mapped bitvectors
+	twk_numa_topology numa;
+	std::vector<uint32_t> numa_rows; // first row unpacked on each NUMA node or empty
 };
 
 
@@ -246,7 +269,7 @@ bool twk_ld::twk_ld_impl::LoadTargetSingle(twk_reader& reader,
 	for(int i = 0; i < n_blks; ++i){
 		//std::cerr << "ldd2 size=" << ldd2[i].n << "/" << ldd2[i].m << " " << ldd2[i].minpos << "-" << ldd2[i].maxpos << std::endl;
 		ldd[i].SetOwn(ldd2[i], reader.hdr.GetNumberSamples());
-		ldd[i].Inflate(reader.hdr.GetNumberSamples(),settings.ldd_load_type, true);
+		ldd[i].Inflate(reader.hdr.GetNumberSamples(),settings.ldd_load_type, true, &sampler);
 		//std::cerr << ldd[i].n_rec << std::endl;
 		//std::cerr << "first=" << ldd2[i].rcds[0].pos << std::endl;
 	}
@@ -306,8 +329,14 @@ bool twk_ld::twk_ld_impl::LoadTargetBlocks(twk_reader& reader,
 		ldd2   = new twk1_block_t[m_blks];
 	}
 
+	// Blocks are inflated on demand by the block cache when a memory limit
+	// is set.
+	const uint8_t load_type = settings.memory_limit ? 0 : settings.ldd_load_type;
+
 	if(settings.low_memory)
 		std::cerr << utility::timestamp("LOG") << "Running in restriced memory mode..." << std::endl;
+	else if(settings.memory_limit)
+		std::cerr << utility::timestamp("LOG") << "Running in memory-limited mode. Pre-computing data on demand..." << std::endl;
 	else
 		std::cerr << utility::timestamp("LOG") << "Running in standard mode. Pre-computing data..." << std::endl;
 
@@ -329,7 +358,7 @@ bool twk_ld::twk_ld_impl::LoadTargetBlocks(twk_reader& reader,
 
 				ldd2[i] = std::move(bit.blk);
 				ldd[i].SetOwn(ldd2[i], reader.hdr.GetNumberSamples());
-				ldd[i].Inflate(reader.hdr.GetNumberSamples(), settings.ldd_load_type, true);
+				ldd[i].Inflate(reader.hdr.GetNumberSamples(), load_type, true, &sampler);
 			}
 		} else {
 			uint32_t offset = 0;
@@ -342,7 +371,7 @@ bool twk_ld::twk_ld_impl::LoadTargetBlocks(twk_reader& reader,
 
 				ldd2[offset] = std::move(bit.blk);
 				ldd[offset].SetOwn(ldd2[offset], reader.hdr.GetNumberSamples());
-				ldd[offset].Inflate(reader.hdr.GetNumberSamples(),settings.ldd_load_type, true);
+				ldd[offset].Inflate(reader.hdr.GetNumberSamples(), load_type, true, &sampler);
 				++offset;
 			}
 
@@ -355,7 +384,7 @@ bool twk_ld::twk_ld_impl::LoadTargetBlocks(twk_reader& reader,
 
 				ldd2[offset] = std::move(bit.blk);
 				ldd[offset].SetOwn(ldd2[offset], reader.hdr.GetNumberSamples());
-				ldd[offset].Inflate(reader.hdr.GetNumberSamples(),settings.ldd_load_type, true);
+				ldd[offset].Inflate(reader.hdr.GetNumberSamples(), load_type, true, &sampler);
 				++offset;
 			}
 		}
@@ -401,8 +430,14 @@ bool twk_ld::twk_ld_impl::LoadAllBlocks(twk_reader& reader,
 		ldd2 = new twk1_block_t[m_blks];
 	}
 
+	// Blocks are inflated on demand by the block cache when a memory limit
+	// is set.
+	const uint8_t load_type = settings.memory_limit ? 0 : settings.ldd_load_type;
+
 	if(settings.low_memory)
 		std::cerr << utility::timestamp("LOG") << "Running in restriced memory mode..." << std::endl;
+	else if(settings.memory_limit)
+		std::cerr << utility::timestamp("LOG") << "Running in memory-limited mode. Pre-computing data on demand..." << std::endl;
 	else
 		std::cerr << utility::timestamp("LOG") << "Running in standard mode. Pre-computing data..." << std::endl;
 
@@ -445,6 +480,8 @@ bool twk_ld::twk_ld_impl::LoadAllBlocks(twk_reader& reader,
 		slaves[i].ldd2 = ldd2;
 		slaves[i].rdr  = &reader;
 		slaves[i].resize = true;
+		slaves[i].sampler = &sampler;
+		slaves[i].sidecar = sidecar.IsOpen() ? &sidecar : nullptr;
 		slaves[i].fL = balancer.fromL + ppthreadL*i; // from-left
 		slaves[i].tL = i+1 == unpack_threads ? balancer.fromL+rangeL : balancer.fromL+(ppthreadL*(i+1)); // to-left
 		slaves[i].fR = balancer.fromR + ppthreadL*i; // from-right
@@ -456,7 +493,21 @@ bool twk_ld::twk_ld_impl::LoadAllBlocks(twk_reader& reader,
 		//std::cerr << "range=" << slaves[i].fL << "->" << slaves[i].tL << " and " << slaves[i].fR << "->" << slaves[i].tR << std::endl;
 	}
 
-	for(uint32_t i = 0; i < unpack_threads; ++i) slaves[i].Start(balancer.diag, settings.ldd_load_type, settings.in);
+	// Unpack threads are bound to NUMA nodes in contiguous groups such that
+	// each node first-touches a contiguous range of rows.
+	const uint32_t n_nodes = settings.numa ? numa.size() : 0;
+	numa_rows.clear();
+	if(n_nodes > 1){
+		numa_rows.resize(n_nodes + 1, balancer.toL);
+		for(int i = unpack_threads - 1; i >= 0; --i) numa_rows[i * n_nodes / unpack_threads] = slaves[i].fL;
+		for(int k = n_nodes - 1; k >= 0; --k) numa_rows[k] = std::min(numa_rows[k], numa_rows[k+1]);
+	}
+
+	for(uint32_t i = 0; i < unpack_threads; ++i){
+		if(n_nodes > 1) numa.Bind(i * n_nodes / unpack_threads);
+		slaves[i].Start(balancer.diag, load_type, settings.in);
+	}
+	if(n_nodes > 1) numa.Unbind();
 	for(uint32_t i = 0; i < unpack_threads; ++i) slaves[i].thread->join();
 	delete[] slaves;
 
@@ -487,6 +538,29 @@ bool twk_ld::Compute(){
 		return false;
 	}
 
+	if(settings.lsh && (settings.window || settings.low_memory || settings.n_chunks != 1)){
+		std::cerr << utility::timestamp("ERROR") << "Cannot use window, low-memory, or chunking in LSH mode!" << std::endl;
+		return false;
+	}
+
+	if(settings.lsh && settings.memory_limit){
+		std::cerr << utility::timestamp("ERROR") << "Cannot use a memory limit in LSH mode!" << std::endl;
+		return false;
+	}
+
+	if(settings.lsh && settings.ival_strings.size()){
+		std::cerr << utility::timestamp("ERROR") << "Cannot use intervals in LSH mode!" << std::endl;
+		return false;
+	}
+
+	if(settings.memory_limit && settings.low_memory){
+		std::cerr << utility::timestamp("WARNING") << "Memory limit overrides low-memory mode..." << std::endl;
+		settings.low_memory = false;
+	}
+
+	if(settings.n_compressors < 0)
+		settings.n_compressors = std::max(1, settings.n_threads / 4);
+
 	std::cerr << utility::timestamp("LOG","READER") << "Opening " << settings.in << "..." << std::endl;
 
 	twk_reader reader;
@@ -497,6 +571,16 @@ bool twk_ld::Compute(){
 
 	std::cerr << utility::timestamp("LOG") << "Samples: " << utility::ToPrettyString(reader.hdr.GetNumberSamples()) << "..." << std::endl;
 
+	const uint32_t n_samples = mImpl->DrawSamples(reader, settings);
+	if(n_samples == 0) return false;
+
+	// Windows defined in centiMorgans are resolved against a genetic map.
+	twk_genetic_map gmap;
+	if(settings.window && settings.l_window_cm > 0){
+		if(gmap.Open(settings.genetic_map, reader.hdr) == false)
+			return false;
+	}
+
 	twk1_blk_iterator bit;
 	bit.stream = reader.stream;
 
@@ -519,6 +603,14 @@ bool twk_ld::Compute(){
 		settings.ldd_load_type = TWK_LDD_VEC | TWK_LDD_LIST;
 	}
 
+	// Candidate pairs are sketched from and computed with bitvectors only.
+	if(settings.lsh) settings.ldd_load_type = TWK_LDD_VEC;
+
+	// Frequency-sorted block layout is only used when pairs can be pruned
+	// by a minimum R2 threshold.
+	if(settings.lsh == false && settings.bitmaps == false && settings.window == false && settings.GetScreenR2() > TWK_ALLOWED_ROUNDING_ERROR)
+		settings.ldd_load_type |= TWK_LDD_SORT;
+
 	// Construct interval trees for the input interval strings, if any.
 	if(settings.ival_strings.size() == 0) mImpl->n_blks = reader.index.n;
 	else {
@@ -534,9 +626,45 @@ bool twk_ld::Compute(){
 	}
 	std::cerr << utility::timestamp("LOG","BALANCING") << "Using ranges [" << balancer.fromL << "-" << balancer.toL << "," << balancer.fromR << "-" << balancer.toR << "] in " << (settings.window ? "window mode" : "square mode") <<"..." << std::endl;
 
+	// In window mode blocks are streamed through a sliding window instead of
+	// being loaded up front. Interval-restricted and low-memory runs still
+	// load their blocks.
+	const bool streaming = settings.window && settings.low_memory == false && settings.ival_strings.size() == 0;
+
+	// Bitvectors are mapped from a persistent sidecar when all blocks are
+	// pre-computed over all samples.
+	if(settings.bv_sidecar){
+		const std::string path = twk_ld_sidecar::GetPath(settings.in);
+		if(streaming || settings.low_memory || settings.memory_limit || settings.ival_strings.size() || mImpl->sampler.IsActive() || (settings.ldd_load_type & TWK_LDD_VEC) == 0){
+			std::cerr << utility::timestamp("WARNING","SIDECAR") << "Sidecar is only used when pre-computing bitvectors of all blocks over all samples. Ignoring..." << std::endl;
+		} else if(mImpl->sidecar.Open(path, settings.in, reader) == false){
+			std::cerr << utility::timestamp("LOG","SIDECAR") << "Building " << path << "..." << std::endl;
+			Timer sc_timer; sc_timer.Start();
+			// The sidecar is a cache only: bitvectors are built in memory if
+			// it cannot be written or mapped, for example in a read-only directory.
+			if(twk_ld_sidecar::Build(path, settings.in, reader) == false || mImpl->sidecar.Open(path, settings.in, reader) == false){
+				mImpl->sidecar.Close();
+				std::cerr << utility::timestamp("WARNING","SIDECAR") << "Failed to build " << path << ". Building bitvectors in memory..." << std::endl;
+			} else {
+				std::cerr << utility::timestamp("LOG","SIDECAR") << "Built " << utility::ToPrettyDiskString(mImpl->sidecar.b_map) << " in " << sc_timer.ElapsedString() << "..." << std::endl;
+			}
+		} else {
+			std::cerr << utility::timestamp("LOG","SIDECAR") << "Mapping " << path << "..." << std::endl;
+		}
+	}
+
+	if(settings.numa){
+		if(mImpl->numa.Detect())
+			std::cerr << utility::timestamp("LOG","NUMA") << "Binding threads to " << mImpl->numa.size() << " NUMA nodes..." << std::endl;
+		else
+			std::cerr << utility::timestamp("WARNING","NUMA") << "Found a single NUMA node. Ignoring..." << std::endl;
+	}
+
 	// Load and construct data blocks.
-	if(this->mImpl->LoadBlocks(reader, bit, balancer, settings) == false){
-		return false;
+	if(streaming == false){
+		if(this->mImpl->LoadBlocks(reader, bit, balancer, settings) == false){
+			return false;
+		}
 	}
 
 	if(mImpl->n_blks == 0){
@@ -565,15 +693,74 @@ bool twk_ld::Compute(){
 		std::cerr << utility::timestamp("LOG") << utility::ToPrettyString(n_variants) << " variants (" << utility::ToPrettyString(n_variants_left) << "," << utility::ToPrettyString(n_variants_right) << ") from " << utility::ToPrettyString(balancer.n_m) << " blocks..." << std::endl;
 	}
 	std::cerr << utility::timestamp("LOG","PARAMS") << settings.GetString() << std::endl;
+
+	// Restrict the comparisons to pairs colliding in the LSH sketches.
+	twk_ld_lsh lsh;
+	if(settings.lsh){
+		Timer lsh_timer; lsh_timer.Start();
+		const double recall = lsh.SetParameters(settings.GetScreenR2(), n_variants, settings.lsh_recall);
+		std::cerr << utility::timestamp("LOG","LSH") << "Sketching with " << lsh.n_bands << " bands of " << lsh.n_bits << " bits (expected recall " << recall << " at R2 >= " << settings.GetScreenR2() << ")..." << std::endl;
+		if(recall < settings.lsh_recall)
+			std::cerr << utility::timestamp("WARNING","LSH") << "Desired recall " << settings.lsh_recall << " is not attainable at this threshold..." << std::endl;
+
+		if(lsh.Build(mImpl->ldd, mImpl->n_blks, n_samples, settings.n_threads) == false){
+			std::cerr << utility::timestamp("ERROR","LSH") << "Failed to build sketches..." << std::endl;
+			return false;
+		}
+		n_comparisons = lsh.n_candidates;
+		std::cerr << utility::timestamp("LOG","LSH") << "About " << utility::ToPrettyString(lsh.n_candidates) << " candidate pairs (" << utility::ToPrettyString(lsh.n_split) << " oversized buckets split) in " << lsh_timer.ElapsedString() << "..." << std::endl;
+	}
+
 	std::cerr << utility::timestamp("LOG") << "Performing: " << utility::ToPrettyString(n_comparisons) << " variant comparisons..." << std::endl;
 
 	twk_ld_dynamic_balancer ticker;
 	ticker = balancer;
-	ticker.SetWindow(settings.window, settings.l_window);
+	ticker.SetWindow(settings.window, settings.l_window > 0 ? settings.l_window : std::numeric_limits<uint32_t>::max());
 	ticker.ldd  = mImpl->ldd;
 
+	// Ordinals of the first record in each pre-loaded block for windows
+	// defined in number of variants.
+	std::vector<uint64_t> v_offsets;
+	if(streaming == false && settings.window && settings.l_window_variants > 0){
+		v_offsets.resize(mImpl->n_blks + 1, 0);
+		for(int i = 0; i < mImpl->n_blks; ++i) v_offsets[i+1] = v_offsets[i] + mImpl->ldd[i].blk->n;
+	}
+
+	// Inflated blocks are shared through a cache bounded by the memory limit.
+	// The block grid is traversed in tiles small enough for the blocks of a
+	// tile to stay resident.
+	twk_ld_block_cache cache;
+	const bool caching = settings.memory_limit && streaming == false;
+	if(caching){
+		cache.Set(mImpl->ldd, mImpl->n_blks, reader.hdr.GetNumberSamples(), settings.ldd_load_type, settings.memory_limit, &mImpl->sampler);
+		const uint64_t b_block = std::max((uint64_t)1, cache.Estimate());
+		const uint64_t n_cache = settings.memory_limit / b_block;
+		if(settings.window == false) ticker.SetTiles(std::min((uint64_t)mImpl->n_blks, std::max((uint64_t)1, n_cache / 2)));
+		std::cerr << utility::timestamp("LOG","CACHE") << "Caching up to " << utility::ToPrettyString(n_cache) << " blocks of ~" << utility::ToPrettyDiskString(b_block) << " within " << utility::ToPrettyDiskString(settings.memory_limit) << (settings.window ? "" : " using tiles of " + std::to_string(ticker.l_tile) + " blocks") << "..." << std::endl;
+		if(n_cache < 2*settings.n_threads)
+			std::cerr << utility::timestamp("WARNING","CACHE") << "Memory limit is below two blocks per thread and will be exceeded..." << std::endl;
+	}
+
+	// Partition the rows between NUMA nodes along the ranges unpacked on each
+	// node. Empty partitions are dropped and their node steals from the others.
+	const uint32_t n_nodes = settings.numa && mImpl->numa.size() > 1 ? mImpl->numa.size() : 0;
+	std::vector<uint32_t> node_part(std::max(n_nodes, 1u), 0);
+	uint32_t n_parts = 0;
+	for(uint32_t k = 0; k + 1 < mImpl->numa_rows.size(); ++k)
+		node_part[k] = mImpl->numa_rows[k] < mImpl->numa_rows[k+1] ? n_parts++ : 0;
+	std::vector<twk_ld_dynamic_balancer> local(n_parts);
+	for(uint32_t k = 0, c = 0; k + 1 < mImpl->numa_rows.size(); ++k){
+		if(mImpl->numa_rows[k] == mImpl->numa_rows[k+1]) continue;
+		local[c] = balancer;
+		local[c].SetWindow(ticker.window, ticker.l_window);
+		local[c].ldd = mImpl->ldd;
+		local[c].SetRows(mImpl->numa_rows[k], mImpl->numa_rows[k+1]);
+		if(caching && settings.window == false) local[c].SetTiles(ticker.l_tile);
+		++c;
+	}
+
 	twk_ld_progress progress;
-	progress.n_s = reader.hdr.GetNumberSamples();
+	progress.n_s = n_samples;
 	if(settings.window == false){
 		progress.n_cmps = n_comparisons;
 	}
@@ -620,29 +807,74 @@ bool twk_ld::Compute(){
 	// New index
 	IndexOutput index(reader.hdr.GetNumberContigs());
 
+	// Output blocks are compressed and written off the compute threads.
+	twk_compress_pipeline pipeline;
+	if(settings.n_compressors){
+		pipeline.c_level  = settings.c_level;
+		pipeline.writer   = writer;
+		pipeline.index    = &index;
+		pipeline.progress = &progress;
+		if(pipeline.Start(settings.n_compressors, 2*(settings.n_threads + settings.n_compressors), settings.b_size) == false){
+			std::cerr << utility::timestamp("ERROR","WRITER") << "Failed to start output pipeline!" << std::endl;
+			return false;
+		}
+	}
+
+	// Bound read-ahead to a few block pairs per thread.
+	twk_ld_window_stream stream;
+	if(streaming){
+		std::cerr << utility::timestamp("LOG","WINDOW") << "Streaming blocks in sliding windows..." << std::endl;
+		if(stream.Start(reader, balancer.fromL, balancer.toL, settings, 4*settings.n_threads, &mImpl->sampler, &gmap) == false){
+			std::cerr << utility::timestamp("ERROR","WINDOW") << "Failed to start streaming blocks!" << std::endl;
+			return false;
+		}
+	}
+
 	timer.Start();
 	std::cerr << utility::timestamp("LOG","THREAD") << "Spawning " << settings.n_threads << " threads: ";
 	for(int i = 0; i < settings.n_threads; ++i){
 		slaves[i].ldd    = mImpl->ldd;
-		slaves[i].n_s    = reader.hdr.GetNumberSamples();
+		slaves[i].n_s    = n_samples;
 		slaves[i].ticker = &ticker;
-		slaves[i].engine.SetSamples(reader.hdr.GetNumberSamples());
+		slaves[i].stream = streaming ? &stream : nullptr;
+		slaves[i].cache  = caching ? &cache : nullptr;
+		if(n_parts){
+			slaves[i].local   = local.data();
+			slaves[i].n_local = n_parts;
+			slaves[i].node    = node_part[i * n_nodes / settings.n_threads];
+		}
+		slaves[i].gmap   = settings.l_window_cm > 0 ? &gmap : nullptr;
+		slaves[i].v_offsets = v_offsets.size() ? v_offsets.data() : nullptr;
+		slaves[i].engine.SetSamples(n_samples);
 		slaves[i].engine.SetBlocksize(settings.b_size);
 		slaves[i].engine.progress = &progress;
 		slaves[i].engine.writer   = writer;
 		slaves[i].engine.index    = &index;
 		slaves[i].engine.settings = settings;
+		slaves[i].engine.pipeline = settings.n_compressors ? &pipeline : nullptr;
 		slaves[i].progress = &progress;
 		slaves[i].settings = &settings;
+		slaves[i].sampler  = &mImpl->sampler;
+		if(settings.lsh) slaves[i].lsh = &lsh;
+		if(n_nodes) mImpl->numa.Bind(i * n_nodes / settings.n_threads);
 		threads[i] = slaves[i].Start();
 		std::cerr << ".";
 	}
+	if(n_nodes) mImpl->numa.Unbind();
 	std::cerr << std::endl;
 
 	progress.Start();
 
 	for(int i = 0; i < settings.n_threads; ++i) threads[i]->join();
 	for(int i = 0; i < settings.n_threads; ++i) slaves[i].engine.CompressBlock();
+	pipeline.Stop();
+	if(streaming){
+		stream.Stop();
+		std::cerr << utility::timestamp("LOG","WINDOW") << "Streamed " << utility::ToPrettyString(stream.n_loaded) << " blocks with at most " << utility::ToPrettyString(stream.m_resident) << " resident..." << std::endl;
+	}
+	if(caching){
+		std::cerr << utility::timestamp("LOG","CACHE") << utility::ToPrettyString(cache.n_hits) << " hits, " << utility::ToPrettyString(cache.n_misses) << " misses, " << utility::ToPrettyString(cache.n_evicted) << " evictions with at most " << utility::ToPrettyDiskString(cache.b_peak) << " resident..." << std::endl;
+	}
 	progress.is_ticking = false;
 	progress.PrintFinal();
 	writer->stream.flush();
@@ -706,6 +938,9 @@ bool twk_ld::ComputeSingle(bool verbose, bool progress){
 
 	if(verbose) std::cerr << utility::timestamp("LOG") << "Samples: " << utility::ToPrettyString(reader.hdr.GetNumberSamples()) << "..." << std::endl;
 
+	const uint32_t n_samples = mImpl->DrawSamples(reader, settings);
+	if(n_samples == 0) return false;
+
 	twk1_blk_iterator bit;
 	bit.stream = reader.stream;
 
@@ -728,6 +963,11 @@ bool twk_ld::ComputeSingle(bool verbose, bool progress){
 		settings.ldd_load_type = TWK_LDD_VEC | TWK_LDD_LIST;
 	}
 
+	// Frequency-sorted block layout is only used when pairs can be pruned
+	// by a minimum R2 threshold.
+	if(settings.bitmaps == false && settings.window == false && settings.GetScreenR2() > TWK_ALLOWED_ROUNDING_ERROR)
+		settings.ldd_load_type |= TWK_LDD_SORT;
+
 	// Construct interval trees for the input interval string.
 	if(this->mImpl->LoadTargetSingle(reader, bit, settings, settings.ldd_load_type) == false)
 		return false;
@@ -776,7 +1016,7 @@ bool twk_ld::ComputeSingle(bool verbose, bool progress){
 	ticker.ldd = mImpl->ldd;
 
 	twk_ld_progress progression;
-	progression.n_s = reader.hdr.GetNumberSamples();
+	progression.n_s = n_samples;
 	if(settings.window == false){
 		progression.n_cmps = n_comparisons;
 	}
@@ -827,9 +1067,9 @@ bool twk_ld::ComputeSingle(bool verbose, bool progress){
 	if(verbose) std::cerr << utility::timestamp("LOG","THREAD") << "Spawning " << settings.n_threads << " threads: ";
 	for(int i = 0; i < settings.n_threads; ++i){
 		slaves[i].ldd    = mImpl->ldd;
-		slaves[i].n_s    = reader.hdr.GetNumberSamples();
+		slaves[i].n_s    = n_samples;
 		slaves[i].ticker = &ticker;
-		slaves[i].engine.SetSamples(reader.hdr.GetNumberSamples());
+		slaves[i].engine.SetSamples(n_samples);
 		slaves[i].engine.SetBlocksize(settings.b_size);
 		slaves[i].engine.progress = &progression;
 		slaves[i].engine.writer   = writer;
@@ -837,6 +1077,7 @@ bool twk_ld::ComputeSingle(bool verbose, bool progress){
 		slaves[i].engine.settings = settings;
 		slaves[i].progress = &progression;
 		slaves[i].settings = &settings;
+		slaves[i].sampler  = &mImpl->sampler;
 		threads[i] = slaves[i].Start();
 		if(verbose) std::cerr << ".";
 	}
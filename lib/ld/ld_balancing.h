@@ -1,6 +1,8 @@
 #ifndef TWK_LD_BALANCING_H_
 #define TWK_LD_BALANCING_H_
 
+#include <algorithm>
+
 #include "utility.h"
 
 namespace tomahawk {
@@ -120,6 +122,7 @@ struct twk_ld_dynamic_balancer {
 		diag(false), window(false),
 		n_perf(0), i(0), j(0),
 		fL(0), tL(0), fR(0), tR(0), l_window(0),
+		l_tile(0), ti(0), tj(0), ii(0), jj(0),
 		ldd(nullptr),
 		_getfunc(&twk_ld_dynamic_balancer::GetBlockPair)
 	{}
@@ -152,6 +155,33 @@ struct twk_ld_dynamic_balancer {
 		_getfunc = (window ? &twk_ld_dynamic_balancer::GetBlockWindow : &twk_ld_dynamic_balancer::GetBlockPair);
 	}
 
+	/**<
+	 * Restrict the rows drawn to [from,to) while keeping the offsets of the
+	 * full ranges. Used for partitioning the grid between NUMA nodes. Has to
+	 * be set after assigning the ranges and the range must not be empty.
+	 * @param from First row.
+	 * @param to   Row past the last row.
+	 */
+	void SetRows(const uint32_t from, const uint32_t to){
+		assert(from < to && from >= fL && to <= tL);
+		i  = from; j = (diag ? from : fR);
+		tL = to;
+	}
+
+	/**<
+	 * Traverse the block grid in square tiles of `l_tile` blocks instead of
+	 * row by row. Consecutive pairs then revisit the same 2*l_tile blocks
+	 * such that a cache holding that many inflated blocks is reused for
+	 * l_tile^2 pairs. Has to be set after assigning the ranges.
+	 * @param l_tile Number of blocks along each side of a tile.
+	 */
+	void SetTiles(const uint32_t l_tile){
+		this->l_tile = std::max(1u, l_tile);
+		ti = i; tj = (diag ? i : fR);
+		ii = ti; jj = tj;
+		_getfunc = &twk_ld_dynamic_balancer::GetBlockTiled;
+	}
+
 	/**<
 	 * Indirection using functional pointer to actual function used. This
 	 * allows us to use a singular function without writing multiple
@@ -177,7 +207,7 @@ struct twk_ld_dynamic_balancer {
 		spinlock.lock();
 
 		if(j == tR){
-			++i; j = (diag ? i : fR); from = i; to = j; type = 1; ++j;
+			++i; j = (diag ? i : fR); from = i; to = j; type = diag; ++j;
 			if(i == tL){ spinlock.unlock(); return false; }
 			++n_perf;
 			spinlock.unlock();
@@ -189,7 +219,7 @@ struct twk_ld_dynamic_balancer {
 		if(i != j){
 			// check if this (x,y) pair have any overlapping intervals.
 			if(ldd[j].blk->rcds[0].pos - ldd[i].blk->rcds[ldd[i].n_rec-1].pos > l_window){
-				++i; j = (diag ? i : fR); from = i; to = j; type = 1; ++j;
+				++i; j = (diag ? i : fR); from = i; to = j; type = diag; ++j;
 				spinlock.unlock();
 				return true;
 			}
@@ -215,7 +245,7 @@ struct twk_ld_dynamic_balancer {
 		spinlock.lock();
 
 		if(j == tR){ // if current position is at the last column
-			++i; j = (diag ? i : fR); from = i; to = j; type = 1; ++j;
+			++i; j = (diag ? i : fR); from = i; to = j; type = diag; ++j;
 			// if current position is at the last row
 			if(i == tL){ spinlock.unlock(); return false; }
 			++n_perf;
@@ -232,10 +262,49 @@ struct twk_ld_dynamic_balancer {
 		return true;
 	}
 
+	/**<
+	 * Retrieves (x,y)-coordinates from the selected load-balancing subproblem
+	 * in tiled order: all pairs within a tile are drawn before moving to the
+	 * next tile in the same row of tiles. In diagonal mode only tiles on or
+	 * above the diagonal are visited.
+	 * Uses a spin-lock to make this function thread-safe.
+	 * @param from Row position
+	 * @param to   Column position
+	 * @param type Diagonal (1) or square (0)
+	 * @return     Returns TRUE if it is possible to retrieve a new (x,y)-pair or FALSE otherwise.
+	 */
+	bool GetBlockTiled(uint32_t& from, uint32_t& to, uint8_t& type){
+		spinlock.lock();
+
+		while(ti < tL){
+			const uint32_t i_end = std::min(ti + l_tile, tL);
+			const uint32_t j_end = std::min(tj + l_tile, tR);
+			if(ii < i_end){
+				if(jj < j_end){
+					type = (diag && ii == jj); from = ii; to = jj;
+					++jj; ++n_perf;
+					spinlock.unlock();
+					return true;
+				}
+				++ii; jj = (diag ? std::max(tj, ii) : tj);
+				continue;
+			}
+
+			// Move to the next tile.
+			tj += l_tile;
+			if(tj >= tR){ ti += l_tile; tj = (diag ? ti : fR); }
+			ii = ti; jj = (diag ? std::max(tj, ii) : tj);
+		}
+
+		spinlock.unlock();
+		return false;
+	}
+
 public:
 	bool diag, window;
 	uint32_t n_perf, i,j;
 	uint32_t fL, tL, fR, tR, l_window;
+	uint32_t l_tile, ti, tj, ii, jj; // tile size, current tile, and position within the tile
 	twk1_ldd_blk* ldd;
 	get_func _getfunc;
 	SpinLock spinlock;
@@ -0,0 +1,168 @@
+#ifndef LIB_LD_LD_CACHE_H_
+#define LIB_LD_LD_CACHE_H_
+
+#include <mutex>
+#include <condition_variable>
+#include <list>
+#include <vector>
+#include <algorithm>
+
+#include "ld/ld_structs.h"
+
+namespace tomahawk {
+
+/**<
+ * Least-recently used cache of inflated twk1_ldd_blk bounded by a memory
+ * budget. This sits in between standard mode, where all blocks are inflated
+ * up front, and low-memory mode, where every thread re-inflates its pair of
+ * blocks whenever the pair changes. Raw blocks are kept resident and a
+ * block is inflated on first use and shared between all threads until it
+ * is evicted. Blocks in use by any thread are pinned and are never evicted:
+ * the budget may therefore be exceeded by at most two blocks per thread.
+ */
+struct twk_ld_block_cache {
+public:
+	struct twk_ld_cache_entry {
+		twk_ld_cache_entry() : state(0), n_pinned(0), b_size(0), ldd(nullptr){}
+		~twk_ld_cache_entry(){ delete ldd; }
+
+		uint8_t  state; // absent (0), inflating (1), or ready (2)
+		uint32_t n_pinned; // number of outstanding Acquire() calls
+		uint64_t b_size; // memory used by the inflated block
+		std::list<uint32_t>::iterator it; // position in the LRU list if unpinned
+		twk1_ldd_blk* ldd;
+	};
+
+public:
+	twk_ld_block_cache() :
+		n_samples(0), load_type(0), b_limit(0), b_used(0), b_peak(0),
+		b_estimate(0), b_inflated(0), n_hits(0), n_misses(0), n_evicted(0),
+		raw(nullptr), sampler(nullptr)
+	{}
+
+	/**<
+	 * Parameterise the cache. The provided blocks must hold the records
+	 * only and remain valid for the lifetime of the cache.
+	 * @param raw       Src array of raw twk1_ldd_blk.
+	 * @param n_blks    Number of blocks.
+	 * @param n_samples Number of samples.
+	 * @param load_type Data structures to construct (TWK_LDD_*).
+	 * @param b_limit   Memory budget in bytes.
+	 * @param sampler   Subsampler or nullptr.
+	 */
+	void Set(const twk1_ldd_blk* raw, const uint32_t n_blks, const uint32_t n_samples,
+	         const uint8_t load_type, const uint64_t b_limit, const twk_ld_sampler* sampler)
+	{
+		this->raw = raw;
+		this->n_samples = n_samples;
+		this->load_type = load_type;
+		this->b_limit   = b_limit;
+		this->sampler   = sampler;
+		entries.clear();
+		entries.resize(n_blks);
+		lru.clear();
+	}
+
+	/**<
+	 * Estimate the memory used by a single inflated block by inflating the
+	 * first block.
+	 * @return Returns the number of bytes.
+	 */
+	uint64_t Estimate(){
+		if(entries.size() == 0) return(0);
+		// Releasing may evict and delete the block if it exceeds the budget.
+		const uint64_t b_size = this->Acquire(0)->GetMemoryUsage();
+		this->Release(0);
+		return(b_size);
+	}
+
+	/**<
+	 * Retrieve the inflated block with the given offset. The block is
+	 * inflated if not resident and is pinned until a matching call to
+	 * Release(). Blocks requested concurrently by multiple threads are
+	 * inflated once.
+	 * @param id Block offset.
+	 * @return   Returns a pointer to the inflated block.
+	 */
+	const twk1_ldd_blk* Acquire(const uint32_t id){
+		std::unique_lock<std::mutex> lock(mutex);
+		twk_ld_cache_entry& e = entries[id];
+		cv.wait(lock, [&e]{ return(e.state != 1); });
+
+		if(e.state == 2){
+			if(e.n_pinned++ == 0) lru.erase(e.it);
+			++n_hits;
+			return(e.ldd);
+		}
+
+		e.state = 1; e.n_pinned = 1;
+		++n_misses;
+		this->Evict(b_estimate);
+		lock.unlock();
+
+		twk1_ldd_blk* b = new twk1_ldd_blk;
+		*b = raw[id];
+		b->Inflate(n_samples, load_type, true, sampler);
+		const uint64_t b_size = b->GetMemoryUsage();
+
+		lock.lock();
+		e.ldd    = b;
+		e.b_size = b_size;
+		e.state  = 2;
+		b_used += b_size;
+		b_peak  = std::max(b_peak, b_used);
+		b_inflated += b_size;
+		b_estimate  = b_inflated / n_misses;
+		lock.unlock();
+		cv.notify_all();
+		return(b);
+	}
+
+	/**<
+	 * Unpin a block retrieved with Acquire(). Unpinned blocks are evicted in
+	 * least-recently used order whenever the budget is exceeded.
+	 * @param id Block offset.
+	 */
+	void Release(const uint32_t id){
+		std::lock_guard<std::mutex> lock(mutex);
+		twk_ld_cache_entry& e = entries[id];
+		assert(e.n_pinned != 0);
+		if(--e.n_pinned == 0){
+			lru.push_back(id);
+			e.it = std::prev(lru.end());
+		}
+		this->Evict(0);
+	}
+
+private:
+	// Evict unpinned blocks until `b_needed` additional bytes fit in the
+	// budget. Must be called with the mutex held.
+	void Evict(const uint64_t b_needed){
+		while(lru.size() && b_used + b_needed > b_limit){
+			twk_ld_cache_entry& e = entries[lru.front()];
+			lru.pop_front();
+			delete e.ldd; e.ldd = nullptr;
+			b_used -= e.b_size;
+			e.b_size = 0;
+			e.state  = 0;
+			++n_evicted;
+		}
+	}
+
+public:
+	uint32_t n_samples;
+	uint8_t  load_type;
+	uint64_t b_limit, b_used, b_peak; // budget, resident, and largest resident bytes
+	uint64_t b_estimate, b_inflated; // mean bytes per inflated block, total bytes inflated
+	uint64_t n_hits, n_misses, n_evicted;
+	const twk1_ldd_blk* raw;
+	const twk_ld_sampler* sampler;
+	std::vector<twk_ld_cache_entry> entries;
+	std::list<uint32_t> lru; // unpinned resident blocks, least-recently used first
+	std::mutex mutex;
+	std::condition_variable cv;
+};
+
+}
+
+#endif /* LIB_LD_LD_CACHE_H_ */
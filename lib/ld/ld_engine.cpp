@@ -37,8 +37,8 @@ twk_ld_engine::twk_ld_engine() :
 	n_samples(0), n_out(0), n_lim(10000), n_out_tick(250),
 	byte_width(0), byte_aligned_end(0), vector_cycles(0),
 	phased_unbalanced_adjustment(0), unphased_unbalanced_adjustment(0), t_out(0),
-	mask_placeholder(nullptr),
-	index(nullptr), writer(nullptr), progress(nullptr), list_out(nullptr)
+	mask_placeholder(nullptr), refining(false), refine_unphased(false), emit(true),
+	index(nullptr), writer(nullptr), progress(nullptr), pipeline(nullptr), list_out(nullptr)
 {
 	memset(n_method, 0, sizeof(uint64_t)*10);
 }
@@ -1018,12 +1018,13 @@ bool twk_ld_engine::PhasedRunlength(const twk1_ldd_blk& b1, const uint32_t p1, c
 	const twk1_gt_t& gt1 = *b1.blk->rcds[p1].gt;
 	const twk1_gt_t& gt2 = *b2.blk->rcds[p2].gt;
 
-	uint32_t lenA = gt1.GetLength(0);
-	uint32_t lenB = gt2.GetLength(0);
-	uint8_t currentMixL = (gt1.GetRefA(0) << 2) | gt2.GetRefA(0);
-	uint8_t currentMixR = (gt1.GetRefB(0) << 2) | gt2.GetRefB(0);
-	uint32_t offsetA = 0;
-	uint32_t offsetB = 0;
+	twk1_gt_cursor c1(gt1), c2(gt2);
+	c1.Next(); c2.Next();
+	uint32_t lenA = c1.len;
+	uint32_t lenB = c2.len;
+	uint8_t currentMixL = (c1.GetRefA() << 2) | c2.GetRefA();
+	uint8_t currentMixR = (c1.GetRefB() << 2) | c2.GetRefB();
+	bool moreA = true, moreB = true;
 	uint32_t add;
 	// Branchless
 	//__m128* voffset = reinterpret_cast<__m128*>(&offsetA);
@@ -1042,30 +1043,30 @@ bool twk_ld_engine::PhasedRunlength(const twk1_ldd_blk& b1, const uint32_t p1, c
 		if(lenA > lenB){ // If processed run length A > processed run length B
 			lenA -= lenB;
 			add = lenB;
-			lenB = gt2.GetLength(++offsetB);
+			moreB = c2.Next(); lenB = c2.len;
 		} else if(lenA < lenB){ // If processed run length A < processed run length B
 			lenB -= lenA;
 			add = lenA;
-			lenA = gt1.GetLength(++offsetA);
+			moreA = c1.Next(); lenA = c1.len;
 		} else { // If processed run length A == processed run length B
 			add = lenB;
-			lenA = gt1.GetLength(++offsetA);
-			lenB = gt2.GetLength(++offsetB);
+			moreA = c1.Next(); lenA = c1.len;
+			moreB = c2.Next(); lenB = c2.len;
 		}
 		helper.alleleCounts[currentMixL] += add;
 		helper.alleleCounts[currentMixR] += add;
 
 		// Exit condition
-		if(offsetA == gt1.n || offsetB == gt2.n){
-			if(offsetA != gt1.n || offsetB != gt2.n){
-				std::cerr << utility::timestamp("FATAL") << "Failed to exit equally!\n" << offsetA << "/" << gt1.n << " and " << offsetB << "/" << gt2.n << std::endl;
+		if(moreA == false || moreB == false){
+			if(moreA != moreB){
+				std::cerr << utility::timestamp("FATAL") << "Failed to exit equally!\n" << c1.k << "/" << gt1.n << " and " << c2.k << "/" << gt2.n << std::endl;
 				exit(1);
 			}
 			break;
 		}
 
-		currentMixL = (gt1.GetRefA(offsetA) << 2) | gt2.GetRefA(offsetB);
-		currentMixR = (gt1.GetRefB(offsetA) << 2) | gt2.GetRefB(offsetB);
+		currentMixL = (c1.GetRefA() << 2) | c2.GetRefA();
+		currentMixR = (c1.GetRefB() << 2) | c2.GetRefB();
 	}
 	++n_method[6];
 
@@ -1100,41 +1101,42 @@ bool twk_ld_engine::UnphasedRunlength(const twk1_ldd_blk& b1, const uint32_t p1,
 	const twk1_gt_t& gt1 = *b1.blk->rcds[p1].gt;
 	const twk1_gt_t& gt2 = *b2.blk->rcds[p2].gt;
 
-	uint32_t lenA = gt1.GetLength(0);
-	uint32_t lenB = gt2.GetLength(0);
-	uint8_t  currentMix = (gt1.GetRefA(0) << 6) | (gt1.GetRefB(0) << 4) | (gt2.GetRefA(0) << 2) | (gt2.GetRefB(0));
-	uint32_t offsetA = 0;
-	uint32_t offsetB = 0;
+	twk1_gt_cursor c1(gt1), c2(gt2);
+	c1.Next(); c2.Next();
+	uint32_t lenA = c1.len;
+	uint32_t lenB = c2.len;
+	uint8_t  currentMix = (c1.GetRefA() << 6) | (c1.GetRefB() << 4) | (c2.GetRefA() << 2) | (c2.GetRefB());
+	bool moreA = true, moreB = true;
 	uint32_t add;
 
 	while(true){
 		if(lenA > lenB){ // If processed run length A > processed run length B
 			lenA -= lenB;
 			add = lenB;
-			lenB = gt2.GetLength(++offsetB);
+			moreB = c2.Next(); lenB = c2.len;
 		} else if(lenA < lenB){ // If processed run length A < processed run length B
 			lenB -= lenA;
 			add = lenA;
-			lenA = gt1.GetLength(++offsetA);
+			moreA = c1.Next(); lenA = c1.len;
 		} else { // If processed run length A == processed run length B
 			add = lenB;
-			lenA = gt1.GetLength(++offsetA);
-			lenB = gt2.GetLength(++offsetB);
+			moreA = c1.Next(); lenA = c1.len;
+			moreB = c2.Next(); lenB = c2.len;
 		}
 		helper.alleleCounts[currentMix] += add;
 		//std::cerr << "adding: " << std::bitset<8>(currentMix) << std::endl;
 		assert(currentMix < 171);
 
 		// Exit condition
-		if(offsetA == gt1.n && offsetB == gt2.n){
-			if(offsetA != gt1.n || offsetB != gt2.n){
-				std::cerr << utility::timestamp("FATAL") << "Failed to exit equally!\n" << offsetA << "/" << gt1.n << " and " << offsetB << "/" << gt2.n << std::endl;
+		if(moreA == false || moreB == false){
+			if(moreA != moreB){
+				std::cerr << utility::timestamp("FATAL") << "Failed to exit equally!\n" << c1.k << "/" << gt1.n << " and " << c2.k << "/" << gt2.n << std::endl;
 				exit(1);
 			}
 			break;
 		}
 
-		currentMix = (gt1.GetRefA(offsetA) << 6) | (gt1.GetRefB(offsetA) << 4) | (gt2.GetRefA(offsetB) << 2) | (gt2.GetRefB(offsetB));
+		currentMix = (c1.GetRefA() << 6) | (c1.GetRefB() << 4) | (c2.GetRefA() << 2) | (c2.GetRefB());
 	}
 	++n_method[7];
 
@@ -1201,6 +1203,17 @@ bool twk_ld_engine::PhasedMath(const twk1_ldd_blk& b1, const uint32_t p1, const
 
 	cur_rcd.D = pA*qB - qA*pB;
 	cur_rcd.R2 = cur_rcd.D*cur_rcd.D / (g0*g1*h0*h1);
+	if(settings.n_sampled && refining == false){
+		if(settings.sample_refine >= 0){
+			if(cur_rcd.R2 < settings.sample_refine){
+				cur_rcd.controller = 0;
+				return false;
+			}
+			return(this->RefineExact(b1,p1,b2,p2,refine_unphased));
+		}
+		cur_rcd.SetSampled();
+	}
+
 	if(cur_rcd.R2 < settings.minR2 || cur_rcd.R2 > settings.maxR2){
 		cur_rcd.controller = 0;
 		return false;
@@ -1265,6 +1278,9 @@ bool twk_ld_engine::PhasedMath(const twk1_ldd_blk& b1, const uint32_t p1, const
 //std::cout << "P\t" << b1.blk->rcds[p1].pos << "\t" << b2.blk->rcds[p2].pos << "\t" << helper.D << "\t" << helper.Dprime << "\t" << helper.R << "\t" << helper.R2 << '\n';
 	}
 #endif
+	// Pairs are only queried: the record is left in `cur_rcd`.
+	if(emit == false) return true;
+
 	// If the number of rcds written is equal to the flush limit then
 	// compress and write output.
 	if(blk_f.n == n_lim || irecF.rid != cur_rcd.ridA || irecR.rid != cur_rcd.ridB){
@@ -1309,6 +1325,19 @@ bool twk_ld_engine::PhasedMath(const twk1_ldd_blk& b1, const uint32_t p1, const
 	return true;
 }
 
+bool twk_ld_engine::RefineExact(const twk1_ldd_blk& b1, const uint32_t p1, const twk1_ldd_blk& b2, const uint32_t p2, const bool unphased){
+	assert(b1.full != nullptr && b2.full != nullptr);
+	full_view[0].blk = b1.full; full_view[0].n_rec = b1.full->n;
+	full_view[1].blk = b2.full; full_view[1].n_rec = b2.full->n;
+
+	cur_rcd.controller = 0;
+	refining = true;
+	const bool ret = unphased ? this->UnphasedRunlength(full_view[0],p1,full_view[1],p2)
+	                          : this->PhasedRunlength(full_view[0],p1,full_view[1],p2);
+	refining = false;
+	return(ret);
+}
+
 bool twk_ld_engine::UnphasedMath(const twk1_ldd_blk& b1, const uint32_t p1, const twk1_ldd_blk& b2, const uint32_t p2){
 	// Total amount of non-missing alleles
 	helper.totalHaplotypeCounts =
@@ -1344,7 +1373,10 @@ bool twk_ld_engine::UnphasedMath(const twk1_ldd_blk& b1, const uint32_t p1, cons
 		cur_rcd.ChiSqModel = 0;
 
 		// Use standard math
-		return(this->PhasedMath(b1,p1,b2,p2));
+		refine_unphased = true;
+		const bool ret = this->PhasedMath(b1,p1,b2,p2);
+		refine_unphased = false;
+		return(ret);
 	}
 #endif
 
@@ -1614,6 +1646,17 @@ bool twk_ld_engine::ChooseF11Calculate(const twk1_ldd_blk& b1, const uint32_t po
 	//std::cerr << "unphased-choose=" << p1 << "," << p2 << "," << q1 << "," << q2 << " with p=" << p << " q=" << q << " R2=" << cur_rcd.R2  << std::endl;
 	//if(rsquared > 0.5) exit(1);
 
+	if(settings.n_sampled && refining == false){
+		if(settings.sample_refine >= 0){
+			if(cur_rcd.R2 < settings.sample_refine){
+				cur_rcd.controller = 0;
+				return false;
+			}
+			return(this->RefineExact(b1,pos1,b2,pos2,true));
+		}
+		cur_rcd.SetSampled();
+	}
+
 	if(cur_rcd.R2 < settings.minR2 || cur_rcd.R2 > settings.maxR2){
 		cur_rcd.controller = 0;
 		return false;
@@ -1697,6 +1740,9 @@ bool twk_ld_engine::ChooseF11Calculate(const twk1_ldd_blk& b1, const uint32_t po
 	}
 	#endif
 
+	// Pairs are only queried: the record is left in `cur_rcd`.
+	if(emit == false) return true;
+
 	// If the number of rcds written is equal to the flush limit then
 	// compress and write output.
 	if(blk_f.n == n_lim || irecF.rid != cur_rcd.ridA || irecR.rid != cur_rcd.ridB){
@@ -1739,8 +1785,23 @@ bool twk_ld_engine::ChooseF11Calculate(const twk1_ldd_blk& b1, const uint32_t po
 	return false;
 }
 
+void twk_ld_engine::Dispatch(twk1_two_block_t& blk, IndexEntryOutput& irec){
+	twk_compress_job* job = pipeline->Acquire();
+	std::swap(job->blk.n, blk.n);
+	std::swap(job->blk.m, blk.m);
+	std::swap(job->blk.rcds, blk.rcds);
+	job->irec = irec;
+	t_out += job->blk.n;
+	pipeline->Submit(job);
+
+	blk.reset();
+	irec.clear();
+}
+
 bool twk_ld_engine::CompressFwd(){
-	if(blk_f.n){
+	if(blk_f.n && pipeline != nullptr){
+		this->Dispatch(blk_f, irecF);
+	} else if(blk_f.n){
 		//progress->n_out += blk_f.n;
 		ibuf << blk_f;
 
@@ -1771,7 +1832,9 @@ bool twk_ld_engine::CompressFwd(){
 }
 
 bool twk_ld_engine::CompressRev(){
-	if(blk_r.n){
+	if(blk_r.n && pipeline != nullptr){
+		this->Dispatch(blk_r, irecR);
+	} else if(blk_r.n){
 		ibuf << blk_r;
 		//progress->n_out += blk_r.n;
 
@@ -1814,9 +1877,11 @@ bool twk_ld_engine::CompressBlock(){
 ****************************/
 twk_ld_slave::twk_ld_slave() : n_s(0), n_total(0),
 	i_start(0), j_start(0), prev_i(0), prev_j(0), n_cycles(0),
-	ticker(nullptr), thread(nullptr), ldd(nullptr),
-	progress(nullptr), settings(nullptr)
-{}
+	ticker(nullptr), stream(nullptr), cache(nullptr), local(nullptr), n_local(0), node(0), gmap(nullptr), v_offsets(nullptr),
+	thread(nullptr), ldd(nullptr),
+	progress(nullptr), settings(nullptr), sampler(nullptr),
+	lsh(nullptr)
+{ w_off[0] = 0; w_off[1] = 0; }
 
 twk_ld_slave::~twk_ld_slave(){ delete thread; }
 
@@ -1829,6 +1894,11 @@ std::thread* twk_ld_slave::Start(){
 		return(thread);
 	}
 
+	if(lsh != nullptr){
+		thread = new std::thread(&twk_ld_slave::CalculateCandidates, this, nullptr);
+		return(thread);
+	}
+
 	if(settings->force_phased && settings->low_memory && settings->bitmaps)
 		if(settings->window) thread = new std::thread(&twk_ld_slave::CalculatePhasedBitmapWindow, this, nullptr);
 		else thread = new std::thread(&twk_ld_slave::CalculatePhasedBitmap, this, nullptr);
@@ -1850,12 +1920,48 @@ void twk_ld_slave::UpdateBlocks(twk1_ldd_blk* blks,
                                 const uint32_t& from,
                                 const uint32_t& to)
 {
-	if(settings->low_memory == false)
+	if(cache != nullptr)
+		this->UpdateBlocksCached(blks,from,to);
+	else if(settings->low_memory == false)
 		this->UpdateBlocksPreloaded(blks,from,to);
 	else
 		this->UpdateBlocksGenerate(blks,from,to);
 }
 
+bool twk_ld_slave::NextBlocks(twk1_ldd_blk* blks, uint8_t& type){
+	if(stream == nullptr){
+		uint32_t from, to;
+		if(!this->NextPair(from, to, type)){
+			// Return the last pair to the cache.
+			if(cache != nullptr && n_cycles){
+				cache->Release(prev_i); cache->Release(prev_j);
+				n_cycles = 0;
+			}
+			return false;
+		}
+		this->UpdateBlocks(blks,from,to);
+		if(v_offsets != nullptr){ w_off[0] = v_offsets[prev_i]; w_off[1] = v_offsets[prev_j]; }
+		return true;
+	}
+
+	stream->Release(wpair);
+	if(stream->Get(wpair) == false) return false;
+	blks[0].SetPreloaded(wpair.blks[0]->ldd);
+	blks[1].SetPreloaded(wpair.blks[1]->ldd);
+	w_off[0] = wpair.blks[0]->offset; w_off[1] = wpair.blks[1]->offset;
+	type = wpair.type;
+	return true;
+}
+
+bool twk_ld_slave::NextPair(uint32_t& from, uint32_t& to, uint8_t& type){
+	if(n_local == 0) return(ticker->Get(from, to, type));
+
+	for(uint32_t k = 0; k < n_local; ++k){
+		if(local[(node + k) % n_local].Get(from, to, type)) return true;
+	}
+	return false;
+}
+
 void twk_ld_slave::UpdateBlocksPreloaded(twk1_ldd_blk* blks,
                                          const uint32_t& from,
                                          const uint32_t& to)
@@ -1876,16 +1982,16 @@ void twk_ld_slave::UpdateBlocksGenerate(twk1_ldd_blk* blks,
 
 	if(n_cycles == 0 || prev_i != from - i_start){
 		blks[0] = ldd[from - i_start];
-		blks[0].Inflate(n_s, settings->ldd_load_type, true);
-	} else {
+		blks[0].Inflate(n_s, settings->ldd_load_type, true, sampler);
+	} else if(blks[0].full == nullptr){
 		blks[0].blk   = ldd[from - i_start].blk;
 		blks[0].n_rec = ldd[from - i_start].blk->n;
 	}
 
 	if(n_cycles == 0 || prev_j != add + (to - j_start)){
 		blks[1] = ldd[add + (to - j_start)];
-		blks[1].Inflate(n_s, settings->ldd_load_type, true);
-	} else {
+		blks[1].Inflate(n_s, settings->ldd_load_type, true, sampler);
+	} else if(blks[1].full == nullptr){
 		blks[1].blk   = ldd[add + (to - j_start)].blk;
 		blks[1].n_rec = ldd[add + (to - j_start)].blk->n;
 	}
@@ -1895,6 +2001,251 @@ void twk_ld_slave::UpdateBlocksGenerate(twk1_ldd_blk* blks,
 	++n_cycles;
 }
 
+void twk_ld_slave::UpdateBlocksCached(twk1_ldd_blk* blks,
+                                      const uint32_t& from,
+                                      const uint32_t& to)
+{
+	const uint32_t add = ticker->diag ? 0 : (ticker->tL - ticker->fL);
+
+	// Acquire the new pair before releasing the previous one such that
+	// blocks shared by consecutive pairs are never evicted in between.
+	blks[0].SetPreloaded(*cache->Acquire(from - i_start));
+	blks[1].SetPreloaded(*cache->Acquire(add + (to - j_start)));
+	if(n_cycles){ cache->Release(prev_i); cache->Release(prev_j); }
+
+	prev_i = from - i_start;
+	prev_j = add + (to - j_start);
+	++n_cycles;
+}
+
+uint64_t twk_ld_slave::UpdateWindowBounds(const twk1_ldd_blk* blocks, const uint8_t type){
+	const uint32_t n0 = blocks[0].n_rec, n1 = blocks[1].n_rec;
+	w_begin.resize(n0); w_end.resize(n0);
+
+	uint64_t n_window = 0;
+	if(settings->window == false){
+		for(uint32_t i = 0; i < n0; ++i){
+			w_begin[i] = (type == 1 ? i + 1 : 0);
+			w_end[i]   = n1;
+			n_window  += w_end[i] - w_begin[i];
+		}
+		return(n_window);
+	}
+
+	if(blocks[0].blk->rid != blocks[1].blk->rid){
+		std::fill(w_begin.begin(), w_begin.end(), 0);
+		std::fill(w_end.begin(), w_end.end(), 0);
+		return(0);
+	}
+
+	// Window sizes that are not set are unbounded.
+	const uint64_t l_bases = settings->l_window > 0 ? settings->l_window : std::numeric_limits<uint32_t>::max();
+	const uint64_t l_vnts  = settings->l_window_variants > 0 ? settings->l_window_variants : std::numeric_limits<uint32_t>::max();
+	const bool by_cm = gmap != nullptr && settings->l_window_cm > 0;
+
+	w_pos.resize(n1);
+	for(uint32_t j = 0; j < n1; ++j) w_pos[j] = blocks[1].blk->rcds[j].pos;
+	if(by_cm){
+		for(int k = 0; k < 2; ++k){
+			w_cm[k].resize(blocks[k].n_rec);
+			for(uint32_t j = 0; j < blocks[k].n_rec; ++j)
+				w_cm[k][j] = gmap->Get(blocks[k].blk->rid, blocks[k].blk->rcds[j].pos);
+		}
+	}
+
+	// Window coordinates are sorted such that the end of the window never decreases.
+	uint32_t j_end = 0;
+	for(uint32_t i = 0; i < n0; ++i){
+		const uint64_t limit   = (uint64_t)blocks[0].blk->rcds[i].pos + l_bases;
+		const uint64_t limit_v = w_off[0] + i + l_vnts;
+		const double   limit_c = by_cm ? w_cm[0][i] + settings->l_window_cm : 0;
+		w_begin[i] = (type == 1 ? i + 1 : 0);
+		if(j_end < w_begin[i]) j_end = w_begin[i];
+		while(j_end < n1 && w_pos[j_end] <= limit && w_off[1] + j_end <= limit_v
+		      && (by_cm == false || w_cm[1][j_end] <= limit_c))
+			++j_end;
+		w_end[i]   = j_end;
+		n_window  += j_end - w_begin[i];
+	}
+	return(n_window);
+}
+
+bool twk_ld_slave::UpdateFrequencyBounds(const twk1_ldd_blk* blocks, const uint8_t type){
+	if(settings->GetScreenR2() <= TWK_ALLOWED_ROUNDING_ERROR) return false;
+
+	const double n_alleles = 2*n_s;
+	for(int k = 0; k < (type == 1 ? 1 : 2); ++k){
+		const twk1_t* rcds = blocks[k].blk->rcds;
+		maf[k].resize(blocks[k].n_rec);
+		for(uint32_t i = 0; i < blocks[k].n_rec; ++i){
+			if(rcds[i].gt_missing){ maf[k][i] = -1; continue; }
+			maf[k][i] = std::min(rcds[i].ac, 2*n_s - rcds[i].ac) / n_alleles;
+		}
+	}
+	return true;
+}
+
+void twk_ld_slave::UpdateFrequencyTiles(const uint32_t n_rec, const uint32_t bsize){
+	const uint32_t n_tiles = n_rec / bsize;
+	tile_lo.resize(n_tiles); tile_hi.resize(n_tiles);
+	for(uint32_t t = 0; t < n_tiles; ++t){
+		double l = 2, h = -1;
+		for(uint32_t j = t*bsize; j < (t+1)*bsize; ++j){
+			if(maf[1][j] < 0){ l = -1; break; }
+			l = std::min(l, maf[1][j]);
+			h = std::max(h, maf[1][j]);
+		}
+		tile_lo[t] = l; tile_hi[t] = h;
+	}
+}
+
+/**<
+ * Admissible partners of a record without missing genotypes: the contiguous
+ * range of records in `perm` without missing data whose minor allele
+ * frequency is within [lo,hi].
+ */
+static inline void twk_ld_sorted_range(const twk1_ldd_blk& b, const double* maf,
+                                       const double lo, const double hi,
+                                       const uint32_t*& from, const uint32_t*& to)
+{
+	const uint32_t* first = b.perm.data();
+	const uint32_t* last  = first + b.n_nomiss;
+	from = std::lower_bound(first, last, lo, [maf](const uint32_t j, const double v){ return(maf[j] < v); });
+	to   = std::upper_bound(from, last, hi, [maf](const double v, const uint32_t j){ return(v < maf[j]); });
+}
+
+/**<
+ * First record with missing genotypes in `perm` with an allele count of at
+ * least `limit`.
+ */
+static inline const uint32_t* twk_ld_sorted_split(const twk1_ldd_blk& b, const uint32_t limit){
+	const twk1_t* rcds = b.blk->rcds;
+	return(std::lower_bound(b.perm.data() + b.n_nomiss, b.perm.data() + b.n_rec, limit,
+	       [rcds](const uint32_t j, const uint32_t v){ return(rcds[j].ac < v); }));
+}
+
+void twk_ld_slave::PhasedSorted(const twk1_ldd_blk* blocks, const uint8_t type, twk_ld_perf* perf){
+	const uint32_t thresh_miss = 0.0047*n_s + 5.2913;
+
+	const twk1_ldd_blk& b0 = blocks[0];
+	const twk1_ldd_blk& b1 = blocks[type == 1 ? 0 : 1];
+	const twk1_t* rcds0 = b0.blk->rcds;
+	const twk1_t* rcds1 = b1.blk->rcds;
+	const double* maf1 = maf[type == 1 ? 0 : 1].data();
+	const uint32_t* mend = b1.perm.data() + b1.n_rec;
+	const uint32_t *from = nullptr, *to = nullptr, *split = nullptr;
+	double lo = -1, hi = 2;
+
+	uint64_t cur_out = engine.n_out;
+	for(uint32_t a = 0; a < b0.n_rec; ++a){
+		const uint32_t i = b0.perm[a];
+		cur_out = engine.n_out;
+
+		if(a < b0.n_nomiss){
+			this->FrequencyWindow(maf[0][i], lo, hi);
+			twk_ld_sorted_range(b1, maf1, lo, hi, from, to);
+			for(const uint32_t* k = from; k != to; ++k){
+				if(type == 1 && *k <= i) continue;
+				if(rcds0[i].ac + rcds1[*k].ac <= 2) continue;
+				engine.PhasedListVector(b0,i,b1,*k,perf);
+			}
+
+			split = twk_ld_sorted_split(b1, thresh_miss > rcds0[i].ac ? thresh_miss - rcds0[i].ac : 0);
+			for(const uint32_t* k = b1.perm.data() + b1.n_nomiss; k != split; ++k){
+				if(type == 1 && *k <= i) continue;
+				if(rcds0[i].ac + rcds1[*k].ac <= 2) continue;
+				engine.PhasedRunlength(b0,i,b1,*k,perf);
+			}
+			for(const uint32_t* k = split; k != mend; ++k){
+				if(type == 1 && *k <= i) continue;
+				engine.PhasedVectorized(b0,i,b1,*k,perf);
+			}
+		} else {
+			// Anchor with missing genotypes: no pruning is possible.
+			for(const uint32_t* k = b1.perm.data(); k != mend; ++k){
+				if(type == 1 && *k <= i) continue;
+				if(rcds0[i].ac + rcds1[*k].ac <= 2) continue;
+
+				if(rcds0[i].ac + rcds1[*k].ac < thresh_miss)
+					engine.PhasedRunlength(b0,i,b1,*k,perf);
+				else
+					engine.PhasedVectorized(b0,i,b1,*k,perf);
+			}
+		}
+		progress->n_out += engine.n_out - cur_out;
+	}
+
+	if(type == 1) progress->n_var += ((b0.n_rec * b0.n_rec) - b0.n_rec) / 2; // n choose 2
+	else progress->n_var += b0.n_rec * b1.n_rec;
+}
+
+void twk_ld_slave::UnphasedSorted(const twk1_ldd_blk* blocks, const uint8_t type, twk_ld_perf* perf){
+	const uint32_t thresh_nomiss = 0.0088*n_s + 18.972;
+	const uint32_t thresh_miss = 0.012*n_s + 22.3661;
+
+	const twk1_ldd_blk& b0 = blocks[0];
+	const twk1_ldd_blk& b1 = blocks[type == 1 ? 0 : 1];
+	const twk1_t* rcds0 = b0.blk->rcds;
+	const twk1_t* rcds1 = b1.blk->rcds;
+	const double* maf1 = maf[type == 1 ? 0 : 1].data();
+	const uint32_t* mend = b1.perm.data() + b1.n_rec;
+	const uint32_t *from = nullptr, *to = nullptr, *split = nullptr;
+	double lo = -1, hi = 2;
+
+	uint64_t cur_out = engine.n_out;
+	for(uint32_t a = 0; a < b0.n_rec; ++a){
+		const uint32_t i = b0.perm[a];
+		cur_out = engine.n_out;
+
+		if(a < b0.n_nomiss){
+			this->FrequencyWindow(maf[0][i], lo, hi);
+			twk_ld_sorted_range(b1, maf1, lo, hi, from, to);
+			if(rcds0[i].ac < thresh_nomiss){
+				for(const uint32_t* k = from; k != to; ++k){
+					if(type == 1 && *k <= i) continue;
+					if(rcds0[i].ac + rcds1[*k].ac <= 2) continue;
+					engine.UnphasedRunlength(b0,i,b1,*k,perf);
+				}
+			} else {
+				for(const uint32_t* k = from; k != to; ++k){
+					if(type == 1 && *k <= i) continue;
+					if(rcds0[i].ac + rcds1[*k].ac <= 2) continue;
+					if(rcds1[*k].ac < thresh_nomiss)
+						engine.UnphasedRunlength(b0,i,b1,*k,perf);
+					else
+						engine.UnphasedVectorizedNoMissing(b0,i,b1,*k,perf);
+				}
+			}
+
+			split = twk_ld_sorted_split(b1, thresh_miss > rcds0[i].ac ? thresh_miss - rcds0[i].ac : 0);
+			for(const uint32_t* k = b1.perm.data() + b1.n_nomiss; k != split; ++k){
+				if(type == 1 && *k <= i) continue;
+				if(rcds0[i].ac + rcds1[*k].ac <= 2) continue;
+				engine.UnphasedRunlength(b0,i,b1,*k,perf);
+			}
+			for(const uint32_t* k = split; k != mend; ++k){
+				if(type == 1 && *k <= i) continue;
+				engine.UnphasedVectorized(b0,i,b1,*k,perf);
+			}
+		} else {
+			// Anchor with missing genotypes: no pruning is possible.
+			for(const uint32_t* k = b1.perm.data(); k != mend; ++k){
+				if(type == 1 && *k <= i) continue;
+				if(rcds0[i].ac + rcds1[*k].ac <= 2) continue;
+
+				if(rcds0[i].ac + rcds1[*k].ac < thresh_miss)
+					engine.UnphasedRunlength(b0,i,b1,*k,perf);
+				else
+					engine.UnphasedVectorized(b0,i,b1,*k,perf);
+			}
+		}
+		progress->n_out += engine.n_out - cur_out;
+	}
+
+	if(type == 1) progress->n_var += ((b0.n_rec * b0.n_rec) - b0.n_rec) / 2; // n choose 2
+	else progress->n_var += b0.n_rec * b1.n_rec;
+}
+
 void twk_ld_slave::Phased(const twk1_t* rcds0,
                           const twk1_t* rcds1,
                           const twk1_ldd_blk* blocks,
@@ -1908,16 +2259,31 @@ void twk_ld_slave::Phased(const twk1_t* rcds0,
 	// RLEP-BVP intersection
 	// y = 0.0047*n_s + 5.2913
 	const uint32_t thresh_miss = 0.0047*n_s + 5.2913;
+
+	// Frequency-bound pruning: pairs whose marginals cannot reach minR2 are
+	// skipped before counting.
+	const bool prune = this->UpdateFrequencyBounds(blocks, type);
+	const double* maf0 = maf[0].data();
+	const double* maf1 = (type == 1 ? maf[0].data() : maf[1].data());
+	double lo = -1, hi = 2;
+
+	if(prune && blocks[0].perm.size() == blocks[0].n_rec && blocks[1].perm.size() == blocks[1].n_rec){
+		return(this->PhasedSorted(blocks, type, perf));
+	}
 	//std::cerr << thresh_nomiss << "," << thresh_miss << std::endl;
 
 	if(type == 1){
 		uint64_t cur_out = engine.n_out;
 		for(uint32_t i = 0; i < blocks[0].n_rec; ++i){
 			cur_out = engine.n_out;
+			if(prune) this->FrequencyWindow(maf0[i], lo, hi);
 			for(uint32_t j = i+1; j < blocks[0].n_rec; ++j){
 				if(rcds0[i].ac + rcds0[j].ac <= 2){
 					continue;
 				}
+				if(prune && maf1[j] >= 0 && (maf1[j] < lo || maf1[j] > hi)){
+					continue;
+				}
 
 				if(rcds0[i].gt_missing == false && rcds1[j].gt_missing == false){
 					engine.PhasedListVector(blocks[0],i,blocks[0],j,perf);
@@ -1937,6 +2303,7 @@ void twk_ld_slave::Phased(const twk1_t* rcds0,
 		bsize = (bsize == 0 ? 10 : bsize);
 		const uint32_t n_blocks1 = blocks[0].n_rec / bsize;
 		const uint32_t n_blocks2 = blocks[1].n_rec / bsize;
+		if(prune) this->UpdateFrequencyTiles(blocks[1].n_rec, bsize);
 
 		uint64_t d = 0;
 		uint64_t cur_out = engine.n_out;
@@ -1944,11 +2311,19 @@ void twk_ld_slave::Phased(const twk1_t* rcds0,
 			for(uint32_t jj = 0; jj < n_blocks2*bsize; jj += bsize){
 				for(uint32_t i = ii; i < ii + bsize; ++i){
 					cur_out = engine.n_out;
+					if(prune) this->FrequencyWindow(maf0[i], lo, hi);
+					if(prune && tile_lo[jj/bsize] >= 0 && (tile_hi[jj/bsize] < lo || tile_lo[jj/bsize] > hi)){
+						d += bsize; // no partner in this tile can reach minR2
+						continue;
+					}
 					for(uint32_t j = jj; j < jj + bsize; ++j){
 						++d;
 						if( rcds0[i].ac + rcds1[j].ac <= 2){
 							continue;
 						}
+						if(prune && maf1[j] >= 0 && (maf1[j] < lo || maf1[j] > hi)){
+							continue;
+						}
 
 						//std::cerr << ii << "/" << n_blocks1 << "," << jj << "/" << n_blocks2 << "," << i << "/" << ii+bsize << "," << j << "/" << jj+bsize << " bsize=" << bsize << std::endl;
 						if(rcds0[i].gt_missing == false && rcds1[j].gt_missing == false){
@@ -1968,11 +2343,15 @@ void twk_ld_slave::Phased(const twk1_t* rcds0,
 			// residual j that does not fit in a block
 			for(uint32_t i = ii; i < ii + bsize; ++i){
 				cur_out = engine.n_out;
+				if(prune) this->FrequencyWindow(maf0[i], lo, hi);
 				for(uint32_t j = n_blocks2*bsize; j < blocks[1].n_rec; ++j){
 					++d;
 					if( rcds0[i].ac + rcds1[j].ac <= 2){
 						continue;
 					}
+					if(prune && maf1[j] >= 0 && (maf1[j] < lo || maf1[j] > hi)){
+						continue;
+					}
 
 					if(rcds0[i].gt_missing == false && rcds1[j].gt_missing == false){
 						engine.PhasedListVector(blocks[0],i,blocks[1],j,perf);
@@ -1993,11 +2372,15 @@ void twk_ld_slave::Phased(const twk1_t* rcds0,
 
 		for(uint32_t i = n_blocks1*bsize; i < blocks[0].n_rec; ++i){
 			cur_out = engine.n_out;
+			if(prune) this->FrequencyWindow(maf0[i], lo, hi);
 			for(uint32_t j = 0; j < blocks[1].n_rec; ++j){
 				++d;
 				if( rcds0[i].ac + rcds1[j].ac <= 2){
 					continue;
 				}
+				if(prune && maf1[j] >= 0 && (maf1[j] < lo || maf1[j] > hi)){
+					continue;
+				}
 
 				if(rcds0[i].gt_missing == false && rcds1[j].gt_missing == false){
 					engine.PhasedListVector(blocks[0],i,blocks[1],j,perf);
@@ -2025,14 +2408,29 @@ void twk_ld_slave::Unphased(const twk1_t* rcds0, const twk1_t* rcds1, const twk1
 	// y = 0.012*n_s + 22.3661
 	const uint32_t thresh_miss = 0.012*n_s + 22.3661;
 
+	// Frequency-bound pruning: pairs whose marginals cannot reach minR2 are
+	// skipped before counting.
+	const bool prune = this->UpdateFrequencyBounds(blocks, type);
+	const double* maf0 = maf[0].data();
+	const double* maf1 = (type == 1 ? maf[0].data() : maf[1].data());
+	double lo = -1, hi = 2;
+
+	if(prune && blocks[0].perm.size() == blocks[0].n_rec && blocks[1].perm.size() == blocks[1].n_rec){
+		return(this->UnphasedSorted(blocks, type, perf));
+	}
+
 	if(type == 1){
 		uint64_t cur_out = engine.n_out;
 		for(uint32_t i = 0; i < blocks[0].n_rec; ++i){
 			cur_out = engine.n_out;
+			if(prune) this->FrequencyWindow(maf0[i], lo, hi);
 			for(uint32_t j = i+1; j < blocks[0].n_rec; ++j){
 				if(rcds0[i].ac + rcds0[j].ac <= 2){
 					continue;
 				}
+				if(prune && maf1[j] >= 0 && (maf1[j] < lo || maf1[j] > hi)){
+					continue;
+				}
 
 #if(TWK_SLAVE_DEBUG_MODE == 2)
 				if((rcds0[i].gt_missing || rcds1[j].gt_missing) == false){
@@ -2065,6 +2463,7 @@ void twk_ld_slave::Unphased(const twk1_t* rcds0, const twk1_t* rcds1, const twk1
 		bsize = (bsize == 0 ? 10 : bsize);
 		const uint32_t n_blocks1 = blocks[0].n_rec / bsize;
 		const uint32_t n_blocks2 = blocks[1].n_rec / bsize;
+		if(prune) this->UpdateFrequencyTiles(blocks[1].n_rec, bsize);
 
 		uint64_t d = 0;
 		uint64_t cur_out = engine.n_out;
@@ -2072,11 +2471,19 @@ void twk_ld_slave::Unphased(const twk1_t* rcds0, const twk1_t* rcds1, const twk1
 			for(uint32_t jj = 0; jj < n_blocks2*bsize; jj += bsize){
 				for(uint32_t i = ii; i < ii + bsize; ++i){
 					cur_out = engine.n_out;
+					if(prune) this->FrequencyWindow(maf0[i], lo, hi);
+					if(prune && tile_lo[jj/bsize] >= 0 && (tile_hi[jj/bsize] < lo || tile_lo[jj/bsize] > hi)){
+						d += bsize; // no partner in this tile can reach minR2
+						continue;
+					}
 					for(uint32_t j = jj; j < jj + bsize; ++j){
 						++d;
 						if( rcds0[i].ac + rcds1[j].ac <= 2){
 							continue;
 						}
+						if(prune && maf1[j] >= 0 && (maf1[j] < lo || maf1[j] > hi)){
+							continue;
+						}
 
 						//std::cerr << ii << "/" << n_blocks1 << "," << jj << "/" << n_blocks2 << "," << i << "/" << ii+bsize << "," << j << "/" << jj+bsize << " bsize=" << bsize << std::endl;
 #if(TWK_SLAVE_DEBUG_MODE == 2)
@@ -2110,11 +2517,15 @@ void twk_ld_slave::Unphased(const twk1_t* rcds0, const twk1_t* rcds1, const twk1
 			// residual j that does not fit in a block
 			for(uint32_t i = ii; i < ii + bsize; ++i){
 				cur_out = engine.n_out;
+				if(prune) this->FrequencyWindow(maf0[i], lo, hi);
 				for(uint32_t j = n_blocks2*bsize; j < blocks[1].n_rec; ++j){
 					++d;
 					if( rcds0[i].ac + rcds1[j].ac <= 2){
 						continue;
 					}
+					if(prune && maf1[j] >= 0 && (maf1[j] < lo || maf1[j] > hi)){
+						continue;
+					}
 
 #if(TWK_SLAVE_DEBUG_MODE == 2)
 					if((rcds0[i].gt_missing || rcds1[j].gt_missing) == false){
@@ -2149,11 +2560,15 @@ void twk_ld_slave::Unphased(const twk1_t* rcds0, const twk1_t* rcds1, const twk1
 
 		for(uint32_t i = n_blocks1*bsize; i < blocks[0].n_rec; ++i){
 			cur_out = engine.n_out;
+			if(prune) this->FrequencyWindow(maf0[i], lo, hi);
 			for(uint32_t j = 0; j < blocks[1].n_rec; ++j){
 				++d;
 				if( rcds0[i].ac + rcds1[j].ac <= 2){
 					continue;
 				}
+				if(prune && maf1[j] >= 0 && (maf1[j] < lo || maf1[j] > hi)){
+					continue;
+				}
 
 #if(TWK_SLAVE_DEBUG_MODE == 2)
 				if((rcds0[i].gt_missing || rcds1[j].gt_missing) == false){
@@ -2189,7 +2604,7 @@ void twk_ld_slave::Unphased(const twk1_t* rcds0, const twk1_t* rcds1, const twk1
 
 bool twk_ld_slave::CalculatePhased(twk_ld_perf* perf){
 	twk1_ldd_blk blocks[2];
-	uint32_t from, to; uint8_t type;
+	uint8_t type;
 	Timer timer; timer.Start();
 
 	i_start = ticker->fL; j_start = ticker->fR;
@@ -2199,8 +2614,7 @@ bool twk_ld_slave::CalculatePhased(twk_ld_perf* perf){
 	const twk1_t* rcds1 = nullptr;
 
 	while(true){
-		if(!ticker->Get(from, to, type)) break;
-		this->UpdateBlocks(blocks,from,to);
+		if(!this->NextBlocks(blocks, type)) break;
 
 		rcds0 = blocks[0].blk->rcds;
 		rcds1 = blocks[1].blk->rcds;
@@ -2269,7 +2683,7 @@ bool twk_ld_slave::CalculateSingle(twk_ld_perf* perf){
 					}*/
 
 					if(blocks[0].blk->rcds[i].an || blocks[0].blk->rcds[j].an){
-						if(blocks[0].blk->rcds[i].gt->n + blocks[0].blk->rcds[j].gt->n < cycle_thresh_u){
+						if(blocks[0].blk->rcds[i].gt->GetRunEstimate() + blocks[0].blk->rcds[j].gt->GetRunEstimate() < cycle_thresh_u){
 							engine.UnphasedRunlength(blocks[0],i,blocks[0],j,nullptr);
 						} else {
 							engine.UnphasedVectorized(blocks[0],i,blocks[0],j,nullptr);
@@ -2295,7 +2709,7 @@ bool twk_ld_slave::CalculateSingle(twk_ld_perf* perf){
 					}*/
 
 					if(blocks[0].blk->rcds[i].an || blocks[1].blk->rcds[j].an){
-						if(blocks[0].blk->rcds[i].gt->n + blocks[1].blk->rcds[j].gt->n < cycle_thresh_u)
+						if(blocks[0].blk->rcds[i].gt->GetRunEstimate() + blocks[1].blk->rcds[j].gt->GetRunEstimate() < cycle_thresh_u)
 							engine.UnphasedRunlength(blocks[0],i,blocks[1],j,nullptr);
 						else {
 							engine.UnphasedVectorized(blocks[0],i,blocks[1],j,nullptr);
@@ -2333,7 +2747,7 @@ bool twk_ld_slave::CalculateSingle(twk_ld_perf* perf){
 
 bool twk_ld_slave::CalculateUnphased(twk_ld_perf* perf){
 	twk1_ldd_blk blocks[2];
-	uint32_t from, to; uint8_t type;
+	uint8_t type;
 	Timer timer; timer.Start();
 
 	i_start = ticker->fL; j_start = ticker->fR;
@@ -2343,9 +2757,7 @@ bool twk_ld_slave::CalculateUnphased(twk_ld_perf* perf){
 	const twk1_t* rcds1 = nullptr;
 
 	while(true){
-		if(!ticker->Get(from, to, type)) break;
-
-		this->UpdateBlocks(blocks,from,to);
+		if(!this->NextBlocks(blocks, type)) break;
 		rcds0 = blocks[0].blk->rcds;
 		rcds1 = blocks[1].blk->rcds;
 
@@ -2369,7 +2781,7 @@ bool twk_ld_slave::CalculateUnphased(twk_ld_perf* perf){
 
 bool twk_ld_slave::CalculatePhasedBitmap(twk_ld_perf* perf){
 	twk1_ldd_blk blocks[2];
-	uint32_t from, to; uint8_t type;
+	uint8_t type;
 	Timer timer; timer.Start();
 
 	i_start = ticker->fL; j_start = ticker->fR;
@@ -2381,9 +2793,7 @@ bool twk_ld_slave::CalculatePhasedBitmap(twk_ld_perf* perf){
 
 
 	while(true){
-		if(!ticker->Get(from, to, type)) break;
-
-		this->UpdateBlocks(blocks,from,to);
+		if(!this->NextBlocks(blocks, type)) break;
 		rcds0 = blocks[0].blk->rcds;
 		rcds1 = blocks[1].blk->rcds;
 
@@ -2440,7 +2850,7 @@ bool twk_ld_slave::CalculatePhasedBitmap(twk_ld_perf* perf){
 
 bool twk_ld_slave::CalculatePhasedBitmapWindow(twk_ld_perf* perf){
 	twk1_ldd_blk blocks[2];
-	uint32_t from, to; uint8_t type;
+	uint8_t type;
 	Timer timer; timer.Start();
 
 	i_start = ticker->fL; j_start = ticker->fR;
@@ -2450,64 +2860,29 @@ bool twk_ld_slave::CalculatePhasedBitmapWindow(twk_ld_perf* perf){
 	const twk1_t* rcds0 = nullptr;
 	const twk1_t* rcds1 = nullptr;
 
-
 	while(true){
-		if(!ticker->Get(from, to, type)) break;
-
-		this->UpdateBlocks(blocks,from,to);
+		if(!this->NextBlocks(blocks, type)) break;
 		rcds0 = blocks[0].blk->rcds;
 		rcds1 = blocks[1].blk->rcds;
 
+		const uint64_t n_window = this->UpdateWindowBounds(blocks, type);
 		uint32_t cur_out = engine.n_out;
-		if(type == 1){
-			for(uint32_t i = 0; i < blocks[0].n_rec; ++i){
-				cur_out = engine.n_out;
-				for(uint32_t j = i+1; j < blocks[0].n_rec; ++j){
-					if(blocks[0].blk->rcds[i].rid != blocks[0].blk->rcds[j].rid
-					   && (blocks[0].blk->rcds[j].pos - blocks[0].blk->rcds[i].pos) > settings->l_window)
-					{
-						//std::cerr << "oor=" << blocks[0].blk->rcds[j].pos - blocks[0].blk->rcds[j].pos << std::endl;
-						continue;
-					}
-
-					if(blocks[0].blk->rcds[i].ac + blocks[0].blk->rcds[j].ac <= 2){
-						continue;
-					}
-
-					if((rcds0[i].gt_missing || rcds1[j].gt_missing) == false){
-						engine.PhasedBitmap(blocks[0],i,blocks[0],j,perf);
-					} else {
-						engine.PhasedRunlength(blocks[0],i,blocks[0],j,perf);
-					}
+		for(uint32_t i = 0; i < blocks[0].n_rec; ++i){
+			cur_out = engine.n_out;
+			for(uint32_t j = w_begin[i]; j < w_end[i]; ++j){
+				if(rcds0[i].ac + rcds1[j].ac <= 2){
+					continue;
 				}
-				progress->n_out += engine.n_out - cur_out;
-			}
-			progress->n_var += ((blocks[0].n_rec * blocks[0].n_rec) - blocks[0].n_rec) / 2; // n choose 2
-		} else {
-			for(uint32_t i = 0; i < blocks[0].n_rec; ++i){
-				cur_out = engine.n_out;
-				for(uint32_t j = 0; j < blocks[1].n_rec; ++j){
-					if(blocks[0].blk->rcds[i].rid != blocks[1].blk->rcds[j].rid
-					   && (blocks[1].blk->rcds[j].pos - blocks[0].blk->rcds[i].pos) > settings->l_window)
-					{
-						//std::cerr << "oor=" << blocks[1].blk->rcds[j].pos - blocks[0].blk->rcds[i].pos << std::endl;
-						continue;
-					}
-
-					if( blocks[0].blk->rcds[i].ac + blocks[1].blk->rcds[j].ac <= 2 ){
-						continue;
-					}
 
-					if((rcds0[i].gt_missing || rcds1[j].gt_missing) == false){
-						engine.PhasedBitmap(blocks[0],i,blocks[1],j,perf);
-					} else {
-						engine.PhasedRunlength(blocks[0],i,blocks[1],j,perf);
-					}
+				if((rcds0[i].gt_missing || rcds1[j].gt_missing) == false){
+					engine.PhasedBitmap(blocks[0],i,blocks[1],j,perf);
+				} else {
+					engine.PhasedRunlength(blocks[0],i,blocks[1],j,perf);
 				}
-				progress->n_out += engine.n_out - cur_out;
 			}
-			progress->n_var += blocks[0].n_rec * blocks[1].n_rec;
+			progress->n_out += engine.n_out - cur_out;
 		}
+		progress->n_var += n_window;
 	}
 
 	// if preloaded
@@ -2525,7 +2900,7 @@ bool twk_ld_slave::CalculatePhasedBitmapWindow(twk_ld_perf* perf){
 
 bool twk_ld_slave::CalculatePhasedWindow(twk_ld_perf* perf){
 	twk1_ldd_blk blocks[2];
-	uint32_t from, to; uint8_t type;
+	uint8_t type;
 	Timer timer; timer.Start();
 
 	i_start = ticker->fL; j_start = ticker->fR;
@@ -2538,74 +2913,31 @@ bool twk_ld_slave::CalculatePhasedWindow(twk_ld_perf* perf){
 	const twk1_t* rcds1 = nullptr;
 
 	while(true){
-		if(!ticker->Get(from, to, type)) break;
-
-		this->UpdateBlocks(blocks,from,to);
+		if(!this->NextBlocks(blocks, type)) break;
 		rcds0 = blocks[0].blk->rcds;
 		rcds1 = blocks[1].blk->rcds;
 
+		const uint64_t n_window = this->UpdateWindowBounds(blocks, type);
 		uint32_t cur_out = engine.n_out;
-		if(type == 1){
-			for(uint32_t i = 0; i < blocks[0].n_rec; ++i){
-				cur_out = engine.n_out;
-				for(uint32_t j = i+1; j < blocks[0].n_rec; ++j){
-					//std::cerr << "here=" << i << "/" << j << " diff=" << blocks[0].blk->rcds[j].pos - blocks[0].blk->rcds[i].pos << std::endl;
-					if(blocks[0].blk->rcds[i].rid == blocks[0].blk->rcds[j].rid
-					   && (blocks[0].blk->rcds[j].pos - blocks[0].blk->rcds[i].pos) > settings->l_window)
-					{
-						//std::cerr << "oor=" << blocks[0].blk->rcds[j].pos - blocks[0].blk->rcds[i].pos << std::endl;
-						//progress->n_var += i*j;
-						goto end_cycle;
-						//continue;
-					}
-
-					if(blocks[0].blk->rcds[i].ac + blocks[0].blk->rcds[j].ac <= 2){
-						continue;
-					}
-
-					if((rcds0[i].gt_missing || rcds1[j].gt_missing) == false){
-						engine.PhasedListVector(blocks[0],i,blocks[0],j,perf);
-					} else {
-						if(rcds0[i].ac + rcds1[j].ac < thresh_miss)
-							engine.PhasedRunlength(blocks[0],i,blocks[0],j,perf);
-						else
-							engine.PhasedVectorized(blocks[0],i,blocks[0],j,perf);
-					}
+		for(uint32_t i = 0; i < blocks[0].n_rec; ++i){
+			cur_out = engine.n_out;
+			for(uint32_t j = w_begin[i]; j < w_end[i]; ++j){
+				if(rcds0[i].ac + rcds1[j].ac <= 2){
+					continue;
 				}
-				progress->n_out += engine.n_out - cur_out;
-			}
-			progress->n_var += ((blocks[0].n_rec * blocks[0].n_rec) - blocks[0].n_rec) / 2; // n choose 2
-		} else {
-			for(uint32_t i = 0; i < blocks[0].n_rec; ++i){
-				cur_out = engine.n_out;
-				for(uint32_t j = 0; j < blocks[1].n_rec; ++j){
-					if(blocks[0].blk->rcds[i].rid == blocks[1].blk->rcds[j].rid
-					   && (blocks[1].blk->rcds[j].pos - blocks[0].blk->rcds[i].pos) > settings->l_window)
-					{
-						//std::cerr << "oor=" << blocks[1].blk->rcds[j].pos - blocks[0].blk->rcds[i].pos << std::endl;
-						goto end_cycle;
-						//continue;
-					}
-
-					if( blocks[0].blk->rcds[i].ac + blocks[1].blk->rcds[j].ac <= 2 ){
-						continue;
-					}
 
-					if((rcds0[i].gt_missing || rcds1[j].gt_missing) == false){
-						engine.PhasedListVector(blocks[0],i,blocks[1],j,perf);
-					} else {
-						if(rcds0[i].ac + rcds1[j].ac < thresh_miss)
-							engine.PhasedRunlength(blocks[0],i,blocks[1],j,perf);
-						else
-							engine.PhasedVectorized(blocks[0],i,blocks[1],j,perf);
-					}
+				if((rcds0[i].gt_missing || rcds1[j].gt_missing) == false){
+					engine.PhasedListVector(blocks[0],i,blocks[1],j,perf);
+				} else {
+					if(rcds0[i].ac + rcds1[j].ac < thresh_miss)
+						engine.PhasedRunlength(blocks[0],i,blocks[1],j,perf);
+					else
+						engine.PhasedVectorized(blocks[0],i,blocks[1],j,perf);
 				}
-				progress->n_out += engine.n_out - cur_out;
 			}
-			progress->n_var += blocks[0].n_rec * blocks[1].n_rec;
+			progress->n_out += engine.n_out - cur_out;
 		}
-		end_cycle:
-		progress->n_var += 0;
+		progress->n_var += n_window;
 	}
 
 	// if preloaded
@@ -2622,9 +2954,8 @@ bool twk_ld_slave::CalculatePhasedWindow(twk_ld_perf* perf){
 }
 
 bool twk_ld_slave::CalculateUnphasedWindow(twk_ld_perf* perf){
-	std::cerr << "in unphased window" << std::endl;
 	twk1_ldd_blk blocks[2];
-	uint32_t from, to; uint8_t type;
+	uint8_t type;
 	Timer timer; timer.Start();
 
 	i_start = ticker->fL; j_start = ticker->fR;
@@ -2643,82 +2974,35 @@ bool twk_ld_slave::CalculateUnphasedWindow(twk_ld_perf* perf){
 	const twk1_t* rcds1 = nullptr;
 
 	while(true){
-		if(!ticker->Get(from, to, type)) break;
-
-		this->UpdateBlocks(blocks,from,to);
+		if(!this->NextBlocks(blocks, type)) break;
 		rcds0 = blocks[0].blk->rcds;
 		rcds1 = blocks[1].blk->rcds;
 
+		const uint64_t n_window = this->UpdateWindowBounds(blocks, type);
 		uint32_t cur_out = engine.n_out;
-		if(type == 1){
-			for(uint32_t i = 0; i < blocks[0].n_rec; ++i){
-				cur_out = engine.n_out;
-				for(uint32_t j = i+1; j < blocks[0].n_rec; ++j){
-					//std::cerr << "here=" << i << "/" << j << " diff=" << blocks[0].blk->rcds[j].pos - blocks[0].blk->rcds[i].pos << std::endl;
-					if(blocks[0].blk->rcds[i].rid == blocks[0].blk->rcds[j].rid
-					   && (blocks[0].blk->rcds[j].pos - blocks[0].blk->rcds[i].pos) > settings->l_window)
-					{
-						//std::cerr << "oor=" << blocks[0].blk->rcds[j].pos - blocks[0].blk->rcds[i].pos << std::endl;
-						//progress->n_var += i*j;
-						goto end_cycle;
-						//continue;
-					}
-
-					if(blocks[0].blk->rcds[i].ac + blocks[0].blk->rcds[j].ac <= 2){
-						continue;
-					}
-
-					if(rcds0[i].gt_missing == false && rcds1[j].gt_missing == false){
-						if(std::min(rcds0[i].ac, rcds0[j].ac) < thresh_nomiss)
-							engine.UnphasedRunlength(blocks[0],i,blocks[0],j,perf);
-						else {
-							engine.UnphasedVectorizedNoMissing(blocks[0],i,blocks[0],j,perf);
-						}
-					} else {
-						if(rcds0[i].ac + rcds1[j].ac < thresh_miss)
-							engine.UnphasedRunlength(blocks[0],i,blocks[0],j,perf);
-						else
-							engine.UnphasedVectorized(blocks[0],i,blocks[0],j,perf);
-					}
+		for(uint32_t i = 0; i < blocks[0].n_rec; ++i){
+			cur_out = engine.n_out;
+			for(uint32_t j = w_begin[i]; j < w_end[i]; ++j){
+				if(rcds0[i].ac + rcds1[j].ac <= 2){
+					continue;
 				}
-				progress->n_out += engine.n_out - cur_out;
-			}
-			progress->n_var += ((blocks[0].n_rec * blocks[0].n_rec) - blocks[0].n_rec) / 2; // n choose 2
-		} else {
-			for(uint32_t i = 0; i < blocks[0].n_rec; ++i){
-				cur_out = engine.n_out;
-				for(uint32_t j = 0; j < blocks[1].n_rec; ++j){
-					if(blocks[0].blk->rcds[i].rid == blocks[1].blk->rcds[j].rid
-					   && (blocks[1].blk->rcds[j].pos - blocks[0].blk->rcds[i].pos) > settings->l_window)
-					{
-						//std::cerr << "oor=" << blocks[1].blk->rcds[j].pos - blocks[0].blk->rcds[i].pos << std::endl;
-						goto end_cycle;
-						//continue;
-					}
-
-					if( blocks[0].blk->rcds[i].ac + blocks[1].blk->rcds[j].ac <= 2 ){
-						continue;
-					}
 
-					if(rcds0[i].gt_missing == false && rcds1[j].gt_missing == false){
-						if(std::min(rcds0[i].ac, rcds0[j].ac) < thresh_nomiss)
-							engine.UnphasedRunlength(blocks[0],i,blocks[1],j,perf);
-						else {
-							engine.UnphasedVectorizedNoMissing(blocks[0],i,blocks[1],j,perf);
-						}
-					} else {
-						if(rcds0[i].ac + rcds1[j].ac < thresh_miss)
-							engine.UnphasedRunlength(blocks[0],i,blocks[1],j,perf);
-						else
-							engine.UnphasedVectorized(blocks[0],i,blocks[1],j,perf);
+				if(rcds0[i].gt_missing == false && rcds1[j].gt_missing == false){
+					if(std::min(rcds0[i].ac, rcds1[j].ac) < thresh_nomiss)
+						engine.UnphasedRunlength(blocks[0],i,blocks[1],j,perf);
+					else {
+						engine.UnphasedVectorizedNoMissing(blocks[0],i,blocks[1],j,perf);
 					}
+				} else {
+					if(rcds0[i].ac + rcds1[j].ac < thresh_miss)
+						engine.UnphasedRunlength(blocks[0],i,blocks[1],j,perf);
+					else
+						engine.UnphasedVectorized(blocks[0],i,blocks[1],j,perf);
 				}
-				progress->n_out += engine.n_out - cur_out;
 			}
-			progress->n_var += blocks[0].n_rec * blocks[1].n_rec;
+			progress->n_out += engine.n_out - cur_out;
 		}
-		end_cycle:
-		progress->n_var += 0;
+		progress->n_var += n_window;
 	}
 
 	// if preloaded
@@ -2734,9 +3018,53 @@ bool twk_ld_slave::CalculateUnphasedWindow(twk_ld_perf* perf){
 	return true;
 }
 
+bool twk_ld_slave::CalculateCandidates(twk_ld_perf* perf){
+	const uint32_t thresh_miss = 0.0047*n_s + 5.2913;
+	const bool phased = settings->forced_unphased == false;
+
+	uint32_t from = 0, to = 0, ba = 0, pa = 0, bb = 0, pb = 0;
+	uint64_t n_var = 0;
+	std::vector<uint32_t> partners;
+
+	while(lsh->Next(from, to)){
+		for(uint32_t a = from; a < to; ++a){
+			lsh->Partners(a, partners);
+			if(partners.size() == 0) continue;
+			lsh->Locate(a, ba, pa);
+			const twk1_t& rcd0 = ldd[ba].blk->rcds[pa];
+
+			for(uint32_t k = 0; k < partners.size(); ++k){
+				lsh->Locate(partners[k], bb, pb);
+				const twk1_t& rcd1 = ldd[bb].blk->rcds[pb];
+				if(++n_var == 1000){ progress->n_var += n_var; n_var = 0; }
+				if(rcd0.ac + rcd1.ac <= 2) continue;
+
+				const uint32_t cur_out = engine.n_out;
+				if(phased && (settings->force_phased || (rcd0.an == 0 && rcd1.an == 0))){
+					if(rcd0.gt_missing == false && rcd1.gt_missing == false)
+						engine.PhasedVectorizedNoMissing(ldd[ba],pa,ldd[bb],pb,perf);
+					else if(rcd0.ac + rcd1.ac < thresh_miss)
+						engine.PhasedRunlength(ldd[ba],pa,ldd[bb],pb,perf);
+					else
+						engine.PhasedVectorized(ldd[ba],pa,ldd[bb],pb,perf);
+				} else {
+					if(rcd0.gt_missing == false && rcd1.gt_missing == false)
+						engine.UnphasedVectorizedNoMissing(ldd[ba],pa,ldd[bb],pb,perf);
+					else
+						engine.UnphasedVectorized(ldd[ba],pa,ldd[bb],pb,perf);
+				}
+				progress->n_out += engine.n_out - cur_out;
+			}
+		}
+	}
+	progress->n_var += n_var;
+
+	return true;
+}
+
 bool twk_ld_slave::Calculate(twk_ld_perf* perf){
 	twk1_ldd_blk blocks[2];
-	uint32_t from, to; uint8_t type;
+	uint8_t type;
 	Timer timer; timer.Start();
 
 	i_start = ticker->fL; j_start = ticker->fR;
@@ -2757,23 +3085,22 @@ bool twk_ld_slave::Calculate(twk_ld_perf* perf){
 	const twk1_t* rcds1 = nullptr;
 
 	while(true){
-		if(!ticker->Get(from, to, type)) break;
-
-		this->UpdateBlocks(blocks,from,to);
+		if(!this->NextBlocks(blocks, type)) break;
 		rcds0 = blocks[0].blk->rcds;
 		rcds1 = blocks[1].blk->rcds;
 
+		const uint64_t n_window = this->UpdateWindowBounds(blocks, type);
 		uint32_t cur_out = engine.n_out;
 		if(type == 1){
 			for(uint32_t i = 0; i < blocks[0].n_rec; ++i){
 				cur_out = engine.n_out;
-				for(uint32_t j = i+1; j < blocks[0].n_rec; ++j){
+				for(uint32_t j = w_begin[i]; j < w_end[i]; ++j){
 					if(blocks[0].blk->rcds[i].ac + blocks[0].blk->rcds[j].ac <= 2){
 						continue;
 					}
 
 					if(blocks[0].blk->rcds[i].an || blocks[0].blk->rcds[j].an){
-						if(blocks[0].blk->rcds[i].gt->n + blocks[0].blk->rcds[j].gt->n < cycle_thresh_u){
+						if(blocks[0].blk->rcds[i].gt->GetRunEstimate() + blocks[0].blk->rcds[j].gt->GetRunEstimate() < cycle_thresh_u){
 							engine.UnphasedRunlength(blocks[0],i,blocks[0],j,nullptr);
 						} else {
 							engine.UnphasedVectorized(blocks[0],i,blocks[0],j,nullptr);
@@ -2791,17 +3118,17 @@ bool twk_ld_slave::Calculate(twk_ld_perf* perf){
 				}
 				progress->n_out += engine.n_out - cur_out;
 			}
-			progress->n_var += ((blocks[0].n_rec * blocks[0].n_rec) - blocks[0].n_rec) / 2; // n choose 2
+			progress->n_var += n_window;
 		} else {
 			for(uint32_t i = 0; i < blocks[0].n_rec; ++i){
 				cur_out = engine.n_out;
-				for(uint32_t j = 0; j < blocks[1].n_rec; ++j){
+				for(uint32_t j = w_begin[i]; j < w_end[i]; ++j){
 					if( blocks[0].blk->rcds[i].ac + blocks[1].blk->rcds[j].ac <= 2 ){
 						continue;
 					}
 
 					if(blocks[0].blk->rcds[i].an || blocks[1].blk->rcds[j].an){
-						if(blocks[0].blk->rcds[i].gt->n + blocks[1].blk->rcds[j].gt->n < cycle_thresh_u)
+						if(blocks[0].blk->rcds[i].gt->GetRunEstimate() + blocks[1].blk->rcds[j].gt->GetRunEstimate() < cycle_thresh_u)
 							engine.UnphasedRunlength(blocks[0],i,blocks[1],j,nullptr);
 						else {
 							engine.UnphasedVectorized(blocks[0],i,blocks[1],j,nullptr);
@@ -2819,7 +3146,7 @@ bool twk_ld_slave::Calculate(twk_ld_perf* perf){
 				}
 				progress->n_out += engine.n_out - cur_out;
 			}
-			progress->n_var += blocks[0].n_rec * blocks[1].n_rec;
+			progress->n_var += n_window;
 		}
 
 	}
@@ -2839,7 +3166,7 @@ bool twk_ld_slave::Calculate(twk_ld_perf* perf){
 
 bool twk_ld_slave::CalculatePerformance(twk_ld_engine::func f, twk_ld_perf* perf){
 	twk1_ldd_blk blocks[2];
-	uint32_t from, to; uint8_t type;
+	uint8_t type;
 	Timer timer; timer.Start();
 
 	i_start = ticker->fL; j_start = ticker->fR;
@@ -2849,9 +3176,7 @@ bool twk_ld_slave::CalculatePerformance(twk_ld_engine::func f, twk_ld_perf* perf
 	const twk1_t* rcds1 = nullptr;
 
 	while(true){
-		if(!ticker->Get(from, to, type)) break;
-
-		this->UpdateBlocks(blocks,from,to);
+		if(!this->NextBlocks(blocks, type)) break;
 		rcds0 = blocks[0].blk->rcds;
 		rcds1 = blocks[1].blk->rcds;
 
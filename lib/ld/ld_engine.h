@@ -10,6 +10,11 @@
 #include "ld/ld_progress.h"
 #include "ld/ld_balancing.h"
 #include "ld/ld_unpacker.h"
+#include "ld/ld_lsh.h"
+#include "ld/ld_pipeline.h"
+#include "ld/ld_window.h"
+#include "ld/ld_cache.h"
+#include "ld/ld_numa.h"
 
 namespace tomahawk {
 
@@ -286,6 +291,19 @@ public:
 	double ChiSquaredUnphasedTable(const double target, const double p, const double q);
 	bool ChooseF11Calculate(const twk1_ldd_blk& b1, const uint32_t p1, const twk1_ldd_blk& b2, const uint32_t p2,const double target, const double p, const double q);
 
+	/**<
+	 * Re-compute a pair that passed the screen over a subsample of individuals
+	 * using the run-length encoded genotypes of all samples. The result is
+	 * filtered and written as any other pair and is not flagged as sampled.
+	 * @param b1       Left twk1_ldd_blk reference with subsampled records.
+	 * @param p1       Left relative offset into the left twk1_ldd_blk reference.
+	 * @param b2       Right twk1_ldd_blk reference with subsampled records.
+	 * @param p2       Right relative offset into the right twk1_ldd_blk reference.
+	 * @param unphased Re-compute using unphased math.
+	 * @return         Returns TRUE if the pair was written or FALSE otherwise.
+	 */
+	bool RefineExact(const twk1_ldd_blk& b1, const uint32_t p1, const twk1_ldd_blk& b2, const uint32_t p2, const bool unphased);
+
 	/**<
 	 * Compress the internal output buffers consisting of twk1_two_t records.
 	 * There are two separate buffers, Fwd and Rev, corresponding to the upper
@@ -301,6 +319,14 @@ public:
 	bool CompressFwd();
 	bool CompressRev();
 
+	/**<
+	 * Hand off an output buffer to the compression pipeline. The records are
+	 * swapped into a recycled job such that the buffer is empty on return.
+	 * @param blk  Src output buffer.
+	 * @param irec Src index entry of the buffer.
+	 */
+	void Dispatch(twk1_two_block_t& blk, IndexEntryOutput& irec);
+
 public:
 	uint32_t n_samples;
 	uint32_t n_out, n_lim, n_out_tick;
@@ -313,6 +339,10 @@ public:
 	uint64_t n_method[10]; // Number of times a tgt function was used
 
 	uint64_t* mask_placeholder; // placeholder all-0 mask.
+	bool refining; // a sampled pair is being re-computed over all samples
+	bool refine_unphased; // the current pair is computed with unphased math
+	bool emit; // write pairs passing the filters to the output or only keep the last in `cur_rcd`
+	twk1_ldd_blk full_view[2]; // views of the records over all samples of the current pair
 
 	IndexEntryOutput irecF, irecR;
 	ZSTDCodec zcodec; // reusable zstd codec instance with internal context.
@@ -326,6 +356,7 @@ public:
 	IndexOutput* index;
 	twk_writer_t* writer;
 	twk_ld_progress* progress;
+	twk_compress_pipeline* pipeline; // output stage or nullptr to compress on the compute thread
 	uint32_t* list_out;
 };
 
@@ -370,6 +401,38 @@ struct twk_ld_slave {
 	 */
 	void UpdateBlocksGenerate(twk1_ldd_blk* blks, const uint32_t& from, const uint32_t& to);
 
+	/**<
+	 * Subroutine for retrieving a pair of twk1_ldd_blk from the shared cache
+	 * of inflated blocks. The previous pair is released back to the cache.
+	 * This subroutine is used exclusively when a memory limit is set.
+	 * @param blks Dst pointers to twk1_ldd_blks.
+	 * @param from Virtual offset for A.
+	 * @param to   Virtual offset for B.
+	 */
+	void UpdateBlocksCached(twk1_ldd_blk* blks, const uint32_t& from, const uint32_t& to);
+
+	/**<
+	 * Retrieve the next pair of blocks to compute. Pairs are drawn from the
+	 * streaming window source if set or from the load-balancer otherwise. A
+	 * pair drawn from the stream is returned to it on the next call.
+	 * @param blks Dst twk1_ldd_blk array of size 2.
+	 * @param type Dst block type: diagonal (1) or square (0).
+	 * @return     Returns TRUE if a pair was retrieved or FALSE otherwise.
+	 */
+	bool NextBlocks(twk1_ldd_blk* blks, uint8_t& type);
+
+	/**<
+	 * Draw the next pair of block offsets from the load-balancer. If the grid
+	 * is partitioned between NUMA nodes pairs are drawn from the partition of
+	 * the local node first and stolen from the other partitions once it is
+	 * exhausted.
+	 * @param from Dst row position.
+	 * @param to   Dst column position.
+	 * @param type Dst block type: diagonal (1) or square (0).
+	 * @return     Returns TRUE if a pair was retrieved or FALSE otherwise.
+	 */
+	bool NextPair(uint32_t& from, uint32_t& to, uint8_t& type);
+
 	/**<
 	 *
 	 * @param rcds0
@@ -390,6 +453,71 @@ struct twk_ld_slave {
 	              const uint8_t type,
 	              twk_ld_perf* perf = nullptr);
 
+	/**<
+	 * Computes LD over a pair of blocks by iterating over their frequency-sorted
+	 * permutations (TWK_LDD_SORT). For each anchor record the admissible
+	 * partners without missing data form a single contiguous range that is
+	 * computed with one kernel. Partners with missing data are sorted by allele
+	 * count and split once into the run-length and vectorized ranges. Records
+	 * are passed to the kernels with their original offsets such that output is
+	 * identical to the unsorted subroutines.
+	 * @param blocks Src pointer to the pair of twk1_ldd_blk.
+	 * @param type   Block type: 1 if the blocks are identical or 0 otherwise.
+	 * @param perf   Performance counters.
+	 */
+	void PhasedSorted(const twk1_ldd_blk* blocks, const uint8_t type, twk_ld_perf* perf = nullptr);
+	void UnphasedSorted(const twk1_ldd_blk* blocks, const uint8_t type, twk_ld_perf* perf = nullptr);
+
+	/**<
+	 * Computes the minor allele frequency of each record in the current pair of
+	 * blocks. These marginals bound the largest R2 any pair can attain such that
+	 * pairs that can never reach the minimum R2 threshold are skipped prior to
+	 * counting. Records with missing genotypes have a negative frequency and are
+	 * never pruned as their marginals are unknown until paired.
+	 * @param blocks Src pointer to the pair of twk1_ldd_blk.
+	 * @param type   Block type: 1 if the blocks are identical or 0 otherwise.
+	 * @return       Returns TRUE if pruning is enabled or FALSE otherwise.
+	 */
+	bool UpdateFrequencyBounds(const twk1_ldd_blk* blocks, const uint8_t type);
+
+	/**<
+	 * Computes the range [w_begin,w_end) of partners in the second block for
+	 * each record in the first block. In window mode the range covers the
+	 * partners on the same contig downstream within each of the window sizes
+	 * that are set (bases, variants, cM) and is resolved with a single sweep
+	 * over the sorted positions. Genetic positions are interpolated once per
+	 * record. Otherwise the range covers all partners.
+	 * @param blocks Src pointer to the pair of twk1_ldd_blk.
+	 * @param type   Block type: 1 if the blocks are identical or 0 otherwise.
+	 * @return       Returns the number of pairs within the ranges.
+	 */
+	uint64_t UpdateWindowBounds(const twk1_ldd_blk* blocks, const uint8_t type);
+
+	/**<
+	 * Computes the smallest and largest frequency of each tile of size `bsize` in
+	 * the second block such that entire tiles of partners can be skipped. A tile
+	 * with any missing record is never skipped.
+	 * @param n_rec Number of records in the second block.
+	 * @param bsize Tile size in records.
+	 */
+	void UpdateFrequencyTiles(const uint32_t n_rec, const uint32_t bsize);
+
+	/**<
+	 * Computes the interval of minor allele frequencies [lo,hi] a partner must
+	 * fall within to possibly reach the minimum R2 threshold with a variant of
+	 * minor allele frequency `a`. Follows from the upper bound
+	 * r2max = a(1-b) / (b(1-a)) for minor allele frequencies a <= b.
+	 * @param a  Minor allele frequency of the anchor variant.
+	 * @param lo Dst lower bound.
+	 * @param hi Dst upper bound.
+	 */
+	inline void FrequencyWindow(const double a, double& lo, double& hi) const{
+		if(a < 0){ lo = -1; hi = 2; return; }
+		const double t = settings->GetScreenR2() - TWK_ALLOWED_ROUNDING_ERROR;
+		lo = (t*a) / ((1 - a) + t*a);
+		hi = a / (a + t*(1 - a));
+	}
+
 	bool CalculatePhased(twk_ld_perf* perf = nullptr);
 	bool CalculateUnphased(twk_ld_perf* perf = nullptr);
 	bool CalculatePhasedBitmap(twk_ld_perf* perf = nullptr);
@@ -400,16 +528,42 @@ struct twk_ld_slave {
 	bool CalculatePerformance(twk_ld_engine::func f, twk_ld_perf* perf = nullptr);
 	bool CalculateSingle(twk_ld_perf* perf = nullptr);
 
+	/**<
+	 * Computes LD for the candidate pairs generated by locality-sensitive
+	 * hashing. Ranges of variants are drawn from the generator and the
+	 * partners of each variant are looked up in turn such that the pairs are
+	 * never materialized. Candidate pairs address variants by their global
+	 * identifiers in the pre-loaded blocks.
+	 * @param perf Performance counters.
+	 * @return     Returns TRUE upon success or FALSE otherwise.
+	 */
+	bool CalculateCandidates(twk_ld_perf* perf = nullptr);
+
 public:
 	uint32_t n_s, n_total;
 	uint32_t i_start, j_start, prev_i, prev_j, n_cycles;
 
 	twk_ld_dynamic_balancer* ticker;
+	twk_ld_window_stream* stream; // streaming window source or nullptr
+	twk_ld_window_pair wpair; // pair currently drawn from the stream
+	twk_ld_block_cache* cache; // cache of inflated blocks or nullptr
+	twk_ld_dynamic_balancer* local; // load-balancers of the per-node partitions or nullptr
+	uint32_t n_local, node; // number of partitions, partition of this slave
+	const twk_genetic_map* gmap; // genetic map for windows in cM or nullptr
+	const uint64_t* v_offsets; // ordinal of the first record in each pre-loaded block or nullptr
+	uint64_t w_off[2]; // ordinal of the first record in the current pair of blocks
 	std::thread* thread;
 	twk1_ldd_blk* ldd;
 	twk_ld_progress* progress;
 	twk_ld_settings* settings;
+	const twk_ld_sampler* sampler; // subsampler used in low-memory mode or nullptr
+	twk_ld_lsh* lsh; // candidate generator or nullptr
 	twk_ld_engine engine;
+	std::vector<double> maf[2]; // minor allele frequencies or -1 if missing
+	std::vector<double> tile_lo, tile_hi; // frequency range per tile of maf[1]
+	std::vector<uint32_t> w_begin, w_end; // range of partners for each record in the first block
+	std::vector<uint32_t> w_pos; // positions of the records in the second block
+	std::vector<double> w_cm[2]; // genetic positions of the records in the current pair of blocks
 };
 
 }
@@ -0,0 +1,315 @@
+#ifndef LIB_LD_LD_LSH_H_
+#define LIB_LD_LD_LSH_H_
+
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "ld/ld_structs.h"
+
+namespace tomahawk {
+
+#define TWK_LSH_MAX_BUCKET 1024 // largest bucket paired exhaustively
+#define TWK_LSH_CHUNK_SIZE 256 // number of variants handed out at a time
+
+/**<
+ * Candidate generation for pairs of variants in high linkage-disequilibrium
+ * using locality-sensitive hashing. Each variant is sketched by the signs of
+ * random projections (SimHash) of its mean-centered haplotype bitvector: two
+ * sketch bits agree with probability 1 - acos(R)/pi where R is the Pearson
+ * correlation of the haplotypes. Sketches are split into bands of `n_bits`
+ * bits and any two variants sharing a band are reported as a candidate pair.
+ * Bands are canonicalized under complementation such that negatively
+ * correlated variants collide as well. Every band keeps the variants ordered
+ * by key such that the partners of a variant can be looked up without ever
+ * materializing the set of pairs.
+ */
+struct twk_ld_lsh {
+public:
+	twk_ld_lsh() : n_bits(0), n_bands(0), n_groups(0), n_hap(0), n_variants(0), n_valid(0), max_bucket(TWK_LSH_MAX_BUCKET), n_candidates(0), n_split(0), seed(0), next(0){}
+
+	/**<
+	 * Chooses the band width and the number of bands. The band width grows
+	 * as log2 of the number of variants such that the expected number of
+	 * random collisions per band stays linear; band keys are 32-bit. The
+	 * number of bands is then chosen such that a pair at the R2 threshold is
+	 * reported with probability `recall`.
+	 * @param minR2      Minimum R2 threshold.
+	 * @param n_total    Total number of variants.
+	 * @param recall     Desired probability of reporting a pair at the threshold.
+	 * @return           Returns the expected recall at the threshold.
+	 */
+	double SetParameters(const double minR2, const uint64_t n_total, const double recall = 0.99){
+		n_bits = std::min(32, std::max(8, (int)ceil(log2((double)std::max<uint64_t>(n_total, 2))) + 1));
+		const double p   = this->GetCollisionProbability(minR2);
+		const double p_b = pow(p, n_bits);
+		if(p_b >= 1) n_bands = 1;
+		else n_bands = std::min(64, std::max(1, (int)ceil(log(1 - recall) / log(1 - p_b))));
+		n_groups = (n_bits * n_bands + 63) / 64;
+		return(1 - pow(1 - p_b, n_bands));
+	}
+
+	/**<
+	 * Probability that a single sketch bit agrees for a pair of variants
+	 * with the given R2.
+	 * @param r2 Squared correlation.
+	 * @return   Returns the collision probability.
+	 */
+	static double GetCollisionProbability(const double r2){
+		return(1 - acos(sqrt(std::min(std::max(r2, 0.0), 1.0))) / M_PI);
+	}
+
+	/**<
+	 * Computes the sketches of all variants in the provided blocks. Variants
+	 * are addressed by a global identifier given by their block order. The
+	 * bitvectors (TWK_LDD_VEC) have to be constructed.
+	 * @param ldd       Src array of twk1_ldd_blk.
+	 * @param n_blks    Number of blocks.
+	 * @param n_samples Number of samples.
+	 * @param n_threads Number of threads.
+	 * @return          Returns TRUE upon success or FALSE otherwise.
+	 */
+	bool Build(const twk1_ldd_blk* ldd, const uint32_t n_blks, const uint32_t n_samples, const uint32_t n_threads){
+		if(n_groups == 0) return false;
+
+		n_hap = 2*n_samples;
+		offsets.resize(n_blks + 1);
+		offsets[0] = 0;
+		for(uint32_t i = 0; i < n_blks; ++i) offsets[i+1] = offsets[i] + ldd[i].n_rec;
+		n_variants = offsets[n_blks];
+
+		// Sum of the projection weights over all haplotypes used for centering.
+		totals.resize(n_groups*64, 0);
+		for(uint32_t k = 0; k < n_hap; ++k){
+			for(uint32_t g = 0; g < n_groups; ++g){
+				const uint64_t w = this->Hash(g, k);
+				for(uint32_t b = 0; b < 64; ++b) totals[g*64+b] += ((w >> b) & 1) ? 1 : -1;
+			}
+		}
+
+		sketches.resize(n_variants * n_groups, 0);
+		valid.resize(n_variants, 0);
+
+		std::vector<std::thread*> threads(n_threads);
+		for(uint32_t i = 0; i < n_threads; ++i)
+			threads[i] = new std::thread(&twk_ld_lsh::SketchRange, this, ldd, i, n_threads);
+		for(uint32_t i = 0; i < n_threads; ++i){ threads[i]->join(); delete threads[i]; }
+
+		// Order the polymorphic variants of every band by their band keys.
+		n_valid = 0;
+		for(uint64_t id = 0; id < n_variants; ++id) n_valid += valid[id];
+		order.resize((uint64_t)n_bands * n_valid);
+		std::vector<uint64_t> n_pairs(n_threads, 0), n_splits(n_threads, 0);
+		for(uint32_t i = 0; i < n_threads; ++i)
+			threads[i] = new std::thread(&twk_ld_lsh::IndexBands, this, std::ref(n_pairs[i]), std::ref(n_splits[i]), i, n_threads);
+		for(uint32_t i = 0; i < n_threads; ++i){ threads[i]->join(); delete threads[i]; }
+
+		n_candidates = 0; n_split = 0;
+		for(uint32_t i = 0; i < n_threads; ++i){ n_candidates += n_pairs[i]; n_split += n_splits[i]; }
+		next = 0;
+
+		return true;
+	}
+
+	/**<
+	 * Retrieves the next range of global identifiers whose candidate pairs
+	 * have not been computed. Ranges are handed out dynamically such that
+	 * threads can be load-balanced.
+	 * @param from Dst first global identifier.
+	 * @param to   Dst global identifier past the end.
+	 * @return     Returns TRUE if a range is available or FALSE otherwise.
+	 */
+	bool Next(uint32_t& from, uint32_t& to){
+		const uint64_t f = next.fetch_add(TWK_LSH_CHUNK_SIZE);
+		if(f >= n_variants) return false;
+		from = f;
+		to   = std::min<uint64_t>(f + TWK_LSH_CHUNK_SIZE, n_variants);
+		return true;
+	}
+
+	/**<
+	 * Collects the partners B > A of a variant A colliding with it in at
+	 * least one band. Buckets with more than `max_bucket` variants are split
+	 * by the key of the following band and, if still too large, restricted
+	 * to the `max_bucket` neighbours of A in key order. Every pair is thus
+	 * reported exactly once, from the side of its smaller identifier.
+	 * @param a    Global identifier of A.
+	 * @param out  Dst sorted vector of global identifiers without duplicates.
+	 */
+	void Partners(const uint32_t a, std::vector<uint32_t>& out) const{
+		out.clear();
+		if(valid[a] == 0) return;
+
+		for(uint32_t band = 0; band < n_bands; ++band){
+			const uint32_t* ids = &order[(uint64_t)band * n_valid];
+			const uint64_t key = this->GetKey(a, band);
+			uint64_t lo = this->Bound(ids, band, key >> 32, 32);
+			uint64_t hi = this->Bound(ids, band, (key >> 32) + 1, 32);
+			if(hi - lo > max_bucket){
+				lo = this->Bound(ids, band, key, 0);
+				hi = this->Bound(ids, band, key + 1, 0);
+			}
+			if(hi - lo > max_bucket){
+				const uint64_t p = std::lower_bound(ids + lo, ids + hi, a) - ids;
+				lo = std::max<uint64_t>(lo, p >= max_bucket / 2 ? p - max_bucket / 2 : 0);
+				hi = std::min<uint64_t>(hi, lo + max_bucket);
+			}
+			for(uint64_t i = lo; i < hi; ++i){
+				if(ids[i] > a) out.push_back(ids[i]);
+			}
+		}
+		std::sort(out.begin(), out.end());
+		out.erase(std::unique(out.begin(), out.end()), out.end());
+	}
+
+	/**<
+	 * Maps a global variant identifier to its block and offset.
+	 * @param id  Global identifier.
+	 * @param blk Dst block offset.
+	 * @param pos Dst record offset in the block.
+	 */
+	inline void Locate(const uint32_t id, uint32_t& blk, uint32_t& pos) const{
+		blk = std::upper_bound(offsets.begin(), offsets.end(), id) - offsets.begin() - 1;
+		pos = id - offsets[blk];
+	}
+
+private:
+	// SplitMix64 finalizer of the (group, haplotype)-tuple providing 64
+	// pseudo-random +1/-1 projection weights.
+	inline uint64_t Hash(const uint32_t g, const uint32_t k) const{
+		uint64_t z = seed + ((((uint64_t)g << 32) | k) + 1) * 0x9E3779B97F4A7C15ULL;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		return(z ^ (z >> 31));
+	}
+
+	inline uint64_t GetBand(const uint32_t id, const uint32_t band) const{
+		const uint64_t* s = &sketches[(uint64_t)id * n_groups];
+		const uint32_t from = band * n_bits;
+		const uint32_t w = from >> 6, o = from & 63;
+		uint64_t v = s[w] >> o;
+		if(o + n_bits > 64) v |= s[w+1] << (64 - o);
+		const uint64_t mask = (1ULL << n_bits) - 1;
+		v &= mask;
+		return(std::min(v, ~v & mask));
+	}
+
+	// Sort key of a variant in a band: its band key followed by the key of
+	// the next band used to split oversized buckets.
+	inline uint64_t GetKey(const uint32_t id, const uint32_t band) const{
+		return(((uint64_t)this->GetBand(id, band) << 32) | this->GetBand(id, band + 1 == (uint32_t)n_bands ? 0 : band + 1));
+	}
+
+	// First offset in the ordered band with (key >> shift) >= value.
+	inline uint64_t Bound(const uint32_t* ids, const uint32_t band, const uint64_t value, const uint32_t shift) const{
+		uint64_t lo = 0, hi = n_valid;
+		while(lo < hi){
+			const uint64_t mid = (lo + hi) / 2;
+			if((this->GetKey(ids[mid], band) >> shift) < value) lo = mid + 1;
+			else hi = mid;
+		}
+		return(lo);
+	}
+
+	/**<
+	 * Sketches the variants with a global identifier congruent to `t` modulo
+	 * `n_threads`. Only the positions of the minor bit are visited: for a
+	 * bitvector with mostly set bits the projection of the set bits follows
+	 * from the totals. Monomorphic variants are never reported.
+	 */
+	void SketchRange(const twk1_ldd_blk* ldd, const uint32_t t, const uint32_t n_threads){
+		std::vector<int32_t> acc(n_groups*64);
+		const uint32_t n_words = (n_hap + 63) / 64;
+		const uint64_t tail = (n_hap & 63) ? ((1ULL << (n_hap & 63)) - 1) : ~0ULL;
+
+		for(uint32_t b = 0; b + 1 < offsets.size(); ++b){
+			for(uint32_t id = offsets[b] + ((t + n_threads - offsets[b] % n_threads) % n_threads); id < offsets[b+1]; id += n_threads){
+				const uint64_t* data = ldd[b].vec[id - offsets[b]].data;
+
+				uint64_t n_ones = 0;
+				for(uint32_t w = 0; w < n_words; ++w) n_ones += __builtin_popcountll(data[w] & (w + 1 == n_words ? tail : ~0ULL));
+				if(n_ones == 0 || n_ones == n_hap) continue;
+				valid[id] = 1;
+
+				const bool invert = 2*n_ones > n_hap;
+				std::fill(acc.begin(), acc.end(), 0);
+				for(uint32_t w = 0; w < n_words; ++w){
+					uint64_t word = (invert ? ~data[w] : data[w]) & (w + 1 == n_words ? tail : ~0ULL);
+					while(word){
+						const uint32_t k = (w << 6) + __builtin_ctzll(word);
+						word &= word - 1;
+						for(uint32_t g = 0; g < n_groups; ++g){
+							const uint64_t h = this->Hash(g, k);
+							int32_t* a = &acc[g*64];
+							for(uint32_t j = 0; j < 64; ++j) a[j] += ((h >> j) & 1) ? 1 : -1;
+						}
+					}
+				}
+
+				// Sign of the projection of the centered vector: sum_{set} w - (n_ones/n_hap) * sum w.
+				uint64_t* s = &sketches[(uint64_t)id * n_groups];
+				for(uint32_t h = 0; h < n_groups*64; ++h){
+					const int64_t proj = invert ? totals[h] - acc[h] : acc[h];
+					if((int64_t)n_hap * proj > (int64_t)n_ones * totals[h]) s[h >> 6] |= 1ULL << (h & 63);
+				}
+			}
+		}
+	}
+
+	/**<
+	 * Orders the polymorphic variants of the bands congruent to `t` modulo
+	 * `n_threads` by their sort keys and estimates the number of candidate pairs
+	 * together with the number of oversized buckets.
+	 */
+	void IndexBands(uint64_t& n_pairs, uint64_t& n_splits, const uint32_t t, const uint32_t n_threads){
+		std::vector< std::pair<uint64_t, uint32_t> > keys;
+		keys.reserve(n_valid);
+		for(uint32_t band = t; band < n_bands; band += n_threads){
+			keys.clear();
+			for(uint32_t id = 0; id < n_variants; ++id){
+				if(valid[id]) keys.push_back(std::pair<uint64_t, uint32_t>(this->GetKey(id, band), id));
+			}
+			std::sort(keys.begin(), keys.end());
+
+			uint32_t* ids = &order[(uint64_t)band * n_valid];
+			for(uint64_t i = 0; i < keys.size(); ++i) ids[i] = keys[i].second;
+
+			for(uint64_t i = 0; i < keys.size(); ){
+				uint64_t j = i + 1;
+				while(j < keys.size() && (keys[j].first >> 32) == (keys[i].first >> 32)) ++j;
+				if(j - i <= max_bucket) n_pairs += (j - i) * (j - i - 1) / 2;
+				else {
+					++n_splits;
+					for(uint64_t k = i; k < j; ){
+						uint64_t l = k + 1;
+						while(l < j && keys[l].first == keys[k].first) ++l;
+						n_pairs += (l - k) * (std::min<uint64_t>(l - k, max_bucket) - 1) / 2;
+						k = l;
+					}
+				}
+				i = j;
+			}
+		}
+	}
+
+public:
+	int32_t  n_bits, n_bands, n_groups; // bits per band, number of bands, number of 64-bit sketch words
+	uint32_t n_hap; // number of haplotypes (2*samples)
+	uint64_t n_variants, n_valid; // number of variants, number of polymorphic variants
+	uint64_t max_bucket; // largest bucket paired exhaustively
+	uint64_t n_candidates, n_split; // estimated number of candidate pairs, number of oversized buckets
+	uint64_t seed;
+	std::atomic<uint64_t> next; // next global identifier to hand out
+	std::vector<uint32_t> offsets; // global identifier of the first variant in each block
+	std::vector<int32_t>  totals; // sum of weights over all haplotypes for each projection
+	std::vector<uint64_t> sketches; // n_groups words per variant
+	std::vector<uint8_t>  valid; // variant is polymorphic
+	std::vector<uint32_t> order; // n_valid global identifiers per band ordered by sort key
+};
+
+}
+
+#endif /* LIB_LD_LD_LSH_H_ */
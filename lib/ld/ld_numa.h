@@ -0,0 +1,121 @@
+#ifndef LIB_LD_LD_NUMA_H_
+#define LIB_LD_LD_NUMA_H_
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+namespace tomahawk {
+
+/**<
+ * NUMA topology of the cores available to this process. Nodes and their cores
+ * are read from sysfs without depending on libnuma. Threads are placed on a
+ * node by setting the affinity of the spawning thread: spawned threads
+ * inherit it such that memory they first touch is allocated on that node.
+ * On systems without NUMA information all cores form a single node.
+ */
+struct twk_numa_topology {
+public:
+	twk_numa_topology() : detected(false){}
+
+	/**<
+	 * Read the topology of the system restricted to the cores this process
+	 * may run on.
+	 * @return Returns TRUE if more than one node is available or FALSE otherwise.
+	 */
+	bool Detect(){
+		nodes.clear();
+#if defined(__linux__)
+		CPU_ZERO(&allowed);
+		if(sched_getaffinity(0, sizeof(cpu_set_t), &allowed) != 0) return false;
+		detected = true;
+
+		// Node ids may have gaps, for example offline or hot-plugged nodes:
+		// visit the online nodes rather than probing consecutive ids.
+		std::ifstream fo("/sys/devices/system/node/online");
+		if(fo.good() == false) return false;
+		std::string online;
+		std::getline(fo, online);
+		std::vector<int> ids;
+		ParseList(online, ids);
+
+		for(uint32_t n = 0; n < ids.size(); ++n){
+			std::ifstream f("/sys/devices/system/node/node" + std::to_string(ids[n]) + "/cpulist");
+			if(f.good() == false) continue;
+			std::string line;
+			std::getline(f, line);
+
+			std::vector<int> cpus;
+			ParseList(line, cpus);
+			std::vector<int> usable;
+			for(uint32_t i = 0; i < cpus.size(); ++i){
+				if(cpus[i] < CPU_SETSIZE && CPU_ISSET(cpus[i], &allowed)) usable.push_back(cpus[i]);
+			}
+			if(usable.size()) nodes.push_back(usable);
+		}
+#endif
+		return(nodes.size() > 1);
+	}
+
+	inline uint32_t size() const{ return(nodes.size()); }
+
+	/**<
+	 * Restrict the calling thread to the cores of a node. Threads spawned
+	 * afterwards inherit the restriction.
+	 * @param node Node offset.
+	 * @return     Returns TRUE upon success or FALSE otherwise.
+	 */
+	bool Bind(const uint32_t node) const{
+#if defined(__linux__)
+		if(node >= nodes.size()) return false;
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for(uint32_t i = 0; i < nodes[node].size(); ++i) CPU_SET(nodes[node][i], &set);
+		return(sched_setaffinity(0, sizeof(cpu_set_t), &set) == 0);
+#else
+		return false;
+#endif
+	}
+
+	/**<
+	 * Restore the affinity of the calling thread to the cores available
+	 * when the topology was detected.
+	 */
+	void Unbind() const{
+#if defined(__linux__)
+		if(detected) sched_setaffinity(0, sizeof(cpu_set_t), &allowed);
+#endif
+	}
+
+private:
+	// Parse a sysfs cpu list such as "0-3,8-11".
+	static void ParseList(const std::string& s, std::vector<int>& out){
+		std::stringstream ss(s);
+		std::string tok;
+		while(std::getline(ss, tok, ',')){
+			if(tok.size() == 0) continue;
+			const size_t d = tok.find('-');
+			const int a = atoi(tok.substr(0, d).c_str());
+			const int b = (d == std::string::npos ? a : atoi(tok.substr(d + 1).c_str()));
+			for(int c = a; c <= b; ++c) out.push_back(c);
+		}
+	}
+
+public:
+	bool detected;
+	std::vector< std::vector<int> > nodes; // usable cores of each node
+#if defined(__linux__)
+	cpu_set_t allowed; // cores available to the process
+#endif
+};
+
+}
+
+#endif /* LIB_LD_LD_NUMA_H_ */
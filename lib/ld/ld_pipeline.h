@@ -0,0 +1,203 @@
+#ifndef LIB_LD_LD_PIPELINE_H_
+#define LIB_LD_LD_PIPELINE_H_
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+
+#include "core.h"
+#include "index.h"
+#include "writer.h"
+#include "zstd_codec.h"
+#include "ld/ld_progress.h"
+
+namespace tomahawk {
+
+/**<
+ * Unit of work passed through the output pipeline: a filled block of output
+ * records together with its index entry and the buffers used to serialize
+ * and compress it. Jobs are recycled such that neither records nor buffers
+ * are reallocated in the steady state.
+ */
+struct twk_compress_job {
+	twk_compress_job(const uint32_t n_lim) : blk(n_lim + 100){}
+
+	twk1_two_block_t blk;
+	IndexEntryOutput irec;
+	twk_buffer_t ibuf, obuf;
+};
+
+/**<
+ * Output stage for computing linkage-disequilibrium. Compute threads hand off
+ * filled output blocks instead of compressing them: blocks are queued to a
+ * pool of compressor threads and the compressed blocks to a single writer
+ * thread that appends them to the output and updates the index. The number
+ * of jobs in flight is bounded by a fixed set of recycled jobs: a compute
+ * thread blocks in Acquire() until a job has been written.
+ */
+struct twk_compress_pipeline {
+public:
+	twk_compress_pipeline() :
+		c_level(1), writer(nullptr), index(nullptr), progress(nullptr),
+		compressing(false), writing(false), n_active(0), wthread(nullptr)
+	{}
+
+	~twk_compress_pipeline(){
+		this->Stop();
+		for(int i = 0; i < jobs.size(); ++i) delete jobs[i];
+	}
+
+	/**<
+	 * Allocate jobs and spawn the compressor and writer threads.
+	 * @param n_compressors Number of compressor threads.
+	 * @param n_jobs        Number of recycled jobs in flight.
+	 * @param n_lim         Number of records in an output block.
+	 * @return              Returns TRUE upon success or FALSE otherwise.
+	 */
+	bool Start(const uint32_t n_compressors, const uint32_t n_jobs, const uint32_t n_lim){
+		if(n_compressors == 0 || n_jobs == 0 || writer == nullptr || index == nullptr)
+			return false;
+
+		for(uint32_t i = 0; i < n_jobs; ++i){
+			jobs.push_back(new twk_compress_job(n_lim));
+			free_jobs.push_back(jobs.back());
+		}
+
+		compressing = true; writing = true; n_active = n_compressors;
+		for(uint32_t i = 0; i < n_compressors; ++i)
+			cthreads.push_back(new std::thread(&twk_compress_pipeline::Compress, this));
+		wthread = new std::thread(&twk_compress_pipeline::Write, this);
+		return true;
+	}
+
+	/**<
+	 * Retrieve an empty job. Blocks until a job is available.
+	 * @return Returns a pointer to an empty job.
+	 */
+	twk_compress_job* Acquire(){
+		std::unique_lock<std::mutex> lock(free_mutex);
+		free_cv.wait(lock, [this]{ return(free_jobs.size() != 0); });
+		twk_compress_job* job = free_jobs.front();
+		free_jobs.pop_front();
+		return(job);
+	}
+
+	/**<
+	 * Queue a filled job for compression.
+	 * @param job Src pointer to a job retrieved with Acquire().
+	 */
+	void Submit(twk_compress_job* job){
+		{
+			std::lock_guard<std::mutex> lock(compress_mutex);
+			compress_jobs.push_back(job);
+		}
+		compress_cv.notify_one();
+	}
+
+	/**<
+	 * Drain all queued jobs and join the threads. Must be called after the
+	 * compute threads have finished and before writing the final index.
+	 */
+	void Stop(){
+		if(wthread == nullptr) return;
+
+		{
+			std::lock_guard<std::mutex> lock(compress_mutex);
+			compressing = false;
+		}
+		compress_cv.notify_all();
+		for(int i = 0; i < cthreads.size(); ++i){ cthreads[i]->join(); delete cthreads[i]; }
+		cthreads.clear();
+
+		wthread->join();
+		delete wthread; wthread = nullptr;
+	}
+
+private:
+	void Compress(){
+		ZSTDCodec zcodec;
+		while(true){
+			twk_compress_job* job = nullptr;
+			{
+				std::unique_lock<std::mutex> lock(compress_mutex);
+				compress_cv.wait(lock, [this]{ return(compress_jobs.size() != 0 || compressing == false); });
+				if(compress_jobs.size() == 0) break;
+				job = compress_jobs.front();
+				compress_jobs.pop_front();
+			}
+
+			job->ibuf << job->blk;
+			if(zcodec.Compress(job->ibuf, job->obuf, c_level) == false){
+				std::cerr << utility::timestamp("ERROR","COMPRESSION") << "Failed compression..." << std::endl;
+				job->obuf.reset();
+			}
+			if(progress != nullptr) progress->b_out += job->ibuf.size();
+
+			{
+				std::lock_guard<std::mutex> lock(write_mutex);
+				write_jobs.push_back(job);
+			}
+			write_cv.notify_one();
+		}
+
+		// The last compressor to finish signals the writer.
+		{
+			std::lock_guard<std::mutex> lock(write_mutex);
+			if(--n_active == 0) writing = false;
+		}
+		write_cv.notify_one();
+	}
+
+	void Write(){
+		while(true){
+			twk_compress_job* job = nullptr;
+			{
+				std::unique_lock<std::mutex> lock(write_mutex);
+				write_cv.wait(lock, [this]{ return(write_jobs.size() != 0 || writing == false); });
+				if(write_jobs.size() == 0) break;
+				job = write_jobs.front();
+				write_jobs.pop_front();
+			}
+
+			if(job->obuf.size()){
+				job->irec.b_cmp = job->obuf.size(); // keep here because writer resets obuf.
+				writer->Add(job->ibuf.size(), job->obuf.size(), job->obuf, job->irec);
+				job->irec.n = job->blk.n;
+				job->irec.b_unc = twk1_two_t::packed_size * job->irec.n + 2*sizeof(uint32_t);
+				index->AddThreadSafe(job->irec);
+			}
+
+			job->ibuf.reset();
+			job->obuf.reset();
+			job->blk.reset();
+			job->irec.clear();
+			{
+				std::lock_guard<std::mutex> lock(free_mutex);
+				free_jobs.push_back(job);
+			}
+			free_cv.notify_one();
+		}
+	}
+
+public:
+	int32_t c_level;
+	twk_writer_t* writer;
+	IndexOutput* index;
+	twk_ld_progress* progress;
+
+private:
+	bool compressing, writing;
+	uint32_t n_active; // number of running compressor threads
+	std::vector<twk_compress_job*> jobs; // all allocated jobs
+	std::deque<twk_compress_job*> free_jobs, compress_jobs, write_jobs;
+	std::mutex free_mutex, compress_mutex, write_mutex;
+	std::condition_variable free_cv, compress_cv, write_cv;
+	std::vector<std::thread*> cthreads;
+	std::thread* wthread;
+};
+
+}
+
+#endif /* LIB_LD_LD_PIPELINE_H_ */
@@ -0,0 +1,230 @@
+#ifndef LIB_LD_LD_SIDECAR_H_
+#define LIB_LD_LD_SIDECAR_H_
+
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "core.h"
+#include "twk_reader.h"
+#include "ld/ld_structs.h"
+
+namespace tomahawk {
+
+// Magic string and alignment of the per-block data in bitvector sidecars.
+#define TWK_BV_MAGIC "TWK-BV\x01\x00"
+#define TWK_BV_MAGIC_LENGTH 8
+#define TWK_BV_ALIGNMENT 64
+
+/**<
+ * Fixed-size header of a bitvector sidecar. The source file is identified by
+ * its size and modification time such that stale sidecars are rebuilt.
+ */
+struct twk_ld_sidecar_header {
+	char     magic[TWK_BV_MAGIC_LENGTH];
+	uint32_t n_samples, stride; // number of samples, words between bitvectors
+	uint64_t n_blocks;
+	uint64_t b_source, t_source; // size and modification time of the source file
+};
+
+/**<
+ * Persistent sidecar (`<in>.bv`) holding the bitvectors (TWK_LDD_VEC) of every
+ * block of a twk file in the layout of the slab built by
+ * `twk1_ldd_blk::BuildVectors`. The file is written once and memory-mapped
+ * read-only on subsequent runs: blocks then point their bitvectors directly
+ * into the mapping instead of constructing them, and the pages are shared
+ * through the page cache by concurrent jobs on the same input.
+ *
+ * Layout: header, one 64-bit offset per block, and for each block at its
+ * aligned offset the number of records, the leading and trailing zero counts
+ * of each record, and the aligned slab words.
+ */
+struct twk_ld_sidecar {
+public:
+	twk_ld_sidecar() : b_map(0), map(nullptr), hdr(nullptr), offsets(nullptr){}
+	~twk_ld_sidecar(){ this->Close(); }
+
+	static std::string GetPath(const std::string& in){ return(in + ".bv"); }
+
+	inline bool IsOpen() const{ return(map != nullptr); }
+
+	/**<
+	 * Map an existing sidecar. Fails without messages if the sidecar does not
+	 * exist or was built from a different file or build configuration.
+	 * @param path   Src sidecar path.
+	 * @param in     Src path of the twk file.
+	 * @param reader Src reader of the twk file.
+	 * @return       Returns TRUE upon success or FALSE otherwise.
+	 */
+	bool Open(const std::string& path, const std::string& in, const twk_reader& reader){
+		this->Close();
+
+		twk_ld_sidecar_header expected;
+		if(this->GetHeader(in, reader, expected) == false) return false;
+
+		const int fd = open(path.c_str(), O_RDONLY);
+		if(fd < 0) return false;
+		struct stat st;
+		if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(twk_ld_sidecar_header)){ close(fd); return false; }
+
+		void* m = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if(m == MAP_FAILED) return false;
+
+		map = reinterpret_cast<const char*>(m);
+		b_map = st.st_size;
+		hdr = reinterpret_cast<const twk_ld_sidecar_header*>(map);
+		offsets = reinterpret_cast<const uint64_t*>(map + sizeof(twk_ld_sidecar_header));
+
+		if(memcmp(hdr, &expected, sizeof(twk_ld_sidecar_header)) != 0 ||
+		   sizeof(twk_ld_sidecar_header) + hdr->n_blocks*sizeof(uint64_t) > b_map)
+		{
+			this->Close();
+			return false;
+		}
+		return true;
+	}
+
+	void Close(){
+		if(map != nullptr) munmap(const_cast<char*>(map), b_map);
+		map = nullptr; b_map = 0; hdr = nullptr; offsets = nullptr;
+	}
+
+	/**<
+	 * Point the bitvectors of a block into the mapping.
+	 * @param id        Block offset in the twk file.
+	 * @param ldd       Dst block holding the records of the block.
+	 * @param n_samples Number of samples.
+	 * @return          Returns TRUE upon success or FALSE otherwise.
+	 */
+	bool Map(const uint32_t id, twk1_ldd_blk& ldd, const uint32_t n_samples) const{
+		if(map == nullptr || id >= hdr->n_blocks) return false;
+		const uint64_t off = offsets[id];
+		if(off + sizeof(uint64_t) > b_map) return false;
+
+		const uint64_t n_rec = *reinterpret_cast<const uint64_t*>(map + off);
+		if(n_rec != ldd.blk->n) return false;
+
+		uint64_t n_words = 0;
+		for(uint64_t i = 0; i < n_rec; ++i) n_words += (uint64_t)hdr->stride * (1 + ldd.blk->rcds[i].gt_missing);
+		const uint64_t w_off = Align(off + sizeof(uint64_t) + 2*sizeof(uint16_t)*n_rec);
+		if(w_off + n_words*sizeof(uint64_t) > b_map) return false;
+
+		ldd.MapVectors(const_cast<uint64_t*>(reinterpret_cast<const uint64_t*>(map + w_off)),
+		               reinterpret_cast<const uint16_t*>(map + off + sizeof(uint64_t)),
+		               n_samples);
+		return true;
+	}
+
+	/**<
+	 * Build the sidecar of a twk file. The sidecar is written to a temporary
+	 * file that is renamed once complete such that concurrent jobs never map
+	 * a partial sidecar.
+	 * @param path   Dst sidecar path.
+	 * @param in     Src path of the twk file.
+	 * @param reader Src reader of the twk file.
+	 * @return       Returns TRUE upon success or FALSE otherwise.
+	 */
+	static bool Build(const std::string& path, const std::string& in, const twk_reader& reader){
+		twk_ld_sidecar_header h;
+		if(GetHeader(in, reader, h) == false) return false;
+
+		const std::string tmp = path + ".tmp." + std::to_string(getpid());
+		std::ofstream out(tmp, std::ios::binary | std::ios::out);
+		if(out.good() == false){
+			std::cerr << utility::timestamp("WARNING","SIDECAR") << "Failed to open \"" << tmp << "\"!" << std::endl;
+			return false;
+		}
+
+		twk1_blk_iterator bit;
+		bit.stream = new std::ifstream(in, std::ios::binary | std::ios::in);
+		if(reader.index.n) bit.stream->seekg(reader.index.ent[0].foff);
+		if(bit.stream->good() == false){
+			std::cerr << utility::timestamp("WARNING","SIDECAR") << "Failed to open \"" << in << "\"!" << std::endl;
+			delete bit.stream; bit.stream = nullptr;
+			remove(tmp.c_str());
+			return false;
+		}
+
+		std::vector<uint64_t> offs(h.n_blocks, 0);
+		out.write(reinterpret_cast<const char*>(&h), sizeof(twk_ld_sidecar_header));
+		out.write(reinterpret_cast<const char*>(offs.data()), offs.size()*sizeof(uint64_t));
+
+		const char pad[TWK_BV_ALIGNMENT] = {0};
+		uint64_t pos = sizeof(twk_ld_sidecar_header) + offs.size()*sizeof(uint64_t);
+		std::vector<uint16_t> zeros;
+		for(uint32_t b = 0; b < h.n_blocks; ++b){
+			if(bit.NextBlock() == false){
+				std::cerr << utility::timestamp("WARNING","SIDECAR") << "Failed to load block " << b << "!" << std::endl;
+				delete bit.stream; bit.stream = nullptr;
+				remove(tmp.c_str());
+				return false;
+			}
+
+			twk1_ldd_blk ldd;
+			ldd.SetOwn(bit.blk, h.n_samples);
+			ldd.Inflate(h.n_samples, TWK_LDD_VEC, true, nullptr);
+
+			out.write(pad, Align(pos) - pos); pos = Align(pos);
+			offs[b] = pos;
+
+			const uint64_t n_rec = ldd.n_rec;
+			zeros.resize(2*n_rec);
+			uint64_t n_words = 0;
+			for(uint32_t i = 0; i < n_rec; ++i){
+				zeros[2*i+0] = ldd.vec[i].front_zero;
+				zeros[2*i+1] = ldd.vec[i].tail_zero;
+				n_words += (uint64_t)h.stride * (1 + ldd.blk->rcds[i].gt_missing);
+			}
+			out.write(reinterpret_cast<const char*>(&n_rec), sizeof(uint64_t));
+			out.write(reinterpret_cast<const char*>(zeros.data()), zeros.size()*sizeof(uint16_t));
+			pos += sizeof(uint64_t) + zeros.size()*sizeof(uint16_t);
+			out.write(pad, Align(pos) - pos); pos = Align(pos);
+			out.write(reinterpret_cast<const char*>(ldd.slab), n_words*sizeof(uint64_t));
+			pos += n_words*sizeof(uint64_t);
+		}
+		delete bit.stream; bit.stream = nullptr;
+
+		out.seekp(sizeof(twk_ld_sidecar_header));
+		out.write(reinterpret_cast<const char*>(offs.data()), offs.size()*sizeof(uint64_t));
+		out.close();
+		if(out.fail() || rename(tmp.c_str(), path.c_str()) != 0){
+			std::cerr << utility::timestamp("WARNING","SIDECAR") << "Failed to write \"" << path << "\"!" << std::endl;
+			remove(tmp.c_str());
+			return false;
+		}
+		return true;
+	}
+
+private:
+	static inline uint64_t Align(const uint64_t x){ return((x + TWK_BV_ALIGNMENT - 1) / TWK_BV_ALIGNMENT * TWK_BV_ALIGNMENT); }
+
+	static bool GetHeader(const std::string& in, const twk_reader& reader, twk_ld_sidecar_header& h){
+		struct stat st;
+		if(stat(in.c_str(), &st) != 0) return false;
+		memset(&h, 0, sizeof(twk_ld_sidecar_header));
+		memcpy(h.magic, TWK_BV_MAGIC, TWK_BV_MAGIC_LENGTH);
+		h.n_samples = reader.hdr.GetNumberSamples();
+		h.stride    = twk_igt_vec::GetStride(h.n_samples);
+		h.n_blocks  = reader.index.n;
+		h.b_source  = st.st_size;
+		h.t_source  = st.st_mtime;
+		return true;
+	}
+
+public:
+	uint64_t b_map; // size of the mapping
+	const char* map;
+	const twk_ld_sidecar_header* hdr;
+	const uint64_t* offsets; // offset of each block
+};
+
+}
+
+#endif /* LIB_LD_LD_SIDECAR_H_ */
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <random>
+
 #include "twk_reader.h"
 #include "ld_structs.h"
 
@@ -6,27 +9,31 @@ namespace tomahawk {
 /****************************
 *  twk1_ldd_blk
 ****************************/
-twk1_ldd_blk::twk1_ldd_blk() : owns_block(false), unphased(true), n_rec(0), m_vec(0), m_list(0), m_bitmap(0), blk(nullptr), vec(nullptr), list(nullptr), bitmap(nullptr){}
+twk1_ldd_blk::twk1_ldd_blk() : owns_block(false), unphased(true), mapped(false), n_rec(0), m_vec(0), m_list(0), m_bitmap(0), blk(nullptr), vec(nullptr), slab(nullptr), m_slab(0), list(nullptr), bitmap(nullptr), n_nomiss(0), full(nullptr), sblk(nullptr){}
 twk1_ldd_blk::twk1_ldd_blk(twk1_blk_iterator& it, const uint32_t n_samples) :
-	owns_block(false), unphased(true),
+	owns_block(false), unphased(true), mapped(false),
 	n_rec(it.blk.n),
 	m_vec(0), m_list(0), m_bitmap(0),
 	blk(&it.blk),
 	vec(new twk_igt_vec[it.blk.n]),
+	slab(nullptr), m_slab(0),
 	list(new twk_igt_list[it.blk.n]),
-	bitmap(nullptr)
+	bitmap(nullptr),
+	n_nomiss(0),
+	full(nullptr), sblk(nullptr)
 {
-	for(int i = 0; i < it.blk.n; ++i){
-		vec[i].Build(it.blk.rcds[i], n_samples);
+	this->BuildVectors(n_samples);
+	for(int i = 0; i < it.blk.n; ++i)
 		list[i].Build(it.blk.rcds[i], n_samples);
-	}
 }
 
 twk1_ldd_blk::~twk1_ldd_blk(){
 	if(owns_block) delete blk;
 	delete[] vec;
+	aligned_free(slab);
 	delete[] list;
 	delete[] bitmap;
+	delete sblk;
 }
 
 twk1_ldd_blk& twk1_ldd_blk::operator=(const twk1_ldd_blk& other){
@@ -34,6 +41,7 @@ twk1_ldd_blk& twk1_ldd_blk::operator=(const twk1_ldd_blk& other){
 	unphased = other.unphased;
 	owns_block = false; n_rec = 0; // do not change m
 	blk = other.blk;
+	full = other.full;
 	if(blk != nullptr){
 		n_rec = other.blk->n;
 	}
@@ -49,11 +57,19 @@ twk1_ldd_blk& twk1_ldd_blk::operator=(twk1_ldd_blk&& other){
 	n_rec = other.n_rec; // do not change m
 
 	delete[] vec; vec = nullptr;
+	aligned_free(slab); slab = nullptr; m_slab = 0;
 	delete[] list; list = nullptr;
 	delete[] bitmap; bitmap = nullptr;
 	std::swap(vec, other.vec);
+	std::swap(slab, other.slab);
+	std::swap(m_slab, other.m_slab);
+	mapped = other.mapped;
 	std::swap(list, other.list);
 	std::swap(bitmap, other.bitmap);
+	n_nomiss = other.n_nomiss;
+	std::swap(perm, other.perm);
+	std::swap(full, other.full);
+	std::swap(sblk, other.sblk);
 
 	if(blk != nullptr){
 		n_rec = blk->n;
@@ -76,6 +92,9 @@ void twk1_ldd_blk::SetPreloaded(const twk1_ldd_blk& other){
 	this->m_vec = other.m_vec;
 	this->bitmap = other.bitmap;
 	this->m_bitmap = other.m_bitmap;
+	this->n_nomiss = other.n_nomiss;
+	this->perm = other.perm;
+	this->full = other.full;
 }
 
 void twk1_ldd_blk::Set(twk1_blk_iterator& it, const uint32_t n_samples){
@@ -94,6 +113,7 @@ void twk1_ldd_blk::SetOwn(twk1_blk_iterator& it, const uint32_t n_samples){
 	delete[] list; list = nullptr;
 
 	owns_block = true;
+	mapped = false;
 	blk = new twk1_block_t;
 	// Decompress data
 	it.zcodec.Decompress(it.oblk.bytes, it.buf);
@@ -108,6 +128,7 @@ void twk1_ldd_blk::SetOwn(twk1_block_t& it, const uint32_t n_samples){
 	delete[] list; list = nullptr;
 
 	owns_block = false;
+	mapped = false;
 	blk = &it;
 	// Decompress data
 	//it.zcodec.Decompress(it.oblk.bytes, it.buf);
@@ -122,10 +143,22 @@ void twk1_ldd_blk::Clear(){
 	delete[] list;
 }
 
-void twk1_ldd_blk::Inflate(const uint32_t n_samples,
+void twk1_ldd_blk::Inflate(uint32_t n_samples,
                            const uint8_t unpack,
-                           const bool resizeable)
+                           const bool resizeable,
+                           const twk_ld_sampler* sampler)
 {
+	if(sampler != nullptr && sampler->IsActive()){
+		if(full == nullptr){ // records are not yet subsampled
+			if(sblk == nullptr) sblk = new twk1_block_t;
+			sampler->Subsample(*blk, *sblk);
+			full = blk;
+			blk  = sblk;
+			n_rec = blk->n;
+		}
+		n_samples = sampler->size();
+	}
+
 	if(unpack & TWK_LDD_VEC){
 		if(blk->n > m_vec){
 			delete[] vec;
@@ -148,10 +181,8 @@ void twk1_ldd_blk::Inflate(const uint32_t n_samples,
 		}
 	}
 
-	if(unpack & TWK_LDD_VEC){
-		for(int i = 0; i < blk->n; ++i)
-			vec[i].Build(blk->rcds[i], n_samples);
-	}
+	if((unpack & TWK_LDD_VEC) && mapped == false)
+		this->BuildVectors(n_samples);
 
 	if(unpack & TWK_LDD_LIST){
 		// If we have alrady unpacked the genotypes into a bitvector
@@ -179,12 +210,13 @@ void twk1_ldd_blk::Inflate(const uint32_t n_samples,
 			if(blk->rcds[i].an) continue; // do not construct if missing data
 			bitmap[i].reset(); // does not release memory used
 			uint32_t cumpos = 0;
-			// iterate over run-length encoded entries
+			// iterate over runs
 			uint32_t k = 0;
-			for(int j = 0; j < blk->rcds[i].gt->n; ++j){
-				const uint32_t len  = blk->rcds[i].gt->GetLength(j);
-				const uint8_t  refA = blk->rcds[i].gt->GetRefA(j);
-				const uint8_t  refB = blk->rcds[i].gt->GetRefB(j);
+			twk1_gt_cursor c(*blk->rcds[i].gt);
+			while(c.Next()){
+				const uint32_t len  = c.len;
+				const uint8_t  refA = c.GetRefA();
+				const uint8_t  refB = c.GetRefB();
 
 				if(refA == 0 && refB == 0){
 					cumpos += 2*len;
@@ -200,6 +232,177 @@ void twk1_ldd_blk::Inflate(const uint32_t n_samples,
 			//	std::cerr << bitmap[i] << std::endl;
 		}
 	}
+
+	if(unpack & TWK_LDD_SORT)
+		this->BuildPermutation(n_samples);
+}
+
+void twk1_ldd_blk::BuildVectors(const uint32_t n_samples){
+	const uint32_t n_words = twk_igt_vec::GetNumberWords(n_samples);
+	const uint32_t stride  = twk_igt_vec::GetStride(n_samples);
+
+	uint64_t n_slab = 0;
+	for(uint32_t i = 0; i < blk->n; ++i)
+		n_slab += (uint64_t)stride * (1 + blk->rcds[i].gt_missing);
+
+	if(n_slab > m_slab){
+		aligned_free(slab);
+		slab = reinterpret_cast<uint64_t*>(aligned_malloc(n_slab*sizeof(uint64_t), SIMD_ALIGNMENT));
+		memset(slab, 0, n_slab*sizeof(uint64_t)); // padding words are never written
+		m_slab = n_slab;
+	}
+
+	uint64_t* p = slab;
+	for(uint32_t i = 0; i < blk->n; ++i){
+		const bool missing = blk->rcds[i].gt_missing;
+		vec[i].Set(p, missing ? p + stride : nullptr, n_words);
+		vec[i].Build(blk->rcds[i], n_samples);
+		p += (uint64_t)stride * (1 + missing);
+	}
+}
+
+void twk1_ldd_blk::MapVectors(uint64_t* words, const uint16_t* zeros, const uint32_t n_samples){
+	const uint32_t n_words = twk_igt_vec::GetNumberWords(n_samples);
+	const uint32_t stride  = twk_igt_vec::GetStride(n_samples);
+
+	if(blk->n > m_vec){
+		delete[] vec;
+		vec  = new twk_igt_vec[blk->n];
+		m_vec = blk->n;
+	}
+
+	uint64_t* p = words;
+	for(uint32_t i = 0; i < blk->n; ++i){
+		const bool missing = blk->rcds[i].gt_missing;
+		vec[i].Set(p, missing ? p + stride : nullptr, n_words);
+		vec[i].front_zero = zeros[2*i+0];
+		vec[i].tail_zero  = zeros[2*i+1];
+		p += (uint64_t)stride * (1 + missing);
+	}
+	mapped = true;
+}
+
+void twk1_ldd_blk::BuildPermutation(const uint32_t n_samples){
+	const twk1_t* rcds = blk->rcds;
+	const uint32_t n_alleles = 2*n_samples;
+
+	perm.resize(blk->n);
+	n_nomiss = 0;
+	for(uint32_t i = 0; i < blk->n; ++i)
+		n_nomiss += (rcds[i].gt_missing == false);
+
+	uint32_t a = 0, b = n_nomiss;
+	for(uint32_t i = 0; i < blk->n; ++i){
+		if(rcds[i].gt_missing) perm[b++] = i;
+		else perm[a++] = i;
+	}
+
+	std::stable_sort(perm.begin(), perm.begin() + n_nomiss,
+		[rcds, n_alleles](const uint32_t x, const uint32_t y){
+			return(std::min(rcds[x].ac, n_alleles - rcds[x].ac) < std::min(rcds[y].ac, n_alleles - rcds[y].ac));
+		});
+
+	std::stable_sort(perm.begin() + n_nomiss, perm.end(),
+		[rcds](const uint32_t x, const uint32_t y){ return(rcds[x].ac < rcds[y].ac); });
+}
+
+uint64_t twk1_ldd_blk::GetMemoryUsage() const{
+	uint64_t b = 0;
+	b += m_slab * sizeof(uint64_t) + m_vec * sizeof(twk_igt_vec);
+	if(list != nullptr){
+		for(uint32_t i = 0; i < m_list; ++i)
+			b += list[i].m * sizeof(uint32_t) * (list[i].list_aa != nullptr ? 3 : 1) + (list[i].own ? list[i].n * sizeof(uint64_t) : 0);
+	}
+	if(bitmap != nullptr){
+		for(uint32_t i = 0; i < m_bitmap; ++i)
+			b += bitmap[i].sizeInBytes();
+	}
+	b += perm.size() * sizeof(uint32_t);
+	return(b);
+}
+
+/****************************
+*  twk_ld_sampler
+****************************/
+bool twk_ld_sampler::Draw(const uint32_t n_total, const uint32_t n_draw, const uint32_t seed){
+	ids.clear();
+	n_samples = n_total;
+	if(n_draw == 0 || n_draw >= n_total) return false;
+
+	std::mt19937 rng(seed);
+	ids.resize(n_draw);
+	for(uint32_t i = 0; i < n_draw; ++i){
+		const uint32_t from = ((uint64_t)i * n_total) / n_draw;
+		const uint32_t to   = ((uint64_t)(i + 1) * n_total) / n_draw;
+		ids[i] = from + rng() % (to - from);
+	}
+	return true;
+}
+
+void twk_ld_sampler::Subsample(const twk1_t& src, twk1_t& dst) const{
+	dst.gt_ptype   = TWK_GT_RLE32;
+	dst.gt_flipped = src.gt_flipped;
+	dst.gt_phase   = src.gt_phase;
+	dst.gt_missing = src.gt_missing;
+	dst.alleles = src.alleles;
+	dst.pos = src.pos;
+	dst.rid = src.rid;
+	dst.hwe = src.hwe;
+	dst.ac = 0; dst.an = 0; dst.n_het = 0; dst.n_hom = 0;
+
+	if(dst.gt == nullptr || dst.gt->psize != TWK_GT_RLE32){
+		delete dst.gt;
+		dst.gt = new twk1_igt_t<uint32_t>;
+	}
+	twk1_igt_t<uint32_t>* gt = static_cast<twk1_igt_t<uint32_t>*>(dst.gt);
+	if(gt->own) delete[] gt->runs();
+
+	// Runs over the subset are never more than the number of sampled
+	// individuals.
+	const uint32_t shift = 2 + 2*src.gt->miss;
+	uint32_t* runs = new uint32_t[ids.size()];
+	uint32_t n_runs = 0, s = 0, k = 0;
+	twk1_gt_cursor cur(*src.gt);
+	while(k < ids.size() && cur.Next()){
+		s += cur.len;
+		uint32_t c = 0;
+		for(; k < ids.size() && ids[k] < s; ++k) ++c;
+		if(c == 0) continue;
+
+		const uint8_t refA = cur.GetRefA();
+		const uint8_t refB = cur.GetRefB();
+		dst.ac += c * ((refA == 1) + (refB == 1));
+		dst.an += c * ((refA > 1) + (refB > 1));
+		dst.n_het += c * ((refA == 0 && refB == 1) || (refA == 1 && refB == 0));
+		dst.n_hom += c * (refA == 1 && refB == 1);
+
+		const uint32_t ref = cur.ref;
+		if(n_runs && (runs[n_runs - 1] & ((1 << shift) - 1)) == ref)
+			runs[n_runs - 1] += c << shift;
+		else runs[n_runs++] = (c << shift) | ref;
+	}
+	assert(k == ids.size());
+
+	gt->n    = n_runs;
+	gt->miss = src.gt->miss;
+	gt->data = runs;
+	gt->own  = 1;
+}
+
+void twk_ld_sampler::Subsample(const twk1_block_t& src, twk1_block_t& dst) const{
+	if(src.n > dst.m){
+		delete[] dst.rcds;
+		dst.rcds = new twk1_t[src.n];
+		dst.m = src.n;
+	}
+
+	for(uint32_t i = 0; i < src.n; ++i)
+		this->Subsample(src.rcds[i], dst.rcds[i]);
+
+	dst.n = src.n;
+	dst.rid = src.rid;
+	dst.minpos = src.minpos;
+	dst.maxpos = src.maxpos;
 }
 
 }
@@ -1,10 +1,49 @@
 #ifndef LIB_LD_LD_STRUCTS_H_
 #define LIB_LD_LD_STRUCTS_H_
 
+#include <vector>
+
 #include "third_party/ewah.h"
 
 namespace tomahawk {
 
+/**<
+ * Fixed random subset of samples used for approximating LD in very large
+ * cohorts. Records are projected onto the subset before bitvectors, lists, and
+ * bitmaps are constructed such that all kernels operate over proportionally
+ * fewer genotypes. The subset is stratified: the samples are split into as
+ * many contiguous strata of equal size as there are samples to draw and one
+ * sample is drawn uniformly at random from each stratum.
+ */
+struct twk_ld_sampler {
+	twk_ld_sampler() : n_samples(0){}
+
+	/**<
+	 * Draw a new subset of samples.
+	 * @param n_total Total number of samples.
+	 * @param n_draw  Number of samples to draw.
+	 * @param seed    Random seed.
+	 * @return        Returns TRUE upon success or FALSE if 0 < n_draw < n_total does not hold.
+	 */
+	bool Draw(const uint32_t n_total, const uint32_t n_draw, const uint32_t seed);
+
+	/**<
+	 * Project the genotypes of a record onto the drawn subset of samples.
+	 * Allele and genotype counts are recomputed for the subset.
+	 * @param src Src twk1_t record over all samples.
+	 * @param dst Dst twk1_t record over the subset of samples.
+	 */
+	void Subsample(const twk1_t& src, twk1_t& dst) const;
+	void Subsample(const twk1_block_t& src, twk1_block_t& dst) const;
+
+	inline bool IsActive() const{ return(ids.size() != 0); }
+	inline uint32_t size() const{ return(ids.size()); }
+
+public:
+	uint32_t n_samples; // total number of samples
+	std::vector<uint32_t> ids; // sorted sample offsets in the subset
+};
+
 /**<
  * Expanded twk block for use in linkage-disequilibrium calculations. Expands
  * data into:
@@ -30,9 +69,58 @@ struct twk1_ldd_blk {
 	void SetOwn(twk1_block_t& it, const uint32_t n_samples);
 	void Clear();
 
+	/**<
+	 * Construct the data structures requested by `unpack` from the
+	 * run-length encoded genotypes. If an active sampler is provided then the
+	 * records are first projected onto its subset of samples: `blk` then
+	 * points to the subsampled records and `full` to the original records.
+	 * @param n_samples  Total number of samples.
+	 * @param unpack     Bit-flags of the data structures to construct.
+	 * @param resizeable Allow lists to be resized.
+	 * @param sampler    Pointer to a subsampler or nullptr to use all samples.
+	 */
 	void Inflate(const uint32_t n_samples,
 	             const uint8_t unpack = TWK_LDD_ALL,
-	             const bool resizeable = false);
+	             const bool resizeable = false,
+	             const twk_ld_sampler* sampler = nullptr);
+
+	/**<
+	 * Constructs the permutation `perm` of record offsets where records without
+	 * missing genotypes are placed first, sorted by minor allele count, followed
+	 * by records with missing genotypes sorted by allele count. Iterating over
+	 * this permutation yields contiguous runs of records that are computed with
+	 * the same kernel and contiguous ranges of minor allele frequencies that
+	 * can be pruned as a whole. Offsets are into the original record order.
+	 * @param n_samples Number of samples.
+	 */
+	void BuildPermutation(const uint32_t n_samples);
+
+	/**<
+	 * Constructs the bitvectors (TWK_LDD_VEC) of all records into a single
+	 * aligned slab. Words are laid out variant-major: the data words of a
+	 * record are followed by its mask words, if it has missing genotypes,
+	 * and each run starts at a SIMD boundary. The slab is reused if large
+	 * enough.
+	 * @param n_samples Number of samples.
+	 */
+	void BuildVectors(const uint32_t n_samples);
+
+	/**<
+	 * Point the bitvectors of all records into externally owned words laid
+	 * out as in BuildVectors(), e.g. a memory-mapped sidecar. Subsequent
+	 * calls to Inflate() do not construct the bitvectors.
+	 * @param words     Src pointer to the slab words.
+	 * @param zeros     Src pointer to the leading and trailing zero counts of each record.
+	 * @param n_samples Number of samples.
+	 */
+	void MapVectors(uint64_t* words, const uint16_t* zeros, const uint32_t n_samples);
+
+	/**<
+	 * Number of bytes held by the constructed data structures. The records
+	 * themselves are not included.
+	 * @return Returns the number of bytes.
+	 */
+	uint64_t GetMemoryUsage() const;
 
 	inline void operator=(twk1_block_t* block){ this->blk = block; }
 	inline void operator=(twk1_block_t& block){ this->blk = &block; }
@@ -40,11 +128,18 @@ struct twk1_ldd_blk {
 
 public:
 	bool owns_block, unphased;
+	bool mapped; // bitvectors are views into external words
 	uint32_t n_rec, m_vec, m_list, m_bitmap; // number records, memory allocated for vectors, memory allocated for lists
 	twk1_block_t* blk; // data block
-	twk_igt_vec*  vec; // vectorized (bitvector)
+	twk_igt_vec*  vec; // vectorized (bitvector) views into `slab`
+	uint64_t* slab; // owned aligned words of all bitvectors
+	uint64_t  m_slab; // number of words allocated in `slab`
 	twk_igt_list* list; // list
 	bitmap_type* bitmap; // bitmap
+	uint32_t n_nomiss; // number of records in `perm` without missing genotypes
+	std::vector<uint32_t> perm; // frequency-sorted record offsets (TWK_LDD_SORT)
+	twk1_block_t* full; // records over all samples if `blk` is subsampled or nullptr otherwise
+	twk1_block_t* sblk; // owned container of subsampled records
 };
 
 }
@@ -3,6 +3,7 @@
 
 #include "core.h"
 #include "twk_reader.h"
+#include "ld/ld_sidecar.h"
 
 #include <thread>
 
@@ -59,7 +60,8 @@ struct twk_ld_unpacker {
 
 			ldd2[i] = std::move(bit.blk);
 			ldd[i].SetOwn(ldd2[i], rdr->hdr.GetNumberSamples());
-			ldd[i].Inflate(rdr->hdr.GetNumberSamples(),load, resize);
+			if(sidecar != nullptr && this->Map(fL + (i - lshift), ldd[i]) == false) return false;
+			ldd[i].Inflate(rdr->hdr.GetNumberSamples(),load, resize, sampler);
 		}
 
 		std::ifstream* s = reinterpret_cast<std::ifstream*>(bit.stream);
@@ -91,7 +93,8 @@ struct twk_ld_unpacker {
 
 			ldd2[i] = std::move(bit.blk);
 			ldd[i].SetOwn(ldd2[i], rdr->hdr.GetNumberSamples());
-			ldd[i].Inflate(rdr->hdr.GetNumberSamples(),load, resize);
+			if(sidecar != nullptr && this->Map(fL + (i - lshift), ldd[i]) == false) return false;
+			ldd[i].Inflate(rdr->hdr.GetNumberSamples(),load, resize, sampler);
 		}
 
 		bit.stream->seekg(rdr->index.ent[fR].foff); // seek absolute offset
@@ -112,7 +115,8 @@ struct twk_ld_unpacker {
 
 			ldd2[i] = std::move(bit.blk);
 			ldd[i].SetOwn(ldd2[i], rdr->hdr.GetNumberSamples());
-			ldd[i].Inflate(rdr->hdr.GetNumberSamples(),load, resize);
+			if(sidecar != nullptr && this->Map(fR + (i - loff - roff), ldd[i]) == false) return false;
+			ldd[i].Inflate(rdr->hdr.GetNumberSamples(),load, resize, sampler);
 		}
 
 		std::ifstream* s = reinterpret_cast<std::ifstream*>(bit.stream);
@@ -122,11 +126,27 @@ struct twk_ld_unpacker {
 		return true;
 	}
 
+	/**<
+	 * Point the bitvectors of a block into the sidecar.
+	 * @param id  Block offset in the twk file.
+	 * @param ldd Dst block.
+	 * @return    Returns TRUE upon success or FALSE otherwise.
+	 */
+	bool Map(const uint32_t id, twk1_ldd_blk& ldd){
+		if(sidecar->Map(id, ldd, rdr->hdr.GetNumberSamples()) == false){
+			std::cerr << utility::timestamp("ERROR","SIDECAR") << "Block " << id << " does not match the sidecar!" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
 public:
 	bool resize, diag;
 	uint8_t load;
 	uint32_t fL, tL, fR, tR, loff, roff, lshift;
 	twk_reader* rdr;
+	const twk_ld_sampler* sampler;
+	const twk_ld_sidecar* sidecar; // memory-mapped bitvectors or nullptr
 	std::thread* thread;
 	twk1_ldd_blk* ldd;
 	twk1_block_t* ldd2;
@@ -0,0 +1,346 @@
+#ifndef LIB_LD_LD_WINDOW_H_
+#define LIB_LD_LD_WINDOW_H_
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <limits>
+
+#include "core.h"
+#include "twk_reader.h"
+#include "ld/ld_structs.h"
+
+namespace tomahawk {
+
+/**<
+ * Genetic map used to define windows in centiMorgans. Maps are read from
+ * whitespace-delimited files with the contig name, the 1-based position, and
+ * the genetic position in cM as the last column, such that both three-column
+ * maps and four-column (HapMap/SHAPEIT) maps with a rate column are accepted.
+ * Lines without a numeric position are treated as headers. Genetic positions
+ * are linearly interpolated between map points and extrapolated with the mean
+ * rate of the contig beyond them. Contigs without a map use 1 cM/Mb.
+ */
+struct twk_genetic_map {
+public:
+	typedef std::pair<uint32_t, double> point_type;
+
+	twk_genetic_map() : n_points(0){}
+
+	/**<
+	 * Read a genetic map. Contig names are resolved against the header of the
+	 * input file with and without a "chr" prefix.
+	 * @param file Src file path.
+	 * @param hdr  Src header of the input file.
+	 * @return     Returns TRUE upon success or FALSE otherwise.
+	 */
+	bool Open(const std::string& file, const VcfHeader& hdr){
+		std::ifstream stream(file);
+		if(stream.good() == false){
+			std::cerr << utility::timestamp("ERROR","MAP") << "Failed to open \"" << file << "\"!" << std::endl;
+			return false;
+		}
+
+		maps.clear(); maps.resize(hdr.GetNumberContigs());
+		rates.clear(); rates.resize(hdr.GetNumberContigs(), 1e-6);
+		n_points = 0;
+
+		std::string line, chrom, token;
+		uint32_t n_unknown = 0;
+		while(std::getline(stream, line)){
+			std::istringstream ss(line);
+			std::vector<std::string> tokens;
+			while(ss >> token) tokens.push_back(token);
+			if(tokens.size() < 3) continue;
+			if(tokens[1].find_first_not_of("0123456789") != std::string::npos) continue;
+
+			chrom = tokens[0];
+			const VcfContig* contig = hdr.GetContig(chrom);
+			if(contig == nullptr){
+				if(chrom.compare(0, 3, "chr") == 0) contig = hdr.GetContig(chrom.substr(3));
+				else contig = hdr.GetContig("chr" + chrom);
+			}
+			if(contig == nullptr){ ++n_unknown; continue; }
+
+			maps[contig->idx].push_back(point_type(std::strtoul(tokens[1].c_str(), nullptr, 10), std::strtod(tokens.back().c_str(), nullptr)));
+			++n_points;
+		}
+
+		if(n_points == 0){
+			std::cerr << utility::timestamp("ERROR","MAP") << "No map points for the contigs in the input file!" << std::endl;
+			return false;
+		}
+		if(n_unknown)
+			std::cerr << utility::timestamp("WARNING","MAP") << "Skipped " << utility::ToPrettyString(n_unknown) << " map points on unknown contigs..." << std::endl;
+
+		for(int i = 0; i < maps.size(); ++i){
+			std::sort(maps[i].begin(), maps[i].end());
+			if(maps[i].size() >= 2 && maps[i].back().first > maps[i].front().first)
+				rates[i] = (maps[i].back().second - maps[i].front().second) / (maps[i].back().first - maps[i].front().first);
+		}
+
+		std::cerr << utility::timestamp("LOG","MAP") << "Loaded " << utility::ToPrettyString(n_points) << " map points..." << std::endl;
+		return true;
+	}
+
+	/**<
+	 * Interpolated genetic position of a record.
+	 * @param rid Contig identifier.
+	 * @param pos 0-based position.
+	 * @return    Returns the genetic position in cM.
+	 */
+	double Get(const uint32_t rid, const uint32_t pos) const{
+		const uint32_t p = pos + 1;
+		const std::vector<point_type>& m = maps[rid];
+		if(m.size() == 0) return(p * rates[rid]);
+		if(p <= m.front().first) return(m.front().second - (double)(m.front().first - p) * rates[rid]);
+		if(p >= m.back().first)  return(m.back().second + (double)(p - m.back().first) * rates[rid]);
+
+		const uint32_t k = std::upper_bound(m.begin(), m.end(), point_type(p, std::numeric_limits<double>::max())) - m.begin();
+		const point_type& a = m[k-1];
+		const point_type& b = m[k];
+		if(b.first == a.first) return(a.second);
+		return(a.second + (b.second - a.second) * (double)(p - a.first) / (b.first - a.first));
+	}
+
+public:
+	uint64_t n_points;
+	std::vector< std::vector<point_type> > maps; // sorted map points per contig
+	std::vector<double> rates; // mean rate in cM/bp per contig
+};
+
+/**<
+ * Inflated block resident in the sliding window together with the number of
+ * queued or running block pairs referencing it.
+ */
+struct twk_ld_window_blk {
+	twk_ld_window_blk() : n_pending(0), offset(0){}
+
+	uint32_t n_pending;
+	uint64_t offset; // ordinal of the first record in the file
+	twk1_ldd_blk ldd;
+};
+
+/**<
+ * Pair of resident blocks handed to a compute thread. The first block always
+ * precedes the second block in file order.
+ */
+struct twk_ld_window_pair {
+	twk_ld_window_pair() : type(0){ blks[0] = nullptr; blks[1] = nullptr; }
+
+	uint8_t type; // Diagonal (1) or square (0)
+	twk_ld_window_blk* blks[2];
+};
+
+/**<
+ * Streaming source of block pairs for computing LD in sliding windows. A
+ * reader thread loads and inflates blocks sequentially and keeps only the
+ * blocks that can still pair with blocks further down the file: as a new
+ * block is read it is paired with every resident block on the same contig
+ * within `l_window` bases and blocks that fell out of the window are released
+ * once no pair references them. Memory use is proportional to the number of
+ * blocks spanning a window rather than to the number of blocks in the file.
+ * Read-ahead is bounded by the number of queued pairs.
+ */
+struct twk_ld_window_stream {
+public:
+	twk_ld_window_stream() :
+		reading(false), load_type(0), l_window(0), n_queue(0),
+		l_variants(0), l_cm(0), gmap(nullptr),
+		from(0), to(0), n_loaded(0), m_resident(0),
+		rdr(nullptr), sampler(nullptr), thread(nullptr)
+	{}
+
+	~twk_ld_window_stream(){
+		this->Stop();
+		while(resident.size()){ delete resident.front(); resident.pop_front(); }
+	}
+
+	/**<
+	 * Spawn the reader thread streaming blocks in the range [from,to).
+	 * @param reader    Reference to an open twk reader. Its stream is used exclusively by the reader thread.
+	 * @param from      First block.
+	 * @param to        One past the last block.
+	 * @param settings  Src settings providing the data structures to construct and the window sizes.
+	 * @param n_queue   Maximum number of queued block pairs.
+	 * @param sampler   Pointer to a subsampler or nullptr to use all samples.
+	 * @param gmap      Pointer to a genetic map or nullptr if windows are not defined in cM.
+	 * @return          Returns TRUE upon success or FALSE otherwise.
+	 */
+	bool Start(twk_reader& reader, const uint32_t from, const uint32_t to,
+	           const twk_ld_settings& settings, const uint32_t n_queue,
+	           const twk_ld_sampler* sampler = nullptr,
+	           const twk_genetic_map* gmap = nullptr)
+	{
+		if(from >= to || from >= reader.index.n || n_queue == 0) return false;
+
+		rdr = &reader;
+		this->from = from; this->to = std::min(to, (uint32_t)reader.index.n);
+		this->load_type  = settings.ldd_load_type;
+		this->l_window   = settings.l_window;
+		this->l_variants = settings.l_window_variants;
+		this->l_cm       = settings.l_window_cm;
+		this->n_queue    = n_queue;
+		this->sampler    = sampler;
+		this->gmap       = (l_cm > 0 ? gmap : nullptr);
+		if(l_cm > 0 && gmap == nullptr) return false;
+
+		bit.stream = reader.stream;
+		bit.stream->seekg(reader.index.ent[from].foff);
+		if(bit.stream->good() == false){
+			std::cerr << utility::timestamp("ERROR") << "Failed to seek to index offset " << from << " -> " << reader.index.ent[from].foff << "!" << std::endl;
+			return false;
+		}
+
+		reading = true;
+		thread = new std::thread(&twk_ld_window_stream::Read, this);
+		return true;
+	}
+
+	/**<
+	 * Retrieve the next pair of blocks. Blocks until a pair is available or
+	 * all blocks have been read and paired. The retrieved pair has to be
+	 * returned with Release() once computed.
+	 * @param pair Dst pair of blocks.
+	 * @return     Returns TRUE if a pair was retrieved or FALSE if there are no more pairs.
+	 */
+	bool Get(twk_ld_window_pair& pair){
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			work_cv.wait(lock, [this]{ return(pairs.size() != 0 || reading == false); });
+			if(pairs.size() == 0) return false;
+			pair = pairs.front();
+			pairs.pop_front();
+		}
+		space_cv.notify_one();
+		return true;
+	}
+
+	/**<
+	 * Return a computed pair. Blocks that are no longer referenced and that
+	 * are outside the window of the most recently read block are deleted.
+	 * Calling this function on an empty pair has no effect.
+	 * @param pair Src pair retrieved with Get(). It is reset upon return.
+	 */
+	void Release(twk_ld_window_pair& pair){
+		if(pair.blks[0] == nullptr) return;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			--pair.blks[0]->n_pending;
+			--pair.blks[1]->n_pending;
+			this->Evict(*resident.back());
+		}
+		pair.blks[0] = nullptr; pair.blks[1] = nullptr;
+	}
+
+	/**<
+	 * Join the reader thread.
+	 */
+	void Stop(){
+		if(thread == nullptr) return;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			reading = false;
+		}
+		space_cv.notify_all();
+		thread->join();
+		delete thread; thread = nullptr;
+	}
+
+private:
+	/**<
+	 * Predicate for a pair of blocks, in file order, having any pair of
+	 * records on the same contig within the window: at most `l_window` bases,
+	 * `l_variants` variants, and `l_cm` centiMorgans apart for each of the
+	 * window sizes that are set.
+	 */
+	inline bool InWindow(const twk_ld_window_blk& a, const twk_ld_window_blk& b) const{
+		if(a.ldd.blk->rid != b.ldd.blk->rid) return false;
+		const twk1_t& last  = a.ldd.blk->rcds[a.ldd.n_rec-1];
+		const twk1_t& first = b.ldd.blk->rcds[0];
+		if(l_window && (uint64_t)first.pos > (uint64_t)last.pos + l_window) return false;
+		if(l_variants && b.offset > a.offset + a.ldd.n_rec - 1 + l_variants) return false;
+		if(gmap != nullptr && gmap->Get(first.rid, first.pos) > gmap->Get(last.rid, last.pos) + l_cm) return false;
+		return true;
+	}
+
+	// Resident blocks are in file order such that blocks outside the window of
+	// `newest` form a prefix. Requires the lock to be held.
+	void Evict(const twk_ld_window_blk& newest){
+		while(resident.size() && resident.front()->n_pending == 0 && InWindow(*resident.front(), newest) == false){
+			delete resident.front();
+			resident.pop_front();
+		}
+	}
+
+	void Read(){
+		uint64_t offset = 0;
+		for(uint32_t i = from; i < to; ++i){
+			if(bit.NextBlockRaw() == false){
+				std::cerr << utility::timestamp("ERROR") << "Failed to load block " << i << "!" << std::endl;
+				break;
+			}
+
+			twk_ld_window_blk* blk = new twk_ld_window_blk;
+			blk->ldd.SetOwn(bit, rdr->hdr.GetNumberSamples());
+			blk->ldd.Inflate(rdr->hdr.GetNumberSamples(), load_type, true, sampler);
+			blk->offset = offset;
+			offset += blk->ldd.n_rec;
+			if(blk->ldd.n_rec == 0){ delete blk; continue; }
+
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				space_cv.wait(lock, [this]{ return(pairs.size() < n_queue || reading == false); });
+				if(reading == false){ delete blk; break; }
+
+				this->Evict(*blk);
+				resident.push_back(blk);
+				for(uint32_t j = 0; j < resident.size(); ++j){
+					if(InWindow(*resident[j], *blk) == false) continue;
+					twk_ld_window_pair pair;
+					pair.type    = (resident[j] == blk);
+					pair.blks[0] = resident[j];
+					pair.blks[1] = blk;
+					++resident[j]->n_pending; ++blk->n_pending;
+					pairs.push_back(pair);
+				}
+				++n_loaded;
+				m_resident = std::max(m_resident, (uint32_t)resident.size());
+			}
+			work_cv.notify_all();
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			reading = false;
+		}
+		work_cv.notify_all();
+	}
+
+public:
+	bool reading;
+	uint32_t load_type, l_window, n_queue;
+	uint32_t l_variants; // window size in variants or 0
+	double l_cm; // window size in cM or 0
+	const twk_genetic_map* gmap;
+	uint32_t from, to;
+	uint32_t n_loaded, m_resident; // number of blocks read, largest number of resident blocks
+	twk_reader* rdr;
+	const twk_ld_sampler* sampler;
+	twk1_blk_iterator bit;
+	std::deque<twk_ld_window_blk*> resident;
+	std::deque<twk_ld_window_pair> pairs;
+	std::mutex mutex;
+	std::condition_variable work_cv, space_cv;
+	std::thread* thread;
+};
+
+}
+
+#endif /* LIB_LD_LD_WINDOW_H_ */
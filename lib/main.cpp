@@ -15,6 +15,8 @@ std::string tomahawk::INTERPRETED_COMMAND;
 #include "relationship.h"
 #include "decay.h"
 #include "scalc.h"
+#include "prune.h"
+#include "clump.h"
 
 int main(int argc, char** argv){
 	if(tomahawk::utility::IsBigEndian()){
@@ -75,6 +77,12 @@ int main(int argc, char** argv){
 	else if(strncmp(&argv[1][0], "decay", 5) == 0){
 		return(decay(argc, argv));
 	}
+	else if(strcmp(&argv[1][0], "prune") == 0){
+		return(prune(argc, argv));
+	}
+	else if(strcmp(&argv[1][0], "clump") == 0){
+		return(clump(argc, argv));
+	}
 	else if(strcmp(&argv[1][0], "--version") == 0 || strcmp(&argv[1][0], "version") == 0){
 		tomahawk::ProgramMessage(false);
 		return(0);
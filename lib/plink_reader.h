@@ -0,0 +1,191 @@
+#ifndef TWK_PLINK_READER_H_
+#define TWK_PLINK_READER_H_
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "utility.h"
+
+namespace tomahawk {
+
+// Magic bytes of a variant-major PLINK 1 .bed file.
+#define TWK_BED_MAGIC "\x6c\x1b\x01"
+#define TWK_BED_MAGIC_LENGTH 3
+
+/**<
+ * Variant described by a line of a PLINK .bim file.
+ */
+struct twk_plink_variant {
+	twk_plink_variant() : rid(0), pos(0), a1(0), a2(0), canonical(false){}
+
+	uint32_t rid, pos; // contig offset, 0-based position
+	char a1, a2; // first allele of A1 and A2
+	bool canonical; // both alleles are single canonical bases
+};
+
+/**<
+ * Reader of PLINK 1 binary filesets (`.bed`, `.bim`, and `.fam`). The .bed
+ * file is memory-mapped and the genotypes of a variant are returned as the
+ * raw 2-bit packed bytes of the file such that they can be converted to
+ * tomahawk encodings with word operations. Contigs are ordered by their
+ * first appearance in the .bim file and samples are named by their
+ * within-family identifier.
+ */
+struct twk_plink_reader {
+public:
+	twk_plink_reader() : n_samples(0), stride(0), b_map(0), map(nullptr){}
+	~twk_plink_reader(){ this->Close(); }
+
+	/**<
+	 * Check if a path names a .bed file.
+	 * @param path Src path.
+	 * @return     Returns TRUE if the extension is .bed or FALSE otherwise.
+	 */
+	static bool IsBed(const std::string& path){
+		return(path.size() > 4 && strncasecmp(&path[path.size() - 4], ".bed", 4) == 0);
+	}
+
+	/**<
+	 * Open a fileset given the path of its .bed file. The .bim and .fam files
+	 * are expected alongside it with the same prefix.
+	 * @param path Src path of the .bed file.
+	 * @return     Returns TRUE upon success or FALSE otherwise.
+	 */
+	bool Open(const std::string& path){
+		this->Close();
+		const std::string prefix = path.substr(0, path.size() - 4);
+		if(this->ReadFam(prefix + ".fam") == false) return false;
+		if(this->ReadBim(prefix + ".bim") == false) return false;
+
+		const int fd = open(path.c_str(), O_RDONLY);
+		if(fd < 0){
+			std::cerr << utility::timestamp("ERROR","PLINK") << "Failed to open \"" << path << "\"!" << std::endl;
+			return false;
+		}
+		struct stat st;
+		if(fstat(fd, &st) != 0){ close(fd); return false; }
+
+		stride = (n_samples + 3) / 4;
+		const uint64_t b_expected = TWK_BED_MAGIC_LENGTH + (uint64_t)stride * variants.size();
+		if((uint64_t)st.st_size != b_expected){
+			std::cerr << utility::timestamp("ERROR","PLINK") << "Size of \"" << path << "\" (" << st.st_size << ") does not match " << utility::ToPrettyString(variants.size()) << " variants and " << utility::ToPrettyString(n_samples) << " samples (" << b_expected << ")!" << std::endl;
+			close(fd);
+			return false;
+		}
+
+		void* m = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if(m == MAP_FAILED){
+			std::cerr << utility::timestamp("ERROR","PLINK") << "Failed to map \"" << path << "\"!" << std::endl;
+			return false;
+		}
+		map = reinterpret_cast<const uint8_t*>(m);
+		b_map = st.st_size;
+		madvise(m, b_map, MADV_SEQUENTIAL);
+
+		if(memcmp(map, TWK_BED_MAGIC, TWK_BED_MAGIC_LENGTH) != 0){
+			std::cerr << utility::timestamp("ERROR","PLINK") << "\"" << path << "\" is not a variant-major PLINK .bed file!" << std::endl;
+			this->Close();
+			return false;
+		}
+		return true;
+	}
+
+	void Close(){
+		if(map != nullptr) munmap(const_cast<uint8_t*>(map), b_map);
+		map = nullptr; b_map = 0;
+	}
+
+	inline uint32_t size() const{ return(variants.size()); }
+
+	/**<
+	 * Retrieve the packed genotypes of a variant: `stride` bytes of four
+	 * samples each, lowest bits first.
+	 * @param i Variant offset.
+	 * @return  Returns a pointer into the mapping.
+	 */
+	inline const uint8_t* GetGenotypes(const uint32_t i) const{ return(map + TWK_BED_MAGIC_LENGTH + (uint64_t)stride*i); }
+
+private:
+	bool ReadFam(const std::string& path){
+		std::ifstream f(path);
+		if(f.good() == false){
+			std::cerr << utility::timestamp("ERROR","PLINK") << "Failed to open \"" << path << "\"!" << std::endl;
+			return false;
+		}
+
+		std::string line, fid, iid;
+		while(std::getline(f, line)){
+			if(line.size() == 0) continue;
+			std::stringstream ss(line);
+			if(!(ss >> fid >> iid)){
+				std::cerr << utility::timestamp("ERROR","PLINK") << "Malformed line in \"" << path << "\": " << line << std::endl;
+				return false;
+			}
+			samples.push_back(iid);
+		}
+		n_samples = samples.size();
+		return true;
+	}
+
+	bool ReadBim(const std::string& path){
+		std::ifstream f(path);
+		if(f.good() == false){
+			std::cerr << utility::timestamp("ERROR","PLINK") << "Failed to open \"" << path << "\"!" << std::endl;
+			return false;
+		}
+
+		std::unordered_map<std::string, uint32_t> contig_map;
+		std::string line, chr, id, cm, a1, a2;
+		int64_t pos = 0;
+		while(std::getline(f, line)){
+			if(line.size() == 0) continue;
+			std::stringstream ss(line);
+			if(!(ss >> chr >> id >> cm >> pos >> a1 >> a2) || pos < 1){
+				std::cerr << utility::timestamp("ERROR","PLINK") << "Malformed line in \"" << path << "\": " << line << std::endl;
+				return false;
+			}
+
+			std::unordered_map<std::string, uint32_t>::const_iterator it = contig_map.find(chr);
+			if(it == contig_map.end()){
+				it = contig_map.insert(std::make_pair(chr, (uint32_t)contigs.size())).first;
+				contigs.push_back(chr);
+				contig_max.push_back(0);
+			}
+
+			twk_plink_variant v;
+			v.rid = it->second;
+			v.pos = pos - 1;
+			v.a1  = a1[0];
+			v.a2  = a2[0];
+			v.canonical = (a1.size() == 1 && a2.size() == 1 && strchr("ACGT", a1[0]) != nullptr && strchr("ACGT", a2[0]) != nullptr);
+			contig_max[v.rid] = std::max(contig_max[v.rid], (uint64_t)pos);
+			variants.push_back(v);
+		}
+		return true;
+	}
+
+public:
+	uint32_t n_samples;
+	uint32_t stride; // bytes per variant in the .bed file
+	uint64_t b_map; // size of the mapping
+	const uint8_t* map;
+	std::vector<std::string> samples;
+	std::vector<std::string> contigs;
+	std::vector<uint64_t> contig_max; // largest position observed on each contig
+	std::vector<twk_plink_variant> variants;
+};
+
+}
+
+#endif /* TWK_PLINK_READER_H_ */
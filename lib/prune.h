@@ -0,0 +1,184 @@
+/*
+Copyright (C) 2016-present Genome Research Ltd.
+Author: Marcus D. R. Klarqvist <mk819@cam.ac.uk>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+#include <getopt.h>
+#include <thread>
+#include <fstream>
+
+#include "utility.h"
+#include "twk_reader.h"
+#include "timer.h"
+#include "prune_structs.h"
+
+void prune_usage(void){
+	tomahawk::ProgramMessage();
+	std::cerr <<
+	"About:  Prune variants in linkage-disequilibrium in sliding windows\n"
+	"        (indep-pairwise). Within each window of -w variants, the variant\n"
+	"        with the smaller minor allele frequency of any pair with\n"
+	"        R-squared >= -r is removed. The window then advances by -s\n"
+	"        variants. Pairs are computed on demand and never written.\n\n"
+	"Usage:  " << tomahawk::TOMAHAWK_PROGRAM_NAME << " prune [options] -i <in.twk>\n\n"
+	"Options:\n"
+	"  -i FILE   input TWK file (required)\n"
+	"  -o FILE   output file listing retained variants (default: stdout)\n"
+	"  -w INT    window size in number of variants (default: 50)\n"
+	"  -s INT    number of variants to advance the window by (default: 5)\n"
+	"  -r FLOAT  Pearson's R-squared threshold (default: 0.5)\n"
+	"  -u        force computations to use unphased math\n"
+	"  -t INT    number of parallel threads (default: " << std::thread::hardware_concurrency() << ")\n\n"
+	"Retained variants are written as tab-delimited (contig,position)-tuples.\n"
+	"Contigs are pruned independently and in parallel.\n\n";
+}
+
+int prune(int argc, char** argv){
+	if(argc < 3){
+		prune_usage();
+		return(0);
+	}
+
+	static struct option long_options[] = {
+		{"input",       required_argument, 0, 'i' },
+		{"output",      required_argument, 0, 'o' },
+		{"window",      required_argument, 0, 'w' },
+		{"step",        required_argument, 0, 's' },
+		{"minR2",       required_argument, 0, 'r' },
+		{"force-unphased", no_argument,    0, 'u' },
+		{"threads",     required_argument, 0, 't' },
+		{0,0,0,0}
+	};
+
+	std::string input, output;
+	int32_t n_window = 50, n_step = 5;
+	double minR2 = 0.5;
+	bool unphased = false;
+	int32_t n_threads = std::thread::hardware_concurrency();
+
+	int c = 0;
+	int long_index = 0;
+	int hits = 0;
+	while ((c = getopt_long(argc, argv, "i:o:w:s:r:ut:?", long_options, &long_index)) != -1){
+		hits += 2;
+		switch (c){
+		case ':':   /* missing option argument */
+			fprintf(stderr, "%s: option `-%c' requires an argument\n",
+					argv[0], optopt);
+			break;
+
+		case '?':
+		default:
+			fprintf(stderr, "%s: option `-%c' is invalid: ignored\n",
+					argv[0], optopt);
+			break;
+
+		case 'i': input  = std::string(optarg); break;
+		case 'o': output = std::string(optarg); break;
+		case 'w': n_window = atoi(optarg); break;
+		case 's': n_step   = atoi(optarg); break;
+		case 'r': minR2    = atof(optarg); break;
+		case 'u': unphased = true; break;
+		case 't': n_threads = atoi(optarg); break;
+		}
+	}
+
+	if(input.length() == 0){
+		std::cerr << tomahawk::utility::timestamp("ERROR") << "No input value specified..." << std::endl;
+		return(1);
+	}
+
+	if(n_window < 2 || n_step <= 0 || n_step > n_window){
+		std::cerr << tomahawk::utility::timestamp("ERROR") << "Window size must be > 1 and step size in [1,window size]..." << std::endl;
+		return(1);
+	}
+
+	if(minR2 < 0 || minR2 > 1){
+		std::cerr << tomahawk::utility::timestamp("ERROR") << "R-squared threshold must be in [0,1]..." << std::endl;
+		return(1);
+	}
+
+	if(n_threads <= 0){
+		std::cerr << tomahawk::utility::timestamp("ERROR") << "Cannot have a non-positive number of threads..." << std::endl;
+		return(1);
+	}
+
+	// Print messages
+	tomahawk::ProgramMessage();
+	std::cerr << tomahawk::utility::timestamp("LOG") << "Calling prune..." << std::endl;
+
+	tomahawk::twk_reader rdr;
+	if(rdr.Open(input) == false) return 1;
+
+	const std::vector<tomahawk::twk_contig_range> ranges = tomahawk::twk_contig_range::Build(rdr.index);
+	if(ranges.size() == 0){
+		std::cerr << tomahawk::utility::timestamp("ERROR") << "No data available..." << std::endl;
+		return 1;
+	}
+	n_threads = std::min((uint32_t)n_threads, (uint32_t)ranges.size());
+
+	std::ostream* os = &std::cout;
+	std::ofstream ofs;
+	if(output.size() && output != "-"){
+		ofs.open(output);
+		if(ofs.good() == false){
+			std::cerr << tomahawk::utility::timestamp("ERROR") << "Failed to open \"" << output << "\"..." << std::endl;
+			return 1;
+		}
+		os = &ofs;
+	}
+
+	std::atomic<uint32_t> ticker(0);
+	std::vector<std::string> out(ranges.size());
+	tomahawk::twk_prune_slave* slaves = new tomahawk::twk_prune_slave[n_threads];
+
+	tomahawk::Timer timer;
+	timer.Start();
+	for(int i = 0; i < n_threads; ++i){
+		slaves[i].n_window = n_window;
+		slaves[i].n_step   = n_step;
+		slaves[i].minR2    = minR2;
+		slaves[i].unphased = unphased;
+		slaves[i].filename = input;
+		slaves[i].ranges   = &ranges;
+		slaves[i].ticker   = &ticker;
+		slaves[i].out      = &out;
+		if(slaves[i].Start() == nullptr){
+			std::cerr << tomahawk::utility::timestamp("ERROR","THREAD") << "Failed to start thread " << i << "..." << std::endl;
+			return 1;
+		}
+	}
+
+	uint64_t n_removed = 0, n_cmps = 0, n_variants = 0;
+	for(int i = 0; i < n_threads; ++i){
+		slaves[i].thread->join();
+		n_removed += slaves[i].n_removed;
+		n_cmps    += slaves[i].query.n_cmps;
+	}
+	for(int i = 0; i < ranges.size(); ++i){
+		os->write(out[i].data(), out[i].size());
+		n_variants += ranges[i].n_variants;
+	}
+	os->flush();
+	delete[] slaves;
+
+	std::cerr << tomahawk::utility::timestamp("LOG") << "Removed " << tomahawk::utility::ToPrettyString(n_removed) << " of " << tomahawk::utility::ToPrettyString(n_variants) << " variants with " << tomahawk::utility::ToPrettyString(n_cmps) << " comparisons in " << timer.ElapsedString() << "..." << std::endl;
+	return 0;
+}
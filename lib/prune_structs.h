@@ -0,0 +1,416 @@
+#ifndef LIB_PRUNE_STRUCTS_H_
+#define LIB_PRUNE_STRUCTS_H_
+
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include <string>
+
+#include "core.h"
+#include "twk_reader.h"
+#include "ld/ld_engine.h"
+
+namespace tomahawk {
+
+/**<
+ * Queries linkage-disequilibrium of individual pairs of variants with the
+ * engine kernels. Pairs are never written: a query only returns whether the
+ * pair reaches the R2 threshold and its record is left in `engine.cur_rcd`.
+ */
+struct twk_ld_query {
+public:
+	twk_ld_query() : unphased(false), n_cmps(0){}
+
+	/**<
+	 * Prepare the engine for querying pairs.
+	 * @param n_samples      Number of samples.
+	 * @param minR2          Minimum R2 a pair has to reach.
+	 * @param force_unphased Always use unphased math.
+	 */
+	void Set(const uint32_t n_samples, const double minR2, const bool force_unphased){
+		engine.SetSamples(n_samples);
+		engine.settings.minR2 = minR2;
+		engine.emit = false;
+		unphased = force_unphased;
+	}
+
+	/**<
+	 * Compute a pair of variants. Phased math is used unless forced otherwise
+	 * or either variant has missing genotypes.
+	 * @param b1 Left twk1_ldd_blk reference with constructed bitvectors.
+	 * @param p1 Left relative offset.
+	 * @param b2 Right twk1_ldd_blk reference with constructed bitvectors.
+	 * @param p2 Right relative offset.
+	 * @return   Returns TRUE if the pair reaches the R2 threshold or FALSE otherwise.
+	 */
+	bool operator()(const twk1_ldd_blk& b1, const uint32_t p1, const twk1_ldd_blk& b2, const uint32_t p2){
+		const twk1_t& a = b1.blk->rcds[p1];
+		const twk1_t& b = b2.blk->rcds[p2];
+		if(a.ac + b.ac <= 2) return false;
+		++n_cmps;
+
+		const bool missing = a.gt_missing || b.gt_missing;
+		if(unphased || a.an || b.an){
+			if(missing) return(engine.UnphasedVectorized(b1,p1,b2,p2));
+			return(engine.UnphasedVectorizedNoMissing(b1,p1,b2,p2));
+		}
+		if(missing) return(engine.PhasedVectorized(b1,p1,b2,p2));
+		return(engine.PhasedVectorizedNoMissing(b1,p1,b2,p2));
+	}
+
+	/**<
+	 * Minor allele frequency of a variant over its non-missing alleles.
+	 * @param rcd       Src twk1_t record.
+	 * @param n_samples Number of samples.
+	 * @return          Returns the minor allele frequency.
+	 */
+	static inline double GetMaf(const twk1_t& rcd, const uint32_t n_samples){
+		const uint32_t n_alleles = 2*n_samples - rcd.an;
+		if(n_alleles == 0) return 0;
+		return((double)std::min(rcd.ac, n_alleles - rcd.ac) / n_alleles);
+	}
+
+public:
+	bool unphased;
+	uint64_t n_cmps;
+	twk_ld_engine engine;
+};
+
+/**<
+ * Range of blocks [from,to) in a twk file holding the variants of a contig.
+ */
+struct twk_contig_range {
+	twk_contig_range() : rid(0), from(0), to(0), n_variants(0){}
+
+	/**<
+	 * Collects the ranges of blocks for each contig in a sorted twk file.
+	 * @param index Src index of the twk file.
+	 * @return      Returns a vector of contig ranges in file order.
+	 */
+	static std::vector<twk_contig_range> Build(const Index& index){
+		std::vector<twk_contig_range> ranges;
+		for(uint32_t i = 0; i < index.n; ++i){
+			if(ranges.size() == 0 || ranges.back().rid != index.ent[i].rid){
+				ranges.push_back(twk_contig_range());
+				ranges.back().rid  = index.ent[i].rid;
+				ranges.back().from = i;
+			}
+			ranges.back().to = i + 1;
+			ranges.back().n_variants += index.ent[i].n;
+		}
+		return(ranges);
+	}
+
+	int32_t  rid;
+	uint32_t from, to;
+	uint64_t n_variants;
+};
+
+/**<
+ * Sequential access to the variants in a range of blocks by a running
+ * identifier. Blocks are read and unpacked into bitvectors on demand and
+ * released once all of their variants precede the smallest identifier still
+ * in use such that only the blocks overlapping the current window are held
+ * in memory.
+ */
+struct twk_variant_stream {
+public:
+	twk_variant_stream() : n_samples(0), n_blks(0), n_loaded(0){}
+	~twk_variant_stream(){ this->Release(n_loaded); }
+
+	/**<
+	 * Start streaming variants from the given range of blocks.
+	 * @param reader Reference to an open twk reader.
+	 * @param range  Src range of blocks.
+	 * @return       Returns TRUE upon success or FALSE otherwise.
+	 */
+	bool Open(twk_reader& reader, const twk_contig_range& range){
+		this->Release(n_loaded);
+		n_samples = reader.hdr.GetNumberSamples();
+		n_blks    = range.to - range.from;
+		n_loaded  = 0;
+		bit.stream = reader.stream;
+		bit.stream->seekg(reader.index.ent[range.from].foff);
+		return(bit.stream->good());
+	}
+
+	/**<
+	 * Load blocks until the variant with identifier `id` is available.
+	 * @param id Target identifier.
+	 * @return   Returns TRUE if the variant is available or FALSE if there are no more variants.
+	 */
+	bool Load(const uint64_t id){
+		while(id >= n_loaded){
+			if(n_blks == 0) return false;
+			if(bit.NextBlockRaw() == false){
+				std::cerr << utility::timestamp("ERROR") << "Failed to load block..." << std::endl;
+				n_blks = 0;
+				return false;
+			}
+			--n_blks;
+
+			twk1_ldd_blk* blk = new twk1_ldd_blk;
+			blk->SetOwn(bit, n_samples);
+			blk->Inflate(n_samples, TWK_LDD_VEC, true);
+			blks.push_back(blk);
+			starts.push_back(n_loaded);
+			n_loaded += blk->n_rec;
+		}
+		return true;
+	}
+
+	/**<
+	 * Release all blocks in which every variant precedes `id`.
+	 * @param id Smallest identifier still in use.
+	 */
+	void Release(const uint64_t id){
+		while(blks.size() && starts.front() + blks.front()->n_rec <= id){
+			delete blks.front();
+			blks.pop_front();
+			starts.pop_front();
+		}
+	}
+
+	/**<
+	 * Maps a loaded identifier to its block and offset.
+	 * @param id  Identifier.
+	 * @param pos Dst offset into the returned block.
+	 * @return    Returns a reference to the block.
+	 */
+	inline const twk1_ldd_blk& Locate(const uint64_t id, uint32_t& pos) const{
+		const uint32_t b = std::upper_bound(starts.begin(), starts.end(), id) - starts.begin() - 1;
+		pos = id - starts[b];
+		return(*blks[b]);
+	}
+
+	inline const twk1_t& operator[](const uint64_t id) const{
+		uint32_t pos = 0;
+		return(this->Locate(id, pos).blk->rcds[pos]);
+	}
+
+public:
+	uint32_t n_samples, n_blks; // number of samples, number of blocks left to read
+	uint64_t n_loaded; // number of variants loaded
+	twk1_blk_iterator bit;
+	std::deque<twk1_ldd_blk*> blks;
+	std::deque<uint64_t> starts; // identifier of the first variant in each block
+};
+
+/**<
+ * Worker for pruning variants in sliding windows of a fixed number of
+ * variants (plink --indep-pairwise). Within each window any pair of retained
+ * variants reaching the R2 threshold has the variant with the smaller minor
+ * allele frequency removed. A removed variant is never compared again, and
+ * pairs already compared in the previous overlapping window are skipped.
+ * Contigs are pulled from a shared ticker and computed independently.
+ */
+struct twk_prune_slave {
+public:
+	twk_prune_slave() : n_window(50), n_step(5), minR2(0.5), unphased(false),
+		n_removed(0), ranges(nullptr), ticker(nullptr), out(nullptr), thread(nullptr)
+	{}
+	~twk_prune_slave(){ delete thread; }
+
+	std::thread* Start(){
+		delete thread; thread = nullptr;
+		if(reader.Open(filename) == false) return nullptr;
+		query.Set(reader.hdr.GetNumberSamples(), minR2, unphased);
+		thread = new std::thread(&twk_prune_slave::Compute, this);
+		return(thread);
+	}
+
+	bool Compute(){
+		while(true){
+			const uint32_t c = (*ticker)++;
+			if(c >= ranges->size()) break;
+			if(this->PruneContig((*ranges)[c], (*out)[c]) == false) return false;
+		}
+		return true;
+	}
+
+	/**<
+	 * Prune the variants of a contig and write the retained variants as
+	 * (contig,position)-tuples.
+	 * @param range Src range of blocks of the contig.
+	 * @param dst   Dst output string.
+	 * @return      Returns TRUE upon success or FALSE otherwise.
+	 */
+	bool PruneContig(const twk_contig_range& range, std::string& dst){
+		if(stream.Open(reader, range) == false) return false;
+		const std::string& contig = reader.hdr.GetContig(range.rid)->name;
+
+		std::deque<uint8_t> removed; // flags of identifiers >= base
+		uint64_t base = 0, s = 0, prev_end = 0;
+		while(stream.Load(s)){
+			uint64_t e = s;
+			while(e < s + n_window && stream.Load(e)) ++e;
+			while(removed.size() < e - base) removed.push_back(0);
+
+			for(uint64_t i = s; i < e; ++i){
+				if(removed[i - base]) continue;
+				uint32_t pi = 0;
+				const twk1_ldd_blk& bi = stream.Locate(i, pi);
+				for(uint64_t j = std::max(i + 1, prev_end); j < e; ++j){
+					if(removed[j - base]) continue;
+					uint32_t pj = 0;
+					const twk1_ldd_blk& bj = stream.Locate(j, pj);
+					if(query(bi, pi, bj, pj) == false) continue;
+
+					const uint32_t n_s = reader.hdr.GetNumberSamples();
+					if(twk_ld_query::GetMaf(bi[pi], n_s) < twk_ld_query::GetMaf(bj[pj], n_s)){
+						removed[i - base] = 1;
+						break;
+					}
+					removed[j - base] = 1;
+				}
+			}
+			prev_end = e;
+
+			// Variants before the start of the next window are final. If the
+			// window was truncated then the contig is exhausted.
+			const uint64_t next = (e < s + n_window) ? e : s + n_step;
+			for(uint64_t k = s; k < next; ++k){
+				if(removed[k - base]){ ++n_removed; continue; }
+				dst += contig;
+				dst += '\t';
+				dst += std::to_string(stream[k].pos + 1);
+				dst += '\n';
+			}
+			removed.erase(removed.begin(), removed.begin() + (next - base));
+			base = next;
+			stream.Release(next);
+			s = next;
+		}
+		return true;
+	}
+
+public:
+	uint32_t n_window, n_step;
+	double minR2;
+	bool unphased;
+	uint64_t n_removed;
+	std::string filename;
+	const std::vector<twk_contig_range>* ranges;
+	std::atomic<uint32_t>* ticker; // next contig to compute
+	std::vector<std::string>* out; // output per contig
+	twk_reader reader;
+	twk_variant_stream stream;
+	twk_ld_query query;
+	std::thread* thread;
+};
+
+/**<
+ * Variant with an association P-value loaded for clumping.
+ */
+struct twk_clump_variant {
+	twk_clump_variant() : p(1), clumped(false){}
+	double p;
+	bool clumped;
+};
+
+/**<
+ * Worker for clumping associated variants around index variants (plink
+ * --clump). Index variants are visited in order of increasing P-value and
+ * claim every unclaimed variant within the window reaching the R2 threshold.
+ * Variants already claimed by a more significant index variant are skipped
+ * without being computed. Contigs are pulled from a shared ticker.
+ */
+struct twk_clump_slave {
+public:
+	twk_clump_slave() : n_samples(0), window(250000), minR2(0.5), p1(1e-4), unphased(false),
+		blocks(nullptr), variants(nullptr), ticker(nullptr), out(nullptr), names(nullptr), thread(nullptr)
+	{}
+	~twk_clump_slave(){ delete thread; }
+
+	std::thread* Start(){
+		delete thread; thread = nullptr;
+		query.Set(n_samples, minR2, unphased);
+		thread = new std::thread(&twk_clump_slave::Compute, this);
+		return(thread);
+	}
+
+	bool Compute(){
+		while(true){
+			const uint32_t c = (*ticker)++;
+			if(c >= names->size()) break;
+			this->ClumpContig(c);
+		}
+		return true;
+	}
+
+	/**<
+	 * Clump the variants of a contig. Writes one line per index variant with
+	 * its position, P-value, and the positions of the variants it claimed.
+	 * @param c Offset of the contig.
+	 */
+	void ClumpContig(const uint32_t c){
+		const twk1_ldd_blk& blk = blocks[c];
+		std::vector<twk_clump_variant>& vars = (*variants)[c];
+		if(blk.n_rec == 0) return;
+
+		std::vector<uint32_t> order;
+		for(uint32_t i = 0; i < blk.n_rec; ++i){
+			if(vars[i].p <= p1) order.push_back(i);
+		}
+		std::stable_sort(order.begin(), order.end(),
+			[&vars](const uint32_t a, const uint32_t b){ return(vars[a].p < vars[b].p); });
+
+		const twk1_t* rcds = blk.blk->rcds;
+		std::vector<uint32_t> members;
+		for(uint32_t k = 0; k < order.size(); ++k){
+			const uint32_t i = order[k];
+			if(vars[i].clumped) continue;
+			vars[i].clumped = true;
+			members.clear();
+
+			// Variants are sorted by position: scan outwards within the window.
+			const uint32_t lo = rcds[i].pos > window ? rcds[i].pos - window : 0;
+			const uint32_t hi = rcds[i].pos + window;
+			uint32_t j = i;
+			while(j > 0 && rcds[j-1].pos >= lo) --j;
+			for(; j < blk.n_rec && rcds[j].pos <= hi; ++j){
+				if(vars[j].clumped) continue;
+				if(query(blk, i, blk, j)){
+					vars[j].clumped = true;
+					members.push_back(j);
+				}
+			}
+
+			std::string& dst = (*out)[c];
+			dst += (*names)[c];
+			dst += '\t';
+			dst += std::to_string(rcds[i].pos + 1);
+			dst += '\t';
+			char pbuf[32];
+			snprintf(pbuf, sizeof(pbuf), "%.4g", vars[i].p);
+			dst += pbuf;
+			dst += '\t';
+			dst += std::to_string(members.size());
+			dst += '\t';
+			if(members.size() == 0) dst += '.';
+			for(uint32_t m = 0; m < members.size(); ++m){
+				if(m) dst += ',';
+				dst += std::to_string(rcds[members[m]].pos + 1);
+			}
+			dst += '\n';
+		}
+	}
+
+public:
+	uint32_t n_samples, window;
+	double minR2, p1;
+	bool unphased;
+	const twk1_ldd_blk* blocks; // variants of each contig
+	std::vector< std::vector<twk_clump_variant> >* variants; // P-values of each contig
+	std::atomic<uint32_t>* ticker; // next contig to compute
+	std::vector<std::string>* out; // output per contig
+	const std::vector<std::string>* names; // contig names
+	twk_ld_query query;
+	std::thread* thread;
+};
+
+}
+
+#endif /* LIB_PRUNE_STRUCTS_H_ */
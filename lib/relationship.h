@@ -21,9 +21,11 @@ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
 DEALINGS IN THE SOFTWARE.
 */
 #include <getopt.h>
+#include <thread>
 
 #include "utility.h"
 #include "twk_reader.h"
+#include "relationship_structs.h"
 
 void relationship_usage(void){
 	tomahawk::ProgramMessage();
@@ -31,8 +33,13 @@ void relationship_usage(void){
 	"About:  Computes the relationship matrix for all samples.\n\n"
 	"Usage:  " << tomahawk::TOMAHAWK_PROGRAM_NAME << " relationship [options] -i <in.twk>\n\n"
 	"Options:\n"
-	"  -i FILE   input TWO file (required)\n"
-	"  -I STRING interval string for target region\n\n";
+	"  -i FILE   input TWK file (required)\n"
+	"  -I STRING interval string for target region\n"
+	"  -t INT    number of parallel threads (default: " << std::thread::hardware_concurrency() << ")\n"
+	"  -l        output the upper triangle as (sampleA,sampleB,relationship)-tuples\n\n"
+	"Relationships are the identity-by-state over sites where both samples are\n"
+	"non-missing. The square matrix (default) is held in memory as its upper\n"
+	"triangle; use -l to stream output for large numbers of samples.\n\n";
 }
 
 int relationship(int argc, char** argv){
@@ -45,6 +52,8 @@ int relationship(int argc, char** argv){
 		{"input",       required_argument, 0, 'i' },
 		{"intervals",   required_argument, 0, 'I' },
 		{"numeric",     optional_argument, 0, 'n' },
+		{"threads",     required_argument, 0, 't' },
+		{"long",        no_argument,       0, 'l' },
 		{0,0,0,0}
 	};
 
@@ -52,11 +61,13 @@ int relationship(int argc, char** argv){
 	std::string input;
 	std::vector<std::string> intervals;
 	bool output_numeric_encoding = false;
+	bool output_long = false;
+	int32_t n_threads = std::thread::hardware_concurrency();
 
 	int c = 0;
 	int long_index = 0;
 	int hits = 0;
-	while ((c = getopt_long(argc, argv, "i:I:n?", long_options, &long_index)) != -1){
+	while ((c = getopt_long(argc, argv, "i:I:nt:l?", long_options, &long_index)) != -1){
 		hits += 2;
 		switch (c){
 		case ':':   /* missing option argument */
@@ -79,6 +90,12 @@ int relationship(int argc, char** argv){
 		case 'n':
 			output_numeric_encoding = true;
 			break;
+		case 't':
+			n_threads = atoi(optarg);
+			break;
+		case 'l':
+			output_long = true;
+			break;
 		}
 	}
 
@@ -92,6 +109,11 @@ int relationship(int argc, char** argv){
 		return(1);
 	}
 
+	if(n_threads <= 0){
+		std::cerr << tomahawk::utility::timestamp("ERROR") << "Cannot have a non-positive number of threads..." << std::endl;
+		return(1);
+	}
+
 	// Print messages
 	tomahawk::ProgramMessage();
 	std::cerr << tomahawk::utility::timestamp("LOG") << "Calling relationship..." << std::endl;
@@ -120,117 +142,91 @@ int relationship(int argc, char** argv){
 		return 1;
 	}
 
-	// Output matrix of size N^2.
-	struct kinship_el {
-		kinship_el() : n(0), c(0){}
-		/*kinship_el& operator=(const kinship_el& other){
-			n = other.n.load();
-			c = other.c.load();
-			return(*this);
-		}*/
-
-		//std::atomic<uint32_t> n, c;
-		uint32_t n, c;
-	};
-	kinship_el** kin = new kinship_el*[rdr.hdr.GetNumberSamples()];
-	for(int i = 0; i < rdr.hdr.GetNumberSamples(); ++i)
-		kin[i] = new kinship_el[rdr.hdr.GetNumberSamples()];
+	const uint32_t n_samples = rdr.hdr.GetNumberSamples();
+
+	// Transpose genotypes of all sites in the target region into per-sample
+	// bitplanes.
+	tomahawk::twk_kinship_planes planes;
+	planes.Allocate(n_samples, rdr.hdr.sample_order_);
+	const std::vector<std::string> samples = rdr.hdr.GetInputSamples();
 
 	tomahawk::twk1_blk_iterator bit;
 	bit.stream = rdr.stream;
-	uint32_t n_variants = 0;
-
-	// Todo: split matrix into N/t submatrices. One submatrix per worker thread.
 
-	// If both are the same then add 1.0 -> 2
-	// If both are different add 0.0 -> 0
-	// If both have the same het layout at 0.5 -> 1
-	// Divide end by 2
 	tomahawk::Timer timer;
+	timer.Start();
 	for(int i = 0; i < n_blks; ++i){
 		bit.stream->seekg(ivals.overlap_blocks[i]->foff);
 		if(bit.NextBlock() == false){
 			std::cerr << tomahawk::utility::timestamp("ERROR") << "Failed to load block " << i << "..." << std::endl;
-			return false;
+			return 1;
 		}
 
-		timer.Start();
-		//n_variants += bit.blk.n;
-		uint32_t score = 0;
-
-		// Foreach record.
 		for(int j = 0; j < bit.blk.n; ++j){
 			if(ivals.itree[bit.blk.rcds[j].rid]->findOverlapping(bit.blk.rcds[j].pos, bit.blk.rcds[j].pos).size() == 0)
 				continue;
 
-			++n_variants;
-
-			// Foreach RLE object against ever other (except self)
-			// First loop over all, second loop over non-diagonal
-			uint32_t sample_col = 0;
-			for(int k = 0; k < bit.blk.rcds[j].gt->n; ++k){
-				// Self
-				//std::cerr << "outer=" << sample_col << "-" << sample_col + bit.blk.rcds[j].gt->GetLength(k) << std::endl;
-				// Start a 1 because i==j then sample individual.
-				for(int c = 0; c < bit.blk.rcds[j].gt->GetLength(k); ++c){
-					for(int z = c + 1; z < bit.blk.rcds[j].gt->GetLength(k); ++z){
-						// Add 2 for all these samples.
-						kin[sample_col + c][sample_col + z].n += 2;
-					}
-				}
-
-				uint32_t sample_row = sample_col + bit.blk.rcds[j].gt->GetLength(k);
-				uint8_t refA = (bit.blk.rcds[j].gt->GetRefA(k) << 2) | bit.blk.rcds[j].gt->GetRefB(k);
-				for(int l = k + 1; l < bit.blk.rcds[j].gt->n; ++l){
-					uint8_t refB = (bit.blk.rcds[j].gt->GetRefA(l) << 2) | bit.blk.rcds[j].gt->GetRefB(l);
-					// If both have different homozygous alleles then skip (add 0)
-					if((refA == 0 && refB == 5) || (refA == 5 && refB == 0)){ // 0101 = 5
-						// Add 0 for all these samples.
-						sample_row += bit.blk.rcds[j].gt->GetLength(l);
-						continue;
-					}
-
-					score = ((refA == 0 && refB == 0) || (refA == 5 && refB == 5) ? 2 : 1);
-
-					// Sample col range (sample_col +c)
-					for(int c = 0; c < bit.blk.rcds[j].gt->GetLength(k); ++c){
-						// Sample row range (smaple_row + z)
-						for(int z = 1; z < bit.blk.rcds[j].gt->GetLength(l); ++z){
-							kin[sample_col + c][sample_row + z].n += score;
-						}
-					}
-					sample_row += bit.blk.rcds[j].gt->GetLength(l);
-				}
-				assert(sample_row == rdr.hdr.GetNumberSamples());
-				sample_col += bit.blk.rcds[j].gt->GetLength(k);
-			}
-			assert(sample_col == rdr.hdr.GetNumberSamples());
+			planes.Add(bit.blk.rcds[j]);
 		}
-		std::cerr << tomahawk::utility::timestamp("PROGRESS") << i << "/" << n_blks << "/" << rdr.index.n << ": " << bit.blk.n << " in " << timer.ElapsedString() << " (" << tomahawk::utility::ToPrettyString((uint64_t)((bit.blk.n*bit.blk.n*rdr.hdr.GetNumberSamples())/timer.Elapsed().count())) << " cmps/s)" << std::endl;
 	}
-	std::cerr << tomahawk::utility::timestamp("LOG") << "Number of individuals: " << rdr.hdr.GetNumberSamples() << " over " << n_variants << " sites..." << std::endl;
+	std::cerr << tomahawk::utility::timestamp("LOG") << "Number of individuals: " << n_samples << " over " << planes.n_variants << " sites in " << timer.ElapsedString() << "..." << std::endl;
 
-	// Add diagonal and add in lower triangular values.
-	for(int i = 0; i < rdr.hdr.GetNumberSamples(); ++i) kin[i][i].n = 2*n_variants;
-	for(int i = 0; i < rdr.hdr.GetNumberSamples(); ++i){
-		for(int j = 1; j < rdr.hdr.GetNumberSamples(); ++j){
-			kin[j][i] = kin[i][j];
-		}
+	if(planes.n_variants == 0){
+		std::cerr << tomahawk::utility::timestamp("ERROR") << "No sites in the target region..." << std::endl;
+		return 1;
 	}
 
+	// Compute the upper triangle in blocks of rows. Each block is computed
+	// in parallel and then either streamed or retained in packed form.
+	const uint32_t n_rows = std::max((uint32_t)(n_threads * TWK_KINSHIP_ROW_GROUP), (uint32_t)256);
+	float* rows = new float[(uint64_t)n_rows * n_samples];
+	std::vector<float> tri; // packed upper triangle
+	if(output_long == false) tri.resize((uint64_t)n_samples * (n_samples + 1) / 2);
+
+	tomahawk::twk_kinship_slave* slaves = new tomahawk::twk_kinship_slave[n_threads];
+	for(int i = 0; i < n_threads; ++i){
+		slaves[i].thread_id = i;
+		slaves[i].n_threads = n_threads;
+		slaves[i].planes    = &planes;
+		slaves[i].out       = rows;
+	}
 
-	for(int i = 0; i < rdr.hdr.GetNumberSamples(); ++i){
-		std::cout << (double)kin[i][0].n / n_variants / 2;
-		for(int j = 1; j < rdr.hdr.GetNumberSamples(); ++j){
-			std::cout << '\t' << (double)kin[i][j].n / n_variants / 2;
+	timer.Start();
+	for(uint32_t r0 = 0; r0 < n_samples; r0 += n_rows){
+		const uint32_t r1 = std::min(r0 + n_rows, n_samples);
+		for(int i = 0; i < n_threads; ++i){
+			slaves[i].r0 = r0; slaves[i].r1 = r1;
+			slaves[i].Start();
+		}
+		for(int i = 0; i < n_threads; ++i) slaves[i].thread->join();
+
+		for(uint32_t i = r0; i < r1; ++i){
+			const float* row = &rows[(uint64_t)(i - r0) * n_samples];
+			if(output_long){
+				for(uint32_t j = i; j < n_samples; ++j)
+					std::cout << samples[i] << '\t' << samples[j] << '\t' << row[j] << '\n';
+			} else {
+				const uint64_t offset = (uint64_t)i * n_samples - ((uint64_t)i * (i - 1)) / 2;
+				memcpy(&tri[offset], &row[i], sizeof(float)*(n_samples - i));
+			}
+		}
+		std::cerr << tomahawk::utility::timestamp("PROGRESS") << r1 << "/" << n_samples << " rows in " << timer.ElapsedString() << std::endl;
+	}
+	delete[] slaves;
+	delete[] rows;
+
+	// Square matrix: the lower triangle is read from the upper triangle.
+	if(output_long == false){
+		for(uint32_t i = 0; i < n_samples; ++i){
+			for(uint32_t j = 0; j < n_samples; ++j){
+				const uint32_t a = std::min(i, j), b = std::max(i, j);
+				if(j) std::cout.put('\t');
+				std::cout << tri[(uint64_t)a * n_samples - ((uint64_t)a * (a - 1)) / 2 + (b - a)];
+			}
+			std::cout.put('\n');
 		}
-		std::cout.put('\n');
 	}
 	std::cout.flush();
 
-	for(int i = 0; i < rdr.hdr.GetNumberSamples(); ++i)
-		delete[] kin[i];
-	delete[] kin;
-
 	return 0;
 }
@@ -0,0 +1,144 @@
+#ifndef LIB_RELATIONSHIP_STRUCTS_H_
+#define LIB_RELATIONSHIP_STRUCTS_H_
+
+#include <thread>
+#include <cstdint>
+#include <vector>
+#include <limits>
+
+#include "core.h"
+
+namespace tomahawk {
+
+/**<
+ * Genotypes of a set of variants transposed into per-sample bitplanes. For
+ * every 64 variants each sample stores three words: heterozygous genotypes,
+ * homozygous alternative genotypes, and non-missing genotypes. Homozygous
+ * reference genotypes are the non-missing genotypes set in neither of the
+ * former two words.
+ */
+struct twk_kinship_planes {
+public:
+	twk_kinship_planes() : n_variants(0){}
+
+	/**<
+	 * @param n_samples Number of samples.
+	 * @param order     Input offset of each stored sample or empty if
+	 *                  samples are stored in input order. Bitplanes are
+	 *                  kept in input order.
+	 */
+	void Allocate(const uint32_t n_samples, const std::vector<uint32_t>& order = std::vector<uint32_t>()){
+		planes.clear();
+		planes.resize(n_samples);
+		this->order = order;
+		n_variants = 0;
+	}
+
+	/**<
+	 * Append a variant to the bitplanes of all samples by iterating over its
+	 * runs of genotypes.
+	 * @param rcd Src twk1_t record.
+	 */
+	void Add(const twk1_t& rcd){
+		const uint32_t bit = n_variants & 63;
+		if(bit == 0){
+			for(uint32_t s = 0; s < planes.size(); ++s)
+				planes[s].resize(planes[s].size() + 3, 0);
+		}
+
+		const uint32_t word = (n_variants >> 6) * 3;
+		const uint64_t mask = 1ULL << bit;
+		uint32_t s = 0;
+		twk1_gt_cursor cur(*rcd.gt);
+		while(cur.Next()){
+			const uint32_t len  = cur.len;
+			const uint8_t  refA = cur.GetRefA();
+			const uint8_t  refB = cur.GetRefB();
+
+			if(refA > 1 || refB > 1){ s += len; continue; } // missing
+			const uint8_t type = (refA != refB) ? 0 : (refA == 1 ? 1 : 2);
+			for(uint32_t c = 0; c < len; ++c, ++s){
+				std::vector<uint64_t>& plane = planes[order.size() ? order[s] : s];
+				if(type < 2) plane[word + type] |= mask;
+				plane[word + 2] |= mask;
+			}
+		}
+		assert(s == planes.size());
+		++n_variants;
+	}
+
+	/**<
+	 * Identity-by-state of two samples over all variants where both samples
+	 * have non-missing genotypes: two alleles are shared when the genotypes
+	 * are identical, zero when they are opposite homozygotes, and one
+	 * otherwise.
+	 * @param x First sample.
+	 * @param y Second sample.
+	 * @return  Returns the number of shared alleles divided by twice the number of shared non-missing sites.
+	 */
+	inline float Compare(const uint32_t x, const uint32_t y) const{
+		const uint64_t* a = planes[x].data();
+		const uint64_t* b = planes[y].data();
+		const uint32_t n_words = planes[x].size();
+
+		uint64_t n = 0, dist = 0;
+		for(uint32_t w = 0; w < n_words; w += 3){
+			const uint64_t m    = a[w+2] & b[w+2];
+			const uint64_t refa = a[w+2] & ~(a[w] | a[w+1]);
+			const uint64_t refb = b[w+2] & ~(b[w] | b[w+1]);
+			n    += __builtin_popcountll(m);
+			dist += __builtin_popcountll((a[w] ^ b[w]) & m);
+			dist += 2*__builtin_popcountll((a[w+1] & refb) | (refa & b[w+1]));
+		}
+		if(n == 0) return(std::numeric_limits<float>::quiet_NaN());
+		return((double)(2*n - dist) / (2*n));
+	}
+
+public:
+	uint32_t n_variants;
+	std::vector<uint32_t> order; // input offset of each stored sample
+	std::vector< std::vector<uint64_t> > planes;
+};
+
+// Number of consecutive rows a worker compares against each partner sample.
+#define TWK_KINSHIP_ROW_GROUP 8
+
+/**<
+ * Worker computing a block of rows of the upper triangle of the relationship
+ * matrix. Rows in [r0,r1) are assigned in groups interleaved over threads.
+ * All rows in a group are compared against one partner sample at a time such
+ * that the partner bitplanes are read once per group rather than once per row.
+ */
+struct twk_kinship_slave {
+public:
+	twk_kinship_slave() : thread_id(0), n_threads(1), r0(0), r1(0), planes(nullptr), out(nullptr), thread(nullptr){}
+	~twk_kinship_slave(){ delete thread; }
+
+	std::thread* Start(){
+		delete thread; thread = nullptr;
+		thread = new std::thread(&twk_kinship_slave::Compute, this);
+		return(thread);
+	}
+
+	void Compute(){
+		const uint32_t n_samples = planes->planes.size();
+		for(uint32_t g = r0 + thread_id*TWK_KINSHIP_ROW_GROUP; g < r1; g += n_threads*TWK_KINSHIP_ROW_GROUP){
+			const uint32_t g_end = std::min(g + TWK_KINSHIP_ROW_GROUP, r1);
+			for(uint32_t j = g; j < n_samples; ++j){
+				for(uint32_t i = g; i < g_end && i <= j; ++i)
+					out[(uint64_t)(i - r0)*n_samples + j] = planes->Compare(i, j);
+			}
+		}
+	}
+
+public:
+	uint32_t thread_id, n_threads;
+	uint32_t r0, r1; // row range [r0,r1)
+	const twk_kinship_planes* planes;
+	float* out; // (r1 - r0) x n_samples matrix of rows
+	std::thread* thread;
+};
+
+}
+
+#endif /* LIB_RELATIONSHIP_STRUCTS_H_ */
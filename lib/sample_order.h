@@ -0,0 +1,140 @@
+#ifndef TWK_SAMPLE_ORDER_H_
+#define TWK_SAMPLE_ORDER_H_
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "htslib/vcf.h"
+#include "genotype_encoder.h"
+
+namespace tomahawk {
+
+/**<
+ * Permutation of samples applied at import to lengthen runs of genotypes.
+ * Genotypes of a subset of variants are collected and samples are sorted
+ * lexicographically by their genotypes over those variants, ordered from the
+ * most to the least polymorphic, such that samples sharing haplotypes at
+ * common variants become neighbours. Only the order of the columns changes:
+ * the permutation is stored in the header (`VcfHeader::sample_order_`) and
+ * sample-level outputs map samples back to the input order.
+ */
+struct twk_sample_permuter {
+public:
+	twk_sample_permuter() : n_samples(0), n_runs_before(0), n_runs_after(0){}
+
+	inline bool IsActive() const{ return(order.size() != 0); }
+	inline uint32_t size() const{ return(cols.size()); }
+
+	void Allocate(const uint32_t n_samples){
+		this->n_samples = n_samples;
+		cols.clear(); n_minor.clear(); order.clear();
+	}
+
+	/**<
+	 * Collect the genotypes of a diploid biallelic record. Genotypes are
+	 * packed into 4 bits per sample as in the encoder with missing values.
+	 * @param rec Src record.
+	 */
+	void Add(const bcf1_t* rec){
+		const uint8_t* p = rec->d.fmt[0].p;
+		cols.push_back(std::vector<uint8_t>((n_samples + 1) / 2, 0));
+		std::vector<uint8_t>& c = cols.back();
+
+		uint32_t n_nonzero = 0;
+		for(uint32_t i = 0; i < n_samples; ++i){
+			const uint8_t ref = TWK_GT_PACK(p[2*i], p[2*i+1], 1);
+			c[i >> 1] |= ref << (4*(i & 1));
+			n_nonzero += (ref != 0);
+		}
+		n_minor.push_back(std::min(n_nonzero, n_samples - n_nonzero));
+	}
+
+	/**<
+	 * Compute the permutation from the collected variants and release them.
+	 * @return Returns TRUE if the permutation differs from the input order or FALSE otherwise.
+	 */
+	bool Build(){
+		order.clear();
+		if(cols.size() == 0 || n_samples < 2) return false;
+
+		// Variants from the most to the least polymorphic.
+		std::vector<uint32_t> vorder(cols.size());
+		for(uint32_t i = 0; i < vorder.size(); ++i) vorder[i] = i;
+		std::stable_sort(vorder.begin(), vorder.end(),
+		                 [this](const uint32_t a, const uint32_t b){ return(n_minor[a] > n_minor[b]); });
+
+		// Sort keys of 16 genotypes per word with the first variant in the
+		// most significant bits.
+		const uint32_t n_words = (cols.size() + 15) / 16;
+		std::vector<uint64_t> keys((uint64_t)n_samples * n_words, 0);
+		for(uint32_t v = 0; v < vorder.size(); ++v){
+			const std::vector<uint8_t>& c = cols[vorder[v]];
+			const uint32_t w = v / 16, shift = 60 - 4*(v % 16);
+			for(uint32_t i = 0; i < n_samples; ++i)
+				keys[(uint64_t)i*n_words + w] |= (uint64_t)((c[i >> 1] >> (4*(i & 1))) & 15) << shift;
+		}
+
+		std::vector<uint32_t> perm(n_samples);
+		for(uint32_t i = 0; i < n_samples; ++i) perm[i] = i;
+		const uint64_t* k = keys.data();
+		std::stable_sort(perm.begin(), perm.end(), [k, n_words](const uint32_t a, const uint32_t b){
+			return(std::lexicographical_compare(&k[(uint64_t)a*n_words], &k[(uint64_t)(a+1)*n_words],
+			                                    &k[(uint64_t)b*n_words], &k[(uint64_t)(b+1)*n_words]));
+		});
+
+		n_runs_before = this->CountRuns(nullptr);
+		n_runs_after  = this->CountRuns(&perm);
+		cols.clear(); n_minor.clear();
+
+		for(uint32_t i = 0; i < n_samples; ++i){
+			if(perm[i] != i){ order.swap(perm); break; }
+		}
+		return(order.size() != 0);
+	}
+
+	/**<
+	 * Permute the genotypes of a record in place such that the genotypes of
+	 * input sample `order[i]` are stored at offset `i`.
+	 * @param rec Src/dst record.
+	 */
+	void Apply(bcf1_t* rec){
+		uint8_t* p = rec->d.fmt[0].p;
+		scratch.resize(2*n_samples);
+		memcpy(scratch.data(), p, 2*n_samples);
+		for(uint32_t i = 0; i < n_samples; ++i){
+			p[2*i+0] = scratch[2*order[i]+0];
+			p[2*i+1] = scratch[2*order[i]+1];
+		}
+	}
+
+private:
+	// Count runs of identical genotypes over the collected variants.
+	uint64_t CountRuns(const std::vector<uint32_t>* perm) const{
+		uint64_t n_runs = 0;
+		for(uint32_t v = 0; v < cols.size(); ++v){
+			const std::vector<uint8_t>& c = cols[v];
+			uint8_t prev = 255;
+			for(uint32_t i = 0; i < n_samples; ++i){
+				const uint32_t s = (perm == nullptr ? i : (*perm)[i]);
+				const uint8_t ref = (c[s >> 1] >> (4*(s & 1))) & 15;
+				n_runs += (ref != prev);
+				prev = ref;
+			}
+		}
+		return(n_runs);
+	}
+
+public:
+	uint32_t n_samples;
+	uint64_t n_runs_before, n_runs_after; // runs over the collected variants
+	std::vector<uint32_t> order; // input offset of each stored sample; empty if unchanged
+	std::vector< std::vector<uint8_t> > cols; // packed genotypes of collected variants
+	std::vector<uint32_t> n_minor; // number of samples with the minor genotype class
+	std::vector<uint8_t> scratch;
+};
+
+}
+
+#endif /* TWK_SAMPLE_ORDER_H_ */
@@ -40,7 +40,9 @@ void scalc_usage(void){
 	"               block1*variants + block2*variants\n"
 	"  -M        use phased bitmaps in low-memory mode. Automatically triggers -m and -p.\n"
 	"  -b        number of records in a block. Has an effect on memory usage only when -m is set.\n"
-	//"  -S INT    trigger sampling mode: number of individuals to sample when allele counts are large.\n"
+	"  -S INT    approximate LD over a stratified random subset of INT individuals\n"
+	"  -e FLOAT  with -S: re-compute pairs with sampled R-squared >= FLOAT over all individuals\n"
+	"  -z INT    with -S: random seed used for drawing individuals (default: 0)\n"
 	"  -P FLOAT  Fisher's exact test / Chi-squared cutoff P-value (default: 1)\n"
 	"  -r FLOAT  Pearson's R-squared minimum cut-off value (default: 0.0)\n"
 	//"  -R FLOAT  Pearson's R-squared maximum cut-off value (default: 1.0)\n"
@@ -72,6 +74,9 @@ int scalc(int argc, char** argv){
 
 		{"minP",              optional_argument, 0, 'P' },
 		{"minR2",             optional_argument, 0, 'r' },
+		{"samples",           optional_argument, 0, 'S' },
+		{"sample-refine",     optional_argument, 0, 'e' },
+		{"sample-seed",       optional_argument, 0, 'z' },
 		//{"maxR2",             optional_argument, 0, 'R' },
 
 		{"silent",            no_argument,       0, 's' },
@@ -81,7 +86,7 @@ int scalc(int argc, char** argv){
 	tomahawk::twk_ld_settings settings;
 	//std::vector<std::string> filter_regions;
 
-	while ((c = getopt_long(argc, argv, "i:o:t:P:a:A:r:I:smMb:k:w:?", long_options, &option_index)) != -1){
+	while ((c = getopt_long(argc, argv, "i:o:t:P:a:A:r:I:smMb:k:w:S:e:z:?", long_options, &option_index)) != -1){
 		switch (c){
 		case 0:
 			std::cerr << "Case 0: " << option_index << '\t' << long_options[option_index].name << std::endl;
@@ -142,6 +147,23 @@ int scalc(int argc, char** argv){
 			}
 			break;
 		*/
+		case 'S':
+			if(atoi(optarg) <= 0){
+				std::cerr << tomahawk::utility::timestamp("ERROR") << "Cannot sample a non-positive number of individuals" << std::endl;
+				return(1);
+			}
+			settings.n_sampled = atoi(optarg);
+			break;
+		case 'e':
+			settings.sample_refine = atof(optarg);
+			if(settings.sample_refine < 0 || settings.sample_refine > 1){
+				std::cerr << tomahawk::utility::timestamp("ERROR") << "Re-computation R-squared threshold must be in [0,1]" << std::endl;
+				return(1);
+			}
+			break;
+		case 'z':
+			settings.sample_seed = atoi(optarg);
+			break;
 		case 'P':
 		  settings.minP = atof(optarg);
 		  if(settings.minP < 0){
@@ -21,6 +21,7 @@ FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
 DEALINGS IN THE SOFTWARE.
 */
 #include <getopt.h>
+#include <thread>
 
 #include "utility.h"
 #include "two_reader.h"
@@ -30,26 +31,216 @@ template <class int_t>
 		pair() : t(0), n(0){}
 
 		void operator+=(const int_t v){ t += v; ++n; }
+		void operator+=(const pair& other){ t += other.t; n += other.n; }
 
 		int_t t;
 		uint64_t n;
 	};
 
+namespace tomahawk {
+
+/**<
+ * Worker for computing summary statistics over a (from,to)-range of blocks.
+ * Every slave owns its accumulators that are reduced into a single instance
+ * after all threads have joined. Because all accumulators are counts or sums
+ * the merged result is equivalent to a single-threaded pass up to
+ * floating-point rounding: double-precision sums depend on the order in which
+ * they are accumulated.
+ */
+struct twk_stats_slave {
+public:
+	twk_stats_slave() : f(0), t(0), success(false), it(nullptr), thread(nullptr){}
+	~twk_stats_slave(){ delete it; delete thread; }
+
+	/**<
+	 * Allocate the thread-local accumulators.
+	 * @param n_samples Number of samples in the file.
+	 * @param n_contigs Number of contigs in the file.
+	 */
+	void Allocate(const uint32_t n_samples, const uint32_t n_contigs){
+		r2.resize(101);
+		stats.resize(16, 0);
+		h1.resize(2*n_samples, 0);
+		h2.resize(2*n_samples, 0);
+		h3.resize(2*n_samples, 0);
+		h4.resize(2*n_samples, 0);
+		cmatrix.resize(n_contigs, std::vector<uint64_t>(n_contigs, 0));
+	}
+
+	/**<
+	 * Spawn a new thread computing statistics for the blocks in the range [f,t).
+	 * @param rdr Reference instance of a two reader.
+	 * @return    Returns a pointer to the spawned thread instance if successful or a nullptr otherwise.
+	 */
+	std::thread* Start(two_reader& rdr){
+		if(f >= t) return nullptr;
+
+		if(stream.good()) stream.close();
+
+		stream.open(filename,std::ios::binary | std::ios::in);
+		if(stream.good() == false){
+			std::cerr << utility::timestamp("ERROR","THREAD") << "Failed to open \"" << filename << "\"..." << std::endl;
+			return nullptr;
+		}
+
+		stream.seekg(rdr.index.ent[f].foff);
+		if(stream.good() == false){
+			std::cerr << utility::timestamp("ERROR","THREAD") << "Failed to seek to position " << rdr.index.ent[f].foff << " in \""  << filename << "\"..." << std::endl;
+			return nullptr;
+		}
+
+		delete it; it = nullptr;
+		it  = new twk1_two_iterator;
+		it->stream = &stream;
+
+		delete thread; thread = nullptr;
+		thread = new std::thread(&twk_stats_slave::Compute, this);
+
+		return(thread);
+	}
+
+	bool Compute(){
+		success = false;
+		for(int i = f; i < t; ++i){
+			if(it->NextBlock() == false){
+				std::cerr << utility::timestamp("ERROR","THREAD") << "Failed to read block " << i << "..." << std::endl;
+				delete it; it = nullptr;
+				return false;
+			}
+			this->Update(it->GetBlock());
+		}
+
+		delete it; it = nullptr;
+		success = true;
+		return true;
+	}
+
+	/**<
+	 * Update the accumulators with all records in the provided block.
+	 * @param blk Source block of records.
+	 */
+	void Update(const twk1_two_block_t& blk){
+		for(int j = 0; j < blk.n; ++j){
+			const twk1_two_t& rcd = blk.rcds[j];
+			r2[uint32_t(rcd.R2 * 100)] += rcd.R2;
+			++h1[rcd.cnt[0]];
+			++h2[rcd.cnt[1]];
+			++h3[rcd.cnt[2]];
+			++h4[rcd.cnt[3]];
+			++cmatrix[rcd.ridA][rcd.ridB];
+
+			for(int k = 0; k < 16; ++k){
+				stats[k] += (rcd.controller & (1 << k)) != 0;
+			}
+		}
+	}
+
+	/**<
+	 * Reduction helper. Adds the accumulators in the passed slave instance
+	 * to the current instance.
+	 * @param other Reference to other slave instance.
+	 */
+	void operator+=(const twk_stats_slave& other){
+		for(int i = 0; i < r2.size(); ++i) r2[i] += other.r2[i];
+		for(int i = 0; i < stats.size(); ++i) stats[i] += other.stats[i];
+		for(int i = 0; i < h1.size(); ++i){
+			h1[i] += other.h1[i];
+			h2[i] += other.h2[i];
+			h3[i] += other.h3[i];
+			h4[i] += other.h4[i];
+		}
+		for(int i = 0; i < cmatrix.size(); ++i){
+			for(int j = 0; j < cmatrix[i].size(); ++j)
+				cmatrix[i][j] += other.cmatrix[i][j];
+		}
+	}
+
+public:
+	uint32_t f, t; // (from,to)-tuple
+	bool success;
+	std::ifstream stream;
+	twk1_two_iterator* it;
+	std::thread* thread;
+	std::string filename;
+	std::vector< pair<double> > r2;
+	std::vector< uint64_t > stats;
+	std::vector< uint64_t > h1, h2, h3, h4;
+	std::vector< std::vector<uint64_t> > cmatrix; // Contig-contig matrix.
+};
+
+}
+
 void stats_usage(void){
 	tomahawk::ProgramMessage();
 	std::cerr <<
-	"About:  Aggregate TWO data into a rasterized matrix of size [x,y] for\n"
-    "        plotting. Data has to be sorted and pre-sliced to the correct\n"
-	"        interval-of-interest prior to running.\n"
-	"Usage:  " << tomahawk::TOMAHAWK_PROGRAM_NAME << " aggregate [options] <in.two>\n\n"
+	"About:  Compute summary statistics for a TWO file: R2 histogram, flag\n"
+	"        counts, haplotype count histograms and the number of\n"
+	"        associations between each pair of contigs.\n"
+	"Usage:  " << tomahawk::TOMAHAWK_PROGRAM_NAME << " stats [options] <in.two>\n\n"
 
 	"Options:\n"
 	"  -i   FILE   input TWO file (required)\n"
-	"  -x,y INT    number of X/Y-axis bins (default: 1000)\n"
-	"  -f   STRING aggregation function: can be one of (r2,r,d,dprime,dp,p,hets,alts,het,alt)(required)\n"
-	"  -r   STRING reduction function: can be one of (mean,count,n,min,max,sd)(required)\n"
-	"  -I   STRING filter interval <contig>:pos-pos (TWK/TWO) or linked interval <contig>:pos-pos,<contig>:pos-pos\n"
-	"  -c   INT    min cut-off value used in reduction function: value < c will be set to 0 (default: 5)\n\n";
+	"  -t   INT    number of parallel threads (default: " << std::thread::hardware_concurrency() << ")\n"
+	"  -f          fast mode: only report the contig-contig matrix using the\n"
+	"              index of a sorted file; blocks spanning multiple contigs are\n"
+	"              decompressed\n\n";
+}
+
+/**<
+ * Print the contig-contig matrix.
+ * @param oreader Reference reader providing contig names.
+ * @param cmatrix Source matrix.
+ */
+void stats_print_contigs(const tomahawk::two_reader& oreader, const std::vector< std::vector<uint64_t> >& cmatrix){
+	std::cout << "contig";
+	for(int i = 0; i < oreader.hdr.GetNumberContigs(); ++i){
+	    std::cout << '\t' << oreader.hdr.GetContig(i)->name;
+	}
+	 std::cout.put('\n');
+
+	for(int i = 0; i < oreader.hdr.GetNumberContigs(); ++i){
+	    std::cout << oreader.hdr.GetContig(i)->name;
+	    for(int j = 0; j < oreader.hdr.GetNumberContigs(); ++j){
+	        std::cout << '\t' << cmatrix[i][j];
+	    }
+	    std::cout.put('\n');
+	}
+}
+
+/**<
+ * Index-only computation of the contig-contig matrix. Blocks in sorted files
+ * have a uniform ridA and, if uniform, their ridB stored in the index. Only
+ * blocks with mixed ridB have to be decompressed.
+ * @param oreader Reference reader.
+ * @param cmatrix Destination matrix.
+ * @return        Returns TRUE upon success or FALSE otherwise.
+ */
+bool stats_index_only(tomahawk::two_reader& oreader, std::vector< std::vector<uint64_t> >& cmatrix){
+	if(oreader.index.state != TWK_IDX_SORTED){
+		std::cerr << tomahawk::utility::timestamp("ERROR") << "Fast mode requires a sorted file. Sort the file first with " << tomahawk::TOMAHAWK_PROGRAM_NAME << " sort..." << std::endl;
+		return false;
+	}
+
+	uint32_t n_decoded = 0;
+	for(int i = 0; i < oreader.index.n; ++i){
+		const tomahawk::IndexEntryOutput& ent = oreader.index.ent[i];
+		if(ent.rid >= 0 && ent.ridB >= 0){
+			cmatrix[ent.rid][ent.ridB] += ent.n;
+			continue;
+		}
+
+		oreader.stream->seekg(ent.foff);
+		if(oreader.it.NextBlock() == false){
+			std::cerr << tomahawk::utility::timestamp("ERROR") << "Failed to read block " << i << "..." << std::endl;
+			return false;
+		}
+		for(int j = 0; j < oreader.it.blk.n; ++j)
+			++cmatrix[oreader.it.blk.rcds[j].ridA][oreader.it.blk.rcds[j].ridB];
+		++n_decoded;
+	}
+
+	std::cerr << tomahawk::utility::timestamp("LOG") << "Decompressed " << n_decoded << "/" << oreader.index.n << " blocks..." << std::endl;
+	return true;
 }
 
 int stats(int argc, char** argv){
@@ -60,16 +251,18 @@ int stats(int argc, char** argv){
 
 	static struct option long_options[] = {
 		{"input",       required_argument, 0, 'i' },
+		{"threads",     required_argument, 0, 't' },
+		{"fast",        no_argument,       0, 'f' },
 		{0,0,0,0}
 	};
 
 	tomahawk::twk_two_settings settings;
-	int32_t bins = 100;
+	bool index_only = false;
 
 	int c = 0;
 	int long_index = 0;
 	int hits = 0;
-	while ((c = getopt_long(argc, argv, "i:", long_options, &long_index)) != -1){
+	while ((c = getopt_long(argc, argv, "i:t:f?", long_options, &long_index)) != -1){
 		hits += 2;
 		switch (c){
 		case ':':   /* missing option argument */
@@ -86,6 +279,12 @@ int stats(int argc, char** argv){
 		case 'i':
 			settings.in = std::string(optarg);
 			break;
+		case 't':
+			settings.n_threads = atoi(optarg);
+			break;
+		case 'f':
+			index_only = true;
+			break;
 		}
 	}
 
@@ -94,62 +293,89 @@ int stats(int argc, char** argv){
 		return(1);
 	}
 
+	if(settings.n_threads <= 0){
+		std::cerr << tomahawk::utility::timestamp("ERROR") << "Number of threads must be > 0..." << std::endl;
+		return(1);
+	}
+
 	// New instance of reader.
 	tomahawk::two_reader oreader;
 
 	// Open file handle.
 	if(oreader.Open(settings.in) == false) return 1;
 
+	if(index_only){
+		std::vector< std::vector<uint64_t> > cmatrix(oreader.hdr.GetNumberContigs(), std::vector<uint64_t>(oreader.hdr.GetNumberContigs(), 0));
+		if(stats_index_only(oreader, cmatrix) == false) return 1;
+		stats_print_contigs(oreader, cmatrix);
+		std::cout.flush();
+		return 0;
+	}
 
-	std::vector< pair<double> > r2(101);
-	std::vector< uint64_t > stats(16, 0);
-	std::vector< uint64_t > h1(2*oreader.hdr.GetNumberSamples(), 0);
-	std::vector< uint64_t > h2(2*oreader.hdr.GetNumberSamples(), 0);
-	std::vector< uint64_t > h3(2*oreader.hdr.GetNumberSamples(), 0);
-	std::vector< uint64_t > h4(2*oreader.hdr.GetNumberSamples(), 0);
-
-	// Contig-contig matrix.
-	std::vector< std::vector<uint64_t> > cmatrix(oreader.hdr.GetNumberContigs(), std::vector<uint64_t>());
-	for(int i = 0; i < oreader.hdr.GetNumberContigs(); ++i) cmatrix[i].resize(oreader.hdr.GetNumberContigs());
+	// Partition blocks into ranges of approximately equal uncompressed size.
+	uint64_t b_unc = 0;
+	for(int i = 0; i < oreader.index.n; ++i) b_unc += oreader.index.ent[i].b_unc;
 
-	while(oreader.NextRecord()){
-		r2[uint32_t(oreader.it.rcd->R2 * 100)] += oreader.it.rcd->R2;
-		++h1[oreader.it.rcd->cnt[0]];
-		++h2[oreader.it.rcd->cnt[1]];
-		++h3[oreader.it.rcd->cnt[2]];
-		++h4[oreader.it.rcd->cnt[3]];
-		++cmatrix[oreader.it.rcd->ridA][oreader.it.rcd->ridB];
+	if(oreader.index.n < settings.n_threads) settings.n_threads = std::max((uint64_t)1, oreader.index.n);
+	uint64_t b_unc_thread = b_unc / settings.n_threads;
 
-		for(int j = 0; j < 16; ++j){
-			stats[j] += (oreader.it.rcd->controller & (1 << j)) != 0;
+	std::vector< std::pair<uint32_t,uint32_t> > ranges;
+	uint64_t fR = 0, tR = 0, b_unc_tot = 0;
+	for(int i = 0; i < oreader.index.n; ++i){
+		if(b_unc_tot >= b_unc_thread && ranges.size() + 1 < settings.n_threads){
+			ranges.push_back(std::pair<uint32_t,uint32_t>(fR, tR));
+			b_unc_tot = 0;
+			fR = tR;
 		}
+		b_unc_tot += oreader.index.ent[i].b_unc;
+		++tR;
 	}
+	if(fR != tR) ranges.push_back(std::pair<uint32_t,uint32_t>(fR, tR));
 
-	for(int i = 0; i < r2.size(); ++i){
-		std::cout << i << "\t" << r2[i].t << "\t" << r2[i].n << '\n';
+	tomahawk::twk_stats_slave* slaves = new tomahawk::twk_stats_slave[std::max((size_t)1, ranges.size())];
+	slaves[0].Allocate(oreader.hdr.GetNumberSamples(), oreader.hdr.GetNumberContigs());
+	for(int i = 0; i < ranges.size(); ++i){
+		slaves[i].f = ranges[i].first;
+		slaves[i].t = ranges[i].second;
+		slaves[i].filename = settings.in;
+		slaves[i].Allocate(oreader.hdr.GetNumberSamples(), oreader.hdr.GetNumberContigs());
 	}
-	for(int i = 0; i < stats.size(); ++i){
-		std::cout << i << "\t" << stats[i] << '\n';
+
+	std::cerr << tomahawk::utility::timestamp("LOG","THREAD") << "Computing statistics for " << oreader.index.n << " blocks using " << ranges.size() << " threads..." << std::endl;
+
+	for(int i = 0; i < ranges.size(); ++i){
+		if(slaves[i].Start(oreader) == nullptr){
+			std::cerr << tomahawk::utility::timestamp("ERROR","THREAD") << "Failed to spawn slave" << std::endl;
+			for(int j = 0; j < i; ++j) slaves[j].thread->join();
+			delete[] slaves;
+			return 1;
+		}
 	}
-	for(int i = 0; i < h1.size(); ++i){
-		std::cout << i << "\t" << h1[i] << "\t" << h2[i] << "\t" << h3[i] << "\t" << h4[i] << '\n';
+	for(int i = 0; i < ranges.size(); ++i) slaves[i].thread->join();
+	for(int i = 0; i < ranges.size(); ++i){
+		if(slaves[i].success == false){
+			delete[] slaves;
+			return 1;
+		}
 	}
 
-	std::cout << "contig";
-	for(int i = 0; i < oreader.hdr.GetNumberContigs(); ++i){
-	    std::cout << '\t' << oreader.hdr.GetContig(i)->name;
-	}
-	 std::cout.put('\n');
+	// Reduce.
+	for(int i = 1; i < ranges.size(); ++i) slaves[0] += slaves[i];
+	const tomahawk::twk_stats_slave& s = slaves[0];
 
-	for(int i = 0; i < oreader.hdr.GetNumberContigs(); ++i){
-	    std::cout << oreader.hdr.GetContig(i)->name;
-	    for(int j = 0; j < oreader.hdr.GetNumberContigs(); ++j){
-	        std::cout << '\t' << cmatrix[i][j];
-	    }
-	    std::cout.put('\n');
+	for(int i = 0; i < s.r2.size(); ++i){
+		std::cout << i << "\t" << s.r2[i].t << "\t" << s.r2[i].n << '\n';
+	}
+	for(int i = 0; i < s.stats.size(); ++i){
+		std::cout << i << "\t" << s.stats[i] << '\n';
+	}
+	for(int i = 0; i < s.h1.size(); ++i){
+		std::cout << i << "\t" << s.h1[i] << "\t" << s.h2[i] << "\t" << s.h3[i] << "\t" << s.h4[i] << '\n';
 	}
 
+	stats_print_contigs(oreader, s.cmatrix);
 	std::cout.flush();
 
+	delete[] slaves;
 	return 0;
 }
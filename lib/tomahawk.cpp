@@ -24,7 +24,7 @@ void ProgramMessage(const bool separator){
 
 void ProgramHelp(void){
 	std::cerr << "Usage: " << TOMAHAWK_PROGRAM_NAME << " [--version] [--help] <commands> <argument>" << std::endl;
-	std::cerr << "Commands: aggregate, calc, scalc, concat, import, sort, view, haplotype, decay" << std::endl;
+	std::cerr << "Commands: aggregate, calc, scalc, concat, import, sort, view, haplotype, decay, prune, clump" << std::endl;
 }
 
 void ProgramHelpDetailed(void){
@@ -41,7 +41,8 @@ void ProgramHelpDetailed(void){
 	"haplotype    extract per-sample haplotype strings in FASTA/binary format\n"
 	//"relationship compute marker-based pair-wise sample relationship matrices\n"
 	"decay        compute LD-decay over distance\n"
-	//"prune        perform graph-based LD-pruning of variant sites\n"
+	"prune        prune variants in linkage-disequilibrium in sliding windows\n"
+	"clump        clump associated variants around index variants by linkage-disequilibrium\n"
 	//"stats        general stats for TWO files\n"
     << std::endl;
 }
@@ -5,6 +5,7 @@
 #include "writer.h"
 #include "two_sorter_structs.h"
 #include "aggregation.h"
+#include "decay_structs.h"
 
 namespace tomahawk {
 
@@ -421,6 +422,87 @@ bool two_reader::Sort(two_sorter_settings& settings){
 	return true;
 }
 
+/**<
+ * Partition the blocks in a two file over a set of decay slaves and reduce
+ * the results into the first slave. For sorted files, blocks that only
+ * contain inter-contig associations are skipped as they never contribute
+ * to decay.
+ * @param rdr         Reference reader instance.
+ * @param settings    Reference settings.
+ * @param positional  Compute positional decay if TRUE or binned decay otherwise.
+ * @param n_bins      Number of bins.
+ * @param n_range_bin Width of each bin in base-pairs.
+ * @return            Returns a pointer to the array of slaves with the reduced results in the first slave or a nullptr otherwise.
+ */
+static twk_decay_slave* DecayPartitionReduce(two_reader& rdr,
+		twk_two_settings& settings,
+		const bool positional,
+		const uint32_t n_bins, const uint32_t n_range_bin)
+{
+	if(settings.n_threads <= 0){
+		std::cerr << utility::timestamp("ERROR") << "Cannot have <= 0 threads (-t)..." << std::endl;
+		return nullptr;
+	}
+
+	std::vector<uint32_t> blocks;
+	uint64_t b_unc = 0;
+	for(int i = 0; i < rdr.index.n; ++i){
+		const IndexEntryOutput& ent = rdr.index.ent[i];
+		if(rdr.index.state == TWK_IDX_SORTED && ent.rid >= 0 && ent.ridB >= 0 && ent.rid != ent.ridB)
+			continue;
+
+		blocks.push_back(i);
+		b_unc += ent.b_unc;
+	}
+	std::cerr << utility::timestamp("LOG") << "Using " << utility::ToPrettyString(blocks.size()) << "/" << utility::ToPrettyString(rdr.index.n) << " blocks with intra-contig associations..." << std::endl;
+
+	uint32_t n_threads = std::max((size_t)1, std::min((size_t)settings.n_threads, blocks.size()));
+	uint64_t b_unc_thread = b_unc / n_threads;
+
+	twk_decay_slave* slaves = new twk_decay_slave[n_threads];
+	uint32_t n_slaves = 0;
+	uint64_t b_unc_tot = 0;
+	for(int i = 0; i < blocks.size(); ++i){
+		if(b_unc_tot >= b_unc_thread && n_slaves + 1 < n_threads){
+			++n_slaves;
+			b_unc_tot = 0;
+		}
+		slaves[n_slaves].blocks.push_back(blocks[i]);
+		b_unc_tot += rdr.index.ent[blocks[i]].b_unc;
+	}
+	if(blocks.size()) ++n_slaves;
+
+	for(int i = 0; i < n_threads; ++i){
+		slaves[i].positional  = positional;
+		slaves[i].n_bins      = n_bins;
+		slaves[i].n_range_bin = n_range_bin;
+		slaves[i].filename    = settings.in;
+		slaves[i].decay.resize(n_bins, std::pair<double, uint64_t>(0, 0));
+	}
+
+	for(int i = 0; i < n_slaves; ++i){
+		if(slaves[i].Start(rdr) == nullptr){
+			std::cerr << utility::timestamp("ERROR","THREAD") << "Failed to spawn slave" << std::endl;
+			for(int j = 0; j < i; ++j) slaves[j].thread->join();
+			delete[] slaves;
+			return nullptr;
+		}
+	}
+	for(int i = 0; i < n_slaves; ++i) slaves[i].thread->join();
+
+	for(int i = 0; i < n_slaves; ++i){
+		if(slaves[i].success == false){
+			delete[] slaves;
+			return nullptr;
+		}
+	}
+
+	// Reduce in block order.
+	for(int i = 1; i < n_slaves; ++i) slaves[0] += slaves[i];
+
+	return(slaves);
+}
+
 bool two_reader::Decay(twk_two_settings& settings, int64_t window_bp, int32_t n_bins){
 	if(window_bp <= 0){
 		std::cerr << utility::timestamp("ERROR") << "Window size cannot be <= 0 (provided " << window_bp << ")..." << std::endl;
@@ -450,27 +532,23 @@ bool two_reader::Decay(twk_two_settings& settings, int64_t window_bp, int32_t n_
 		return false;
 	}
 
-	const uint32_t n_bins_i = n_bins - 1;
 	uint32_t n_range_bin = window_bp / n_bins;
-	std::vector< std::pair<double, uint64_t> > decay(n_bins, {0,0});
-
-	while(NextRecord()){
-		// Same contig only.
-		if(it.rcd->ridA == it.rcd->ridB){
-			// Upper trig only.
-			if(it.rcd->Apos < it.rcd->Bpos){
-				decay[std::min((it.rcd->Bpos - it.rcd->Apos) / n_range_bin, n_bins_i)].first += it.rcd->R2;
-				++decay[std::min((it.rcd->Bpos - it.rcd->Apos) / n_range_bin, n_bins_i)].second;
-			}
-		}
+	if(n_range_bin == 0){
+		std::cerr << utility::timestamp("ERROR") << "Window size must be >= number of bins..." << std::endl;
+		return false;
 	}
 
+	twk_decay_slave* slaves = DecayPartitionReduce(*this, settings, false, n_bins, n_range_bin);
+	if(slaves == nullptr) return false;
+	const std::vector< std::pair<double, uint64_t> >& decay = slaves[0].decay;
+
 	std::cout << "From\tTo\tMean\tFrequency\n";
 	for(int i = 0; i < decay.size(); ++i){
 		std::cout << (i*n_range_bin) << '\t' << ((i+1)*n_range_bin) << '\t' << decay[i].first/std::max(decay[i].second,(uint64_t)1) << '\t' << decay[i].second << '\n';
 	}
 	std::cout.flush();
 
+	delete[] slaves;
 	return true;
 }
 
@@ -493,42 +571,9 @@ bool two_reader::PositionalDecay(twk_two_settings& settings){
         return false;
     }
 
-    if(NextRecord() == false){
-        std::cerr << utility::timestamp("ERROR") << "Failed to get a record..."  << std::endl;
-        return false;
-    }
-
-    //
-    struct twk_sstats_pos : public twk_sstats {
-        twk_sstats_pos() : rid(0), pos(0){}
-        twk_sstats_pos(uint32_t chrom, uint32_t position) : rid(chrom), pos(position){}
-
-        void operator+=(const twk1_two_t* rec){
-            if(rec->ridA == rec->ridB && rec->Apos < rec->Bpos)
-                Add(rec->Bpos, 1);
-        }
-
-        uint32_t rid, pos;
-    };
-    //
-
-    uint32_t rid_prev = it.rcd->ridA;
-    uint32_t pos_prev = it.rcd->Apos;
-    std::vector<twk_sstats_pos> variants;
-    variants.push_back(twk_sstats_pos(it.rcd->ridA, it.rcd->Apos));
-
-    while(NextRecord()){
-        if(FilterInterval(it.rcd)) continue;
-
-        if(it.rcd->ridA != rid_prev || it.rcd->Apos != pos_prev){
-            variants.push_back(twk_sstats_pos(it.rcd->ridA, it.rcd->Apos));
-            rid_prev = it.rcd->ridA;
-            pos_prev = it.rcd->Apos;
-            variants.back().n = 1;
-        }
-
-        variants.back() += it.rcd;
-    }
+    twk_decay_slave* slaves = DecayPartitionReduce(*this, settings, true, 0, 0);
+    if(slaves == nullptr) return false;
+    const std::vector<twk_sstats_pos>& variants = slaves[0].variants;
 
     std::cerr << "variants = " << variants.size() << std::endl;
     std::cout << std::fixed;
@@ -537,6 +582,7 @@ bool two_reader::PositionalDecay(twk_two_settings& settings){
     }
     std::cout.flush();
 
+    delete[] slaves;
     return true;
 }
 
@@ -598,6 +644,12 @@ bool two_reader::Aggregate(twk1_aggregate_t& agg,
 		else if(red_name == "n")    { r = &twk_sstats::GetCount; }
 		else if(red_name == "total"){ r = &twk_sstats::GetTotal; }
 		else if(red_name == "sd")   { r = &twk_sstats::GetStandardDeviation; }
+		else if(red_name == "median"){ r = &twk_sstats::GetMedian; }
+		else if(red_name == "q25")  { r = &twk_sstats::GetQ25; }
+		else if(red_name == "q75")  { r = &twk_sstats::GetQ75; }
+		else if(red_name == "q90")  { r = &twk_sstats::GetQ90; }
+		else if(red_name == "q95")  { r = &twk_sstats::GetQ95; }
+		else if(red_name == "q99")  { r = &twk_sstats::GetQ99; }
 		else {
 			std::cerr << utility::timestamp("ERROR") << "Unknown reduce function \"" << red_name << "\"..." << std::endl;
 			return(false);
@@ -815,7 +867,6 @@ bool two_reader::Aggregate(twk1_aggregate_t& agg,
 	if(verbose){
 		std::cerr << utility::timestamp("LOG") << "===== Second pass (building matrix) =====" << std::endl;
 		std::cerr << utility::timestamp("LOG") << "Aggregating " << utility::ToPrettyString(n_recs) << " records..." << std::endl;
-		std::cerr << utility::timestamp("LOG","THREAD") << "Allocating: " << utility::ToPrettyDiskString(sizeof(twk_sstats)*xbins*ybins*settings.n_threads) << " for matrices..." << std::endl;
 	}
 
 	twk_sort_progress progress_sort_step2;